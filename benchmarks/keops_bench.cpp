@@ -0,0 +1,400 @@
+// Benchmark driver of the KeOps C++ backends, without the Python bindings : see keops_bench.py,
+// which generates the code of the formulas with keopscore, builds this file and runs it.
+//
+// The cases are read from a text file, one case per line, as "key=value" items separated by
+// spaces (lists are comma separated, "-" is an empty list) :
+//   name       : name of the case, copied to the output
+//   backend    : "cpu" (generated CpuConv code, compiled in the shared library lib) or
+//                "gpu" (KeOps_module, loading the cubin or ptx file lib)
+//   dtype      : "float" or "double"
+//   host       : 1 for data on the host, 0 for data on the device (gpu backend only)
+//   M, N       : sizes of the i and j indices
+//   nclusters  : 0, or number of blocks of a block diagonal sparsity pattern given by ranges
+//   reps       : number of timed calls
+//   flops      : number of floating point operations for each (i,j) pair, estimated by the caller
+// and the metadata of the formula returned by get_keops_dll : tagI, tagZero, tag1D2D, dimred,
+// dimout, dimy, cuda_block_size, use_chunk_mode, indsi, indsj, indsp, dimsx, dimsy, dimsp.
+//
+// For each case, one line of JSON is written on the standard output, with times in milliseconds :
+//   init_ms  : loading of the module (cubin or shared library),
+//   first_ms : first call, which also computes the launch configuration and allocates the workspace,
+//   call_ms  : median of the following calls (synchronized),
+//   gpu_ms   : median time of the work enqueued on the stream, measured with events (gpu backend),
+//   enqueue_ms : median time spent in launch_kernel before it returns (gpu backend, device data),
+//   host_overhead_ms : call_ms - gpu_ms,
+// and gflops = flops * M * N / call_ms, gbytes_per_s = (inputs + output bytes) / call_ms (for ranges,
+// only the pairs of the diagonal blocks are counted).
+//
+// compilation (see keops_bench.py) :
+//   g++ -O3 -std=c++11 -I<keopscore> keops_bench.cpp -o keops_bench -ldl
+// with -DKEOPS_BENCH_GPU and the flags of the nvrtc binder for the gpu backend.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <dlfcn.h>
+
+#ifdef KEOPS_BENCH_GPU
+#include <binders/nvrtc/keops_nvrtc.cpp>
+#endif
+
+// entry point of the shared libraries built by keops_bench.py for the cpu backend : it calls
+// launch_keops_cpu_<tag>< TYPE > of the generated code.
+template< typename TYPE >
+using keops_bench_cpu_t = int (*)(int dimY, int nx, int ny, int tagI, int tagZero, int use_half, int dimred,
+                                  int use_chunk_mode,
+                                  std::vector< int > indsi, std::vector< int > indsj, std::vector< int > indsp,
+                                  int dimout,
+                                  std::vector< int > dimsx, std::vector< int > dimsy, std::vector< int > dimsp,
+                                  int **ranges, std::vector< int > shapeout, TYPE *out, TYPE **arg,
+                                  std::vector< std::vector< int > > argshape);
+
+typedef std::chrono::steady_clock bench_clock;
+
+double elapsed_ms(bench_clock::time_point start) {
+    return std::chrono::duration< double, std::milli >(bench_clock::now() - start).count();
+}
+
+double median(std::vector< double > v) {
+    if (v.empty())
+        return 0;
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return (n % 2) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+
+class Case {
+public:
+    std::map< std::string, std::string > items;
+
+    Case(const std::string &line) {
+        std::istringstream ss(line);
+        std::string item;
+        while (ss >> item) {
+            size_t pos = item.find('=');
+            if (pos == std::string::npos)
+                throw std::runtime_error("[KeOps bench] invalid item " + item + " (expected key=value).");
+            items[item.substr(0, pos)] = item.substr(pos + 1);
+        }
+    }
+
+    const std::string &str(const std::string &key) const {
+        std::map< std::string, std::string >::const_iterator it = items.find(key);
+        if (it == items.end())
+            throw std::runtime_error("[KeOps bench] missing key " + key + ".");
+        return it->second;
+    }
+
+    int num(const std::string &key) const {
+        return std::atoi(str(key).c_str());
+    }
+
+    double real(const std::string &key) const {
+        return std::atof(str(key).c_str());
+    }
+
+    std::vector< int > list(const std::string &key) const {
+        std::vector< int > res;
+        const std::string &s = str(key);
+        if (s == "-")
+            return res;
+        std::istringstream ss(s);
+        std::string tok;
+        while (std::getline(ss, tok, ','))
+            res.push_back(std::atoi(tok.c_str()));
+        return res;
+    }
+};
+
+
+// Arguments of a case on the host : random arrays of shapes (M, dim) for the i variables,
+// (N, dim) for the j variables and (dim) for the parameters, and the block diagonal ranges.
+template< typename TYPE >
+class Bench_data {
+public:
+    int nx, ny, nargs, nclusters;
+    std::vector< int > shapeout;
+    std::vector< std::vector< TYPE > > args;
+    std::vector< std::vector< int > > argshape;
+    std::vector< TYPE > out;
+    std::vector< std::vector< int > > ranges;
+    size_t bytes;
+    double npairs;
+
+    Bench_data(const Case &c) {
+        nx = c.num("M");
+        ny = c.num("N");
+        nclusters = c.num("nclusters");
+        int tagI = c.num("tagI");
+        std::vector< int > indsi = c.list("indsi"), indsj = c.list("indsj"), indsp = c.list("indsp");
+        std::vector< int > dimsx = c.list("dimsx"), dimsy = c.list("dimsy"), dimsp = c.list("dimsp");
+        // get_keops_dll gives the i and j variables of the reduction ; the output is indexed like
+        // the i variables if tagI=0, and like the j variables otherwise.
+        int nout = tagI == 0 ? nx : ny;
+        shapeout = {nout, c.num("dimout")};
+
+        nargs = indsi.size() + indsj.size() + indsp.size();
+        args.resize(nargs);
+        argshape.resize(nargs);
+        std::mt19937 gen(0);
+        std::uniform_real_distribution< double > unif(0, 1);
+        bytes = 0;
+        for (int pass = 0; pass < 3; pass++) {
+            const std::vector< int > &inds = pass == 0 ? indsi : (pass == 1 ? indsj : indsp);
+            const std::vector< int > &dims = pass == 0 ? dimsx : (pass == 1 ? dimsy : dimsp);
+            for (size_t k = 0; k < inds.size(); k++) {
+                int n = pass == 2 ? 1 : ((pass == 0) == (tagI == 0) ? nx : ny);
+                argshape[inds[k]] = pass == 2 ? std::vector< int >{dims[k]} : std::vector< int >{n, dims[k]};
+                args[inds[k]].resize((size_t) n * dims[k]);
+                for (size_t l = 0; l < args[inds[k]].size(); l++)
+                    args[inds[k]][l] = (TYPE) unif(gen);
+                bytes += args[inds[k]].size() * sizeof(TYPE);
+            }
+        }
+        out.resize((size_t) shapeout[0] * shapeout[1]);
+        bytes += out.size() * sizeof(TYPE);
+
+        // ranges_i, slices_i, redranges_j, ranges_j, slices_j, redranges_i and their sizes,
+        // with -1 as first size if there are no ranges (see include/Ranges.h)
+        ranges.resize(7);
+        npairs = (double) nx * ny;
+        if (nclusters > 0) {
+            std::vector< int > ri, rj, slices;
+            npairs = 0;
+            for (int k = 0; k < nclusters; k++) {
+                int i0 = (int) ((long long) nx * k / nclusters), i1 = (int) ((long long) nx * (k + 1) / nclusters);
+                int j0 = (int) ((long long) ny * k / nclusters), j1 = (int) ((long long) ny * (k + 1) / nclusters);
+                ri.push_back(i0);
+                ri.push_back(i1);
+                rj.push_back(j0);
+                rj.push_back(j1);
+                slices.push_back(k + 1);
+                npairs += (double) (i1 - i0) * (j1 - j0);
+            }
+            ranges[0] = ri;
+            ranges[1] = slices;
+            ranges[2] = rj;
+            ranges[3] = rj;
+            ranges[4] = slices;
+            ranges[5] = ri;
+            ranges[6] = std::vector< int >(6, nclusters);
+        } else {
+            for (int k = 0; k < 6; k++)
+                ranges[k] = std::vector< int >(1, 0);
+            ranges[6] = std::vector< int >(6, 0);
+            ranges[6][0] = -1;
+        }
+    }
+};
+
+
+// timings of a case, see the header of this file
+struct Bench_result {
+    double init_ms, first_ms, call_ms, gpu_ms, enqueue_ms;
+};
+
+
+template< typename TYPE >
+Bench_result bench_cpu(const Case &c, Bench_data< TYPE > &D) {
+    Bench_result R = {0, 0, 0, 0, 0};
+    int reps = c.num("reps");
+
+    bench_clock::time_point start = bench_clock::now();
+    void *lib = dlopen(c.str("lib").c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (lib == NULL)
+        throw std::runtime_error(std::string("[KeOps bench] cannot load ") + c.str("lib") + " : " + dlerror());
+    keops_bench_cpu_t< TYPE > launch = (keops_bench_cpu_t< TYPE >) dlsym(lib, "keops_bench_cpu");
+    if (launch == NULL)
+        throw std::runtime_error("[KeOps bench] no entry point keops_bench_cpu in " + c.str("lib") + ".");
+    R.init_ms = elapsed_ms(start);
+
+    std::vector< TYPE * > arg(D.nargs);
+    for (int k = 0; k < D.nargs; k++)
+        arg[k] = D.args[k].data();
+    std::vector< int * > ranges(7);
+    for (int k = 0; k < 7; k++)
+        ranges[k] = D.ranges[k].data();
+
+    std::vector< double > times;
+    for (int r = 0; r <= reps; r++) {
+        start = bench_clock::now();
+        launch(c.num("dimy"), D.nx, D.ny, c.num("tagI"), c.num("tagZero"), 0, c.num("dimred"),
+               c.num("use_chunk_mode"), c.list("indsi"), c.list("indsj"), c.list("indsp"), c.num("dimout"),
+               c.list("dimsx"), c.list("dimsy"), c.list("dimsp"), ranges.data(), D.shapeout, D.out.data(),
+               arg.data(), D.argshape);
+        double t = elapsed_ms(start);
+        if (r == 0)
+            R.first_ms = t;
+        else
+            times.push_back(t);
+    }
+    R.call_ms = median(times);
+    // N.B. the library is not closed, as the generated code may have started OpenMP threads
+    return R;
+}
+
+
+#ifdef KEOPS_BENCH_GPU
+
+template< typename TYPE >
+Bench_result bench_gpu(const Case &c, Bench_data< TYPE > &D) {
+    Bench_result R = {0, 0, 0, 0, 0};
+    int reps = c.num("reps");
+    int host = c.num("host");
+
+    bench_clock::time_point start = bench_clock::now();
+    KeOps_module< TYPE > module(0, D.nargs, c.str("lib").c_str());
+    R.init_ms = elapsed_ms(start);
+
+    KeOps_context_guard guard(module.ctx);
+    CUstream stream;
+    CUevent ev_start, ev_stop;
+    CUDA_SAFE_CALL(cuStreamCreate(&stream, CU_STREAM_NON_BLOCKING));
+    CUDA_SAFE_CALL(cuEventCreate(&ev_start, CU_EVENT_DEFAULT));
+    CUDA_SAFE_CALL(cuEventCreate(&ev_stop, CU_EVENT_DEFAULT));
+
+    // pointers given to launch_kernel : the host arrays, or copies on the device
+    std::vector< TYPE * > arg(D.nargs);
+    std::vector< int * > ranges(7);
+    TYPE *out = D.out.data();
+    std::vector< CUdeviceptr > allocs;
+    if (host) {
+        for (int k = 0; k < D.nargs; k++)
+            arg[k] = D.args[k].data();
+        for (int k = 0; k < 7; k++)
+            ranges[k] = D.ranges[k].data();
+    } else {
+        for (int k = 0; k < D.nargs + 7; k++) {
+            // the seventh ranges array (the sizes of the others) always stays on the host
+            if (k == D.nargs + 6) {
+                ranges[6] = D.ranges[6].data();
+                continue;
+            }
+            size_t size = k < D.nargs ? D.args[k].size() * sizeof(TYPE) : D.ranges[k - D.nargs].size() * sizeof(int);
+            const void *src = k < D.nargs ? (const void *) D.args[k].data() : (const void *) D.ranges[k - D.nargs].data();
+            CUdeviceptr p;
+            CUDA_SAFE_CALL(cuMemAlloc(&p, std::max(size, (size_t) 1)));
+            CUDA_SAFE_CALL(cuMemcpyHtoD(p, src, size));
+            allocs.push_back(p);
+            if (k < D.nargs)
+                arg[k] = (TYPE *) p;
+            else
+                ranges[k - D.nargs] = (int *) p;
+        }
+        CUdeviceptr p;
+        CUDA_SAFE_CALL(cuMemAlloc(&p, D.out.size() * sizeof(TYPE)));
+        allocs.push_back(p);
+        out = (TYPE *) p;
+    }
+
+    std::vector< double > times, gpu_times, enqueue_times;
+    for (int r = 0; r <= reps; r++) {
+        start = bench_clock::now();
+        CUDA_SAFE_CALL(cuEventRecord(ev_start, stream));
+        module.launch_kernel(1 - host, c.num("dimy"), D.nx, D.ny, c.num("tagI"), c.num("tagZero"), 0,
+                             c.num("tag1D2D"), c.num("dimred"), c.num("cuda_block_size"), c.num("use_chunk_mode"),
+                             c.list("indsi"), c.list("indsj"), c.list("indsp"), c.num("dimout"),
+                             c.list("dimsx"), c.list("dimsy"), c.list("dimsp"), ranges.data(), D.shapeout, out,
+                             arg.data(), D.argshape, stream);
+        double t_enqueue = elapsed_ms(start);
+        CUDA_SAFE_CALL(cuEventRecord(ev_stop, stream));
+        CUDA_SAFE_CALL(cuStreamSynchronize(stream));
+        double t = elapsed_ms(start);
+        float t_gpu;
+        CUDA_SAFE_CALL(cuEventElapsedTime(&t_gpu, ev_start, ev_stop));
+        if (r == 0) {
+            R.first_ms = t;
+        } else {
+            times.push_back(t);
+            gpu_times.push_back(t_gpu);
+            enqueue_times.push_back(t_enqueue);
+        }
+    }
+    R.call_ms = median(times);
+    R.gpu_ms = median(gpu_times);
+    // with host data, launch_kernel waits for the result before returning
+    R.enqueue_ms = host ? 0 : median(enqueue_times);
+
+    for (size_t k = 0; k < allocs.size(); k++)
+        CUDA_SAFE_CALL(cuMemFree(allocs[k]));
+    CUDA_SAFE_CALL(cuEventDestroy(ev_start));
+    CUDA_SAFE_CALL(cuEventDestroy(ev_stop));
+    CUDA_SAFE_CALL(cuStreamDestroy(stream));
+    return R;
+}
+
+#endif
+
+
+template< typename TYPE >
+void run_case(const Case &c) {
+    Bench_data< TYPE > D(c);
+    Bench_result R;
+    const std::string &backend = c.str("backend");
+    if (backend == "cpu") {
+        R = bench_cpu< TYPE >(c, D);
+    } else if (backend == "gpu") {
+#ifdef KEOPS_BENCH_GPU
+        R = bench_gpu< TYPE >(c, D);
+#else
+        throw std::runtime_error("[KeOps bench] this driver was built without the gpu backend.");
+#endif
+    } else {
+        throw std::runtime_error("[KeOps bench] unknown backend " + backend + ".");
+    }
+
+    double gflops = c.real("flops") * D.npairs / (R.call_ms * 1e6);
+    double gbytes = D.bytes / (R.call_ms * 1e6);
+    printf("{\"name\": \"%s\", \"init_ms\": %.6g, \"first_ms\": %.6g, \"call_ms\": %.6g, \"gpu_ms\": %.6g, "
+           "\"enqueue_ms\": %.6g, \"host_overhead_ms\": %.6g, \"gflops\": %.6g, \"gbytes_per_s\": %.6g}\n",
+           c.str("name").c_str(), R.init_ms, R.first_ms, R.call_ms, R.gpu_ms, R.enqueue_ms,
+           backend == "gpu" ? R.call_ms - R.gpu_ms : 0., gflops, gbytes);
+    fflush(stdout);
+}
+
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage : %s <cases file>\n", argv[0]);
+        return 2;
+    }
+    std::ifstream f(argv[1]);
+    if (!f) {
+        fprintf(stderr, "[KeOps bench] cannot open %s\n", argv[1]);
+        return 2;
+    }
+    int status = 0;
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::string name = "?";
+        try {
+            Case c(line);
+            name = c.str("name");
+            if (c.str("dtype") == "float")
+                run_case< float >(c);
+            else if (c.str("dtype") == "double")
+                run_case< double >(c);
+            else
+                throw std::runtime_error("[KeOps bench] unsupported dtype " + c.str("dtype") + ".");
+        } catch (std::exception &e) {
+            // the other cases are still run
+            printf("{\"name\": \"%s\", \"error\": \"%s\"}\n", name.c_str(), e.what());
+            fflush(stdout);
+            status = 1;
+        }
+    }
+    return status;
+}
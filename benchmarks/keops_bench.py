@@ -0,0 +1,361 @@
+"""
+KeOps C++ benchmark suite
+=========================
+
+Benchmarks of the C++ backends of KeOps, without the Python bindings : the code of the formulas
+is generated by keopscore, and the driver keops_bench.cpp calls KeOps_module::launch_kernel
+(nvrtc backend) or the generated launch_keops_cpu_<tag> entry point (cpu backend) directly,
+so that the timings do not include the overheads of the Python interpreter and of pykeops.
+
+The sweep covers the sizes M, N, the dimension D of the points, the dtype, the scheme
+(1D, 2D, chunk, finalchunk, ranges), the reduction and the location of the data (host or device).
+Results are saved as JSON, and may be compared with the results of a previous run :
+
+    python keops_bench.py --preset quick --output new.json --compare baseline.json
+
+prints the cases which are slower than in baseline.json by more than --tolerance, and exits
+with status 1 if there are some. Other options restrict the sweep, e.g.
+--backend cpu --scheme 1D ranges --reduction sum --M 10000 --N 10000.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import time
+from itertools import product
+
+import keopscore
+import keopscore.config.config as cfg
+from keopscore.config.config import get_build_folder
+from keopscore.get_keops_dll import get_keops_dll
+
+bench_src = os.path.join(os.path.abspath(os.path.dirname(__file__)), "keops_bench.cpp")
+
+presets = {
+    "quick": dict(
+        M=[10000, 100000],
+        D=[3],
+        dtype=["float"],
+        reduction=["sum", "argmin"],
+        data=["host", "device"],
+    ),
+    "full": dict(
+        M=[1000, 10000, 100000, 1000000],
+        D=[3, 16, 64, 200],
+        dtype=["float", "double"],
+        reduction=["sum", "logsumexp", "argmin", "argkmin"],
+        data=["host", "device"],
+    ),
+}
+
+# gpu schemes : map_reduce id, enable_chunks, enable_final_chunks, mult_var_highdim,
+# whether ranges are used, and the expected chunk mode (see get_keops_dll). The chunked
+# schemes only apply to large dimensions : other cases are skipped.
+gpu_schemes = {
+    "1D": ("GpuReduc1D", 0, 0, 0, False, 0),
+    "2D": ("GpuReduc2D", 0, 0, 0, False, 0),
+    "chunk": ("GpuReduc1D", 1, 0, 0, False, 1),
+    "finalchunk": ("GpuReduc1D", 1, 1, 1, False, 2),
+    "ranges": ("GpuReduc1D_ranges", 0, 0, 0, True, 0),
+}
+cpu_schemes = {
+    "1D": ("CpuReduc", 0, 0, 0, False, 0),
+    "ranges": ("CpuReduc_ranges", 0, 0, 0, True, 0),
+}
+
+# number of blocks of the block diagonal pattern of the ranges scheme
+nclusters = 100
+
+
+def reduction_formula(reduction, D):
+    # formula of the reduction on x = Vi(D), y = Vj(D) and b = Vj(D), and the estimated
+    # number of floating point operations for each (i,j) pair (exp and comparisons count as one)
+    sqdist = f"Sum((Var(0,{D},0)-Var(1,{D},1))**2)"
+    if reduction == "sum":
+        return f"Sum_Reduction(Exp(-{sqdist})*Var(2,{D},1),0)", 3 * D + 2 + 2 * D
+    elif reduction == "logsumexp":
+        return f"Max_SumShiftExp_Reduction(-{sqdist},0)", 3 * D + 5
+    elif reduction == "argmin":
+        return f"ArgMin_Reduction({sqdist},0)", 3 * D + 1
+    elif reduction == "argkmin":
+        return f"ArgKMin_Reduction({sqdist},8,0)", 3 * D + 8
+    raise ValueError("unknown reduction " + reduction)
+
+
+def cpu_isa_flags():
+    # flags of the first instruction set of cpu_isa_targets supported by this cpu
+    # (the last one is the generic target)
+    try:
+        with open("/proc/cpuinfo") as f:
+            flags = set(
+                next(l for l in f if l.startswith("flags")).split(":")[1].split()
+            )
+    except (OSError, StopIteration):
+        return cfg.cpu_isa_targets[-1][1]
+    for _, isa_flags, features in cfg.cpu_isa_targets:
+        if all(feature.replace(".", "_") in flags for feature in features):
+            return isa_flags
+    return cfg.cpu_isa_targets[-1][1]
+
+
+def run_command(command):
+    print("[KeOps bench] " + command, flush=True)
+    subprocess.run(command, shell=True, check=True)
+
+
+def build_driver(use_gpu):
+    # the driver is rebuilt when its source, or the binder that it includes, changes
+    exe = os.path.join(get_build_folder(), "keops_bench" + ("_gpu" if use_gpu else ""))
+    sources = [bench_src]
+    if use_gpu:
+        sources.append(cfg.jit_source_file)
+    if os.path.exists(exe) and all(
+        os.path.getmtime(exe) > os.path.getmtime(s) for s in sources
+    ):
+        return exe
+    command = f"{cfg.cxx_compiler} -O3 -std=c++11 -I{cfg.bindings_source_dir}"
+    if use_gpu:
+        command += f" -fpermissive -pthread -DKEOPS_BENCH_GPU {cfg.nvrtc_include}"
+    command += f" {bench_src} -o {exe} -ldl"
+    if use_gpu:
+        command += f" -L{cfg.libcuda_folder} -L{cfg.libnvrtc_folder} -lcuda -lnvrtc"
+    run_command(command)
+    return exe
+
+
+def build_cpu_lib(source_name, tag, dtype):
+    # shared library with the entry point keops_bench_cpu of keops_bench.cpp, which calls
+    # the generated code compiled for the instruction set of this cpu
+    lib = os.path.join(get_build_folder(), f"keops_bench_cpu_{tag}_{dtype}.so")
+    if os.path.exists(lib):
+        return lib
+    headers = ["cmath", "stdlib.h", "stdarg.h", "algorithm", "vector", "numeric"]
+    headers += ["functional", "string", "iostream", "stdexcept"]
+    if cfg.use_OpenMP:
+        headers.append("omp.h")
+    params = f"""int dimY, int nx, int ny, int tagI, int tagZero, int use_half, int dimred,
+                 int use_chunk_mode,
+                 std::vector< int > indsi, std::vector< int > indsj, std::vector< int > indsp,
+                 int dimout,
+                 std::vector< int > dimsx, std::vector< int > dimsy, std::vector< int > dimsp,
+                 int **ranges, std::vector< int > shapeout, {dtype} *out, {dtype} **arg,
+                 std::vector< std::vector< int > > argshape"""
+    code = "".join(f"#include <{h}>\n" for h in headers)
+    code += f"""
+#include "{source_name}"
+
+extern "C" int keops_bench_cpu({params}) {{
+    return launch_keops_cpu_{tag}< {dtype} >(dimY, nx, ny, tagI, tagZero, use_half, dimred, use_chunk_mode,
+                                             indsi, indsj, indsp, dimout, dimsx, dimsy, dimsp,
+                                             ranges, shapeout, out, arg, argshape);
+}}
+"""
+    src = lib[: -len(".so")] + ".cpp"
+    with open(src, "w") as f:
+        f.write(code)
+    run_command(f"{cfg.cxx_compiler} {cfg.cpp_flags} {cpu_isa_flags()} {src} -o {lib}")
+    return lib
+
+
+def get_case(backend, scheme, reduction, dtype, data, M, N, D, reps):
+    # line of the cases file of keops_bench.cpp, and the metadata of the case ; None if
+    # the case does not apply
+    schemes = gpu_schemes if backend == "gpu" else cpu_schemes
+    if scheme not in schemes or (backend == "cpu" and data == "device"):
+        return None
+    (
+        map_reduce_id,
+        chunks,
+        final_chunks,
+        highdim,
+        use_ranges,
+        chunk_mode,
+    ) = schemes[scheme]
+    formula, flops = reduction_formula(reduction, D)
+    tagHostDevice = 1 if data == "device" else 0
+    tagCPUGPU = 1 if backend == "gpu" else 0
+    tag1D2D = 1 if scheme == "2D" else 0
+    sum_scheme = "block_sum" if reduction in ("sum", "logsumexp") else "direct_sum"
+    (
+        tag,
+        source_name,
+        low_level_code_file,
+        tagI,
+        tagZero,
+        use_half,
+        cuda_block_size,
+        use_chunk_mode,
+        tag1D2D,
+        dimred,
+        dim,
+        dimy,
+        indsi,
+        indsj,
+        indsp,
+        dimsx,
+        dimsy,
+        dimsp,
+    ) = get_keops_dll(
+        map_reduce_id,
+        formula,
+        chunks,
+        final_chunks,
+        highdim,
+        [],
+        3 if reduction == "sum" else 2,
+        dtype,
+        dtype,
+        sum_scheme,
+        tagHostDevice,
+        tagCPUGPU,
+        tag1D2D,
+        0,
+        0,
+    )
+    if backend == "gpu" and use_chunk_mode != chunk_mode:
+        return None
+    # the same conventions as pykeops for reductions over i (see LoadKeOps.init)
+    if tagI == 1:
+        indsi, indsj = indsj, indsi
+        dimsx, dimsy = dimsy, dimsx
+    if backend == "gpu":
+        lib = low_level_code_file.decode("utf-8")
+    else:
+        lib = build_cpu_lib(source_name, tag, dtype)
+
+    name = f"{backend}-{scheme}-{reduction}-{dtype}-{data}-M{M}-N{N}-D{D}"
+    lst = lambda l: ",".join(str(k) for k in l) if len(l) > 0 else "-"
+    items = dict(
+        name=name,
+        backend=backend,
+        dtype=dtype,
+        lib=lib,
+        host=1 - tagHostDevice,
+        M=M,
+        N=N,
+        nclusters=nclusters if use_ranges else 0,
+        reps=reps,
+        flops=flops,
+        tagI=tagI,
+        tagZero=tagZero,
+        tag1D2D=tag1D2D,
+        dimred=dimred,
+        dimout=dim,
+        dimy=dimy,
+        cuda_block_size=cuda_block_size,
+        use_chunk_mode=use_chunk_mode,
+        indsi=lst(indsi),
+        indsj=lst(indsj),
+        indsp=lst(indsp),
+        dimsx=lst(dimsx),
+        dimsy=lst(dimsy),
+        dimsp=lst(dimsp),
+    )
+    line = " ".join(f"{k}={v}" for k, v in items.items())
+    meta = dict(
+        name=name,
+        backend=backend,
+        scheme=scheme,
+        reduction=reduction,
+        dtype=dtype,
+        data=data,
+        M=M,
+        N=N,
+        D=D,
+    )
+    return line, meta
+
+
+def run_sweep(args):
+    use_gpu = "gpu" in args.backend
+    if use_gpu and not cfg.use_cuda:
+        print("[KeOps bench] no GPU detected : only the cpu backend is benchmarked.")
+        use_gpu = False
+    backends = [b for b in args.backend if b == "cpu" or use_gpu]
+
+    lines, metas = [], {}
+    for backend, scheme, reduction, dtype, data, M, D in product(
+        backends, args.scheme, args.reduction, args.dtype, args.data, args.M, args.D
+    ):
+        for N in args.N if args.N else [M]:
+            case = get_case(backend, scheme, reduction, dtype, data, M, N, D, args.reps)
+            if case is not None:
+                lines.append(case[0])
+                metas[case[1]["name"]] = case[1]
+
+    results = []
+    if lines:
+        cases_file = os.path.join(get_build_folder(), "keops_bench_cases.txt")
+        with open(cases_file, "w") as f:
+            f.write("\n".join(lines) + "\n")
+        exe = build_driver(use_gpu)
+        proc = subprocess.run([exe, cases_file], stdout=subprocess.PIPE, text=True)
+        for l in proc.stdout.splitlines():
+            res = json.loads(l)
+            res.update(metas[res["name"]])
+            results.append(res)
+            if "error" in res:
+                print(f"{res['name']:60s} error : {res['error']}")
+            else:
+                print(
+                    f"{res['name']:60s} {res['call_ms']:10.4g} ms"
+                    f" {res['gflops']:10.4g} GFLOP/s {res['gbytes_per_s']:10.4g} GB/s"
+                )
+    return dict(
+        keops_version=keopscore.__version__,
+        date=time.strftime("%Y-%m-%d %H:%M:%S"),
+        results=results,
+    )
+
+
+def compare(results, baseline, tolerance):
+    # cases of results slower than in baseline by more than the relative tolerance
+    ref = {r["name"]: r for r in baseline["results"] if "error" not in r}
+    regressions = []
+    for r in results["results"]:
+        if "error" in r or r["name"] not in ref:
+            continue
+        ratio = r["call_ms"] / max(ref[r["name"]]["call_ms"], 1e-9)
+        if ratio > 1 + tolerance:
+            t_ref = ref[r["name"]]["call_ms"]
+            regressions.append((r["name"], t_ref, r["call_ms"], ratio))
+    for name, t_ref, t, ratio in regressions:
+        print(
+            f"[KeOps bench] regression : {name} {t_ref:.4g} ms -> {t:.4g} ms"
+            f" (x{ratio:.2f})"
+        )
+    return regressions
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="KeOps C++ benchmark suite")
+    parser.add_argument("--preset", choices=presets.keys(), default="quick")
+    parser.add_argument("--backend", nargs="+", default=["cpu", "gpu"])
+    parser.add_argument("--scheme", nargs="+", default=list(gpu_schemes.keys()))
+    parser.add_argument("--reduction", nargs="+")
+    parser.add_argument("--dtype", nargs="+")
+    parser.add_argument("--data", nargs="+")
+    parser.add_argument("--M", nargs="+", type=int)
+    parser.add_argument("--N", nargs="+", type=int, help="default : N = M")
+    parser.add_argument("--D", nargs="+", type=int)
+    parser.add_argument("--reps", type=int, default=10)
+    parser.add_argument("--output", default="keops_bench.json")
+    parser.add_argument("--compare", help="JSON results of a previous run")
+    parser.add_argument("--tolerance", type=float, default=0.1)
+    args = parser.parse_args()
+    for key, val in presets[args.preset].items():
+        if getattr(args, key) is None:
+            setattr(args, key, val)
+
+    results = run_sweep(args)
+    with open(args.output, "w") as f:
+        json.dump(results, f, indent=1)
+    print(f"[KeOps bench] results saved in {args.output}")
+
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+        if compare(results, baseline, args.tolerance):
+            sys.exit(1)
@@ -0,0 +1,299 @@
+"""
+Ahead of time packaging of KeOps reductions, for C or C++ applications which do not embed Python.
+For each reduction, build_aot_library writes in output_dir :
+  - lib<name>.so : a standalone shared library, with the C interface of binders/aot/keops_aot.h.
+    Gpu libraries embed the cubin (or ptx) of the formula and the nvrtc binder, and only depend
+    on the CUDA driver ; no JIT compilation happens at run time. N.B. a cubin is specific to the
+    compute capability of the device used for the build. Cpu libraries contain the formula
+    compiled for several instruction sets, as the pykeops cpu modules (see get_cpu_isa_targets in
+    keopscore/config/config.py).
+  - <name>.h : the description of the reduction (sizes and dimensions of the arguments), and
+    the declarations of the entry points,
+  - keops_aot.h : the C interface shared by all the libraries.
+Its arguments are :
+  - name : name of the reduction, used for the file names (a C identifier),
+  - red_formula_string : the reduction, as for get_keops_dll, e.g. "Sum_Reduction(Exp(-SqDist(x,y))*b,0)"
+    (0 for a reduction over j, 1 for a reduction over i),
+  - aliases : list of aliases, e.g. ["x=Var(0,3,0)", "y=Var(1,3,1)", "b=Var(2,1,1)"], or with
+    the notations of pykeops, ["x=Vi(3)", "y=Vj(3)", "b=Vj(1)"],
+  - nargs : number of arguments (None means the largest index of the variables plus one),
+  - dtype : "float" or "double", or "__nv_bfloat16" for Gpu reductions,
+  - dtypeacc : type of the accumulator of the reduction (None means dtype),
+  - sum_scheme_string : "direct_sum", "block_sum" or "kahan_scheme",
+  - backend : "gpu" or "cpu",
+  - scheme : "1D" or "2D", for Gpu reductions,
+  - use_ranges : True for block-sparse reductions (see keops_aot_launch),
+  - device_id : id of the Gpu used for the build.
+It returns the path of the library.
+
+It can be used as a Python function or as a standalone Python script :
+  python -m keopscore.aot <name> <red_formula_string> <aliases> [key=value ...]
+e.g.
+  python -m keopscore.aot gauss "Sum_Reduction(Exp(-SqDist(x,y))*b,0)" "['x=Vi(3)','y=Vj(3)','b=Vj(1)']" backend=cpu
+"""
+
+import ast
+import os
+import shutil
+import sys
+
+import keopscore.config.config as cfg
+from keopscore.binders.cpp.isa_dispatch import (
+    get_isa_code,
+    get_isa_compile_command,
+    get_isa_dispatch_code,
+)
+from keopscore.get_keops_dll import get_keops_dll
+from keopscore.formulas.GetReduction import GetReduction
+from keopscore.utils.code_gen_utils import KeOps_Error
+from keopscore.utils.misc_utils import (
+    KeOps_Message,
+    KeOps_OS_Run,
+    KeOps_OS_Run_parallel,
+)
+
+aot_source_dir = os.path.join(cfg.base_dir_path, "binders", "aot")
+
+
+def convert_aliases(aliases):
+    # aliases with the notations of pykeops (Vi, Vj, Pm) are converted to Var, as in LoadKeOps.init
+    res = []
+    for k, alias in enumerate(aliases):
+        alias = alias.replace(" ", "")
+        varname, var = alias.split("=")
+        if var[:3] in ("Vi(", "Vj(", "Pm("):
+            cat = ("Vi(", "Vj(", "Pm(").index(var[:3])
+            alias_args = var[3:-1].split(",")
+            if len(alias_args) == 1:
+                ind, dim = k, int(alias_args[0])
+            else:
+                ind, dim = int(alias_args[0]), int(alias_args[1])
+            alias = f"{varname}=Var({ind},{dim},{cat})"
+        res.append(alias)
+    return res
+
+
+def c_array(values):
+    # initializer of a C array, which may not be empty
+    return "{" + ", ".join(str(v) for v in (values if len(values) > 0 else [0])) + "}"
+
+
+def c_string(string):
+    return '"' + string.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+def get_header_code(name, info):
+    # description of the reduction and declarations of the entry points, for the applications
+    NAME = name.upper()
+    cats = ["i variable", "j variable", "parameter"]
+    lines = "\n".join(
+        f"//   argument {k} : "
+        + (f"{cats[c]} of dimension {d}" if c >= 0 else "not used by the formula")
+        for k, (c, d) in enumerate(zip(info["cats"], info["dims"]))
+    )
+    return f"""#ifndef KEOPS_AOT_{NAME}_H
+#define KEOPS_AOT_{NAME}_H
+
+// Standalone KeOps library lib{name}.so, built by keopscore/aot.py, for the reduction
+//   {info["formula"]}
+// with aliases {info["aliases"]}, on {info["backend"]} with data of type {info["dtype"]} :
+{lines}
+// The output has dimension {info["dimout"]}, and is indexed by {"i" if info["tagI"] == 0 else "j"}.
+// See keops_aot.h for the entry points of the library.
+
+#include "keops_aot.h"
+
+#define {NAME}_TAG {c_string(info["tag"])}
+#define {NAME}_NARGS {info["nargs"]}
+#define {NAME}_DIMOUT {info["dimout"]}
+#define {NAME}_TAGI {info["tagI"]}
+#define {NAME}_USE_RANGES {info["use_ranges"]}
+
+#endif
+"""
+
+
+def build_aot_library(
+    name,
+    red_formula_string,
+    aliases,
+    nargs=None,
+    dtype="float",
+    dtypeacc=None,
+    sum_scheme_string="block_sum",
+    backend="gpu",
+    scheme="1D",
+    use_ranges=False,
+    device_id=0,
+    output_dir=".",
+):
+    if not name.isidentifier():
+        KeOps_Error(f"The name of a standalone library must be an identifier : {name}.")
+    if backend not in ("gpu", "cpu"):
+        KeOps_Error(f"Unknown backend {backend} : it should be 'gpu' or 'cpu'.")
+    if dtype not in ("float", "double", "__nv_bfloat16"):
+        KeOps_Error(f"Standalone libraries do not support the type {dtype}.")
+    if backend == "gpu" and not cfg.use_cuda:
+        KeOps_Error("Trying to build a Gpu library, but KeOps is in cpu only mode.")
+
+    aliases = convert_aliases(aliases)
+    if nargs is None:
+        Vars = GetReduction(red_formula_string, aliases).Vars_
+        nargs = max(v.ind for v in Vars) + 1 if len(Vars) > 0 else 0
+
+    if backend == "cpu":
+        map_reduce_id = "CpuReduc"
+    else:
+        map_reduce_id = "GpuReduc" + scheme
+    if use_ranges:
+        map_reduce_id += "_ranges"
+
+    # N.B. the code of Gpu reductions on host data also contains the kernel of out-of-core
+    # computations, so that the library may be used with host and device data.
+    (
+        tag,
+        source_name,
+        low_level_code_file,
+        tagI,
+        tagZero,
+        use_half,
+        cuda_block_size,
+        use_chunk_mode,
+        tag1D2D,
+        dimred,
+        dimout,
+        dimy,
+        indsi,
+        indsj,
+        indsp,
+        dimsx,
+        dimsy,
+        dimsp,
+    ) = get_keops_dll(
+        map_reduce_id,
+        red_formula_string,
+        1,
+        -1,
+        0,
+        aliases,
+        nargs,
+        dtype,
+        dtypeacc if dtypeacc else dtype,
+        sum_scheme_string,
+        0,
+        1 if backend == "gpu" else 0,
+        1 if scheme == "2D" else 0,
+        0,
+        device_id,
+    )
+
+    # the same conventions as the bindings for reductions over i (see LoadKeOps.init)
+    if tagI == 1:
+        indsi, indsj = indsj, indsi
+        dimsx, dimsy = dimsy, dimsx
+
+    os.makedirs(output_dir, exist_ok=True)
+    build_dir = os.path.join(cfg.get_build_folder(), f"aot_{name}_{tag}")
+    os.makedirs(build_dir, exist_ok=True)
+    lib = os.path.abspath(os.path.join(output_dir, f"lib{name}.so"))
+
+    params = {
+        "formula": red_formula_string,
+        "aliases": ";".join(aliases),
+        "tag": tag,
+        "nargs": nargs,
+        "tagI": tagI,
+        "tagZero": tagZero,
+        "tag1D2D": tag1D2D,
+        "dimred": dimred,
+        "dimout": dimout,
+        "dimy": dimy,
+        "cuda_block_size": cuda_block_size,
+        "use_chunk_mode": use_chunk_mode,
+        "use_ranges": int(use_ranges),
+    }
+    code = f"""
+#include <stddef.h>
+
+#define KEOPS_AOT_BACKEND {1 if backend == "gpu" else 0}
+#define KEOPS_AOT_TYPE {dtype}
+"""
+    for key, val in params.items():
+        if isinstance(val, str):
+            code += f"static const char keops_aot_{key}[] = {c_string(val)};\n"
+        else:
+            code += f"static const int keops_aot_{key} = {val};\n"
+    for key, val in (("i", indsi), ("j", indsj), ("p", indsp)):
+        code += f"static const int keops_aot_n{key} = {len(val)};\n"
+        code += f"static const int keops_aot_inds{key}[] = {c_array(val)};\n"
+    for key, val in (("x", dimsx), ("y", dimsy), ("p", dimsp)):
+        code += f"static const int keops_aot_dims{key}[] = {c_array(val)};\n"
+
+    objects = []
+    if backend == "gpu":
+        # image of the cubin (or ptx) of the formula
+        with open(low_level_code_file.decode("utf-8"), "rb") as f:
+            target = f.read()
+        code += "static const unsigned char keops_aot_target[] = {\n"
+        for k in range(0, len(target), 32):
+            code += ",".join(str(b) for b in target[k : k + 32]) + ",\n"
+        code += f"}};\nstatic const size_t keops_aot_target_size = {len(target)};\n"
+        # N.B. only the CUDA driver is needed at run time
+        flags = f"{cfg.compile_options} -fpermissive -L{cfg.libcuda_folder} -lcuda"
+        flags += f" -pthread {cfg.nvrtc_include}"
+    else:
+        # the generated code, compiled for each instruction set
+        commands, names = [], []
+        for isa, isa_flags, _ in cfg.get_cpu_isa_targets():
+            isa_src = os.path.join(build_dir, f"{name}_{isa}.cpp")
+            obj = os.path.join(build_dir, f"{name}_{isa}.o")
+            with open(isa_src, "w") as f:
+                f.write(get_isa_code(source_name, tag, dtype, isa))
+            commands.append(get_isa_compile_command(isa_src, obj, tag, isa, isa_flags))
+            names.append(f"{name} for instruction set {isa}")
+            objects.append(obj)
+        KeOps_OS_Run_parallel(commands, names)
+        code = "\n#include <vector>\n" + get_isa_dispatch_code(tag) + code
+        flags = cfg.cpp_flags
+
+    code += '\n#include "binders/aot/keops_aot.cpp"\n'
+    src = os.path.join(build_dir, f"lib{name}.cpp")
+    with open(src, "w") as f:
+        f.write(code)
+
+    KeOps_Message(f"Compiling standalone library {lib} ... ", flush=True, end="")
+    if os.path.exists(lib):
+        os.remove(lib)
+    KeOps_OS_Run(f"{cfg.cxx_compiler} {flags} {src} {' '.join(objects)} -o {lib}")
+    if not os.path.exists(lib):
+        KeOps_Error(f"The compilation of the standalone library {lib} failed.")
+    KeOps_Message("OK", use_tag=False, flush=True)
+
+    # headers of the library
+    shutil.copy(os.path.join(aot_source_dir, "keops_aot.h"), output_dir)
+    cats, dims = [-1] * nargs, [0] * nargs
+    for c, (inds, dms) in enumerate(((indsi, dimsx), (indsj, dimsy), (indsp, dimsp))):
+        for ind, d in zip(inds, dms):
+            cats[ind], dims[ind] = c, d
+    info = dict(params, backend=backend, dtype=dtype, cats=cats, dims=dims)
+    with open(os.path.join(output_dir, f"{name}.h"), "w") as f:
+        f.write(get_header_code(name, info))
+
+    return lib
+
+
+if __name__ == "__main__":
+    argv = sys.argv[1:]
+    if len(argv) < 3:
+        KeOps_Error(
+            f"Invalid call to Python script {sys.argv[0]}. Usage : {sys.argv[0]} name red_formula_string aliases [key=value ...]"
+        )
+    kwargs = {}
+    for arg in argv[3:]:
+        key, val = arg.split("=", 1)
+        str_keys = ("dtype", "dtypeacc", "sum_scheme_string", "backend", "scheme")
+        # N.B. the other values are Python literals, e.g. use_ranges=True or nargs=3
+        kwargs[key] = (
+            val if key in str_keys + ("output_dir",) else ast.literal_eval(val)
+        )
+    print(build_aot_library(argv[0], argv[1], ast.literal_eval(argv[2]), **kwargs))
@@ -4,7 +4,8 @@ import keopscore.config.config
 from keopscore.config.config import get_build_folder
 from keopscore.utils.code_gen_utils import get_hash_name
 from keopscore.utils.misc_utils import KeOps_Error, KeOps_Message
-from keopscore.config.config import cpp_flags
+from keopscore.config.config import cpp_flags, get_cpu_isa_targets
+from keopscore.config.indices import get_int64_indices
 
 
 class LinkCompile:
@@ -21,7 +22,7 @@ class LinkCompile:
             self.red_formula_string,
             self.aliases,
             self.nargs,
-            self.dtype,
+            self.dtype_io,
             self.dtypeacc,
             self.sum_scheme_string,
             self.tagHostDevice,
@@ -30,6 +31,8 @@ class LinkCompile:
             self.use_half,
             self.device_id,
             cpp_flags,
+            *([get_cpu_isa_targets()] if self.tagCpuGpu == 0 else []),
+            *(["int64_indices"] if get_int64_indices() else []),
         )
 
         # info_file is the name of the file that will contain some meta-information required by the bindings, e.g. 7b9a611f7e.nfo
@@ -0,0 +1,168 @@
+// Implementation of the C interface of keops_aot.h. This file is included by the source generated
+// for each standalone library by keopscore/aot.py, which defines before :
+//  - KEOPS_AOT_BACKEND (0 for cpu, 1 for gpu) and KEOPS_AOT_TYPE, the type of the data,
+//  - the parameters of the reduction given by get_keops_dll, with the conventions of the bindings
+//    (see pykeops/common/keops_io/LoadKeOps.py) : keops_aot_formula, keops_aot_aliases,
+//    keops_aot_tag, keops_aot_nargs, keops_aot_tagI, keops_aot_tagZero, keops_aot_tag1D2D,
+//    keops_aot_dimred, keops_aot_dimout, keops_aot_dimy, keops_aot_cuda_block_size,
+//    keops_aot_use_chunk_mode, keops_aot_use_ranges, and the arrays keops_aot_indsi, keops_aot_indsj,
+//    keops_aot_indsp, keops_aot_dimsx, keops_aot_dimsy, keops_aot_dimsp with their sizes keops_aot_ni,
+//    keops_aot_nj, keops_aot_np (arrays of size 1 if empty),
+//  - for Gpu libraries, keops_aot_target and keops_aot_target_size, the image of the cubin (or ptx),
+//  - for cpu libraries, select_launch_keops_cpu, which returns the version of the generated
+//    code compiled for the instruction set of the cpu.
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "binders/aot/keops_aot.h"
+
+#if KEOPS_AOT_BACKEND == 1
+#include "binders/nvrtc/keops_nvrtc.cpp"
+#endif
+
+#define KEOPS_AOT_STR2(x) #x
+#define KEOPS_AOT_STR(x) KEOPS_AOT_STR2(x)
+
+
+namespace {
+
+typedef KEOPS_AOT_TYPE TYPE;
+
+const std::vector< int > indsi(keops_aot_indsi, keops_aot_indsi + keops_aot_ni);
+const std::vector< int > indsj(keops_aot_indsj, keops_aot_indsj + keops_aot_nj);
+const std::vector< int > indsp(keops_aot_indsp, keops_aot_indsp + keops_aot_np);
+const std::vector< int > dimsx(keops_aot_dimsx, keops_aot_dimsx + keops_aot_ni);
+const std::vector< int > dimsy(keops_aot_dimsy, keops_aot_dimsy + keops_aot_nj);
+const std::vector< int > dimsp(keops_aot_dimsp, keops_aot_dimsp + keops_aot_np);
+
+// category and dimension of each argument (-1 and 0 for the arguments which are not in the formula)
+int cats[keops_aot_nargs > 0 ? keops_aot_nargs : 1], dims[keops_aot_nargs > 0 ? keops_aot_nargs : 1];
+
+keops_aot_info make_info() {
+    for (int k = 0; k < keops_aot_nargs; k++) {
+        cats[k] = -1;
+        dims[k] = 0;
+    }
+    for (int k = 0; k < keops_aot_ni; k++) {
+        cats[indsi[k]] = 0;
+        dims[indsi[k]] = dimsx[k];
+    }
+    for (int k = 0; k < keops_aot_nj; k++) {
+        cats[indsj[k]] = 1;
+        dims[indsj[k]] = dimsy[k];
+    }
+    for (int k = 0; k < keops_aot_np; k++) {
+        cats[indsp[k]] = 2;
+        dims[indsp[k]] = dimsp[k];
+    }
+    keops_aot_info info = {KEOPS_AOT_ABI_VERSION, keops_aot_formula, keops_aot_aliases, keops_aot_tag,
+                           KEOPS_AOT_STR(KEOPS_AOT_TYPE), KEOPS_AOT_BACKEND, keops_aot_use_ranges,
+                           keops_aot_nargs, cats, dims, keops_aot_tagI, keops_aot_dimout};
+    return info;
+}
+
+const keops_aot_info info = make_info();
+
+thread_local std::string last_error;
+
+#if KEOPS_AOT_BACKEND == 0
+// N.B. the cpu libraries have no state : their handle is the entry point of the generated code
+typedef launch_keops_cpu_t< TYPE > keops_aot_module;
+#else
+typedef KeOps_module< TYPE > keops_aot_module;
+#endif
+
+}
+
+
+extern "C" {
+
+const keops_aot_info *keops_aot_info_get(void) {
+    return &info;
+}
+
+
+void *keops_aot_init(int device_id) {
+    try {
+#if KEOPS_AOT_BACKEND == 0
+        return new keops_aot_module(select_launch_keops_cpu< TYPE >());
+#else
+        return new keops_aot_module(device_id, keops_aot_nargs, (const char *) keops_aot_target,
+                                    keops_aot_target_size, keops_aot_tag);
+#endif
+    } catch (std::exception &e) {
+        last_error = e.what();
+    } catch (...) {
+        last_error = "[KeOps] unknown error.";
+    }
+    return NULL;
+}
+
+
+int keops_aot_launch(void *handle, int nx, int ny, void *out, void *const *args, int *const *ranges,
+                     void *stream, int on_device) {
+    try {
+        if (handle == NULL)
+            throw std::runtime_error("[KeOps] keops_aot_launch : the library is not initialized.");
+        if (ranges != NULL && !keops_aot_use_ranges)
+            throw std::runtime_error("[KeOps] keops_aot_launch : this library was built without ranges.");
+        if (on_device && KEOPS_AOT_BACKEND == 0)
+            throw std::runtime_error("[KeOps] keops_aot_launch : cpu libraries only support host data.");
+
+        // shapes of the output and of the arguments, from nx and ny
+        std::vector< int > shapeout(2);
+        shapeout[0] = (keops_aot_tagI == 0) ? nx : ny;
+        shapeout[1] = keops_aot_dimout;
+        std::vector< std::vector< int > > argshape(keops_aot_nargs, std::vector< int >(1, 0));
+        for (int k = 0; k < keops_aot_nargs; k++) {
+            if (cats[k] == 0 || cats[k] == 1) {
+                argshape[k][0] = (cats[k] == 0) ? nx : ny;
+                argshape[k].push_back(dims[k]);
+            } else {
+                argshape[k][0] = dims[k];
+            }
+        }
+
+        // the same convention as the bindings for the absence of ranges (see include/Ranges.h)
+        int no_range = -1;
+        int no_sizes[6] = {-1, 0, 0, 0, 0, 0};
+        int *no_ranges[7] = {&no_range, &no_range, &no_range, &no_range, &no_range, &no_range, no_sizes};
+        int **ranges_v = (ranges != NULL) ? (int **) ranges : no_ranges;
+
+        TYPE **arg = (TYPE **) args;
+
+#if KEOPS_AOT_BACKEND == 0
+        (*(keops_aot_module *) handle)(keops_aot_dimy, nx, ny, keops_aot_tagI, keops_aot_tagZero, 0,
+                                       keops_aot_dimred, keops_aot_use_chunk_mode, indsi, indsj, indsp,
+                                       keops_aot_dimout, dimsx, dimsy, dimsp, ranges_v, shapeout,
+                                       (TYPE *) out, arg, argshape);
+#else
+        ((keops_aot_module *) handle)->launch_kernel(on_device ? 1 : 0, keops_aot_dimy, nx, ny, keops_aot_tagI,
+                                                     keops_aot_tagZero, 0, keops_aot_tag1D2D, keops_aot_dimred,
+                                                     keops_aot_cuda_block_size, keops_aot_use_chunk_mode,
+                                                     indsi, indsj, indsp, keops_aot_dimout, dimsx, dimsy, dimsp,
+                                                     ranges_v, shapeout, (TYPE *) out, arg, argshape,
+                                                     (CUstream) stream);
+#endif
+        return 0;
+    } catch (std::exception &e) {
+        last_error = e.what();
+    } catch (...) {
+        last_error = "[KeOps] unknown error.";
+    }
+    return -1;
+}
+
+
+void keops_aot_destroy(void *handle) {
+    delete (keops_aot_module *) handle;
+}
+
+
+const char *keops_aot_last_error(void) {
+    return last_error.c_str();
+}
+
+}
@@ -0,0 +1,77 @@
+#ifndef KEOPS_AOT_H
+#define KEOPS_AOT_H
+
+// C interface of the standalone KeOps libraries built ahead of time by keopscore/aot.py.
+// Each library computes one reduction, with the cpu or the nvrtc binder, and needs neither
+// Python nor a JIT compiler at run time : for Gpu reductions, the cubin (or ptx) of the formula
+// is embedded in the library, which is only linked with the CUDA driver. All the libraries have
+// the same entry points, so that they may be loaded with dlopen and dlsym, e.g. :
+//
+//   void *lib = dlopen("libkeops_gauss.so", RTLD_NOW | RTLD_LOCAL);
+//   keops_aot_init_t init = (keops_aot_init_t) dlsym(lib, "keops_aot_init");
+//   ...
+//   void *handle = init(0);
+//   launch(handle, nx, ny, out, args, NULL, NULL, 1);    // data on the device, NULL stream
+//   destroy(handle);
+//
+// The functions return 0 (or a non NULL handle) on success ; otherwise keops_aot_last_error gives
+// the message of the error. Several threads may launch computations with the same handle at once.
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KEOPS_AOT_ABI_VERSION 1
+
+// Description of the reduction computed by a library. Arguments are numbered as in the formula :
+// argument k is an i variable (cats[k]=0) of shape (nx, dims[k]), a j variable (cats[k]=1) of
+// shape (ny, dims[k]), or a parameter (cats[k]=2) of shape (dims[k]). The output has shape
+// (nx, dimout) for a reduction over j (axis=1, tagI=0), and (ny, dimout) for a reduction
+// over i (axis=0, tagI=1). All arrays are contiguous, with the type dtype.
+typedef struct keops_aot_info {
+    int abi_version;            // KEOPS_AOT_ABI_VERSION of the library
+    const char *formula;        // reduction formula, e.g. "Sum_Reduction(Exp(-SqDist(x,y))*b,0)"
+    const char *aliases;        // aliases of the formula, separated by ";"
+    const char *tag;            // hash of the formula and of its compilation options
+    const char *dtype;          // "float", "double", "half2" or "__nv_bfloat16"
+    int backend;                // 0 for cpu, 1 for gpu
+    int use_ranges;             // 1 if the library computes block-sparse reductions (see keops_aot_launch)
+    int nargs;
+    const int *cats, *dims;     // category and dimension of each argument
+    int tagI, dimout;
+} keops_aot_info;
+
+const keops_aot_info *keops_aot_info_get(void);
+
+// Loads the reduction on a Gpu (device_id is ignored by cpu libraries). Returns NULL on failure.
+void *keops_aot_init(int device_id);
+
+// Computes the reduction : args is the array of the nargs pointers to the arguments, and out
+// the pointer to the output. With on_device=1 (Gpu libraries only), all of them point to device
+// memory and the computation is enqueued on stream (a CUstream ; NULL means the NULL stream,
+// and we wait for the result) ; otherwise they point to host memory and we return once out
+// is filled.
+// ranges is NULL, or for libraries built with use_ranges=1, the 7 arrays of the block-sparse
+// reductions (ranges_i, slices_i, redranges_j, ranges_j, slices_j, redranges_i, as in
+// pykeops, and the host array of their 6 sizes).
+int keops_aot_launch(void *handle, int nx, int ny, void *out, void *const *args, int *const *ranges,
+                     void *stream, int on_device);
+
+void keops_aot_destroy(void *handle);
+
+// message of the last error of the calling thread
+const char *keops_aot_last_error(void);
+
+typedef const keops_aot_info *(*keops_aot_info_get_t)(void);
+typedef void *(*keops_aot_init_t)(int);
+typedef int (*keops_aot_launch_t)(void *, int, int, void *, void *const *, int *const *, void *, int);
+typedef void (*keops_aot_destroy_t)(void *);
+typedef const char *(*keops_aot_last_error_t)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,10 +1,13 @@
 from keopscore.binders.LinkCompile import LinkCompile
+from keopscore.utils.code_gen_utils import KeOps_Error
 
 
 class Cpu_link_compile(LinkCompile):
     source_code_extension = "cpp"
 
     def __init__(self):
+        if self.dtype_io == "__nv_bfloat16":
+            KeOps_Error("bfloat16 data is only supported by the Gpu reductions.")
         LinkCompile.__init__(self)
         # these are used for command line compiling mode
         self.low_level_code_file = "".encode("utf-8")
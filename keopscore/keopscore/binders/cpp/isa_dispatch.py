@@ -0,0 +1,104 @@
+import keopscore.config.config as cfg
+
+# Code of the cpu modules compiled for several instruction sets (see get_cpu_isa_targets in
+# keopscore/config/config.py), shared by the pykeops cpp binder and the standalone libraries
+# of keopscore/aot.py.
+
+
+def get_launch_params(TYPE="TYPE"):
+    # parameters of the entry point launch_keops_cpu_<tag> of the generated code
+    return f"""int dimY, int nx, int ny,
+                              int tagI, int tagZero, int use_half,
+                              int dimred,
+                              int use_chunk_mode,
+                              std::vector< int > indsi, std::vector< int > indsj, std::vector< int > indsp,
+                              int dimout,
+                              std::vector< int > dimsx, std::vector< int > dimsy, std::vector< int > dimsp,
+                              int **ranges,
+                              std::vector< int > shapeout, {TYPE} *out,
+                              {TYPE} **arg,
+                              std::vector< std::vector< int > > argshape"""
+
+
+def get_isa_code(source_name, tag, dtype, isa):
+    # The generated code is put in a namespace specific to the instruction set, so that its
+    # functions (and the ones of the KeOps headers) do not clash with the versions compiled
+    # for other instruction sets when the objects are linked. Standard headers must be included
+    # before, outside of the namespace.
+    headers = [
+        "cmath",
+        "stdlib.h",
+        "stdarg.h",
+        "algorithm",
+        "vector",
+        "numeric",
+        "functional",
+        "string",
+        "iostream",
+        "stdexcept",
+    ]
+    if cfg.use_OpenMP:
+        headers.append("omp.h")
+    includes = "".join(f"#include <{h}>\n" for h in headers)
+    return f"""
+{includes}
+namespace keops_cpu_{isa} {{
+
+#include "{source_name}"
+
+template int launch_keops_cpu_{tag}< {dtype} >({get_launch_params(dtype)});
+
+}}
+"""
+
+
+def get_isa_compile_command(isa_srcname, objname, tag, isa, isa_flags):
+    # Shell command compiling the code of an instruction set (see get_isa_code) in an object file.
+    # The std templates instantiated by this code are weak symbols in COMDAT groups, of which the
+    # linker keeps a single copy for all the objects : the copy compiled for avx512 would then be
+    # called by the other versions of the formula, and crash older cpus. So, except for the
+    # baseline, the groups are removed and all the symbols but the entry point are made local
+    # with objcopy, which gives each object its own copies. LTO is disabled for these objects,
+    # which must contain machine code for this.
+    command = f"{cfg.cxx_compiler} {cfg.cpp_flags} {isa_flags} -fno-lto -c {isa_srcname} -o {objname}"
+    if isa != cfg.get_cpu_isa_targets()[-1][0]:
+        command += (
+            f" && objcopy -w --keep-global-symbol='*launch_keops_cpu_{tag}*'"
+            f" --remove-section=.group {objname}"
+        )
+    return command
+
+
+def get_isa_dispatch_code(tag):
+    # declarations of the versions of the entry point compiled for each instruction set (see get_isa_code),
+    # and selection of the first one supported by the cpu. The last target needs no check.
+    targets = cfg.get_cpu_isa_targets()
+    code = f"""
+template < typename TYPE >
+using launch_keops_cpu_t = int (*)({get_launch_params()});
+"""
+    for isa, _, _ in targets:
+        code += f"""
+namespace keops_cpu_{isa} {{
+template < typename TYPE >
+int launch_keops_cpu_{tag}({get_launch_params()});
+}}
+"""
+    code += """
+template < typename TYPE >
+launch_keops_cpu_t< TYPE > select_launch_keops_cpu() {
+"""
+    for isa, _, features in targets[:-1]:
+        condition = " && ".join(
+            f'__builtin_cpu_supports("{feature}")' for feature in features
+        )
+        code += f"""#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if ({condition})
+        return keops_cpu_{isa}::launch_keops_cpu_{tag}< TYPE >;
+#endif
+"""
+    code += f"""    return keops_cpu_{targets[-1][0]}::launch_keops_cpu_{tag}< TYPE >;
+}}
+"""
+    return code
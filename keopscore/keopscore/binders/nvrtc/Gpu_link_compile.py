@@ -14,8 +14,14 @@ from keopscore.config.config import (
     jit_source_file,
     cuda_available,
     get_build_folder,
+    get_kernel_cache_folder,
+)
+from keopscore.utils.misc_utils import (
+    KeOps_Error,
+    KeOps_Message,
+    KeOps_OS_Run,
+    codegen_lock,
 )
-from keopscore.utils.misc_utils import KeOps_Error, KeOps_Message, KeOps_OS_Run
 from keopscore.utils.gpu_utils import get_gpu_props, cuda_include_fp16_path
 
 jit_compile_src = os.path.join(
@@ -33,7 +39,7 @@ def jit_compile_dll():
 class Gpu_link_compile(LinkCompile):
     source_code_extension = "cu"
     low_level_code_prefix = "cubin_" if cuda_version >= 11010 else "ptx_"
-    ngpu, gpu_props_compile_flags = get_gpu_props()
+    ngpu = get_gpu_props()
 
     def __init__(self):
         # checking that the system has a Gpu :
@@ -63,16 +69,23 @@ class Gpu_link_compile(LinkCompile):
         self.get_code()
         # write the code in the source file
         self.write_code()
-        # we execute the main dll, passing the code as argument, and the name of the low level code file to save the assembly instructions
-        self.my_c_dll.Compile(
-            create_string_buffer(self.low_level_code_file),
-            create_string_buffer(self.code.encode("utf-8")),
-            c_int(self.use_half),
-            c_int(self.device_id),
-            create_string_buffer(
-                (cuda_include_fp16_path() + os.path.sep).encode("utf-8")
-            ),
-        )
+        # we execute the main dll, passing the code as argument, and the name of the low level code file to save the assembly instructions.
+        # N.B. ctypes releases the GIL during the call, and code generation is over at this point, so that
+        # other threads may generate and compile other formulas meanwhile (see keopscore.get_keops_dll.warmup)
+        with codegen_lock.released():
+            self.my_c_dll.Compile(
+                create_string_buffer(self.low_level_code_file),
+                create_string_buffer(self.code.encode("utf-8")),
+                # headers of the toolkit needed by the code, see Compile in nvrtc_jit.cpp
+                c_int(
+                    self.use_half | (2 if self.dtype_io == "__nv_bfloat16" else 0)
+                ),
+                c_int(self.device_id),
+                create_string_buffer(
+                    (cuda_include_fp16_path() + os.path.sep).encode("utf-8")
+                ),
+                create_string_buffer(get_kernel_cache_folder().encode("utf-8")),
+            )
         # retreive some parameters that will be saved into info_file.
         self.tagI = self.red_formula.tagI
         self.dim = self.red_formula.dim
@@ -95,7 +108,7 @@ class Gpu_link_compile(LinkCompile):
             else '\\"compute\\"'
         )
         target_type_define = f"-DnvrtcGetTARGET={nvrtcGetTARGET} -DnvrtcGetTARGETSize={nvrtcGetTARGETSize} -DARCHTAG={arch_tag}"
-        return f"{cxx_compiler} {nvrtc_flags} {extra_flags} {target_type_define} {nvrtc_include} {Gpu_link_compile.gpu_props_compile_flags} {sourcename} -o {dllname}"
+        return f"{cxx_compiler} {nvrtc_flags} {extra_flags} {target_type_define} {nvrtc_include} {sourcename} -o {dllname}"
 
     @staticmethod
     def compile_jit_compile_dll():
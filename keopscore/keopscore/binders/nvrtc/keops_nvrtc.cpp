@@ -1,7 +1,7 @@
 
 // nvcc -shared -Xcompiler -fPIC -lnvrtc -lcuda keops_nvrtc.cu -o keops_nvrtc.so
-// g++ --verbose -L/opt/cuda/lib64 -L/opt/cuda/targets/x86_64-linux/lib/ -I/opt/cuda/targets/x86_64-linux/include/ -I../../include -shared -fPIC -lcuda -lnvrtc -fpermissive -DMAXIDGPU=0 -DMAXTHREADSPERBLOCK0=1024 -DSHAREDMEMPERBLOCK0=49152 -DnvrtcGetTARGET=nvrtcGetCUBIN -DnvrtcGetTARGETSize=nvrtcGetCUBINSize -DARCHTAG=\"sm\" keops_nvrtc.cpp -o keops_nvrtc.so
-// g++ -std=c++11  -shared -fPIC -O3 -fpermissive -L /usr/lib -L /opt/cuda/lib64 -lcuda -lnvrtc -DnvrtcGetTARGET=nvrtcGetCUBIN -DnvrtcGetTARGETSize=nvrtcGetCUBINSize -DARCHTAG=\"sm\"  -I/home/bcharlier/projets/keops/keops/keops/include -I/opt/cuda/include -I/usr/include/python3.10/ -DMAXIDGPU=0 -DMAXTHREADSPERBLOCK0=1024 -DSHAREDMEMPERBLOCK0=49152  /home/bcharlier/projets/keops/keops/keops/binders/nvrtc/keops_nvrtc.cpp -o keops_nvrtc.cpython-310-x86_64-linux-gnu.so
+// g++ --verbose -L/opt/cuda/lib64 -L/opt/cuda/targets/x86_64-linux/lib/ -I/opt/cuda/targets/x86_64-linux/include/ -I../../include -shared -fPIC -lcuda -lnvrtc -fpermissive -DnvrtcGetTARGET=nvrtcGetCUBIN -DnvrtcGetTARGETSize=nvrtcGetCUBINSize -DARCHTAG=\"sm\" keops_nvrtc.cpp -o keops_nvrtc.so
+// g++ -std=c++11  -shared -fPIC -O3 -fpermissive -L /usr/lib -L /opt/cuda/lib64 -lcuda -lnvrtc -DnvrtcGetTARGET=nvrtcGetCUBIN -DnvrtcGetTARGETSize=nvrtcGetCUBINSize -DARCHTAG=\"sm\"  -I/home/bcharlier/projets/keops/keops/keops/include -I/opt/cuda/include -I/usr/include/python3.10/  /home/bcharlier/projets/keops/keops/keops/binders/nvrtc/keops_nvrtc.cpp -o keops_nvrtc.cpython-310-x86_64-linux-gnu.so
 
 #include <nvrtc.h>
 #include <cuda.h>
@@ -12,6 +12,15 @@
 #include <stdarg.h>
 #include <vector>
 #include <numeric>
+#include <cstring>
+#include <thread>
+#include <exception>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <memory>
 //#include <ctime>
 
 #define C_CONTIGUOUS 1
@@ -25,13 +34,78 @@
 
 #include "include/CudaSizes.h"
 #include <cuda_fp16.h>
+#include <cuda_bf16.h>
 
 
-int *build_offset_tables(int nbatchdims, int *shapes, int nblocks, int *lookup_h,
+// Type of the computations for a storage type TYPE of the inputs and output. The kernels of
+// bfloat16 reductions load and store bfloat16 values, but compute and accumulate in float :
+// their shared memory and the intermediate output of the 2D scheme hold floats.
+template< typename TYPE >
+struct KeOps_compute_type {
+    typedef TYPE type;
+};
+
+template<>
+struct KeOps_compute_type< __nv_bfloat16 > {
+    typedef float type;
+};
+
+
+// Lookup and offsets tables built on the host by the last call of a slot, which are reused
+// by the next call if they were built from the same ranges, shapes and block size (the key).
+struct KeOps_ranges_cache {
+    std::vector< int > key, new_key;    // N.B. new_key is only a member to reuse its memory
+    std::vector< int > lookup_h, offsets_h;
+
+    void start_key() {
+        new_key.clear();
+    }
+
+    void add_to_key(const int *data, int n) {
+        new_key.insert(new_key.end(), data, data + n);
+    }
+
+    // returns true if the tables were built for the new key ; otherwise the new key is stored,
+    // and the tables must be rebuilt.
+    bool hit() {
+        if (new_key == key)
+            return true;
+        std::swap(key, new_key);
+        return false;
+    }
+};
+
+
+// Creates the lookup table of the blocks of size blockSize_x needed for the ranges : for each block k,
+// lookup_h[3*k], lookup_h[3*k+1], lookup_h[3*k+2] are the index of its range, and its first and last rows.
+void fill_lookup_table(int nranges, const int *ranges_x, int blockSize_x, std::vector< int > &lookup_h) {
+    int nblocks = 0;
+    int len_range = 0;
+    for (int i = 0; i < nranges; i++) {
+        len_range = ranges_x[2 * i + 1] - ranges_x[2 * i];
+        nblocks += (len_range / blockSize_x) + (len_range % blockSize_x == 0 ? 0 : 1);
+    }
+
+    lookup_h.resize(3 * nblocks);
+    int index = 0;
+
+    for (int i = 0; i < nranges; i++) {
+        len_range = ranges_x[2 * i + 1] - ranges_x[2 * i];
+        for (int j = 0; j < len_range; j += blockSize_x) {
+            lookup_h[3 * index] = i;
+            lookup_h[3 * index + 1] = ranges_x[2 * i] + j;
+            lookup_h[3 * index + 2] = ranges_x[2 * i] + j + std::min((int) blockSize_x, len_range - j);
+            index++;
+        }
+    }
+}
+
+
+void build_offset_tables(int nbatchdims, int *shapes, int nblocks, const int *lookup_h,
                          const std::vector< int > &indsi,
                          const std::vector< int > &indsj,
                          const std::vector< int > &indsp,
-                         int tagJ) {
+                         int tagJ, std::vector< int > &offsets_h) {
 
     int sizei = indsi.size();
     int sizej = indsj.size();
@@ -66,9 +140,8 @@ int *build_offset_tables(int nbatchdims, int *shapes, int nblocks, int *lookup_h
     int M = shapes[nbatchdims], N = shapes[nbatchdims + 1];
 
     // We create a lookup table, "offsets", of shape (nblocks, SIZEVARS) --------
-    int *offsets_d = NULL;
-
-    int offsets_h[nblocks * sizevars];
+    // N.B. it lives on the heap, as there may be millions of blocks.
+    offsets_h.resize(nblocks * sizevars);
 
     for (int k = 0; k < nblocks; k++) {
         int range_id = (int) lookup_h[3 * k];
@@ -77,25 +150,79 @@ int *build_offset_tables(int nbatchdims, int *shapes, int nblocks, int *lookup_h
 
         int patch_offset = (int) (lookup_h[3 * k + 1] - start_x);
 
-        vect_broadcast_index(start_x, nbatchdims, sizei, shapes, shapes_i, offsets_h + k * sizevars, patch_offset);
-        vect_broadcast_index(start_y, nbatchdims, sizej, shapes, shapes_j, offsets_h + k * sizevars + sizei);
-        vect_broadcast_index(range_id, nbatchdims, sizep, shapes, shapes_p, offsets_h + k * sizevars + sizei + sizej);
+        vect_broadcast_index(start_x, nbatchdims, sizei, shapes, shapes_i, &offsets_h[k * sizevars], patch_offset);
+        vect_broadcast_index(start_y, nbatchdims, sizej, shapes, shapes_j, &offsets_h[k * sizevars + sizei]);
+        vect_broadcast_index(range_id, nbatchdims, sizep, shapes, shapes_p, &offsets_h[k * sizevars + sizei + sizej]);
+    }
+}
+
+
+// Lookup (and offsets) tables built on the host from ranges_x, which is a host array : if cache is not NULL,
+// the tables of the previous call are reused when the ranges, shapes and block size are the same.
+// The tables are then copied to the device.
+void build_host_tables(int &nblocks, int tagJ, int nranges, const int *ranges_x,
+                       int nbatchdims, int *&lookup_d, int *&offsets_d, int blockSize_x,
+                       const std::vector< int > &indsi,
+                       const std::vector< int > &indsj,
+                       const std::vector< int > &indsp,
+                       int *shapes, int nshapes, KeOps_ranges_cache *cache, Workspace &ws, CUstream stream) {
+
+    KeOps_ranges_cache local;
+    bool hit = false;
+    if (cache != NULL) {
+        int params[8] = {tagJ, nranges, blockSize_x, nbatchdims, nshapes,
+                         (int) indsi.size(), (int) indsj.size(), (int) indsp.size()};
+        cache->start_key();
+        cache->add_to_key(params, 8);
+        cache->add_to_key(ranges_x, 2 * nranges);
+        if (nbatchdims > 0) {
+            cache->add_to_key(shapes, nshapes);
+            cache->add_to_key(indsi.data(), indsi.size());
+            cache->add_to_key(indsj.data(), indsj.size());
+            cache->add_to_key(indsp.data(), indsp.size());
+        }
+        hit = cache->hit();
+    } else {
+        cache = &local;
+    }
+
+    if (!hit) {
+        fill_lookup_table(nranges, ranges_x, blockSize_x, cache->lookup_h);
+        if (nbatchdims > 0)
+            build_offset_tables(nbatchdims, shapes, cache->lookup_h.size() / 3, cache->lookup_h.data(),
+                                indsi, indsj, indsp, tagJ, cache->offsets_h);
     }
+    nblocks = cache->lookup_h.size() / 3;
 
-    CUDA_SAFE_CALL(cuMemAlloc((CUdeviceptr * ) & offsets_d, sizeof(int) * nblocks * sizevars));
-    CUDA_SAFE_CALL(cuMemcpyHtoD((CUdeviceptr) offsets_d, offsets_h, sizeof(int) * nblocks * sizevars));
+    // Load the tables on the device ----------------------------------------------------
+    lookup_d = ws.get< int >(3 * nblocks);
+    CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) lookup_d, cache->lookup_h.data(), sizeof(int) * 3 * nblocks, stream));
+    KEOPS_PROF_BYTES_HTOD(sizeof(int) * 3 * nblocks);
 
-    return offsets_d;
+    if (nbatchdims > 0) {
+        int size = cache->offsets_h.size();
+        offsets_d = ws.get< int >(size);
+        CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) offsets_d, cache->offsets_h.data(), sizeof(int) * size, stream));
+        KEOPS_PROF_BYTES_HTOD(sizeof(int) * size);
+    }
 }
 
 
-void range_preprocess_from_device(int &nblocks, int tagI, int nranges_x, int nranges_y, int **castedranges,
+// number of threads of the kernel KeOps_ranges_scan, and of the blocks of KeOps_ranges_lookup
+// (see keopscore/mapreduce/gpu/ranges_lookup.py)
+#define KEOPS_RANGES_SCAN_THREADS 1024
+#define KEOPS_RANGES_LOOKUP_THREADS 256
+
+
+void range_preprocess_from_device(int &nblocks, int tagI, int nx, int nranges_x, int nranges_y, int **castedranges,
                                   int nbatchdims, int *&slices_x_d, int *&ranges_y_d,
                                   int *&lookup_d, int *&offsets_d, int blockSize_x,
                                   const std::vector< int > &indsi,
                                   const std::vector< int > &indsj,
                                   const std::vector< int > &indsp,
-                                  int *shapes) {
+                                  int *shapes, int nshapes,
+                                  bool device_lookup, int &nranges_lookup, int *&ranges_x_d, int *&block_offsets_d,
+                                  KeOps_ranges_cache *cache, Workspace &ws, CUstream stream) {
 
     // Ranges pre-processing... ==================================================================
 
@@ -113,72 +240,62 @@ void range_preprocess_from_device(int &nblocks, int tagI, int nranges_x, int nra
     int *slices_x = tagJ ? castedranges[1] : castedranges[4];
     int *ranges_y = tagJ ? castedranges[2] : castedranges[5];
 
-    int ranges_x_h_arr[2 * nranges];
-    int* ranges_x_h;
-
-    // The code below needs a pointer to ranges_x on *host* memory,  -------------------
-    // as well as pointers to slices_x and ranges_y on *device* memory.
-    // -> Depending on the "ranges" location, we'll copy ranges_x *or* slices_x and ranges_y
-    //    to the appropriate memory:
+    // Depending on the "ranges" location, we'll build the tables on the device *or* copy
+    // slices_x and ranges_y to the device:
     bool ranges_on_device = (nbatchdims == 0);
     // N.B.: We only support Host ranges with Device data when these ranges were created
     //       to emulate block-sparse reductions.
 
     if (ranges_on_device) {  // The ranges are on the device
-        ranges_x_h = &ranges_x_h_arr[0];
-        // Send data from device to host.
-        cuMemcpyDtoH(ranges_x_h, (CUdeviceptr) ranges_x, sizeof(int) * 2 * nranges);
         slices_x_d = slices_x;
         ranges_y_d = ranges_y;
-    } else {  // The ranges are on host memory; this is typically what happens with **batch processing**,
-        // with ranges generated by keops_io.h:
-        ranges_x_h = ranges_x;
-        // Copy "slices_x" to the device:
-        CUDA_SAFE_CALL(cuMemAlloc((CUdeviceptr * ) & slices_x_d, sizeof(int) * nranges));
-        CUDA_SAFE_CALL(cuMemcpyHtoD((CUdeviceptr) slices_x_d, slices_x, sizeof(int) * nranges));
 
-        // Copy "redranges_y" to the device: with batch processing, we KNOW that they have the same shape as ranges_x
-        CUDA_SAFE_CALL(cuMemAlloc((CUdeviceptr * ) & ranges_y_d, sizeof(int) * 2 * nranges));
-        CUDA_SAFE_CALL(cuMemcpyHtoD((CUdeviceptr) ranges_y_d, ranges_y, sizeof(int) * 2 * nranges));
-    }
-
-    // Computes the number of blocks needed ---------------------------------------------
-    nblocks = 0;
-    int len_range = 0;
-    for (int i = 0; i < nranges; i++) {
-        len_range = ranges_x_h[2 * i + 1] - ranges_x_h[2 * i];
-        nblocks += (len_range / blockSize_x) + (len_range % blockSize_x == 0 ? 0 : 1);
-    }
-
-    // Create a lookup table for the blocks --------------------------------------------
-    int lookup_h[3 * nblocks];
-    int index = 0;
-
-    for (int i = 0; i < nranges; i++) {
-        len_range = ranges_x_h[2 * i + 1] - ranges_x_h[2 * i];
-        for (int j = 0; j < len_range; j += blockSize_x) {
-            lookup_h[3 * index] = i;
-            lookup_h[3 * index + 1] = ranges_x_h[2 * i] + j;
-            lookup_h[3 * index + 2] = ranges_x_h[2 * i] + j + std::min((int) blockSize_x, len_range - j);
-            index++;
+        if (device_lookup) {
+            // The lookup table is built on the device, without any transfer to the host, by the kernels
+            // KeOps_ranges_scan and KeOps_ranges_lookup : the first one computes the index of the first
+            // block of each range (a prefix sum of the numbers of blocks of the ranges), and the second one
+            // fills the table. They are enqueued with the reduction (see KeOps_module::enqueue_kernels), so that
+            // CUDA graphs rebuild the table from the current contents of ranges_x at each replay.
+            // As the actual number of blocks is only known on the device, the grid is sized with an upper
+            // bound (the x-ranges do not overlap, and each range has at most one incomplete block) :
+            // the extra blocks have empty rows and return immediately in GpuConv1DOnDevice_ranges.
+            nblocks = nx / blockSize_x + nranges + 1;
+            nranges_lookup = nranges;
+            ranges_x_d = ranges_x;
+            block_offsets_d = ws.get< int >(nranges + 1);
+            lookup_d = ws.get< int >(3 * nblocks);
+            return;
         }
-    }
 
-    // Load the table on the device -----------------------------------------------------
-    CUDA_SAFE_CALL(cuMemAlloc((CUdeviceptr * ) &lookup_d, sizeof(int) * 3 * nblocks));
-    CUDA_SAFE_CALL(cuMemcpyHtoD((CUdeviceptr) lookup_d, lookup_h, sizeof(int) * 3 * nblocks));
+        // Modules without the kernels above : we need ranges_x on *host* memory.
+        // The ranges may have been written by previous work on the same stream, so we only wait
+        // for this stream (not for the whole device).
+        std::vector< int > ranges_x_h(2 * nranges);
+        CUDA_SAFE_CALL(cuMemcpyDtoHAsync(ranges_x_h.data(), (CUdeviceptr) ranges_x, sizeof(int) * 2 * nranges, stream));
+        KEOPS_PROF_BYTES_DTOH(sizeof(int) * 2 * nranges);
+        CUDA_SAFE_CALL(cuStreamSynchronize(stream));
+        build_host_tables(nblocks, tagJ, nranges, ranges_x_h.data(), nbatchdims, lookup_d, offsets_d, blockSize_x,
+                          indsi, indsj, indsp, shapes, nshapes, NULL, ws, stream);
 
+    } else {  // The ranges are on host memory; this is typically what happens with **batch processing**,
+        // with ranges generated by keops_io.h:
 
-    // Support for broadcasting over batch dimensions =============================================
-
-    // We create a lookup table, "offsets", of shape (nblock, SIZEVARS):
+        // Copy "slices_x" to the device:
+        slices_x_d = ws.get< int >(nranges);
+        CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) slices_x_d, slices_x, sizeof(int) * nranges, stream));
+        KEOPS_PROF_BYTES_HTOD(sizeof(int) * nranges);
 
-    if (nbatchdims > 0) {
-        offsets_d = build_offset_tables(nbatchdims, shapes, nblocks, lookup_h,
-                                        indsi, indsj, indsp, tagJ);
+        // Copy "redranges_y" to the device: with batch processing, we KNOW that they have the same shape as ranges_x
+        ranges_y_d = ws.get< int >(2 * nranges);
+        CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) ranges_y_d, ranges_y, sizeof(int) * 2 * nranges, stream));
+        KEOPS_PROF_BYTES_HTOD(sizeof(int) * 2 * nranges);
+
+        // Support for broadcasting over batch dimensions : build_host_tables creates a lookup table,
+        // "offsets", of shape (nblock, SIZEVARS)
+        build_host_tables(nblocks, tagJ, nranges, ranges_x, nbatchdims, lookup_d, offsets_d, blockSize_x,
+                          indsi, indsj, indsp, shapes, nshapes, cache, ws, stream);
     }
 
-
 }
 
 
@@ -190,7 +307,7 @@ range_preprocess_from_host(int &nblocks, int tagI, int nranges_x, int nranges_y,
                            const std::vector< int > &indsi,
                            const std::vector< int > &indsj,
                            const std::vector< int > &indsp,
-                           int *shapes) {
+                           int *shapes, int nshapes, KeOps_ranges_cache *cache, Workspace &ws, CUstream stream) {
 
     // Ranges pre-processing... ==================================================================
 
@@ -209,70 +326,326 @@ range_preprocess_from_host(int &nblocks, int tagI, int nranges_x, int nranges_y,
     int *slices_x = tagJ ? castedranges[1] : castedranges[4];
     int *ranges_y = tagJ ? castedranges[2] : castedranges[5];
 
-    // Computes the number of blocks needed ---------------------------------------------
-    nblocks = 0;
-    int len_range = 0;
-    for (int i = 0; i < nranges; i++) {
-        len_range = ranges_x[2 * i + 1] - ranges_x[2 * i];
-        nblocks += (len_range / blockSize_x) + (len_range % blockSize_x == 0 ? 0 : 1);
+    // Lookup table for the blocks (and, with batch dimensions, table of offsets of shape
+    // (nblock, SIZEVARS)), loaded on the device
+    build_host_tables(nblocks, tagJ, nranges, ranges_x, nbatchdims, lookup_d, offsets_d, blockSize_x,
+                      indsi, indsj, indsp, shapes, nshapes, cache, ws, stream);
+
+    // Send data from host to device:
+    slices_x_d = ws.get< int >(2 * nranges);
+    CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) slices_x_d, slices_x, sizeof(int) * 2 * nranges, stream));
+    KEOPS_PROF_BYTES_HTOD(sizeof(int) * 2 * nranges);
+
+    ranges_y_d = ws.get< int >(2 * nredranges);
+    CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) ranges_y_d, ranges_y, sizeof(int) * 2 * nredranges, stream));
+    KEOPS_PROF_BYTES_HTOD(sizeof(int) * 2 * nredranges);
+
+}
+
+
+// Device copy of a resident host argument (see KeOps_module::set_resident_args), which is only valid
+// while the host array it was made from is alive : host is only used to detect new arrays. It is shared
+// by the module and by the calls which read it, so that the memory is freed only once the copy
+// has been replaced (or released) and the last of these calls is done.
+struct KeOps_resident_copy {
+    const void *host;
+    size_t size;
+    CUdeviceptr data;
+
+    KeOps_resident_copy(const void *host_, size_t size_) : host(host_), size(size_) {
+        CUDA_SAFE_CALL(cuMemAlloc(&data, std::max(size, (size_t) 1)));
+        KEOPS_PROF_DEVICE_ALLOC(size);
+        CUresult result = cuMemcpyHtoD(data, host, size);
+        if (result != CUDA_SUCCESS) {
+            cuMemFree(data);
+            CUDA_SAFE_CALL(result);
+        }
+        KEOPS_PROF_BYTES_HTOD(size);
     }
 
-    // Create a lookup table for the blocks --------------------------------------------
-    int lookup_h[3 * nblocks];
-    int index = 0;
+    ~KeOps_resident_copy() {
+        CUDA_SAFE_CALL_NO_EXCEPTION(cuMemFree(data));
+    }
 
-    for (int i = 0; i < nranges; i++) {
-        len_range = ranges_x[2 * i + 1] - ranges_x[2 * i];
-        for (int j = 0; j < len_range; j += blockSize_x) {
-            lookup_h[3 * index] = i;
-            lookup_h[3 * index + 1] = ranges_x[2 * i] + j;
-            lookup_h[3 * index + 2] = ranges_x[2 * i] + j + std::min((int) blockSize_x, len_range - j);
-            index++;
+private:
+
+    KeOps_resident_copy(const KeOps_resident_copy &);
+    KeOps_resident_copy &operator=(const KeOps_resident_copy &);
+
+};
+
+
+// Everything needed to enqueue the kernels of one call, once the scratch buffers
+// have been filled : see KeOps_module::prepare_launch and KeOps_module::enqueue_kernels.
+template< typename TYPE >
+struct KeOps_launch {
+    int nx, ny, nbatchdims, dimY, dimred, tag1D2D, tagRanges, tagZero;
+    int blockSize_x, gridSize_x, gridSize_y, gridSize2_x, nblocks, jchunk;
+    // N.B. the numbers of elements of the arrays may not fit in an int
+    size_t sharedMem, sizeout;
+    int *lookup_d, *slices_x_d, *ranges_y_d, *offsets_d;
+    // in ranges mode, ranges and scratch memory of the kernels which build lookup_d on the device
+    // (see range_preprocess_from_device) ; block_offsets_d is NULL if lookup_d is built on the host.
+    int nranges_lookup, *ranges_x_d, *block_offsets_d;
+    int *queue_d;    // in ranges mode, counter of the persistent kernel ; NULL if it is not used
+    TYPE *out_d, **arg_d;
+    typename KeOps_compute_type< TYPE >::type *outB;
+    // device copies of the resident arguments read by the call, kept alive until its end
+    std::vector< std::shared_ptr< KeOps_resident_copy > > resident;
+};
+
+
+// Launch configuration of the kernels for given sizes, see KeOps_module::get_plan
+struct KeOps_plan {
+    int blockSize_x, gridSize_x, gridSize_y, gridSize2_x;
+    size_t sharedMem;
+    // in ranges mode, number of blocks of the persistent kernel (0 if the module does not contain it)
+    int persistent_grid;
+    // in simple 1D mode, number of j indices of each line of blocks of the split-j kernel (0 if it is not used)
+    int jchunk;
+};
+
+// Key of the launch configurations in KeOps_module::plans : a fixed size struct, hashed in place,
+// so that looking up the plan of a call does not allocate memory.
+struct KeOps_plan_key {
+    int nx, ny, tag1D2D, tagRanges, cuda_block_size;
+
+    bool operator==(const KeOps_plan_key &other) const {
+        return nx == other.nx && ny == other.ny && tag1D2D == other.tag1D2D
+               && tagRanges == other.tagRanges && cuda_block_size == other.cuda_block_size;
+    }
+};
+
+struct KeOps_plan_key_hash {
+    size_t operator()(const KeOps_plan_key &key) const {
+        // 64 bits FNV-1a hash of the fields
+        const int fields[5] = {key.nx, key.ny, key.tag1D2D, key.tagRanges, key.cuda_block_size};
+        unsigned long long hash = 14695981039346656037ULL;
+        for (int k = 0; k < 5; k++) {
+            hash ^= (unsigned int) fields[k];
+            hash *= 1099511628211ULL;
         }
+        return (size_t) hash;
     }
+};
 
-    // Load the table on the device -----------------------------------------------------
-    CUDA_SAFE_CALL(cuMemAlloc((CUdeviceptr * ) & lookup_d, sizeof(int) * 3 * nblocks));
-    CUDA_SAFE_CALL(cuMemcpyHtoD((CUdeviceptr) lookup_d, lookup_h, sizeof(int) * 3 * nblocks));
+// Counters of the launch configurations and of the device memory allocations of the workspaces
+// of a module (see KeOps_module::get_plan_stats) : in steady state, calls with the same sizes
+// find their plan in the cache and do not allocate memory.
+struct KeOps_plan_stats {
+    long long plan_hits, plan_misses, workspace_allocs;
 
-    // Send data from host to device:
-    CUDA_SAFE_CALL(cuMemAlloc((CUdeviceptr * ) & slices_x_d, sizeof(int) * 2 * nranges));
-    CUDA_SAFE_CALL(cuMemcpyHtoD((CUdeviceptr) slices_x_d, slices_x, sizeof(int) * 2 * nranges));
+    KeOps_plan_stats() : plan_hits(0), plan_misses(0), workspace_allocs(0) {}
 
-    CUDA_SAFE_CALL(cuMemAlloc((CUdeviceptr * ) & ranges_y_d, sizeof(int) * 2 * nredranges));
-    CUDA_SAFE_CALL(cuMemcpyHtoD((CUdeviceptr) ranges_y_d, ranges_y, sizeof(int) * 2 * nredranges));
+    void merge(const KeOps_plan_stats &other) {
+        plan_hits += other.plan_hits;
+        plan_misses += other.plan_misses;
+        workspace_allocs += other.workspace_allocs;
+    }
+};
 
 
-    // Support for broadcasting over batch dimensions =============================================
+// pipelined computations on host data : number of tiles of rows, and minimal size of a tile
+#define KEOPS_PIPELINE_NTILES 8
+#define KEOPS_PIPELINE_MIN_ROWS 8192
 
-    // We create a lookup table, "offsets", of shape (nblock, SIZEVARS):
+// out-of-core computations on host data : fraction of the free device memory that may be used
+#define KEOPS_OUT_OF_CORE_FRACTION 0.8
 
-    if (nbatchdims > 0) {
-        offsets_d = build_offset_tables(nbatchdims, shapes, nblocks, lookup_h,
-                                        indsi, indsj, indsp, tagJ);
+// maximum number of launch configurations kept by a KeOps_module
+#define KEOPS_MAX_PLANS 1024
+
+// split-j variant of the 1D scheme : minimal number of tiles of j indices of a line of blocks
+#define KEOPS_SPLITJ_MIN_TILES 4
+
+
+// A call captured as a CUDA graph, together with the device memory used by its kernels.
+// This memory belongs to the graph (and not to the workspace of a slot), so that
+// it is never overwritten by other calls.
+template< typename TYPE >
+struct KeOps_graph {
+    KeOps_launch< TYPE > L;
+    Workspace ws;
+    std::vector< TYPE * > args;     // pointers to the arguments currently stored in L.arg_d
+    CUgraphExec exec;
+    unsigned long last_hit;
+};
+
+// maximum number of graphs kept by a KeOps_module ; the least recently used one is dropped beyond this.
+#define KEOPS_MAX_CUDA_GRAPHS 16
+
+
+// Resources used by one call of a KeOps_module : scratch memory, staging buffer, streams and events.
+// Concurrent calls get different slots from the pool of the module (see KeOps_module::acquire_slot),
+// so that they never share mutable state.
+struct KeOps_slot {
+    Workspace ws;
+    PinnedBuffer staging;
+    CUstream stream;                    // used for calls on the NULL stream, see KeOps_module::launch_kernel
+    CUstream pipeline_streams[2];       // pipelined computations on host data, created on first use
+    CUevent pipeline_ready, pipeline_done[2];
+    KeOps_ranges_cache ranges_cache;    // tables of the last call with ranges built on the host
+};
+
+
+// Makes ctx the current context of the calling thread for the lifetime of the guard,
+// and restores the previous current context afterwards.
+class KeOps_context_guard {
+public:
+
+    KeOps_context_guard(CUcontext ctx) : pushed(false) {
+        CUcontext current_ctx;
+        CUDA_SAFE_CALL(cuCtxGetCurrent(&current_ctx));
+        if (current_ctx != ctx) {
+            CUDA_SAFE_CALL(cuCtxPushCurrent(ctx));
+            pushed = true;
+        }
+    }
+
+    ~KeOps_context_guard() {
+        if (pushed) {
+            CUcontext popped_ctx;
+            CUDA_SAFE_CALL_NO_EXCEPTION(cuCtxPopCurrent(&popped_ctx));
+        }
     }
 
+private:
 
-}
+    bool pushed;
+
+    KeOps_context_guard(const KeOps_context_guard &);
+    KeOps_context_guard &operator=(const KeOps_context_guard &);
+
+};
 
 
 template< typename TYPE >
 class KeOps_module {
 public :
 
+    typedef typename KeOps_compute_type< TYPE >::type COMPUTE_TYPE;
+
     CUdevice cuDevice;
     CUcontext ctx;
     CUmodule module;
     char *target;
-    CUdeviceptr buffer;
     int nargs;
 
-    void SetContext() {
-        CUcontext current_ctx;
-        CUDA_SAFE_CALL_NO_EXCEPTION(cuCtxGetCurrent(&current_ctx));
-        if (current_ctx != ctx)
-            CUDA_SAFE_CALL_NO_EXCEPTION(cuCtxPushCurrent(ctx));
-        CUDA_SAFE_CALL_NO_EXCEPTION(cuCtxGetCurrent(&current_ctx));
+    // handles of the kernels of the module, resolved once for all at construction ;
+    // NULL if the module does not contain the corresponding kernel.
+    CUfunction kernel_1D, kernel_1D_ranges, kernel_2D, kernel_reduce2D, kernel_1D_tile;
+    // kernels building the lookup table of the ranges on the device (see range_preprocess_from_device)
+    CUfunction kernel_ranges_scan, kernel_ranges_lookup;
+    // persistent version of kernel_1D_ranges, for large lookup tables
+    CUfunction kernel_1D_ranges_persistent;
+    // split-j version of kernel_1D, for small values of nx (its partial results are combined by kernel_reduce2D)
+    CUfunction kernel_1D_splitj;
+
+    // number of rows of the output computed by each thread of kernel_1D (1, except for the
+    // register blocked scheme GpuReduc1D_regblock, which exports it as KeOps_rows_per_thread)
+    int rows_per_thread;
+
+    // number of threads of kernel_1D computing each row of the output (1, except for the
+    // K-nearest-neighbors scheme GpuReduc1D_knn, whose warps compute one row each, which exports it as KeOps_threads_per_row)
+    int threads_per_row;
+
+    // the block size is rounded down to a multiple of block_multiple (1, except for the tensor core
+    // scheme GpuReduc1D_tensorcore, whose warps compute tiles of 32 rows, which exports it as KeOps_block_multiple)
+    int block_multiple;
+
+    // properties of the device, and maximum size of dynamic shared memory for the main kernels
+    GpuProps props;
+    int maxDynamicSharedMem;
+
+    // N.B. all the members above are set by the constructor and never modified afterwards,
+    // so that launch_kernel may be called from several threads at once. The mutable state
+    // below is either owned by one call at a time (slots), or protected by a mutex.
+
+    // launch configurations, indexed by (nx, ny, tag1D2D, tagRanges, cuda_block_size), and
+    // numbers of lookups which found or computed the plan
+    std::unordered_map< KeOps_plan_key, KeOps_plan, KeOps_plan_key_hash > plans;
+    long long plan_hits, plan_misses;
+    std::mutex plans_mutex;
+
+    // CUDA graph mode (see launch_graph)
+    std::atomic< int > use_cuda_graphs;
+    unsigned long graph_clock;
+    std::map< std::vector< size_t >, KeOps_graph< TYPE > * > graphs;
+    std::mutex graphs_mutex;
+
+    // pipelined computations on host data (see launch_pipelined_from_host)
+    std::atomic< int > use_pipelined;
+
+    // pool of slots : all the slots created so far, and the ones not used by a call
+    std::vector< KeOps_slot * > slots, free_slots;
+    std::mutex slots_mutex;
+
+    // resident arguments (see set_resident_args) : flags, and device copies of the last host arrays
+    std::vector< int > resident_flags;
+    std::vector< std::shared_ptr< KeOps_resident_copy > > resident_copies;
+    std::atomic< int > n_resident;
+    std::mutex resident_mutex;
+
+    // size in bytes of the host data known to fit in device memory, from the last query of the free
+    // memory by launch_out_of_core_from_host. It is reset by the calls on host data which fail, so
+    // that the next call queries the free memory again (it may have decreased in the meantime).
+    std::atomic< size_t > in_core_bound;
+
+    // timings of the phases of the calls and counters of transfers and allocations
+    // (see Profiler.h : only recorded when compiled with KEOPS_PROFILING=1, and enabled by set_profiling)
+    KeOps_profiler profiler;
+
+
+    void SetGpuProps() {
+        CUDA_SAFE_CALL(cuDeviceGetAttribute(&props.maxThreadsPerBlock,
+                                            CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_BLOCK, cuDevice));
+        CUDA_SAFE_CALL(cuDeviceGetAttribute(&props.sharedMemPerBlock,
+                                            CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK, cuDevice));
+        CUDA_SAFE_CALL(cuDeviceGetAttribute(&props.sharedMemPerBlockOptin,
+                                            CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK_OPTIN, cuDevice));
+        props.sharedMemPerBlockOptin = std::max(props.sharedMemPerBlockOptin, props.sharedMemPerBlock);
+        CUDA_SAFE_CALL(cuDeviceGetAttribute(&props.multiProcessorCount,
+                                            CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT, cuDevice));
+        maxDynamicSharedMem = props.sharedMemPerBlockOptin;
+    }
+
+
+    // Allows kernel to use all the shared memory of the device through the opt-in attribute,
+    // and updates maxDynamicSharedMem accordingly.
+    void EnableDynamicSharedMem(CUfunction kernel) {
+        if (kernel == NULL)
+            return;
+        int static_size;
+        CUDA_SAFE_CALL(cuFuncGetAttribute(&static_size, CU_FUNC_ATTRIBUTE_SHARED_SIZE_BYTES, kernel));
+        int dynamic_size = props.sharedMemPerBlockOptin - static_size;
+        if (dynamic_size > props.sharedMemPerBlock - static_size)
+            CUDA_SAFE_CALL(cuFuncSetAttribute(kernel, CU_FUNC_ATTRIBUTE_MAX_DYNAMIC_SHARED_SIZE_BYTES, dynamic_size));
+        maxDynamicSharedMem = std::min(maxDynamicSharedMem, dynamic_size);
+    }
+
+
+    CUfunction GetFunction(const char *name) {
+        CUfunction kernel;
+        CUresult result = cuModuleGetFunction(&kernel, module, name);
+        if (result == CUDA_ERROR_NOT_FOUND)
+            return NULL;
+        CUDA_SAFE_CALL(result);
+        return kernel;
+    }
+
+
+    CUfunction CheckFunction(CUfunction kernel, const char *name) {
+        if (kernel == NULL) {
+            std::cerr << "[KeOps] Kernel " << name << " not found in module." << std::endl;
+            throw std::runtime_error("[KeOps] Cuda error.");
+        }
+        return kernel;
+    }
+
+
+    // true if the module builds the lookup tables of the ranges on the device (see range_preprocess_from_device)
+    bool has_ranges_lookup() {
+        return kernel_ranges_scan != NULL && kernel_ranges_lookup != NULL;
     }
 
 
@@ -289,6 +662,28 @@ public :
 
     KeOps_module(int device_id, int nargs_, const char *target_file_name) {
 
+        // read the ptx or cubin file into a char array
+        Read_Target(target_file_name);
+
+        // the hash of the formula ends the name of the target file (see Gpu_link_compile.py)
+        std::string tag = target_file_name;
+        tag = tag.substr(tag.find_last_of("/_") + 1);
+        tag = tag.substr(0, tag.find('.'));
+
+        Load(device_id, nargs_, tag);
+    }
+
+
+    // the same, from a ptx or cubin image in memory (used by the standalone libraries of binders/aot)
+    KeOps_module(int device_id, int nargs_, const char *target_image, size_t target_size, const char *tag) {
+        target = new char[target_size];
+        memcpy(target, target_image, target_size);
+        Load(device_id, nargs_, tag);
+    }
+
+
+    void Load(int device_id, int nargs_, const std::string &tag) {
+
         nargs = nargs_;
 
         // init cuda in case not already done
@@ -298,112 +693,448 @@ public :
         CUDA_SAFE_CALL(cuDeviceGet(&cuDevice, device_id));
         CUDA_SAFE_CALL(cuDevicePrimaryCtxRetain(&ctx, cuDevice));
 
-        // set the primary context as the active current context
-        SetContext();
+        // the primary context is the current context until the end of the constructor
+        KeOps_context_guard guard(ctx);
 
-        // set global variables giving some properties of device
-        SetGpuProps(device_id);
+        // get some properties of the device
+        SetGpuProps();
 
-        // read the ptx or cubin file into a char array
-        Read_Target(target_file_name);
+        profiler.set_tag(tag);
 
         // load the corresponding module
         CUDA_SAFE_CALL(cuModuleLoadDataEx(&module, target, 0, NULL, NULL));
 
-        // allocate a small memory buffer for "on device" computation mode,
-        // This is just used for storing the list of pointers to device data
-        // as a device array ; it is better to allocate it here once for all,
+        // get the kernels
+        kernel_1D = GetFunction("GpuConv1DOnDevice");
+        kernel_1D_ranges = GetFunction("GpuConv1DOnDevice_ranges");
+        kernel_2D = GetFunction("GpuConv2DOnDevice");
+        kernel_reduce2D = GetFunction("reduce2D");
+        kernel_1D_tile = GetFunction("GpuConv1DOnDevice_tile");
+        kernel_ranges_scan = GetFunction("KeOps_ranges_scan");
+        kernel_ranges_lookup = GetFunction("KeOps_ranges_lookup");
+        kernel_1D_ranges_persistent = GetFunction("GpuConv1DOnDevice_ranges_persistent");
+        kernel_1D_splitj = GetFunction("GpuConv1DOnDevice_splitj");
+
+        rows_per_thread = 1;
+        CUdeviceptr rows_per_thread_d;
+        size_t rows_per_thread_size;
+        if (cuModuleGetGlobal(&rows_per_thread_d, &rows_per_thread_size, module, "KeOps_rows_per_thread") == CUDA_SUCCESS)
+            CUDA_SAFE_CALL(cuMemcpyDtoH(&rows_per_thread, rows_per_thread_d, sizeof(int)));
+
+        threads_per_row = 1;
+        CUdeviceptr threads_per_row_d;
+        size_t threads_per_row_size;
+        if (cuModuleGetGlobal(&threads_per_row_d, &threads_per_row_size, module, "KeOps_threads_per_row") == CUDA_SUCCESS)
+            CUDA_SAFE_CALL(cuMemcpyDtoH(&threads_per_row, threads_per_row_d, sizeof(int)));
+
+        block_multiple = 1;
+        CUdeviceptr block_multiple_d;
+        size_t block_multiple_size;
+        if (cuModuleGetGlobal(&block_multiple_d, &block_multiple_size, module, "KeOps_block_multiple") == CUDA_SUCCESS)
+            CUDA_SAFE_CALL(cuMemcpyDtoH(&block_multiple, block_multiple_d, sizeof(int)));
+
+        // the shared memory used by these kernels is proportional to the block size,
+        // so allowing them to use more shared memory allows larger blocks for large dimensions.
+        EnableDynamicSharedMem(kernel_1D);
+        EnableDynamicSharedMem(kernel_1D_ranges);
+        EnableDynamicSharedMem(kernel_1D_ranges_persistent);
+        EnableDynamicSharedMem(kernel_1D_splitj);
+        EnableDynamicSharedMem(kernel_2D);
+        EnableDynamicSharedMem(kernel_1D_tile);
+
+        // create a first slot for the calls. Its workspace is initially just large enough
+        // for storing the list of pointers to device data as a device array ("on device"
+        // computation mode) ; it is better to allocate it here once for all,
         // otherwise allocating it at each call may cause a small overhead.
-        CUDA_SAFE_CALL(cuMemAlloc(&buffer, nargs * sizeof(TYPE *)));
+        // It will grow if some calls require more memory.
+        free_slots.push_back(create_slot());
+
+        use_cuda_graphs = 0;
+        graph_clock = 0;
+
+        use_pipelined = 0;
+
+        plan_hits = plan_misses = 0;
+
+        resident_flags.assign(nargs, 0);
+        resident_copies.resize(nargs);
+        n_resident = 0;
+
+        in_core_bound = 0;
 
     }
 
 
     ~KeOps_module() {
-        SetContext();
-        CUDA_SAFE_CALL_NO_EXCEPTION(cuMemFree(buffer));
-        CUDA_SAFE_CALL_NO_EXCEPTION(cuModuleUnload(module));
+        {
+            KeOps_context_guard guard(ctx);
+            clear_graphs();
+            resident_copies.clear();
+            for (size_t k = 0; k < slots.size(); k++)
+                destroy_slot(slots[k]);
+            profiler.release();
+            CUDA_SAFE_CALL_NO_EXCEPTION(cuModuleUnload(module));
+        }
         CUDA_SAFE_CALL_NO_EXCEPTION(cuDevicePrimaryCtxRelease(cuDevice));
         delete[] target;
     }
 
-    int launch_kernel(int tagHostDevice, int dimY, int nx, int ny,
-                      int tagI, int tagZero, int use_half,
-                      int tag1D2D, int dimred,
-                      int cuda_block_size, int use_chunk_mode,
-                      std::vector< int > indsi, std::vector< int > indsj, std::vector< int > indsp,
-                      int dimout,
-                      std::vector< int > dimsx, std::vector< int > dimsy, std::vector< int > dimsp,
-                      int **ranges,
-                      std::vector< int > shapeout, TYPE *out,
-                      TYPE **arg,
-                      std::vector <std::vector< int >> argshape
-    ) {
 
+    // Enables (val=1) or disables (val=0) the CUDA graph mode for computations on device data.
+    // Block-sparse reductions (with ranges) are only captured if the module builds their lookup
+    // tables on the device, see launch_graph.
+    void set_cuda_graphs(int val) {
+        use_cuda_graphs = val;
+        if (!val) {
+            KeOps_context_guard guard(ctx);
+            std::lock_guard< std::mutex > lock(graphs_mutex);
+            clear_graphs();
+        }
+    }
+
+
+    // Enables (val=1) or disables (val=0) the pipelined computations on host data. Off by default :
+    // the pipeline only pays off when the transfers of the i variables and of the output take a
+    // significant part of the call (see pykeops/benchmarks/benchmark_gpu_pipelined.py).
+    void set_pipelined(int val) {
+        use_pipelined = val;
+    }
+
+
+    // Flags the arguments of indices inds as resident : in computations on host data, they are copied
+    // to the device at the first call, and the next calls reuse these device copies as long as the host
+    // pointer and the size of the argument stay the same. The module cannot tell a host array from a new
+    // one allocated at its address once it is freed : a copy stands for the array it was made from, and
+    // release_resident_args must be called whenever the arguments may be other arrays, or after in place
+    // modifications of the host arrays (pykeops does so when the identity of a resident argument changes,
+    // see ResidentArgs in pykeops/common/operations.py). Pipelined and out-of-core computations on host
+    // data are disabled for the modules with resident arguments.
+    void set_resident_args(const std::vector< int > &inds) {
+        KeOps_context_guard guard(ctx);
+        std::lock_guard< std::mutex > lock(resident_mutex);
+        resident_flags.assign(nargs, 0);
+        for (size_t k = 0; k < inds.size(); k++)
+            if (inds[k] >= 0 && inds[k] < nargs)
+                resident_flags[inds[k]] = 1;
+        resident_copies.assign(nargs, std::shared_ptr< KeOps_resident_copy >());
+        n_resident = std::accumulate(resident_flags.begin(), resident_flags.end(), 0);
+    }
 
-        SetContext();
+    // Frees the device copies of the resident arguments : the next call copies them again.
+    void release_resident_args() {
+        KeOps_context_guard guard(ctx);
+        std::lock_guard< std::mutex > lock(resident_mutex);
+        resident_copies.assign(nargs, std::shared_ptr< KeOps_resident_copy >());
+    }
 
-        ////end_ = clock();
-        ////std::cout << "  time for set device : " << double(//end_ - start_) / CLOCKS_PER_SEC << std::endl;
-        //start_ = clock();
+    // Device copies of the resident arguments of a call on host data (NULL for the other arguments),
+    // which are copied again if they are new host arrays. They are kept alive by L until the end of the call.
+    void get_resident_args(KeOps_launch< TYPE > &L, TYPE **arg, const std::vector <std::vector< int >> &argshape,
+                           std::vector< TYPE * > &resident_d) {
+        std::lock_guard< std::mutex > lock(resident_mutex);
+        resident_d.assign(nargs, NULL);
+        for (int k = 0; k < nargs; k++) {
+            if (!resident_flags[k])
+                continue;
+            size_t size = sizeof(TYPE) * std::accumulate(argshape[k].begin(), argshape[k].end(), (size_t) 1,
+                                                         std::multiplies< size_t >());
+            std::shared_ptr< KeOps_resident_copy > &copy = resident_copies[k];
+            if (!copy || copy->host != (const void *) arg[k] || copy->size != size)
+                copy = std::make_shared< KeOps_resident_copy >(arg[k], size);
+            L.resident.push_back(copy);
+            resident_d[k] = (TYPE *) copy->data;
+        }
+    }
+
+
+    // Enables (val=1) or disables (val=0) the recording of the profiler. Only effective
+    // when the binder is compiled with KEOPS_PROFILING=1.
+    void set_profiling(int val) {
+        KeOps_context_guard guard(ctx);
+        profiler.set_enabled(val);
+    }
+
+    // Statistics of the calls recorded so far ; waits for the completion of the timed device operations.
+    KeOps_stats get_stats() {
+        KeOps_context_guard guard(ctx);
+        return profiler.get_stats();
+    }
+
+    std::vector< KeOps_trace_event > get_trace() {
+        KeOps_context_guard guard(ctx);
+        return profiler.get_trace();
+    }
+
+    void reset_stats() {
+        KeOps_context_guard guard(ctx);
+        profiler.reset();
+    }
+
+    // Counters of the launch configurations and of the allocations of the workspaces, since
+    // the creation of the module. Contrary to get_stats, they are always recorded.
+    KeOps_plan_stats get_plan_stats() {
+        KeOps_plan_stats stats;
+        {
+            std::lock_guard< std::mutex > lock(plans_mutex);
+            stats.plan_hits = plan_hits;
+            stats.plan_misses = plan_misses;
+        }
+        {
+            std::lock_guard< std::mutex > lock(slots_mutex);
+            for (size_t k = 0; k < slots.size(); k++)
+                stats.workspace_allocs += slots[k]->ws.num_allocs();
+        }
+        {
+            std::lock_guard< std::mutex > lock(graphs_mutex);
+            for (typename std::map< std::vector< size_t >, KeOps_graph< TYPE > * >::iterator it = graphs.begin();
+                 it != graphs.end(); ++it)
+                stats.workspace_allocs += it->second->ws.num_allocs();
+        }
+        return stats;
+    }
+
+    // Writes the events recorded so far in the Chrome trace format (chrome://tracing, Perfetto).
+    void write_trace(const char *filename) {
+        KeOps_write_trace(filename, get_trace());
+    }
+
+
+    // N.B. slots are created and destroyed with the context of the module as current context.
+    KeOps_slot *create_slot() {
+        KeOps_slot *S = new KeOps_slot();
+        S->ws.init(nargs * sizeof(TYPE *));
+        // a blocking stream, hence implicitly synchronized with the NULL stream but not with
+        // the streams of other slots.
+        CUDA_SAFE_CALL(cuStreamCreate(&S->stream, CU_STREAM_DEFAULT));
+        S->pipeline_streams[0] = S->pipeline_streams[1] = NULL;
+        slots.push_back(S);
+        return S;
+    }
+
+
+    void destroy_slot(KeOps_slot *S) {
+        // Workspace::release waits for the last call using the slot to complete
+        S->ws.release();
+        if (S->pipeline_streams[0]) {
+            for (int b = 0; b < 2; b++) {
+                CUDA_SAFE_CALL_NO_EXCEPTION(cuStreamSynchronize(S->pipeline_streams[b]));
+                CUDA_SAFE_CALL_NO_EXCEPTION(cuStreamDestroy(S->pipeline_streams[b]));
+                CUDA_SAFE_CALL_NO_EXCEPTION(cuEventDestroy(S->pipeline_done[b]));
+            }
+            CUDA_SAFE_CALL_NO_EXCEPTION(cuEventDestroy(S->pipeline_ready));
+        }
+        CUDA_SAFE_CALL_NO_EXCEPTION(cuStreamDestroy(S->stream));
+        S->staging.release();
+        delete S;
+    }
+
+
+    // Returns a slot which is not used by any other call, creating a new one if needed.
+    // Hence the pool grows up to the maximal number of concurrent calls on the module.
+    KeOps_slot *acquire_slot() {
+        std::lock_guard< std::mutex > lock(slots_mutex);
+        if (free_slots.empty())
+            return create_slot();
+        KeOps_slot *S = free_slots.back();
+        free_slots.pop_back();
+        return S;
+    }
+
+
+    void release_slot(KeOps_slot *S) {
+        std::lock_guard< std::mutex > lock(slots_mutex);
+        free_slots.push_back(S);
+    }
 
+
+    // gives back the slot to the pool at the end of a call, even if an exception is thrown
+    struct slot_guard {
+        KeOps_module &M;
+        KeOps_slot *S;
+
+        slot_guard(KeOps_module &M_) : M(M_), S(M_.acquire_slot()) {}
+
+        ~slot_guard() { M.release_slot(S); }
+    };
+
+
+    void init_pipeline(KeOps_slot &S) {
+        if (S.pipeline_streams[0])
+            return;
+        for (int b = 0; b < 2; b++) {
+            CUDA_SAFE_CALL(cuStreamCreate(&S.pipeline_streams[b], CU_STREAM_NON_BLOCKING));
+            CUDA_SAFE_CALL(cuEventCreate(&S.pipeline_done[b], CU_EVENT_DISABLE_TIMING));
+        }
+        CUDA_SAFE_CALL(cuEventCreate(&S.pipeline_ready, CU_EVENT_DISABLE_TIMING));
+    }
+
+
+    void release_graph(KeOps_graph< TYPE > *G) {
+        // Workspace::release waits for the last replay to complete before freeing the memory
+        G->ws.release();
+        CUDA_SAFE_CALL_NO_EXCEPTION(cuGraphExecDestroy(G->exec));
+        delete G;
+    }
+
+
+    void clear_graphs() {
+        for (typename std::map< std::vector< size_t >, KeOps_graph< TYPE > * >::iterator it = graphs.begin();
+             it != graphs.end(); ++it)
+            release_graph(it->second);
+        graphs.clear();
+    }
+
+
+    // Returns the launch configuration for given sizes. dimY, dimred and use_chunk_mode are fixed for
+    // a given module, so they are not part of the key ; cuda_block_size is, since the autotuner of
+    // pykeops (see pykeops/common/keops_io/autotune.py) launches the same module with several block sizes.
+    // In ranges mode, gridSize_x is not used here since the number of blocks depends on the ranges.
+    // The plan is returned by value, since the cache may be cleared by another thread.
+    KeOps_plan get_plan(int nx, int ny, int tag1D2D, int tagRanges, int dimY, int dimred,
+                               int cuda_block_size, int use_chunk_mode) {
+
+        KeOps_plan_key key = {nx, ny, tag1D2D, tagRanges, cuda_block_size};
+        std::lock_guard< std::mutex > lock(plans_mutex);
+        std::unordered_map< KeOps_plan_key, KeOps_plan, KeOps_plan_key_hash >::iterator it = plans.find(key);
+        if (it != plans.end()) {
+            plan_hits++;
+            return it->second;
+        }
+        plan_misses++;
+
+        // sizes may change at each call in some applications : we just forget everything
+        // when too many configurations have been stored.
+        if (plans.size() >= KEOPS_MAX_PLANS)
+            plans.clear();
+
+        KeOps_plan plan;
+
+        if (use_chunk_mode == 0) {
+            // warning : blockSize.x was previously set to CUDA_BLOCK_SIZE; currently CUDA_BLOCK_SIZE value is used as a bound.
+            plan.blockSize_x = std::min(cuda_block_size,
+                                        std::min(props.maxThreadsPerBlock,
+                                                 (int) (maxDynamicSharedMem / std::max(1, (int) (dimY * sizeof(COMPUTE_TYPE))))
+                                                )
+                                       ); // number of threads in each block
+        } else {
+            // warning : the value here must match the one which is set in files GpuReduc1D_chunks.py,
+            // GpuReduc1D_finalchunks.py, GpuReduc1D_ranges_chunks.py and GpuReduc1D_ranges_finalchunks.py
+            plan.blockSize_x = std::min(cuda_block_size,
+                                        std::min(1024, (int) (CHUNK_MODE_SHAREDMEMPERBLOCK /
+                                                              std::max(1, (int) (dimY * sizeof(COMPUTE_TYPE))))));
+        }
+
+        if (plan.blockSize_x > block_multiple)
+            plan.blockSize_x -= plan.blockSize_x % block_multiple;
+
+        // Size of the SharedData : blockSize.x*(DIMY)*sizeof(COMPUTE_TYPE)
+        plan.sharedMem = plan.blockSize_x * dimY * sizeof(COMPUTE_TYPE);
+
+        plan.gridSize_x = nx / plan.blockSize_x + (nx % plan.blockSize_x == 0 ? 0 : 1);
+        plan.gridSize_y = 1;
+        plan.gridSize2_x = 1;
+
+        if (tag1D2D == 1) { // 2D scheme
+            plan.gridSize_y = ny / plan.blockSize_x + (ny % plan.blockSize_x == 0 ? 0 : 1);
+            // Reduce : grid and block are both 1d, with the same block size
+            size_t sizeB = (size_t) nx * dimred;
+            plan.gridSize2_x = sizeB / plan.blockSize_x + (sizeB % plan.blockSize_x == 0 ? 0 : 1);
+        }
+
+        // the persistent kernel of the ranges mode runs as many blocks as can be resident on the device
+        plan.persistent_grid = 0;
+        if (tagRanges == 1 && tag1D2D == 0 && kernel_1D_ranges_persistent != NULL) {
+            int blocks_per_sm;
+            CUDA_SAFE_CALL(cuOccupancyMaxActiveBlocksPerMultiprocessor(&blocks_per_sm, kernel_1D_ranges_persistent,
+                                                                       plan.blockSize_x, plan.sharedMem));
+            plan.persistent_grid = blocks_per_sm * props.multiProcessorCount;
+        }
+
+        // In simple 1D mode, if the blocks of kernel_1D cannot fill the device (small nx and large ny),
+        // the j range is split in gridSize_y parts of jchunk indices, computed by the lines of blocks of
+        // kernel_1D_splitj ; the partial results are then combined by kernel_reduce2D, as in the 2D scheme.
+        // kernel_1D_splitj is the generic kernel of the 1D scheme (one row per thread) : it is never used
+        // in place of the variants of the 1D scheme (register blocked, knn and tensor core kernels),
+        // which do not generate it anyway.
+        plan.jchunk = 0;
+        if (tagRanges == 0 && tag1D2D == 0 && kernel_1D_splitj != NULL && kernel_reduce2D != NULL
+            && rows_per_thread == 1 && threads_per_row == 1 && block_multiple == 1) {
+            int blocks_1D = nx / plan.blockSize_x + (nx % plan.blockSize_x == 0 ? 0 : 1);
+            int blocks_per_sm;
+            CUDA_SAFE_CALL(cuOccupancyMaxActiveBlocksPerMultiprocessor(&blocks_per_sm, kernel_1D_splitj,
+                                                                       plan.blockSize_x, plan.sharedMem));
+            int resident_blocks = blocks_per_sm * props.multiProcessorCount;
+            int ntiles = ny / plan.blockSize_x + (ny % plan.blockSize_x == 0 ? 0 : 1);
+            int nsplit = std::min(resident_blocks / std::max(1, plan.gridSize_x), ntiles / KEOPS_SPLITJ_MIN_TILES);
+            if (2 * blocks_1D <= resident_blocks && nsplit > 1) {
+                int tiles_per_split = ntiles / nsplit + (ntiles % nsplit == 0 ? 0 : 1);
+                plan.jchunk = tiles_per_split * plan.blockSize_x;
+                plan.gridSize_y = ny / plan.jchunk + (ny % plan.jchunk == 0 ? 0 : 1);
+                // one thread per row for the combination of the partial results
+                plan.gridSize2_x = plan.gridSize_x;
+            }
+        }
+
+        return plans[key] = plan;
+    }
+
+
+    // Number of elements of the intermediate output outB of a call (the partial results of the 2D scheme
+    // or of the split-j variant of the 1D scheme), with the launch configuration of get_plan ; 0 if
+    // there is none. The binders use it to check that the offsets in outB fit in 32 bits integers.
+    size_t get_buffer_size(int nx, int ny, int tag1D2D, int tagRanges, int dimY, int dimred,
+                           int cuda_block_size, int use_chunk_mode) {
+        KeOps_context_guard guard(ctx);
+        KeOps_plan plan = get_plan(nx, ny, tag1D2D, tagRanges, dimY, dimred, cuda_block_size, use_chunk_mode);
+        if (tag1D2D == 1 || plan.jchunk > 0)
+            return (size_t) nx * dimred * plan.gridSize_y;
+        return 0;
+    }
+
+
+    // Computes the sizes and launch configuration of a call, and fills the scratch buffers
+    // (arguments, ranges lookup tables, etc.) taken from ws. All copies are enqueued on stream.
+    // The lookup tables built on the host are cached in ranges_cache, if it is not NULL.
+    void prepare_launch(KeOps_launch< TYPE > &L, Workspace &ws, KeOps_ranges_cache *ranges_cache, CUstream stream,
+                        int tagHostDevice, int dimY, int nx, int ny,
+                        int tagI, int tagZero, int use_half,
+                        int tag1D2D, int dimred,
+                        int cuda_block_size, int use_chunk_mode,
+                        const std::vector< int > &indsi, const std::vector< int > &indsj, const std::vector< int > &indsp,
+                        int dimout,
+                        const std::vector< int > &dimsx, const std::vector< int > &dimsy, const std::vector< int > &dimsp,
+                        int **ranges,
+                        const std::vector< int > &shapeout, TYPE *out,
+                        TYPE **arg,
+                        const std::vector <std::vector< int >> &argshape) {
+
+        KEOPS_PROF_HOST_START(sizes_timer, "sizes");
         Sizes <TYPE> SS(nargs, arg, argshape, nx, ny,
                         tagI, use_half,
                         dimout,
                         indsi, indsj, indsp,
                         dimsx, dimsy, dimsp);
 
-        //end_ = clock();
-        //std::cout << "  time for Sizes : " << double(//end_ - start_) / CLOCKS_PER_SEC << std::endl;
-        //start_ = clock();
-
         if (use_half)
             SS.switch_to_half2_indexing();
+        KEOPS_PROF_HOST_STOP(sizes_timer);
 
+        KEOPS_PROF_HOST_START(ranges_timer, "ranges");
         Ranges <TYPE> RR(SS, ranges);
+        KEOPS_PROF_HOST_STOP(ranges_timer);
         nx = SS.nx;
         ny = SS.ny;
 
-        //end_ = clock();
-        //std::cout << "  time for Ranges : " << double(//end_ - start_) / CLOCKS_PER_SEC << std::endl;
-        //start_ = clock();
-
-        // now we switch (back...) indsi, indsj and dimsx, dimsy in case tagI=1.
+        // now we switch (back...) indsi, indsj in case tagI=1.
         // This is to be consistent with the convention used in the old
         // bindings where i and j variables had different meanings in bindings
         // and in the core code. Clearly we could do better if we
         // carefully rewrite some parts of the code
-        if (tagI == 1) {
-            std::vector< int > tmp;
-
-            tmp = indsj;
-            indsj = indsi;
-            indsi = tmp;
-
-            tmp = dimsy;
-            dimsy = dimsx;
-            dimsx = tmp;
-        }
-
+        const std::vector< int > &indsi_core = (tagI == 1) ? indsj : indsi;
+        const std::vector< int > &indsj_core = (tagI == 1) ? indsi : indsj;
 
-        int blockSize_x = 1, blockSize_y = 1, blockSize_z = 1;
 
-        if (use_chunk_mode == 0) {
-            // warning : blockSize.x was previously set to CUDA_BLOCK_SIZE; currently CUDA_BLOCK_SIZE value is used as a bound.
-            blockSize_x = std::min(cuda_block_size,
-                                   std::min(maxThreadsPerBlock,
-                                            (int) (sharedMemPerBlock / std::max(1, (int) (dimY * sizeof(TYPE))))
-                                           )
-                                  ); // number of threads in each block
-        } else {
-            // warning : the value here must match the one which is set in file GpuReduc1D_chunks.py, line 59
-            // and file GpuReduc1D_finalchunks.py, line 67
-            blockSize_x = std::min(cuda_block_size,
-                                   std::min(1024, (int) (49152 / std::max(1, (int) (dimY * sizeof(TYPE)))))
-                                  );
-        }
-
-        int nblocks;
+        int nblocks = 0;
 
         if (tagI == 1) {
             int tmp = ny;
@@ -411,177 +1142,986 @@ public :
             nx = tmp;
         }
 
+        KeOps_plan plan = get_plan(nx, ny, tag1D2D, RR.tagRanges, dimY, dimred,
+                                          cuda_block_size, use_chunk_mode);
+        int blockSize_x = plan.blockSize_x;
+
         int *lookup_d = NULL, *slices_x_d = NULL, *ranges_y_d = NULL;
         int *offsets_d = NULL;
+        int nranges_lookup = 0, *ranges_x_d = NULL, *block_offsets_d = NULL;
 
         if (RR.tagRanges == 1) {
+            KEOPS_PROF_HOST("range_preprocess");
+            KEOPS_PROF_DEVICE("range_preprocess", stream);
             if (tagHostDevice == 1) {
-                range_preprocess_from_device(nblocks, tagI, RR.nranges_x, RR.nranges_y, RR.castedranges,
+                range_preprocess_from_device(nblocks, tagI, nx, RR.nranges_x, RR.nranges_y, RR.castedranges,
                                              SS.nbatchdims, slices_x_d, ranges_y_d, lookup_d,
                                              offsets_d,
-                                             blockSize_x, indsi, indsj, indsp, SS.shapes);
+                                             blockSize_x, indsi_core, indsj_core, indsp, SS.shapes, SS._shapes.size(),
+                                             has_ranges_lookup(), nranges_lookup, ranges_x_d, block_offsets_d,
+                                             ranges_cache, ws, stream);
             } else { // tagHostDevice==0
                 range_preprocess_from_host(nblocks, tagI, RR.nranges_x, RR.nranges_y, RR.nredranges_x, RR.nredranges_y,
                                            RR.castedranges,
                                            SS.nbatchdims, slices_x_d, ranges_y_d, lookup_d,
                                            offsets_d,
-                                           blockSize_x, indsi, indsj, indsp, SS.shapes);
+                                           blockSize_x, indsi_core, indsj_core, indsp, SS.shapes, SS._shapes.size(),
+                                           ranges_cache, ws, stream);
             }
         }
 
-        ////end_ = clock();
-        ////std::cout << "  time for interm : " << double(//end_ - start_) / CLOCKS_PER_SEC << std::endl;
-        //start_ = clock();
+        size_t sizeout = std::accumulate(shapeout.begin(), shapeout.end(), (size_t) 1, std::multiplies< size_t >());
 
-        CUdeviceptr p_data;
-        TYPE *out_d;
-        TYPE **arg_d;
+        {
+            KEOPS_PROF_HOST("load_args");
+            KEOPS_PROF_DEVICE("load_args", stream);
+            if (tagHostDevice == 1) {
+                load_args_FromDevice(ws, out, L.out_d, nargs, arg, L.arg_d, stream);
+            } else if (n_resident > 0) {
+                std::vector< TYPE * > resident_d;
+                get_resident_args(L, arg, argshape, resident_d);
+                load_args_FromHost(ws, out, L.out_d, nargs, arg, L.arg_d, argshape, sizeout, stream,
+                                   resident_d.data());
+            } else {
+                load_args_FromHost(ws, out, L.out_d, nargs, arg, L.arg_d, argshape, sizeout, stream);
+            }
+        }
 
-        int sizeout = std::accumulate(shapeout.begin(), shapeout.end(), 1, std::multiplies< int >());
+        L.nx = nx;
+        L.ny = ny;
+        L.nbatchdims = SS.nbatchdims;
+        L.dimY = dimY;
+        L.dimred = dimred;
+        L.tag1D2D = tag1D2D;
+        L.tagRanges = RR.tagRanges;
+        L.tagZero = tagZero;
+        L.sizeout = sizeout;
+        L.blockSize_x = blockSize_x;
+        L.gridSize_x = plan.gridSize_x;
+        L.gridSize_y = plan.gridSize_y;
+        L.gridSize2_x = plan.gridSize2_x;
+        L.jchunk = plan.jchunk;
+        L.sharedMem = plan.sharedMem;
+        L.nblocks = nblocks;
+        L.lookup_d = lookup_d;
+        L.slices_x_d = slices_x_d;
+        L.ranges_y_d = ranges_y_d;
+        L.offsets_d = offsets_d;
+        L.nranges_lookup = nranges_lookup;
+        L.ranges_x_d = ranges_x_d;
+        L.block_offsets_d = block_offsets_d;
+        L.queue_d = NULL;
+        L.outB = NULL;
+
+        if (tag1D2D == 1) {
+            // Data on the device. We need an "inflated" outB, which contains gridSize.y "copies" of out
+            // that will be reduced in the final pass.
+            L.outB = ws.get< COMPUTE_TYPE >((size_t) nx * dimred * L.gridSize_y);
+        } else if (L.jchunk > 0 && RR.tagRanges == 0 && tagZero == 0) {
+            // the same for the split-j variant of the 1D scheme
+            L.outB = ws.get< COMPUTE_TYPE >((size_t) nx * dimred * L.gridSize_y);
+        } else if (RR.tagRanges == 1 && tagZero == 0) {
+            // in ranges mode, the number of blocks depends on the ranges ; if the device cannot run
+            // them all at once, the persistent kernel distributes them to as many blocks as it can run.
+            if (plan.persistent_grid > 0 && nblocks > plan.persistent_grid) {
+                L.queue_d = ws.get< int >(1);
+                L.gridSize_x = plan.persistent_grid;
+            } else {
+                L.gridSize_x = nblocks;
+            }
+        }
+    }
 
-        if (tagHostDevice == 1) {
-            p_data = buffer;
-            load_args_FromDevice(p_data, out, out_d, nargs, arg, arg_d);
-        } else
-            load_args_FromHost(p_data, out, out_d, nargs, arg, arg_d, argshape, sizeout);
 
-        ////end_ = clock();
-        ////std::cout << "  time for load_args : " << double(//end_ - start_) / CLOCKS_PER_SEC << std::endl;
-        //start_ = clock();
+    // Enqueues the kernels of a call prepared by prepare_launch on stream. Nothing else than
+    // kernel launches (and the reset of the queue of the persistent kernel) happens here,
+    // so that this sequence can be captured in a CUDA graph.
+    void enqueue_kernels(KeOps_launch< TYPE > &L, CUstream stream) {
+
+        KEOPS_PROF_HOST("enqueue_kernels");
+
+        if (L.block_offsets_d != NULL) {
+            // lookup table of the ranges, built on the device (see range_preprocess_from_device)
+            KEOPS_PROF_DEVICE("ranges_lookup", stream);
+            void *scan_params[4] = {&L.nranges_lookup, &L.ranges_x_d, &L.blockSize_x, &L.block_offsets_d};
+            CUDA_SAFE_CALL(cuLaunchKernel(kernel_ranges_scan,
+                                          1, 1, 1,
+                                          KEOPS_RANGES_SCAN_THREADS, 1, 1,
+                                          0, stream, scan_params, 0));
+
+            void *lookup_params[6] = {&L.nranges_lookup, &L.ranges_x_d, &L.blockSize_x, &L.block_offsets_d,
+                                      &L.nblocks, &L.lookup_d};
+            int gridSize = L.nblocks / KEOPS_RANGES_LOOKUP_THREADS
+                           + (L.nblocks % KEOPS_RANGES_LOOKUP_THREADS == 0 ? 0 : 1);
+            CUDA_SAFE_CALL(cuLaunchKernel(kernel_ranges_lookup,
+                                          gridSize, 1, 1,
+                                          KEOPS_RANGES_LOOKUP_THREADS, 1, 1,
+                                          0, stream, lookup_params, 0));
+        }
 
-        CUfunction kernel;
+        if (L.tag1D2D == 1) { // 2D scheme
 
-        int gridSize_x = 1, gridSize_y = 1, gridSize_z = 1;
+            void *kernel_params[4];
+            kernel_params[0] = &L.nx;
+            kernel_params[1] = &L.ny;
+            kernel_params[2] = &L.outB;
+            kernel_params[3] = &L.arg_d;
+
+            {
+                KEOPS_PROF_DEVICE("GpuConv2DOnDevice", stream);
+                CUDA_SAFE_CALL(cuLaunchKernel(CheckFunction(kernel_2D, "GpuConv2DOnDevice"),
+                                              L.gridSize_x, L.gridSize_y, 1,      // grid dim
+                                              L.blockSize_x, 1, 1,                // block dim
+                                              L.sharedMem, stream,                // shared mem and stream
+                                              kernel_params, 0));
+            }
+            // N.B. no synchronization is needed here : reduce2D is enqueued on the same stream,
+            // so it will only start once GpuConv2DOnDevice has completed.
 
-        if (tag1D2D == 1) { // 2D scheme
+            // Since we've used a 2D scheme, there's still a "blockwise" line reduction to make on
+            // the output array px_d[0] = x1B. We go from shape ( gridSize.y * nx, DIMRED ) to (nx, DIMOUT)
+            void *kernel_reduce_params[4];
+            kernel_reduce_params[0] = &L.outB;
+            kernel_reduce_params[1] = &L.out_d;
+            kernel_reduce_params[2] = &L.gridSize_y;
+            kernel_reduce_params[3] = &L.nx;
+
+            {
+                KEOPS_PROF_DEVICE("reduce2D", stream);
+                CUDA_SAFE_CALL(cuLaunchKernel(CheckFunction(kernel_reduce2D, "reduce2D"),
+                                              L.gridSize2_x, 1, 1,                // grid dim
+                                              L.blockSize_x, 1, 1,                // block dim
+                                              0, stream,                          // shared mem and stream
+                                              kernel_reduce_params, 0));
+            }
 
-            gridSize_x = nx / blockSize_x + (nx % blockSize_x == 0 ? 0 : 1);
-            gridSize_y = ny / blockSize_x + (ny % blockSize_x == 0 ? 0 : 1);
 
-            // Reduce : grid and block are both 1d
-            int blockSize2_x = 1, blockSize2_y = 1, blockSize2_z = 1;
-            blockSize2_x = blockSize_x; // number of threads in each block
-            int gridSize2_x = 1, gridSize2_y = 1, gridSize2_z = 1;
-            gridSize2_x = (nx * dimred) / blockSize2_x + ((nx * dimred) % blockSize2_x == 0 ? 0 : 1);
+        } else if (L.tagRanges == 1 && L.tagZero == 0) {
+            // ranges mode
 
-            // Data on the device. We need an "inflated" outB, which contains gridSize.y "copies" of out
-            // that will be reduced in the final pass.
-            TYPE *outB;
+            void *kernel_params[9];
+            kernel_params[0] = &L.nx;
+            kernel_params[1] = &L.ny;
+            kernel_params[2] = &L.nbatchdims;
+            kernel_params[3] = &L.offsets_d;
+            kernel_params[4] = &L.lookup_d;
+            kernel_params[5] = &L.slices_x_d;
+            kernel_params[6] = &L.ranges_y_d;
+            kernel_params[7] = &L.out_d;
+            kernel_params[8] = &L.arg_d;
+
+            if (L.queue_d == NULL) {
+                KEOPS_PROF_DEVICE("GpuConv1DOnDevice_ranges", stream);
+                CUDA_SAFE_CALL(cuLaunchKernel(CheckFunction(kernel_1D_ranges, "GpuConv1DOnDevice_ranges"),
+                                              L.gridSize_x, 1, 1,                 // grid dim
+                                              L.blockSize_x, 1, 1,                // block dim
+                                              L.sharedMem, stream,                // shared mem and stream
+                                              kernel_params, 0));                 // arguments
+            } else {
+                KEOPS_PROF_DEVICE("GpuConv1DOnDevice_ranges_persistent", stream);
+                void *persistent_params[11];
+                std::copy(kernel_params, kernel_params + 9, persistent_params);
+                persistent_params[9] = &L.nblocks;
+                persistent_params[10] = &L.queue_d;
+                CUDA_SAFE_CALL(cuMemsetD32Async((CUdeviceptr) L.queue_d, 0, 1, stream));
+                CUDA_SAFE_CALL(cuLaunchKernel(kernel_1D_ranges_persistent,
+                                              L.gridSize_x, 1, 1,                 // grid dim
+                                              L.blockSize_x, 1, 1,                // block dim
+                                              L.sharedMem, stream,                // shared mem and stream
+                                              persistent_params, 0));             // arguments
+            }
 
-            // single cudaMalloc
-            CUdeviceptr p_data_outB;
-            CUDA_SAFE_CALL(cuMemAlloc(&p_data_outB, sizeof(TYPE) * (nx * dimred * gridSize_y)));
+        } else if (L.jchunk > 0 && L.tagZero == 0) {
+            // simple mode, split-j variant : the lines of blocks compute partial reductions over
+            // jchunk indices, which are combined by reduce2D as in the 2D scheme.
+
+            void *kernel_params[5];
+            kernel_params[0] = &L.nx;
+            kernel_params[1] = &L.ny;
+            kernel_params[2] = &L.jchunk;
+            kernel_params[3] = &L.outB;
+            kernel_params[4] = &L.arg_d;
+
+            {
+                KEOPS_PROF_DEVICE("GpuConv1DOnDevice_splitj", stream);
+                CUDA_SAFE_CALL(cuLaunchKernel(kernel_1D_splitj,
+                                              L.gridSize_x, L.gridSize_y, 1,      // grid dim
+                                              L.blockSize_x, 1, 1,                // block dim
+                                              L.sharedMem, stream,                // shared mem and stream
+                                              kernel_params, 0));                 // arguments
+            }
 
-            outB = (TYPE *) ((TYPE **) p_data);
+            void *kernel_reduce_params[4];
+            kernel_reduce_params[0] = &L.outB;
+            kernel_reduce_params[1] = &L.out_d;
+            kernel_reduce_params[2] = &L.gridSize_y;
+            kernel_reduce_params[3] = &L.nx;
+
+            {
+                KEOPS_PROF_DEVICE("reduce2D", stream);
+                CUDA_SAFE_CALL(cuLaunchKernel(kernel_reduce2D,
+                                              L.gridSize2_x, 1, 1,                // grid dim
+                                              L.blockSize_x, 1, 1,                // block dim
+                                              0, stream,                          // shared mem and stream
+                                              kernel_reduce_params, 0));
+            }
 
-            CUDA_SAFE_CALL(cuModuleGetFunction(&kernel, module, "GpuConv2DOnDevice"));
+        } else {
+            // simple mode
 
             void *kernel_params[4];
-            kernel_params[0] = &nx;
-            kernel_params[1] = &ny;
-            kernel_params[2] = &outB;
-            kernel_params[3] = &arg_d;
+            kernel_params[0] = &L.nx;
+            kernel_params[1] = &L.ny;
+            kernel_params[2] = &L.out_d;
+            kernel_params[3] = &L.arg_d;
+
+            // each block computes blockSize_x * rows_per_thread / threads_per_row rows
+            int rows_per_block = L.blockSize_x * rows_per_thread / threads_per_row;
+            int gridSize_x = L.nx / rows_per_block + (L.nx % rows_per_block == 0 ? 0 : 1);
+
+            {
+                KEOPS_PROF_DEVICE("GpuConv1DOnDevice", stream);
+                CUDA_SAFE_CALL(cuLaunchKernel(CheckFunction(kernel_1D, "GpuConv1DOnDevice"),
+                                              gridSize_x, 1, 1,                   // grid dim
+                                              L.blockSize_x, 1, 1,                // block dim
+                                              L.sharedMem, stream,                // shared mem and stream
+                                              kernel_params, 0));                 // arguments
+            }
+        }
+    }
 
-            // Size of the SharedData : blockSize.x*(DIMY)*sizeof(TYPE)
 
-            CUDA_SAFE_CALL(cuLaunchKernel(kernel,
-                                          gridSize_x, gridSize_y, gridSize_z,      // grid dim
-                                          blockSize_x, blockSize_y, blockSize_z,   // block dim
-                                          blockSize_x * dimY * sizeof(TYPE), NULL, // shared mem and stream
-                                          kernel_params, 0));
-            // block until the device has completed
-            CUDA_SAFE_CALL(cuCtxSynchronize());
+    // CUDA graph mode, for computations on device data. The first call with a given key
+    // (sizes, shapes, output and ranges pointers) prepares the scratch data in memory owned by
+    // a new graph, and captures the kernel launches in this graph ; following calls with the same
+    // key just replay it, skipping all the host side preprocessing. Pointers to the arguments are
+    // not part of the key : if they change, the array of pointers used by the graph is updated before
+    // the replay. The contents of the ranges arrays are not part of the key either : block-sparse
+    // calls are only captured when the lookup table is built on the device (see has_ranges_lookup),
+    // by kernels which are part of the graph, so that each replay reads the current ranges.
+    void launch_graph(CUstream stream, int dimY, int nx, int ny,
+                      int tagI, int tagZero, int use_half,
+                      int tag1D2D, int dimred,
+                      int cuda_block_size, int use_chunk_mode,
+                      const std::vector< int > &indsi, const std::vector< int > &indsj, const std::vector< int > &indsp,
+                      int dimout,
+                      const std::vector< int > &dimsx, const std::vector< int > &dimsy, const std::vector< int > &dimsp,
+                      int **ranges,
+                      const std::vector< int > &shapeout, TYPE *out,
+                      TYPE **arg,
+                      const std::vector <std::vector< int >> &argshape) {
+
+        // indices and dimensions of the variables depend only on the formula, hence are not in the key.
+        std::vector< size_t > key;
+        // N.B. graphs are shared by all the calls : the host side of the call is serialized here,
+        // and replays of the same graph are ordered on the device through G->ws.
+        int params[11] = {nx, ny, tagI, tagZero, use_half, tag1D2D, dimred, cuda_block_size, use_chunk_mode, dimY,
+                          dimout};
+        key.insert(key.end(), params, params + 11);
+        for (int k = 0; k < nargs; k++) {
+            key.push_back(argshape[k].size());
+            key.insert(key.end(), argshape[k].begin(), argshape[k].end());
+        }
+        key.push_back(shapeout.size());
+        key.insert(key.end(), shapeout.begin(), shapeout.end());
+        key.push_back((size_t) out);
+        key.push_back((size_t) ranges[6][0]);
+        if (ranges[6][0] != -1)
+            for (int k = 0; k < 6; k++) {
+                key.push_back((size_t) ranges[6][k]);
+                key.push_back((size_t) ranges[k]);
+            }
 
-            // Since we've used a 2D scheme, there's still a "blockwise" line reduction to make on
-            // the output array px_d[0] = x1B. We go from shape ( gridSize.y * nx, DIMRED ) to (nx, DIMOUT)
-            CUfunction kernel_reduce;
-            CUDA_SAFE_CALL(cuModuleGetFunction(&kernel_reduce, module, "reduce2D"));
-            void *kernel_reduce_params[4];
-            kernel_reduce_params[0] = &outB;
-            kernel_reduce_params[1] = &out_d;
-            kernel_reduce_params[2] = &gridSize_y;
-            kernel_reduce_params[3] = &nx;
+        std::lock_guard< std::mutex > lock(graphs_mutex);
+        KEOPS_PROF_HOST("graph");
 
-            CUDA_SAFE_CALL(cuLaunchKernel(kernel_reduce,
-                                          gridSize2_x, gridSize2_y, gridSize2_z,    // grid dim
-                                          blockSize2_x, blockSize2_y, blockSize2_z,   // block dim
-                                          0, NULL,             // shared mem and stream
-                                          kernel_reduce_params, 0));
+        KeOps_graph< TYPE > *G;
+        typename std::map< std::vector< size_t >, KeOps_graph< TYPE > * >::iterator it = graphs.find(key);
 
+        if (it != graphs.end()) {
+            G = it->second;
+            G->ws.wait(stream);
+            if (!std::equal(G->args.begin(), G->args.end(), arg)) {
+                G->args.assign(arg, arg + nargs);
+                CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) G->L.arg_d, arg, nargs * sizeof(TYPE *), stream));
+                KEOPS_PROF_BYTES_HTOD(nargs * sizeof(TYPE *));
+            }
+        } else {
+            if (graphs.size() >= KEOPS_MAX_CUDA_GRAPHS) {
+                typename std::map< std::vector< size_t >, KeOps_graph< TYPE > * >::iterator lru = graphs.begin();
+                for (it = graphs.begin(); it != graphs.end(); ++it)
+                    if (it->second->last_hit < lru->second->last_hit)
+                        lru = it;
+                release_graph(lru->second);
+                graphs.erase(lru);
+            }
 
-        } else if (RR.tagRanges == 1 && tagZero == 0) {
-            // ranges mode
+            G = new KeOps_graph< TYPE >();
+            G->ws.init(nargs * sizeof(TYPE *));
+            G->ws.begin(stream);
+            G->args.assign(arg, arg + nargs);
+
+            // all the copies to the scratch memory of the graph are done here, outside the capture.
+            prepare_launch(G->L, G->ws, NULL, stream, 1, dimY, nx, ny, tagI, tagZero, use_half, tag1D2D, dimred,
+                           cuda_block_size, use_chunk_mode, indsi, indsj, indsp, dimout, dimsx, dimsy, dimsp,
+                           ranges, shapeout, out, arg, argshape);
+
+            CUgraph graph;
+            CUDA_SAFE_CALL(cuStreamBeginCapture(stream, CU_STREAM_CAPTURE_MODE_THREAD_LOCAL));
+            enqueue_kernels(G->L, stream);
+            CUDA_SAFE_CALL(cuStreamEndCapture(stream, &graph));
+#if CUDA_VERSION >= 11040
+            CUDA_SAFE_CALL(cuGraphInstantiateWithFlags(&G->exec, graph, 0));
+#else
+            CUDA_SAFE_CALL(cuGraphInstantiate(&G->exec, graph, NULL, NULL, 0));
+#endif
+            CUDA_SAFE_CALL(cuGraphDestroy(graph));
+
+            graphs[key] = G;
+        }
 
-            gridSize_x = nblocks;
+        G->last_hit = graph_clock++;
+        {
+            KEOPS_PROF_DEVICE("graph", stream);
+            CUDA_SAFE_CALL(cuGraphLaunch(G->exec, stream));
+        }
+        G->ws.end(stream);
+    }
 
-            CUDA_SAFE_CALL(cuModuleGetFunction(&kernel, module, "GpuConv1DOnDevice_ranges"));
-            // std::cout << "GpuConv1DOnDevice_ranges " << nx << " " << gridSize_x ;
-            void *kernel_params[9];
-            kernel_params[0] = &nx;
-            kernel_params[1] = &ny;
-            kernel_params[2] = &SS.nbatchdims;
-            kernel_params[3] = &offsets_d;
-            kernel_params[4] = &lookup_d;
-            kernel_params[5] = &slices_x_d;
-            kernel_params[6] = &ranges_y_d;
-            kernel_params[7] = &out_d;
-            kernel_params[8] = &arg_d;
-
-            CUDA_SAFE_CALL(cuLaunchKernel(kernel,
-                                          gridSize_x, gridSize_y, gridSize_z,       // grid dim
-                                          blockSize_x, blockSize_y, blockSize_z,    // block dim
-                                          blockSize_x * dimY * sizeof(TYPE), NULL,  // shared mem and stream
-                                          kernel_params, 0));                       // arguments
 
-        } else {
-            // simple mode
+    // Out-of-core computation on host data, for data which does not fit in device memory
+    // (simple 1D scheme without batch dimensions, reduction over j). The i range and the j range
+    // are cut in tiles which fit in memory. For each tile of i variables, the tiles of j variables
+    // are processed in turn by GpuConv1DOnDevice_tile, which carries the accumulators of the
+    // reduction from one j tile to the next, so that partial results are merged with the own
+    // semantics of the reduction. The transfers of j tiles are double buffered through pinned
+    // memory and the two pipeline streams, to overlap with the computations on the previous tile.
+    // Returns false (without doing anything) if the data fits in memory or if the call is not supported.
+    bool launch_out_of_core_from_host(KeOps_slot &S, CUstream stream, int dimY, int nx, int ny,
+                                      int tagI, int tagZero, int use_half,
+                                      int tag1D2D, int dimred,
+                                      int cuda_block_size, int use_chunk_mode,
+                                      const std::vector< int > &indsi, const std::vector< int > &indsj,
+                                      const std::vector< int > &indsp,
+                                      int dimout,
+                                      const std::vector< int > &dimsx, const std::vector< int > &dimsy,
+                                      const std::vector< int > &dimsp,
+                                      int **ranges,
+                                      const std::vector< int > &shapeout, TYPE *out,
+                                      TYPE **arg,
+                                      const std::vector <std::vector< int >> &argshape) {
+
+        // without batch dimensions, the output has shape (nx, dimout)
+        if (kernel_1D_tile == NULL || tagI == 1 || use_half || tag1D2D == 1 || ranges[6][0] != -1 ||
+            shapeout.size() != 2)
+            return false;
+
+        // the size of the data is computed from the shapes only, since most calls fit in memory :
+        // the free memory is only queried when the data exceeds the bound of the last query.
+        size_t totsize = (size_t) nx * dimout;
+        for (int k = 0; k < nargs; k++)
+            totsize += std::accumulate(argshape[k].begin(), argshape[k].end(), (size_t) 1, std::multiplies< size_t >());
+        if (sizeof(TYPE) * totsize <= in_core_bound)
+            return false;
+
+        size_t free_mem, total_mem;
+        CUDA_SAFE_CALL(cuMemGetInfo(&free_mem, &total_mem));
+        size_t budget = (size_t) (KEOPS_OUT_OF_CORE_FRACTION * free_mem);
+        in_core_bound = budget;
+        if (sizeof(TYPE) * totsize <= budget)
+            return false;
+
+        // category (0 for i, 1 for j, 2 for parameters) and dimension of each argument
+        std::vector< int > cat(nargs, 2), dim(nargs, 0);
+        int dimx = 0, dimy = 0;
+        for (size_t k = 0; k < indsi.size(); k++) {
+            if (argshape[indsi[k]][0] != nx)
+                return false;
+            cat[indsi[k]] = 0;
+            dim[indsi[k]] = dimsx[k];
+            dimx += dimsx[k];
+        }
+        for (size_t k = 0; k < indsj.size(); k++) {
+            if (argshape[indsj[k]][0] != ny)
+                return false;
+            cat[indsj[k]] = 1;
+            dim[indsj[k]] = dimsy[k];
+            dimy += dimsy[k];
+        }
+        std::vector< size_t > sizes(nargs);
+        size_t sizep = 0;
+        for (int k = 0; k < nargs; k++) {
+            sizes[k] = std::accumulate(argshape[k].begin(), argshape[k].end(), (size_t) 1, std::multiplies< size_t >());
+            if (cat[k] == 2)
+                sizep += sizes[k];
+        }
 
-            gridSize_x = nx / blockSize_x + (nx % blockSize_x == 0 ? 0 : 1);
+        // Memory used by a tile of rows : i variables, output and accumulators for the i tile,
+        // and two buffers of j variables. Accumulators are stored with the size of double,
+        // which is the largest possible type for them, followed by the compensations of the
+        // Kahan scheme, whose dimension is at most dimred (see GpuReduc1D.get_kernel_code).
+        KeOps_plan plan = get_plan(nx, ny, 0, 0, dimY, dimred, cuda_block_size, use_chunk_mode);
+        size_t row_size = sizeof(TYPE) * (dimx + dimout + 2 * dimy) + 2 * sizeof(double) * dimred;
+        size_t fixed_size = sizeof(TYPE) * sizep + 2 * nargs * sizeof(TYPE *) + 8 * KEOPS_WORKSPACE_ALIGN;
+        if (budget <= fixed_size)
+            throw std::runtime_error("[KeOps] Not enough device memory for out-of-core computation.");
+        int tile = (int) std::min((size_t) std::max(nx, ny), (budget - fixed_size) / row_size);
+        tile = (tile / plan.blockSize_x) * plan.blockSize_x;
+        if (tile == 0)
+            throw std::runtime_error("[KeOps] Not enough device memory for out-of-core computation.");
+        int tile_i = std::min(tile, nx), tile_j = std::min(tile, ny);
+
+        KEOPS_PROF_HOST("out_of_core");
+        init_pipeline(S);
+
+        // device buffers, allocated for this call only since they may be very large
+        std::vector< size_t > offsets;
+        size_t total = 0;
+        std::vector< size_t > buf_sizes;
+        buf_sizes.push_back(sizeof(TYPE) * tile_i * dimx);         // i variables
+        buf_sizes.push_back(sizeof(TYPE) * tile_i * dimout);       // output
+        buf_sizes.push_back(2 * sizeof(double) * tile_i * dimred); // accumulators and compensations
+        buf_sizes.push_back(sizeof(TYPE) * tile_j * dimy);         // j variables, buffer 0
+        buf_sizes.push_back(sizeof(TYPE) * tile_j * dimy);         // j variables, buffer 1
+        buf_sizes.push_back(sizeof(TYPE) * std::max(sizep, (size_t) 1));    // parameters
+        buf_sizes.push_back(2 * nargs * sizeof(TYPE *));           // arrays of pointers
+        for (size_t b = 0; b < buf_sizes.size(); b++) {
+            offsets.push_back(total);
+            total += ((buf_sizes[b] + KEOPS_WORKSPACE_ALIGN - 1) / KEOPS_WORKSPACE_ALIGN) * KEOPS_WORKSPACE_ALIGN;
+        }
+        CUdeviceptr buf;
+        CUDA_SAFE_CALL(cuMemAlloc(&buf, total));
+        KEOPS_PROF_DEVICE_ALLOC(total);
+        TYPE *xi_d = (TYPE *) (buf + offsets[0]);
+        TYPE *out_d = (TYPE *) (buf + offsets[1]);
+        void *acc_d = (void *) (buf + offsets[2]);
+        TYPE *yj_d[2] = {(TYPE *) (buf + offsets[3]), (TYPE *) (buf + offsets[4])};
+        TYPE *p_d = (TYPE *) (buf + offsets[5]);
+        TYPE **arg_d = (TYPE **) (buf + offsets[6]);
+
+        // the two arrays of pointers to the arguments (one for each j buffer), and the parameters
+        std::vector< TYPE * > ph(2 * nargs);
+        TYPE *xloc = xi_d, *yloc = NULL, *ploc = p_d;
+        size_t yoffset = 0;
+        for (int k = 0; k < nargs; k++) {
+            for (int b = 0; b < 2; b++) {
+                if (cat[k] == 0)
+                    ph[b * nargs + k] = xloc;
+                else if (cat[k] == 1)
+                    ph[b * nargs + k] = yj_d[b] + yoffset;
+                else
+                    ph[b * nargs + k] = ploc;
+            }
+            if (cat[k] == 0)
+                xloc += (size_t) tile_i * dim[k];
+            else if (cat[k] == 1)
+                yoffset += (size_t) tile_j * dim[k];
+            else {
+                CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) ploc, arg[k], sizeof(TYPE) * sizes[k], stream));
+                KEOPS_PROF_BYTES_HTOD(sizeof(TYPE) * sizes[k]);
+                ploc += sizes[k];
+            }
+        }
+        CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) arg_d, &ph[0], 2 * nargs * sizeof(TYPE *), stream));
+        KEOPS_PROF_BYTES_HTOD(2 * nargs * sizeof(TYPE *));
+        // N.B. S.pipeline_ready is recorded each time the accumulators are up to date.
+        CUDA_SAFE_CALL(cuEventRecord(S.pipeline_ready, stream));
+
+        TYPE *stage = S.staging.get< TYPE >(2 * (size_t) tile_j * dimy);
+        bool stage_used[2] = {false, false};
+        int count = 0;
+
+        for (int istart = 0; istart < nx; istart += tile_i) {
+            int rows_i = std::min(tile_i, nx - istart);
+
+            // copy the i tile, once the previous kernels are done with the buffer
+            CUstream s0 = S.pipeline_streams[0];
+            CUDA_SAFE_CALL(cuStreamWaitEvent(s0, S.pipeline_ready, 0));
+            for (int k = 0; k < nargs; k++)
+                if (cat[k] == 0) {
+                    CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) ph[k], arg[k] + (size_t) istart * dim[k],
+                                                     sizeof(TYPE) * rows_i * dim[k], s0));
+                    KEOPS_PROF_BYTES_HTOD(sizeof(TYPE) * rows_i * dim[k]);
+                }
+            CUDA_SAFE_CALL(cuEventRecord(S.pipeline_ready, s0));
+
+            for (int jstart = 0; jstart < ny; jstart += tile_j, count++) {
+                int rows_j = std::min(tile_j, ny - jstart);
+                int b = count % 2;
+                CUstream s = S.pipeline_streams[b];
+
+                // the staging area b is free once its previous copy is done
+                if (stage_used[b])
+                    CUDA_SAFE_CALL(cuEventSynchronize(S.pipeline_done[b]));
+                TYPE *pin = stage + b * (size_t) tile_j * dimy;
+                for (int k = 0; k < nargs; k++) {
+                    if (cat[k] != 1)
+                        continue;
+                    size_t n = (size_t) rows_j * dim[k];
+                    memcpy(pin, arg[k] + (size_t) jstart * dim[k], sizeof(TYPE) * n);
+                    CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) ph[b * nargs + k], pin, sizeof(TYPE) * n, s));
+                    KEOPS_PROF_BYTES_HTOD(sizeof(TYPE) * n);
+                    pin += n;
+                }
+                CUDA_SAFE_CALL(cuEventRecord(S.pipeline_done[b], s));
+                stage_used[b] = true;
+
+                // the kernels are serialized through the accumulators
+                CUDA_SAFE_CALL(cuStreamWaitEvent(s, S.pipeline_ready, 0));
+
+                KeOps_plan tile_plan = get_plan(rows_i, rows_j, 0, 0, dimY, dimred, cuda_block_size,
+                                                       use_chunk_mode);
+                int first = (jstart == 0), last = (jstart + rows_j == ny);
+                TYPE **arg_tile_d = arg_d + b * nargs;
+                void *kernel_params[8];
+                kernel_params[0] = &rows_i;
+                kernel_params[1] = &rows_j;
+                kernel_params[2] = &jstart;
+                kernel_params[3] = &first;
+                kernel_params[4] = &last;
+                kernel_params[5] = &acc_d;
+                kernel_params[6] = &out_d;
+                kernel_params[7] = &arg_tile_d;
+                {
+                    KEOPS_PROF_DEVICE("GpuConv1DOnDevice_tile", s);
+                    CUDA_SAFE_CALL(cuLaunchKernel(kernel_1D_tile,
+                                                  tile_plan.gridSize_x, 1, 1,       // grid dim
+                                                  tile_plan.blockSize_x, 1, 1,      // block dim
+                                                  tile_plan.sharedMem, s,           // shared mem and stream
+                                                  kernel_params, 0));               // arguments
+                }
+                CUDA_SAFE_CALL(cuEventRecord(S.pipeline_ready, s));
+            }
 
-            CUDA_SAFE_CALL(cuModuleGetFunction(&kernel, module, "GpuConv1DOnDevice"));
+            // send the output of the i tile to the host
+            CUDA_SAFE_CALL(cuEventSynchronize(S.pipeline_ready));
+            CUDA_SAFE_CALL(cuMemcpyDtoH(out + (size_t) istart * dimout, (CUdeviceptr) out_d,
+                                        sizeof(TYPE) * rows_i * dimout));
+            KEOPS_PROF_BYTES_DTOH(sizeof(TYPE) * rows_i * dimout);
+        }
 
-            void *kernel_params[4];
-            kernel_params[0] = &nx;
-            kernel_params[1] = &ny;
-            kernel_params[2] = &out_d;
-            kernel_params[3] = &arg_d;
+        // everything is done at this point, since the last output has been copied to the host
+        CUDA_SAFE_CALL(cuMemFree(buf));
+
+        return true;
+    }
+
+
+    // Pipelined computation on host data, for the simple 1D scheme without batch dimensions.
+    // i variables and outputs are cut in tiles of rows : tile t is copied to the device through
+    // a pinned staging buffer, processed and copied back on pipeline stream t%2, so that the
+    // transfers of a tile overlap with the computations on the previous one. j variables
+    // and parameters are needed by every tile, so they are copied once at the beginning.
+    // Returns false (without doing anything) if the call is not suited for pipelining.
+    bool launch_pipelined_from_host(KeOps_slot &S, CUstream stream, int dimY, int nx, int ny,
+                                    int tagI, int tagZero, int use_half,
+                                    int tag1D2D, int dimred,
+                                    int cuda_block_size, int use_chunk_mode,
+                                    const std::vector< int > &indsi, const std::vector< int > &indsj, const std::vector< int > &indsp,
+                                    int dimout,
+                                    const std::vector< int > &dimsx, const std::vector< int > &dimsy, const std::vector< int > &dimsp,
+                                    int **ranges,
+                                    const std::vector< int > &shapeout, TYPE *out,
+                                    TYPE **arg,
+                                    const std::vector <std::vector< int >> &argshape) {
+
+        if (tagI == 1 || use_half || tag1D2D == 1 || ranges[6][0] != -1)
+            return false;
+
+        Sizes <TYPE> SS(nargs, arg, argshape, nx, ny,
+                        tagI, use_half,
+                        dimout,
+                        indsi, indsj, indsp,
+                        dimsx, dimsy, dimsp);
 
-            //std::cout << "GpuConv1DOnDevice " << nx << " " << gridSize_x ;//<< " " << gridSize_y << " " << gridSize_z << " " <<  blockSize_x << " " << blockSize_y << " " <<  blockSize_z << " " <<   blockSize_x * dimY * sizeof(TYPE)  << std::endl;
+        if (SS.nbatchdims > 0)
+            return false;
+        nx = SS.nx;
+        ny = SS.ny;
+
+        // i variables must have one row per output line (no broadcasting)
+        std::vector< int > dim_i(nargs, 0);
+        for (size_t k = 0; k < indsi.size(); k++) {
+            if (argshape[indsi[k]][0] != nx)
+                return false;
+            dim_i[indsi[k]] = dimsx[k];
+        }
 
-            CUDA_SAFE_CALL(cuLaunchKernel(kernel,
-                                          gridSize_x, gridSize_y, gridSize_z,        // grid dim
-                                          blockSize_x, blockSize_y, blockSize_z,     // block dim
-                                          blockSize_x * dimY * sizeof(TYPE), NULL,   // shared mem and stream
-                                          kernel_params, 0));                        // arguments
+        KeOps_plan plan = get_plan(nx, ny, 0, 0, dimY, dimred, cuda_block_size, use_chunk_mode);
+        int tile = std::max(KEOPS_PIPELINE_MIN_ROWS, (nx + KEOPS_PIPELINE_NTILES - 1) / KEOPS_PIPELINE_NTILES);
+        tile = ((tile + plan.blockSize_x - 1) / plan.blockSize_x) * plan.blockSize_x;
+        if (tile >= nx)
+            return false;
+        int ntiles = (nx + tile - 1) / tile;
+
+        KEOPS_PROF_HOST("pipeline");
+        init_pipeline(S);
+
+        S.ws.begin(stream);
+
+        // device memory : output, full arguments (as in load_args_FromHost), and one array of
+        // pointers to the arguments per tile, shifted for the i variables.
+        size_t sizeout = (size_t) nx * dimout;
+        std::vector< size_t > sizes(nargs);
+        size_t totsize = sizeout;
+        int dimtot_i = 0;
+        for (int k = 0; k < nargs; k++) {
+            sizes[k] = std::accumulate(argshape[k].begin(), argshape[k].end(), (size_t) 1, std::multiplies< size_t >());
+            totsize += sizes[k];
+            dimtot_i += dim_i[k];
         }
+        TYPE *out_d = S.ws.get< TYPE >(totsize);
+        TYPE **arg_d = S.ws.get< TYPE * >(ntiles * nargs);
+        std::vector< TYPE * > ph(ntiles * nargs);
+        TYPE *dataloc = out_d + sizeout;
+        for (int k = 0; k < nargs; k++) {
+            for (int t = 0; t < ntiles; t++)
+                ph[t * nargs + k] = dataloc + (size_t) t * tile * dim_i[k];
+            if (dim_i[k] == 0) {
+                CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) dataloc, arg[k], sizeof(TYPE) * sizes[k], stream));
+                KEOPS_PROF_BYTES_HTOD(sizeof(TYPE) * sizes[k]);
+            }
+            dataloc += sizes[k];
+        }
+        CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) arg_d, &ph[0], ntiles * nargs * sizeof(TYPE *), stream));
+        KEOPS_PROF_BYTES_HTOD(ntiles * nargs * sizeof(TYPE *));
+        CUDA_SAFE_CALL(cuEventRecord(S.pipeline_ready, stream));
+
+        // two staging areas, each holding the i variables and the output of a tile
+        size_t stage_size = (size_t) tile * (dimtot_i + dimout);
+        TYPE *stage = S.staging.get< TYPE >(2 * stage_size);
+
+        int rows_done[2] = {0, 0}, start_done[2] = {0, 0};
+
+        for (int t = 0; t < ntiles; t++) {
+            int b = t % 2;
+            CUstream s = S.pipeline_streams[b];
+            TYPE *stage_in = stage + b * stage_size;
+            TYPE *stage_out = stage_in + (size_t) tile * dimtot_i;
+
+            if (t < 2) {
+                CUDA_SAFE_CALL(cuStreamWaitEvent(s, S.pipeline_ready, 0));
+            } else {
+                // the staging area b is free once tile t-2 is done ; we get its output first.
+                CUDA_SAFE_CALL(cuEventSynchronize(S.pipeline_done[b]));
+                memcpy(out + (size_t) start_done[b] * dimout, stage_out, sizeof(TYPE) * rows_done[b] * dimout);
+            }
 
-        CUDA_SAFE_CALL(cuCtxSynchronize());
+            int start = t * tile;
+            int rows = std::min(tile, nx - start);
+
+            TYPE *pin = stage_in;
+            for (int k = 0; k < nargs; k++) {
+                if (dim_i[k] == 0)
+                    continue;
+                size_t n = (size_t) rows * dim_i[k];
+                memcpy(pin, arg[k] + (size_t) start * dim_i[k], sizeof(TYPE) * n);
+                CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) ph[t * nargs + k], pin, sizeof(TYPE) * n, s));
+                KEOPS_PROF_BYTES_HTOD(sizeof(TYPE) * n);
+                pin += n;
+            }
 
-        ////end_ = clock();
-        ////std::cout << "  time for kernel : " << double(//end_ - start_) / CLOCKS_PER_SEC << std::endl;
-        //start_ = clock();
+            KeOps_launch< TYPE > L;
+            KeOps_plan tile_plan = get_plan(rows, ny, 0, 0, dimY, dimred, cuda_block_size, use_chunk_mode);
+            L.nx = rows;
+            L.ny = ny;
+            L.dimY = dimY;
+            L.dimred = dimred;
+            L.tag1D2D = 0;
+            L.tagRanges = 0;
+            L.tagZero = tagZero;
+            L.blockSize_x = tile_plan.blockSize_x;
+            L.gridSize_x = tile_plan.gridSize_x;
+            L.gridSize_y = 1;
+            L.jchunk = 0;
+            L.sharedMem = tile_plan.sharedMem;
+            L.out_d = out_d + (size_t) start * dimout;
+            L.arg_d = arg_d + t * nargs;
+            enqueue_kernels(L, s);
+
+            CUDA_SAFE_CALL(cuMemcpyDtoHAsync(stage_out, (CUdeviceptr) L.out_d, sizeof(TYPE) * rows * dimout, s));
+            KEOPS_PROF_BYTES_DTOH(sizeof(TYPE) * rows * dimout);
+            CUDA_SAFE_CALL(cuEventRecord(S.pipeline_done[b], s));
+            start_done[b] = start;
+            rows_done[b] = rows;
+        }
 
-        // Send data from device to host.
+        // outputs of the last two tiles
+        for (int t = std::max(0, ntiles - 2); t < ntiles; t++) {
+            int b = t % 2;
+            TYPE *stage_out = stage + b * stage_size + (size_t) tile * dimtot_i;
+            CUDA_SAFE_CALL(cuEventSynchronize(S.pipeline_done[b]));
+            memcpy(out + (size_t) start_done[b] * dimout, stage_out, sizeof(TYPE) * rows_done[b] * dimout);
+        }
 
+        CUDA_SAFE_CALL(cuStreamWaitEvent(stream, S.pipeline_done[0], 0));
+        CUDA_SAFE_CALL(cuStreamWaitEvent(stream, S.pipeline_done[1], 0));
+        S.ws.end(stream);
+
+        return true;
+    }
+
+
+    int launch_kernel(int tagHostDevice, int dimY, int nx, int ny,
+                      int tagI, int tagZero, int use_half,
+                      int tag1D2D, int dimred,
+                      int cuda_block_size, int use_chunk_mode,
+                      const std::vector< int > &indsi, const std::vector< int > &indsj, const std::vector< int > &indsp,
+                      int dimout,
+                      const std::vector< int > &dimsx, const std::vector< int > &dimsy, const std::vector< int > &dimsp,
+                      int **ranges,
+                      const std::vector< int > &shapeout, TYPE *out,
+                      TYPE **arg,
+                      const std::vector <std::vector< int >> &argshape,
+                      CUstream stream = NULL
+    ) {
+
+        // If stream is NULL, we keep the historical synchronous behaviour: the call runs on the
+        // stream of its slot, which is ordered with the work on the NULL stream, and we wait for
+        // it before returning. Otherwise all copies and kernels are enqueued on the given stream,
+        // and we return without synchronizing when data lives on the device, so that KeOps
+        // reductions can be pipelined with other work on this stream.
+        // This function may be called from several threads at once : each call has its own slot.
+
+        KeOps_context_guard guard(ctx);
+        slot_guard slot(*this);
+        KeOps_slot &S = *slot.S;
+        KEOPS_PROF_CALL(profiler);
+
+        bool sync = (stream == NULL);
+        if (stream == NULL)
+            stream = S.stream;
+
+        if (use_cuda_graphs && tagHostDevice == 1 && (ranges[6][0] == -1 || has_ranges_lookup())) {
+            // if the caller is itself capturing its stream, we just let our launches be part of its graph.
+            CUstreamCaptureStatus capture_status;
+            CUDA_SAFE_CALL(cuStreamIsCapturing(stream, &capture_status));
+            if (capture_status == CU_STREAM_CAPTURE_STATUS_NONE) {
+                launch_graph(stream, dimY, nx, ny, tagI, tagZero, use_half, tag1D2D, dimred,
+                             cuda_block_size, use_chunk_mode, indsi, indsj, indsp, dimout, dimsx, dimsy, dimsp,
+                             ranges, shapeout, out, arg, argshape);
+                if (sync)
+                    CUDA_SAFE_CALL(cuStreamSynchronize(stream));
+                return 0;
+            }
+        }
+
+        // the pipelined and out-of-core paths copy all the arguments at each call
+        bool resident = (n_resident > 0);
+
+        if (tagHostDevice == 0 && !resident &&
+            launch_out_of_core_from_host(S, stream, dimY, nx, ny, tagI, tagZero, use_half, tag1D2D, dimred,
+                                         cuda_block_size, use_chunk_mode, indsi, indsj, indsp, dimout,
+                                         dimsx, dimsy, dimsp, ranges, shapeout, out, arg, argshape))
+            return 0;
+
+        // the bound of launch_out_of_core_from_host is only restored when the call succeeds
+        size_t bound = (tagHostDevice == 0 && !resident) ? in_core_bound.exchange(0) : 0;
+
+        if (tagHostDevice == 0 && !resident && use_pipelined &&
+            launch_pipelined_from_host(S, stream, dimY, nx, ny, tagI, tagZero, use_half, tag1D2D, dimred,
+                                       cuda_block_size, use_chunk_mode, indsi, indsj, indsp, dimout,
+                                       dimsx, dimsy, dimsp, ranges, shapeout, out, arg, argshape)) {
+            // the output has been copied to out by the pipeline
+            if (sync)
+                CUDA_SAFE_CALL(cuStreamSynchronize(stream));
+            if (bound > 0)
+                in_core_bound = bound;
+            return 0;
+        }
+
+        // all scratch buffers of this call are taken from the workspace of the slot
+        S.ws.begin(stream);
+
+        KeOps_launch< TYPE > L;
+        prepare_launch(L, S.ws, &S.ranges_cache, stream, tagHostDevice, dimY, nx, ny, tagI, tagZero, use_half, tag1D2D, dimred,
+                       cuda_block_size, use_chunk_mode, indsi, indsj, indsp, dimout, dimsx, dimsy, dimsp,
+                       ranges, shapeout, out, arg, argshape);
+
+        enqueue_kernels(L, stream);
+
+        // Send data from device to host.
 
         if (tagHostDevice == 0) {
-            CUDA_SAFE_CALL(cuMemcpyDtoH(out, (CUdeviceptr) out_d, sizeof(TYPE) * sizeout));
+            KEOPS_PROF_DEVICE("copy_out", stream);
+            CUDA_SAFE_CALL(cuMemcpyDtoHAsync(out, (CUdeviceptr) L.out_d, sizeof(TYPE) * L.sizeout, stream));
+            KEOPS_PROF_BYTES_DTOH(sizeof(TYPE) * L.sizeout);
         }
 
-         CUDA_SAFE_CALL(cuMemFree(p_data));
+        // the workspace may be reused once all the work enqueued so far is done
+        S.ws.end(stream);
 
-        if (RR.tagRanges == 1) {
-            CUDA_SAFE_CALL(cuMemFree((CUdeviceptr) lookup_d));
-            if (SS.nbatchdims > 0) {
-                CUDA_SAFE_CALL(cuMemFree((CUdeviceptr) slices_x_d));
-                CUDA_SAFE_CALL(cuMemFree((CUdeviceptr) ranges_y_d));
-                CUDA_SAFE_CALL(cuMemFree((CUdeviceptr) offsets_d));
+        // Data on host : the output must be available when we return, so we wait for this stream.
+        // Data on device with the NULL stream : we keep the historical synchronous behaviour.
+        if (sync || tagHostDevice == 0)
+            CUDA_SAFE_CALL(cuStreamSynchronize(stream));
+
+        if (bound > 0)
+            in_core_bound = bound;
+
+        return 0;
+    }
+
+};
+
+
+// Multi-device execution of a reduction on host data : the range of the output index
+// (i if tagI=0, j if tagI=1) is split in contiguous slices, one for each device, and each
+// device computes its slice concurrently with the regular code path, from its own thread.
+// All modules load the same compiled binary.
+template< typename TYPE >
+class KeOps_multi_module {
+public :
+
+    std::vector< KeOps_module< TYPE > * > modules;
+
+    KeOps_multi_module(std::vector< int > device_ids, int nargs, const char *target_file_name) {
+        for (size_t d = 0; d < device_ids.size(); d++)
+            modules.push_back(new KeOps_module< TYPE >(device_ids[d], nargs, target_file_name));
+    }
+
+    ~KeOps_multi_module() {
+        for (size_t d = 0; d < modules.size(); d++)
+            delete modules[d];
+    }
+
+    void set_cuda_graphs(int val) {
+        for (size_t d = 0; d < modules.size(); d++)
+            modules[d]->set_cuda_graphs(val);
+    }
+
+    void set_pipelined(int val) {
+        for (size_t d = 0; d < modules.size(); d++)
+            modules[d]->set_pipelined(val);
+    }
+
+    void set_profiling(int val) {
+        for (size_t d = 0; d < modules.size(); d++)
+            modules[d]->set_profiling(val);
+    }
+
+    // each device keeps its own copies of the resident arguments (or of their slices, for i variables)
+    void set_resident_args(const std::vector< int > &inds) {
+        for (size_t d = 0; d < modules.size(); d++)
+            modules[d]->set_resident_args(inds);
+    }
+
+    void release_resident_args() {
+        for (size_t d = 0; d < modules.size(); d++)
+            modules[d]->release_resident_args();
+    }
+
+    // the largest buffer of the devices, for the whole call (the slices of the devices are smaller)
+    size_t get_buffer_size(int nx, int ny, int tag1D2D, int tagRanges, int dimY, int dimred,
+                           int cuda_block_size, int use_chunk_mode) {
+        size_t size = 0;
+        for (size_t d = 0; d < modules.size(); d++)
+            size = std::max(size, modules[d]->get_buffer_size(nx, ny, tag1D2D, tagRanges, dimY, dimred,
+                                                               cuda_block_size, use_chunk_mode));
+        return size;
+    }
+
+    // statistics of all the devices, and events of all the devices in the same trace
+    KeOps_stats get_stats() {
+        KeOps_stats stats;
+        for (size_t d = 0; d < modules.size(); d++)
+            stats.merge(modules[d]->get_stats());
+        return stats;
+    }
+
+    KeOps_plan_stats get_plan_stats() {
+        KeOps_plan_stats stats;
+        for (size_t d = 0; d < modules.size(); d++)
+            stats.merge(modules[d]->get_plan_stats());
+        return stats;
+    }
+
+    std::vector< KeOps_trace_event > get_trace() {
+        std::vector< KeOps_trace_event > trace;
+        for (size_t d = 0; d < modules.size(); d++) {
+            std::vector< KeOps_trace_event > events = modules[d]->get_trace();
+            trace.insert(trace.end(), events.begin(), events.end());
+        }
+        return trace;
+    }
+
+    void reset_stats() {
+        for (size_t d = 0; d < modules.size(); d++)
+            modules[d]->reset_stats();
+    }
+
+    void write_trace(const char *filename) {
+        KeOps_write_trace(filename, get_trace());
+    }
+
+    int launch_kernel(int tagHostDevice, int dimY, int nx, int ny,
+                      int tagI, int tagZero, int use_half,
+                      int tag1D2D, int dimred,
+                      int cuda_block_size, int use_chunk_mode,
+                      const std::vector< int > &indsi, const std::vector< int > &indsj, const std::vector< int > &indsp,
+                      int dimout,
+                      const std::vector< int > &dimsx, const std::vector< int > &dimsy, const std::vector< int > &dimsp,
+                      int **ranges,
+                      const std::vector< int > &shapeout, TYPE *out,
+                      TYPE **arg,
+                      const std::vector <std::vector< int >> &argshape,
+                      CUstream stream = NULL
+    ) {
+
+        // N.B. a stream belongs to the context of a single device, so it cannot be shared by the slices
+        if (tagHostDevice == 1 || use_half || ranges[6][0] != -1 || shapeout.size() != 2 || stream != NULL)
+            throw std::runtime_error("[KeOps] Multi-device computations are only supported for host data, "
+                                     "on the default stream, without ranges, batch dimensions or half precision.");
+
+        int nargs = argshape.size();
+        int nout = (tagI == 0) ? nx : ny;
+        if (nout == 0)
+            return 0;
+        const std::vector< int > &inds_out = (tagI == 0) ? indsi : indsj;
+        const std::vector< int > &dims_out = (tagI == 0) ? dimsx : dimsy;
+
+        int ndevices = std::min((int) modules.size(), nout);
+        int slice = (nout + ndevices - 1) / ndevices;
+
+        // arguments of each device : variables indexed like the output are shifted to the slice
+        std::vector< std::vector< TYPE * > > args(ndevices, std::vector< TYPE * >(arg, arg + nargs));
+        std::vector< std::vector< std::vector< int > > > argshapes(ndevices, argshape);
+        std::vector< std::vector< int > > shapeouts(ndevices, shapeout);
+        std::vector< int > starts(ndevices), sizes(ndevices);
+        for (int d = 0; d < ndevices; d++) {
+            starts[d] = d * slice;
+            sizes[d] = std::max(0, std::min(slice, nout - starts[d]));
+            for (size_t k = 0; k < inds_out.size(); k++) {
+                args[d][inds_out[k]] += (size_t) starts[d] * dims_out[k];
+                argshapes[d][inds_out[k]][0] = sizes[d];
             }
+            shapeouts[d][0] = sizes[d];
         }
 
-        //end_ = end = clock();
-        ////std::cout << "  time for last part : " << double(//end_ - start_) / CLOCKS_PER_SEC << std::endl;
-        ////std::cout << "time for launch_keops inner : " << double(end - start) / CLOCKS_PER_SEC << std::endl;
+        std::vector< std::exception_ptr > errors(ndevices);
+        std::vector< std::thread > threads;
+        for (int d = 0; d < ndevices; d++) {
+            if (sizes[d] == 0)
+                continue;
+            threads.push_back(std::thread([&, d]() {
+                try {
+                    modules[d]->launch_kernel(0, dimY,
+                                              (tagI == 0) ? sizes[d] : nx, (tagI == 0) ? ny : sizes[d],
+                                              tagI, tagZero, use_half, tag1D2D, dimred,
+                                              cuda_block_size, use_chunk_mode,
+                                              indsi, indsj, indsp, dimout, dimsx, dimsy, dimsp,
+                                              ranges, shapeouts[d], out + (size_t) starts[d] * dimout,
+                                              &args[d][0], argshapes[d]);
+                } catch (...) {
+                    errors[d] = std::current_exception();
+                }
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); t++)
+            threads[t].join();
+        for (int d = 0; d < ndevices; d++)
+            if (errors[d])
+                std::rethrow_exception(errors[d]);
 
         return 0;
     }
@@ -597,3 +2137,18 @@ class KeOps_module< double >;
 
 template
 class KeOps_module< half2 >;
+
+template
+class KeOps_module< __nv_bfloat16 >;
+
+template
+class KeOps_multi_module< float >;
+
+template
+class KeOps_multi_module< double >;
+
+template
+class KeOps_multi_module< half2 >;
+
+template
+class KeOps_multi_module< __nv_bfloat16 >;
@@ -1,6 +1,6 @@
 // nvcc -shared -Xcompiler -fPIC -lnvrtc -lcuda keops_nvrtc.cu -o keops_nvrtc.so
-// g++ --verbose -L/opt/cuda/lib64 -L/opt/cuda/targets/x86_64-linux/lib/ -I/opt/cuda/targets/x86_64-linux/include/ -I../../include -shared -fPIC -lcuda -lnvrtc -fpermissive -DMAXIDGPU=0 -DMAXTHREADSPERBLOCK0=1024 -DSHAREDMEMPERBLOCK0=49152 -DnvrtcGetTARGET=nvrtcGetCUBIN -DnvrtcGetTARGETSize=nvrtcGetCUBINSize -DARCHTAG=\"sm\" keops_nvrtc.cpp -o keops_nvrtc.so
-// g++ -std=c++11  -shared -fPIC -O3 -fpermissive -L /usr/lib -L /opt/cuda/lib64 -lcuda -lnvrtc -DnvrtcGetTARGET=nvrtcGetCUBIN -DnvrtcGetTARGETSize=nvrtcGetCUBINSize -DARCHTAG=\"sm\"  -I/home/bcharlier/projets/keops/keops/keops/include -I/opt/cuda/include -I/usr/include/python3.10/ -DMAXIDGPU=0 -DMAXTHREADSPERBLOCK0=1024 -DSHAREDMEMPERBLOCK0=49152  /home/bcharlier/projets/keops/keops/keops/binders/nvrtc/keops_nvrtc.cpp -o keops_nvrtc.cpython-310-x86_64-linux-gnu.so
+// g++ --verbose -L/opt/cuda/lib64 -L/opt/cuda/targets/x86_64-linux/lib/ -I/opt/cuda/targets/x86_64-linux/include/ -I../../include -shared -fPIC -lcuda -lnvrtc -fpermissive -DnvrtcGetTARGET=nvrtcGetCUBIN -DnvrtcGetTARGETSize=nvrtcGetCUBINSize -DARCHTAG=\"sm\" keops_nvrtc.cpp -o keops_nvrtc.so
+// g++ -std=c++11  -shared -fPIC -O3 -fpermissive -L /usr/lib -L /opt/cuda/lib64 -lcuda -lnvrtc -DnvrtcGetTARGET=nvrtcGetCUBIN -DnvrtcGetTARGETSize=nvrtcGetCUBINSize -DARCHTAG=\"sm\"  -I/home/bcharlier/projets/keops/keops/keops/include -I/opt/cuda/include -I/usr/include/python3.10/  /home/bcharlier/projets/keops/keops/keops/binders/nvrtc/keops_nvrtc.cpp -o keops_nvrtc.cpython-310-x86_64-linux-gnu.so
 
 #include <nvrtc.h>
 #include <cuda.h>
@@ -11,6 +11,10 @@
 #include <stdarg.h>
 #include <string.h>
 #include <vector>
+#include <string>
+#include <thread>
+#include <functional>
+#include <unistd.h>
 //#include <ctime>
 
 #define C_CONTIGUOUS 1
@@ -26,30 +30,88 @@
 #include <cuda_fp16.h>
 
 
-extern "C" int Compile(const char *target_file_name, const char *cu_code, int use_half, int device_id,
-                       const char *cuda_include_path) {
+// 64 bits FNV-1a hash, used as content address for the kernel cache
+unsigned long long fnv1a_hash(const std::string &str) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t k = 0; k < str.size(); k++) {
+        hash ^= (unsigned char) str[k];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
 
-    nvrtcProgram prog;
 
-    int numHeaders;
-    const char *header_names[2];
-    const char *header_sources[2];
+// Writes ptx or cubin code to file, with the same layout as the one read by KeOps_module::Read_Target.
+// The code is first written to a temporary file which is then renamed, so that other threads or
+// processes reading the same file (e.g. a kernel cache on a shared file system) never see
+// a partially written file.
+// If key is not empty (entries of the kernel cache), it is written before the code, so that
+// read_target_file can check that the entry was compiled from the same key.
+bool write_target_file(const std::string &file_name, const char *target, size_t targetSize,
+                       const std::string &key = std::string()) {
+    std::ostringstream tmp_name;
+    tmp_name << file_name << ".tmp." << getpid() << "." << std::hash< std::thread::id >()(std::this_thread::get_id());
+    std::ofstream wf(tmp_name.str().c_str(), std::ofstream::binary);
+    if (!wf)
+        return false;
+    if (!key.empty()) {
+        size_t keySize = key.size();
+        wf.write((char *) &keySize, sizeof(size_t));
+        wf.write(key.data(), keySize);
+    }
+    wf.write((char *) &targetSize, sizeof(size_t));
+    wf.write(target, targetSize);
+    wf.close();
+    if (!wf || rename(tmp_name.str().c_str(), file_name.c_str()) != 0) {
+        remove(tmp_name.str().c_str());
+        return false;
+    }
+    return true;
+}
 
-    std::ostringstream cuda_fp16_h_path, cuda_fp16_hpp_path;
-    cuda_fp16_h_path << cuda_include_path << "cuda_fp16.h" ;
-    cuda_fp16_hpp_path << cuda_include_path << "cuda_fp16.hpp" ;
 
-    if (use_half) {
-        numHeaders = 2;
-        header_names[0] = "cuda_fp16.h";
-        header_sources[0] = read_text_file(cuda_fp16_h_path.str().c_str());
+// Reads ptx or cubin code written by write_target_file. Returns NULL if the file does not exist
+// or is not valid, or if it was not written with the same key.
+char *read_target_file(const std::string &file_name, size_t &targetSize,
+                       const std::string &key = std::string()) {
+    std::ifstream rf(file_name.c_str(), std::ifstream::binary | std::ifstream::ate);
+    if (!rf)
+        return NULL;
+    size_t fileSize = rf.tellg();
+    rf.seekg(0);
+    size_t headerSize = sizeof(size_t);
+    if (!key.empty()) {
+        size_t keySize;
+        headerSize += sizeof(size_t) + key.size();
+        if (fileSize < headerSize || !rf.read((char *) &keySize, sizeof(size_t)) || keySize != key.size())
+            return NULL;
+        std::string stored_key(keySize, '\0');
+        if (!rf.read(&stored_key[0], keySize) || stored_key != key)
+            return NULL;
+    }
+    if (fileSize < headerSize || !rf.read((char *) &targetSize, sizeof(size_t))
+        || targetSize != fileSize - headerSize)
+        return NULL;
+    char *target = new char[targetSize];
+    if (!rf.read(target, targetSize)) {
+        delete[] target;
+        return NULL;
+    }
+    return target;
+}
 
-        header_names[1] = "cuda_fp16.hpp";
-        header_sources[1] = read_text_file(cuda_fp16_hpp_path.str().c_str());
 
-    } else {
-        numHeaders = 0;
-    }
+// Compiles the cuda code cu_code for device device_id, and writes the ptx or cubin code to target_file_name.
+// use_half tells which headers of the toolkit, located in cuda_include_path, are included by cu_code :
+// 1 for cuda_fp16.h (half2 codes), 2 for cuda_bf16.h (bfloat16 codes).
+// If cache_dir is not empty, compiled codes are stored in this folder under a hash of the code,
+// compute capability, NVRTC and driver versions and compile options, and looked up there before compiling :
+// the cache may be shared between processes and machines. Each entry also holds the full key, which is
+// checked before the entry is used.
+extern "C" int Compile(const char *target_file_name, const char *cu_code, int use_half, int device_id,
+                       const char *cuda_include_path, const char *cache_dir) {
+
+    nvrtcProgram prog;
 
     // Get device id from Driver API
     CUdevice cuDevice;
@@ -63,9 +125,59 @@ extern "C" int Compile(const char *target_file_name, const char *cu_code, int us
     std::ostringstream arch_flag;
     arch_flag << "-arch=" << ARCHTAG << "_" << deviceProp_major << deviceProp_minor;
 
-    char *arch_flag_char = new char[arch_flag.str().length()];
-    arch_flag_char = strdup(arch_flag.str().c_str());
-    const char *opts[] = {arch_flag_char, "-use_fast_math"};
+    std::string arch_flag_str = arch_flag.str();
+    const char *opts[] = {arch_flag_str.c_str(), "-use_fast_math"};
+    int numOptions = 2;
+
+    // look for the compiled code in the cache
+    std::string cache_file, cache_key;
+    if (cache_dir != NULL && cache_dir[0] != '\0') {
+        int nvrtc_major, nvrtc_minor, driver_version;
+        NVRTC_SAFE_CALL(nvrtcVersion(&nvrtc_major, &nvrtc_minor));
+        CUDA_SAFE_CALL(cuDriverGetVersion(&driver_version));
+        std::ostringstream key;
+        key << ARCHTAG << " nvrtc " << nvrtc_major << "." << nvrtc_minor << " driver " << driver_version
+            << " use_half " << use_half;
+        for (int k = 0; k < numOptions; k++)
+            key << " " << opts[k];
+        key << "\n" << cu_code;
+        std::ostringstream cache_file_name;
+        cache_file_name << cache_dir << "/" << std::hex << fnv1a_hash(key.str()) << "_" << std::dec
+                        << key.str().size() << "." << ARCHTAG;
+        cache_file = cache_file_name.str();
+        cache_key = key.str();
+
+        // the full key is stored in the entry and compared, since different keys may have the same hash
+        size_t targetSize;
+        char *target = read_target_file(cache_file, targetSize, cache_key);
+        if (target != NULL) {
+            bool ok = write_target_file(target_file_name, target, targetSize);
+            delete[] target;
+            if (!ok)
+                throw std::runtime_error("[KeOps] Error when writing compiled formula to file.");
+            return 0;
+        }
+    }
+
+    // the headers of the toolkit are only read when the code is compiled
+    int numHeaders = 0;
+    const char *header_names[4];
+    const char *header_sources[4];
+    std::vector< std::string > headers;
+
+    // cuda_bf16.h may rely on the half precision types of cuda_fp16.h
+    if (use_half & 3)
+        headers.insert(headers.end(), {"cuda_fp16.h", "cuda_fp16.hpp"});
+    if (use_half & 2)
+        headers.insert(headers.end(), {"cuda_bf16.h", "cuda_bf16.hpp"});
+
+    for (const std::string &header : headers) {
+        std::ostringstream header_path;
+        header_path << cuda_include_path << header;
+        header_names[numHeaders] = header.c_str();
+        header_sources[numHeaders] = read_text_file(header_path.str().c_str());
+        numHeaders++;
+    }
 
     NVRTC_SAFE_CALL(nvrtcCreateProgram(&prog,         // prog
                                        cu_code,         // buffer
@@ -76,15 +188,13 @@ extern "C" int Compile(const char *target_file_name, const char *cu_code, int us
                                       ));
 
     nvrtcResult compileResult = nvrtcCompileProgram(prog,     // prog
-                                2,              // numOptions
+                                numOptions,     // numOptions
                                 opts);          // options
 
     if (compileResult != NVRTC_SUCCESS) {
         throw std::runtime_error("[KeOps] Error when compiling formula (error in nvrtcCompileProgram).");
     }
 
-    delete[] arch_flag_char;
-
     // Obtain PTX or CUBIN from the program.
     size_t targetSize;
     NVRTC_SAFE_CALL(nvrtcGetTARGETSize(prog, &targetSize));
@@ -95,14 +205,18 @@ extern "C" int Compile(const char *target_file_name, const char *cu_code, int us
     // Destroy the program.
     NVRTC_SAFE_CALL(nvrtcDestroyProgram(&prog));
 
-    // write PTX code to file
+    // write PTX code to file, and to the cache. N.B. failing to write to the cache is not an error,
+    // e.g. the cache folder may be read only.
 
-    std::ofstream wf(target_file_name, std::ofstream::binary);
-    wf.write((char*)&targetSize, sizeof(size_t));
-    wf.write(target, targetSize);
-    wf.close();
+    if (!cache_file.empty())
+        write_target_file(cache_file, target, targetSize, cache_key);
+
+    bool ok = write_target_file(target_file_name, target, targetSize);
 
     delete[] target;
 
+    if (!ok)
+        throw std::runtime_error("[KeOps] Error when writing compiled formula to file.");
+
     return 0;
 }
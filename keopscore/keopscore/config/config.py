@@ -10,6 +10,16 @@ import platform, sys
 # global parameters can be set here :
 use_cuda = True  # use cuda if possible
 use_OpenMP = True  # use OpenMP if possible (see function set_OpenMP below)
+use_gpu_register_blocking = True  # several rows per thread in the 1D Gpu scheme for low dimensional formulas (see GpuReduc1D_regblock)
+use_gpu_warp_knn = True  # warp level selection in the 1D Gpu scheme for K-nearest-neighbors reductions with large K (see GpuReduc1D_knn)
+# TF32 tensor cores for the inner products of distance based formulas (see GpuReduc1D_tensorcore),
+# enabled by setting KEOPS_TENSOR_CORES=1
+use_gpu_tensor_cores = os.getenv("KEOPS_TENSOR_CORES", "0") == "1"
+use_cpu_isa_dispatch = True  # compile cpu code for several instruction sets (see get_cpu_isa_targets)
+# NUMA mode of cpu reductions (see include/CpuNuma.h), enabled by setting KEOPS_CPU_NUMA=1
+use_cpu_numa = os.getenv("KEOPS_CPU_NUMA", "0") == "1"
+# instrumentation of the nvrtc binder (see include/Profiler.h), compiled by setting KEOPS_PROFILING=1
+use_profiling = os.getenv("KEOPS_PROFILING", "0") == "1"
 
 # System Path
 base_dir_path = os.path.abspath(join(os.path.dirname(os.path.realpath(__file__)), ".."))
@@ -27,6 +37,9 @@ specific_gpus = os.getenv("CUDA_VISIBLE_DEVICES")
 if specific_gpus:
     specific_gpus = specific_gpus.replace(",", "_")
     default_build_folder_name += "_CUDA_VISIBLE_DEVICES_" + specific_gpus
+# the instrumented binder is built in its own folder
+if use_profiling:
+    default_build_folder_name += "_profiling"
 default_build_path = join(keops_cache_folder, default_build_folder_name)
 
 # init cache folder
@@ -91,6 +104,27 @@ def get_build_folder():
 
 jit_binary = join(_build_path, "keops_nvrtc.so")
 
+# Kernel cache : folder where GPU binaries of formulas are stored, indexed by a hash of the
+# generated code, compute capability, NVRTC and driver versions and compile options.
+# Contrary to the build folder, it may be safely shared between processes and machines
+# (e.g. on a network file system), by setting the KEOPS_KERNEL_CACHE environment variable.
+# An empty string disables the cache.
+_kernel_cache_path = os.getenv(
+    "KEOPS_KERNEL_CACHE", join(keops_cache_folder, "kernel_cache")
+)
+
+
+def set_kernel_cache_folder(path):
+    global _kernel_cache_path
+    _kernel_cache_path = path if path else ""
+
+
+def get_kernel_cache_folder():
+    if _kernel_cache_path:
+        os.makedirs(_kernel_cache_path, exist_ok=True)
+    return _kernel_cache_path
+
+
 # Compiler
 cxx_compiler = os.getenv("CXX")
 if cxx_compiler is None:
@@ -170,6 +204,38 @@ if platform.system() == "Darwin":
 
 cpp_flags += " -I" + bindings_source_dir
 
+# NUMA mode : threads bound to the cores, and j variables replicated on each NUMA node
+if use_cpu_numa and use_OpenMP:
+    cpp_flags += " -DKEOPS_CPU_NUMA=1"
+
+# CPU instruction sets : formulas are compiled once for each of these targets, and linked in the
+# same shared object ; at load time, the first target supported by the host cpu is used.
+# Each target is a tuple (name, compile flags, cpu features), where cpu features are names
+# for __builtin_cpu_supports. The last target is the baseline of the platform, which needs
+# no check (N.B. on aarch64 the baseline includes NEON). The objects of the other targets are
+# post-processed with objcopy (see get_isa_compile_command in keopscore/binders/cpp/isa_dispatch.py),
+# so that they are only built if it is available.
+# The list is built when formulas are compiled and looked up in the caches (see get_env_param in
+# keopscore/utils/Cache.py), so that use_cpu_isa_dispatch may be changed after importing keopscore.
+def get_cpu_isa_targets():
+    targets = [("generic", "", [])]
+    if (
+        use_cpu_isa_dispatch
+        and platform.machine().lower() in ("x86_64", "amd64", "i386", "i686")
+        and shutil.which("objcopy")
+    ):
+        targets = [
+            (
+                "avx512",
+                "-mavx512f -mavx512cd -mavx512vl -mavx512bw -mavx512dq"
+                " -mavx2 -mfma -mbmi2 -mpopcnt",
+                ["avx512f", "avx512cd", "avx512vl", "avx512bw", "avx512dq"],
+            ),
+            ("avx2", "-mavx2 -mfma -mbmi2 -mpopcnt", ["avx2", "fma", "bmi2"]),
+            ("sse42", "-msse4.2 -mpopcnt", ["sse4.2", "popcnt"]),
+        ] + targets
+    return targets
+
 
 def find_and_try_library(libtag):
     libname = find_library(libtag)
@@ -190,7 +256,7 @@ if all([find_and_try_library(lib) for lib in cuda_dependencies]):
         get_gpu_props,
     )  # N.B. this import should be kept inside the if statement
 
-    cuda_available = get_gpu_props()[0] > 0
+    cuda_available = get_gpu_props() > 0
 else:
     cuda_available = False
     KeOps_Warning(
@@ -216,8 +282,11 @@ if use_cuda:
     cuda_version = get_cuda_version()
     nvrtc_flags = (
         compile_options
-        + f" -fpermissive -L{libcuda_folder} -L{libnvrtc_folder} -lcuda -lnvrtc"
+        + f" -fpermissive -L{libcuda_folder} -L{libnvrtc_folder} -lcuda -lnvrtc -pthread"
     )
+    if use_profiling:
+        # N.B. NVTX (if found) loads its library at runtime
+        nvrtc_flags += " -DKEOPS_PROFILING=1 -ldl"
     nvrtc_include = " -I" + bindings_source_dir
     cuda_include_path = get_cuda_include_path()
     if cuda_include_path:
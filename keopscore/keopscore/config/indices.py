@@ -0,0 +1,21 @@
+# 64 bits indexing mode, for arrays with more than 2^31 elements.
+# Row indices i and j are always int, but in this mode the offsets of the rows in the arrays
+# (such as i*dim) are computed in 64 bits, which is slightly slower. It is enabled by
+# get_keops_dll for map_reduce ids with the "_int64" suffix.
+
+int64_indices = False
+
+
+def get_int64_indices():
+    global int64_indices
+    return int64_indices
+
+
+def set_int64_indices(val):
+    global int64_indices
+    int64_indices = bool(val)
+
+
+def c_index(expr):
+    # string of C++ code for an index expression, to be multiplied by a dimension
+    return f"((long long) {expr})" if int64_indices else expr
@@ -0,0 +1,83 @@
+from keopscore.formulas.GetReduction import GetReduction
+from keopscore.formulas.variables.Var import Var
+
+
+def prefix_str(formula):
+    # prints formula with the names of its operations only (e.g. "Add(Var(0,3,0),Var(1,3,1))"):
+    # contrary to repr, which uses operators, the string is always parsed back into the same formula.
+    if isinstance(formula, Var):
+        return f"Var({formula.ind},{formula.dim},{formula.cat})"
+    args = [prefix_str(child) for child in formula.children]
+    args += [str(param) for param in formula.params]
+    return formula.string_id + "(" + ",".join(args) + ")"
+
+
+def renumber(formula, new_inds):
+    # changes the indices of the variables of formula, with the dict new_inds
+    if isinstance(formula, Var):
+        return Var(new_inds[formula.ind], formula.dim, formula.cat)
+    if len(formula.children) == 0:
+        return formula
+    new_children = [renumber(child, new_inds) for child in formula.children]
+    return type(formula)(*new_children, *formula.params)
+
+
+def is_static(formula, static_inds):
+    # formula only depends on j variables and parameters of static_inds (and on at least one j
+    # variable), and its value is not larger than these j variables
+    if len(formula.children) == 0:
+        return False
+    vars = formula.Vars()
+    if any(v.cat not in (1, 2) or v.ind not in static_inds for v in vars):
+        return False
+    dimj = sum(v.dim for v in vars if v.cat == 1)
+    return dimj > 0 and formula.dim <= dimj
+
+
+def static_subformulas(formula, static_inds):
+    # largest static subformulas of formula
+    if is_static(formula, static_inds):
+        yield formula
+    else:
+        for child in formula.children:
+            yield from static_subformulas(child, static_inds)
+
+
+def hoist_static_subformulas(formulas, aliases, static_inds, ind):
+    """Finds the subformulas of formulas (strings, with aliases of the form "x=Var(ind,dim,cat)") which
+    only depend on the j variables and parameters of indices static_inds : if these arguments stay the same
+    from call to call, the values of such a subformula for all j may be computed once, in a per-j array
+    which the reduction reads instead of evaluating the subformula for each pair (i,j). To keep the memory
+    traffic of the reduction the same, we only consider subformulas whose dimension is at most the sum of
+    the dimensions of their j variables.
+    Returns the formulas where these subformulas are replaced by new j variables of indices ind, ind+1, ...,
+    and the list of triples (var, subformula, arg_inds), where var is the new variable and subformula is a
+    string whose variables are the arguments of indices arg_inds, renumbered 0, 1, ... Returns None if there
+    is no such subformula."""
+    static_inds = set(static_inds)
+    trees = [GetReduction(formula, aliases) for formula in formulas]
+    hoisted = {}
+    for tree in trees:
+        for node in static_subformulas(tree, static_inds):
+            key = prefix_str(node)
+            if key not in hoisted:
+                hoisted[key] = (Var(ind + len(hoisted), node.dim, 1), node)
+    if len(hoisted) == 0:
+        return None
+    for var, node in hoisted.values():
+        trees = [tree.replace(node, var) for tree in trees]
+    new_formulas = [prefix_str(tree) for tree in trees]
+    res = []
+    for var, node in hoisted.values():
+        arg_inds = [v.ind for v in node.Vars()]
+        node = renumber(node, {k: n for n, k in enumerate(arg_inds)})
+        res.append((var, node, arg_inds))
+    # we check that all the strings are parsed back into the same formulas, since the parameters
+    # of some operations may not be printed in the order of their constructors
+    for formula, tree in zip(new_formulas, trees):
+        if GetReduction(formula) != tree:
+            return None
+    for var, node, arg_inds in res:
+        if GetReduction(prefix_str(node)) != node:
+            return None
+    return new_formulas, [(var, prefix_str(node), inds) for var, node, inds in res]
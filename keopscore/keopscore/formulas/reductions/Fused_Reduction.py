@@ -0,0 +1,175 @@
+from keopscore.formulas.Operation import Operation
+from keopscore.formulas.maths.Extract import Extract
+from keopscore.formulas.reductions.Reduction import Reduction
+from keopscore.formulas.reductions.Sum_Reduction import Sum_Reduction
+from keopscore.formulas.variables.Var import Var
+from keopscore.utils.code_gen_utils import c_array, new_c_varname, VectCopy
+from keopscore.utils.misc_utils import KeOps_Error
+
+
+def subformulas(formula):
+    # all the nodes of a formula, which are not leaves (variables or constants)
+    if len(formula.children) > 0:
+        yield formula
+        for child in formula.children:
+            yield from subformulas(child)
+
+
+def factorize(formulas, ind):
+    """Finds the subformulas which appear several times in the list of formulas.
+    Returns the list of formulas where they have been replaced by new variables with indices ind, ind+1, ...,
+    and the list of pairs (variable, subformula). The largest subformulas are found first, so that
+    the subformulas must be evaluated in the reversed order of the list."""
+    formulas, shared = list(formulas), []
+    while True:
+        # pairs [subformula, count], grouped by repr (formulas are not hashable)
+        groups = {}
+        # the subformulas already factorized are searched too, but not counted themselves
+        roots = formulas + [child for _, node in shared for child in node.children]
+        for root in roots:
+            for node in subformulas(root):
+                group = groups.setdefault(repr(node), [])
+                for entry in group:
+                    if entry[0] == node:
+                        entry[1] += 1
+                        break
+                else:
+                    group.append([node, 1])
+        nodes = [node for group in groups.values() for node, n in group if n > 1]
+        if len(nodes) == 0:
+            return formulas, shared
+        node = max(nodes, key=lambda node: len(list(subformulas(node))))
+        var = Var(ind + len(shared), node.dim, 3)
+        formulas = [formula.replace(node, var) for formula in formulas]
+        shared = [(v, other.replace(node, var)) for v, other in shared]
+        shared.append((var, node))
+
+
+class Fused_Formulas(Operation):
+    # Concatenation of the formulas of a Fused_Reduction. The subformulas which appear
+    # in several formulas (or several times in one formula) are evaluated only once.
+
+    string_id = "Fused_Formulas"
+
+    def __init__(self, *formulas, params=()):
+        # N.B. params keyword is used for compatibility with base class, but should always equal ()
+        if params != ():
+            KeOps_Error("There should be no parameter.")
+        super().__init__(*formulas)
+        self.dim = sum(formula.dim for formula in formulas)
+
+    def __call__(self, out, table):
+        # the shared subformulas are stored in new entries of the table, after the variables
+        ind = max([len(table)] + [v.ind + 1 for v in self.Vars_])
+        formulas, shared = factorize(self.children, ind)
+        table = list(table) + [None] * (ind + len(shared) - len(table))
+        string = f"\n{{\n// Starting code block for {self.__repr__()}.\n\n"
+        for var, node in reversed(shared):
+            res = c_array(out.dtype, node.dim, new_c_varname("shared"))
+            string += res.declare() + node(res, table)
+            table[var.ind] = res
+        outs = out.split(*(formula.dim for formula in formulas))
+        for formula, outk in zip(formulas, outs):
+            if isinstance(formula, Var):
+                string += VectCopy(outk, table[formula.ind])
+            else:
+                string += formula(outk, table)
+        string += f"\n\n// Finished code block for {self.__repr__()}.\n}}\n\n"
+        return string
+
+    def DiffT(self, v, gradin):
+        res, offset = None, 0
+        for formula in self.children:
+            grad = formula.DiffT(v, Extract(gradin, offset, formula.dim))
+            res = grad if res is None else res + grad
+            offset += formula.dim
+        return res
+
+
+class Fused_Reduction(Reduction):
+    """Fused_Reduction(R_1, ..., R_n) computes the reductions R_1, ..., R_n over the same index
+    in a single pass over the data : the formulas of the reductions are evaluated together for each
+    pair (i,j), sharing their common subformulas, and each reduction updates its own part of the
+    accumulator. The output is the concatenation of the outputs of the reductions."""
+
+    string_id = "Fused_Reduction"
+
+    def __init__(self, *reductions):
+        tagI = reductions[0].tagI
+        if any(red.tagI != tagI for red in reductions):
+            KeOps_Error("Fused reductions must all be done over the same index.")
+        super().__init__(Fused_Formulas(*(red.formula for red in reductions)), tagI)
+        self.reductions = reductions
+        self.children = list(reductions)
+        self.params = ()
+        self.dim = sum(red.dim for red in reductions)
+        self.dimred = sum(red.dimred for red in reductions)
+        self.dim_kahan = sum(
+            getattr(red, "dim_kahan", red.dimred) for red in reductions
+        )
+
+    def split(self, arr, attr):
+        # split arr in the parts used by each reduction : attr is "dim" for outputs, "dimred"
+        # for accumulators and "dim_kahan" for the temporary arrays of the Kahan scheme
+        dims = (getattr(red, attr, red.dimred) for red in self.reductions)
+        return arr.split(*dims)
+
+    def split_fout(self, xi):
+        return xi.split(*(red.formula.dim for red in self.reductions))
+
+    def InitializeReduction(self, acc):
+        accs = self.split(acc, "dimred")
+        return "".join(
+            red.InitializeReduction(acck) for red, acck in zip(self.reductions, accs)
+        )
+
+    def ReducePair(self, acc, xi):
+        accs, xis = self.split(acc, "dimred"), self.split(xi, "dimred")
+        return "".join(
+            red.ReducePair(acck, xik)
+            for red, acck, xik in zip(self.reductions, accs, xis)
+        )
+
+    def ReducePairShort(self, acc, xi, ind):
+        accs, xis = self.split(acc, "dimred"), self.split_fout(xi)
+        return "".join(
+            red.ReducePairShort(acck, xik, ind)
+            for red, acck, xik in zip(self.reductions, accs, xis)
+        )
+
+    def KahanScheme(self, acc, xi, tmp):
+        for red in self.reductions:
+            if not hasattr(red, "KahanScheme"):
+                KeOps_Error(f"Kahan scheme is not available for {red.string_id}.")
+        accs, xis = self.split(acc, "dimred"), self.split_fout(xi)
+        tmps = self.split(tmp, "dim_kahan")
+        return "".join(
+            red.KahanScheme(acck, xik, tmpk)
+            for red, acck, xik, tmpk in zip(self.reductions, accs, xis, tmps)
+        )
+
+    def FinalizeOutput(self, acc, out, i):
+        accs, outs = self.split(acc, "dimred"), self.split(out, "dim")
+        return "".join(
+            red.FinalizeOutput(acck, outk, i)
+            for red, acck, outk in zip(self.reductions, accs, outs)
+        )
+
+    def DiffT(self, v, gradin, f0=None):
+        # the gradient is the sum of the gradients of the reductions, which are all sum reductions
+        grads, offset = [], 0
+        for red in self.reductions:
+            if not hasattr(red, "DiffT"):
+                KeOps_Error(f"{red.string_id} is not differentiable.")
+            gradin_k = Extract(gradin, offset, red.dim)
+            f0_k = None if f0 is None else Extract(f0, offset, red.dim)
+            grads.append(red.DiffT(v, gradin_k, f0_k))
+            offset += red.dim
+        if not all(isinstance(grad, Sum_Reduction) for grad in grads):
+            KeOps_Error(
+                "Gradient of fused reductions is only available for sum type reductions."
+            )
+        formula = grads[0].formula
+        for grad in grads[1:]:
+            formula = formula + grad.formula
+        return Sum_Reduction(formula, grads[0].tagI)
@@ -1,6 +1,7 @@
 from .ArgKMin_Reduction import ArgKMin_Reduction
 from .ArgMax_Reduction import ArgMax_Reduction
 from .ArgMin_Reduction import ArgMin_Reduction
+from .Fused_Reduction import Fused_Reduction
 from .KMin_ArgKMin_Reduction import KMin_ArgKMin_Reduction
 from .KMin_Reduction import KMin_Reduction
 from .Max_ArgMax_Reduction import Max_ArgMax_Reduction
@@ -1,6 +1,7 @@
 """
 This is the main entry point for all binders. It takes as inputs :
   - map_reduce_id : string naming the type of map-reduce scheme to be used : either "CpuReduc", "GpuReduc1D_FromDevice", ...
+    The "_int64" suffix may be added to it, for arrays whose sizes do not fit in 32 bits integers (see keopscore/config/indices.py),
   - red_formula_string : string expressing the formula, such as "Sum_Reduction((Exp(Minus(Sum(Square((Var(0,3,0) / Var(1,3,1)))))) * Var(2,1,1)),0)",
   - enable_chunks : -1, 0 or 1, for Gpu mode only, enable special routines for high dimensions (-1 means automatic setting)
   - enable_finalchunks : -1, 0 or 1, for Gpu mode only, enable special routines for final operation in high dimensions (-1 means automatic setting)
@@ -61,6 +62,7 @@ from keopscore.config.chunks import (
     use_final_chunks,
     set_mult_var_highdim,
 )
+from keopscore.config.indices import set_int64_indices
 from keopscore.formulas import Zero_Reduction, Sum_Reduction
 from keopscore.formulas.GetReduction import GetReduction
 from keopscore.formulas.variables.Zero import Zero
@@ -80,6 +82,12 @@ def get_keops_dll_impl(
     aliases,
     *args,
 ):
+    # 64 bits indexing mode, which applies to all the schemes
+    use_int64_indices = map_reduce_id.endswith("_int64")
+    if use_int64_indices:
+        map_reduce_id = map_reduce_id[: -len("_int64")]
+    set_int64_indices(use_int64_indices)
+
     # detecting the need for special chunked computation modes :
     use_chunk_mode = 0
     if "Gpu" in map_reduce_id:
@@ -91,7 +99,12 @@ def get_keops_dll_impl(
         set_enable_finalchunk(enable_finalchunks)
         set_mult_var_highdim(mul_var_highdim)
         red_formula = GetReduction(red_formula_string, aliases)
-        if use_final_chunks(red_formula) and map_reduce_id != "GpuReduc2D":
+        # the final chunks are accumulated in the output array, which is not precise enough with bfloat16
+        if (
+            use_final_chunks(red_formula)
+            and map_reduce_id != "GpuReduc2D"
+            and args[1] != "__nv_bfloat16"
+        ):
             use_chunk_mode = 2
             map_reduce_id += "_finalchunks"
         elif get_enable_chunk() and map_reduce_id != "GpuReduc2D":
@@ -104,6 +117,24 @@ def get_keops_dll_impl(
                 if not chk.chunk_postchunk_mix:
                     use_chunk_mode = 1
                     map_reduce_id += "_chunks"
+        if (
+            map_reduce_id == "GpuReduc1D"
+            and keopscore.config.config.use_gpu_tensor_cores
+            and map_reduce["GpuReduc1D_tensorcore"].applies(red_formula, *args)
+        ):
+            map_reduce_id = "GpuReduc1D_tensorcore"
+        elif (
+            map_reduce_id == "GpuReduc1D"
+            and keopscore.config.config.use_gpu_warp_knn
+            and map_reduce["GpuReduc1D_knn"].applies(red_formula, *args)
+        ):
+            map_reduce_id = "GpuReduc1D_knn"
+        elif (
+            map_reduce_id == "GpuReduc1D"
+            and keopscore.config.config.use_gpu_register_blocking
+        ):
+            if map_reduce["GpuReduc1D_regblock"].rows_per_thread(red_formula) > 1:
+                map_reduce_id = "GpuReduc1D_regblock"
     # Instantiation of
     map_reduce_class = map_reduce[map_reduce_id]
 
@@ -154,6 +185,31 @@ get_keops_dll = Cache(
 )
 
 
+def warmup(list_of_args, max_workers=None):
+    """
+    Builds the code for several formulas at once, e.g. at the start of an application :
+      - list_of_args : list of tuples of arguments of get_keops_dll, one for each formula,
+      - max_workers : maximum number of threads (None means the default of ThreadPoolExecutor).
+    Code generation is serialized, but the compilations of the GPU codes by NVRTC run concurrently,
+    each one starting as soon as the code of its formula is generated.
+    It returns the list of outputs of get_keops_dll, in the same order as list_of_args.
+    """
+    from concurrent.futures import ThreadPoolExecutor
+
+    # a formula given several times is built only once
+    unique_args = {}
+    for args in list_of_args:
+        unique_args.setdefault(str(args), args)
+    with ThreadPoolExecutor(max_workers=max_workers) as pool:
+        results = dict(
+            zip(
+                unique_args.keys(),
+                pool.map(lambda args: get_keops_dll(*args), unique_args.values()),
+            )
+        )
+    return [results[str(args)] for args in list_of_args]
+
+
 if __name__ == "__main__":
     argv = sys.argv[1:]
 
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+#include <cstdio>
+
+#if KEOPS_CPU_NUMA && defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/////////////////////////////////////////////
+//         CPU     NUMA     mode           //
+/////////////////////////////////////////////
+
+// When KEOPS_CPU_NUMA is set (see use_cpu_numa in config.py), the Cpu reductions run on threads
+// bound to the cores (proc_bind(spread)) with a static partition of the rows, so that each socket
+// handles a contiguous part of the i range and first-touches the corresponding pages of the output.
+// The j variables, which are streamed from memory by all the threads, are replicated once per
+// NUMA node by a thread of this node, so that all the reads of the reduction loops are local.
+
+#ifndef KEOPS_CPU_NUMA
+#define KEOPS_CPU_NUMA 0
+#endif
+
+// replication of the j variables is only worth it if they are read many times
+#ifndef KEOPS_CPU_NUMA_MIN_ROWS
+#define KEOPS_CPU_NUMA_MIN_ROWS 1024
+#endif
+
+// number of NUMA nodes of the system (1 if unknown)
+int keops_numa_nodes() {
+#if KEOPS_CPU_NUMA && defined(__linux__)
+    static const int nnodes = []() {
+        // the file contains a list of ranges of node ids, e.g. "0-1" or "0,2-3"
+        FILE *f = fopen("/sys/devices/system/node/online", "r");
+        if (!f)
+            return 1;
+        int count = 0, first, last;
+        char sep;
+        while (fscanf(f, "%d", &first) == 1) {
+            last = first;
+            sep = fgetc(f);
+            if (sep == '-') {
+                if (fscanf(f, "%d", &last) != 1)
+                    break;
+                sep = fgetc(f);
+            }
+            count += last - first + 1;
+            if (sep != ',')
+                break;
+        }
+        fclose(f);
+        return count > 0 ? count : 1;
+    }();
+    return nnodes;
+#else
+    return 1;
+#endif
+}
+
+// NUMA node of the core running the calling thread
+int keops_numa_current_node() {
+#if KEOPS_CPU_NUMA && defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+        return node;
+#endif
+    return 0;
+}
+
+template < typename TYPE >
+class KeOps_numa_replicas {
+public:
+
+    KeOps_numa_replicas(int nx, int ny, int nargs, TYPE **arg,
+                        std::vector< int > indsj, std::vector< int > dimsy) :
+            nnodes(1), ny(ny), arg(arg), indsj(indsj), dimsy(dimsy) {
+        if (KEOPS_CPU_NUMA && nx >= KEOPS_CPU_NUMA_MIN_ROWS && !indsj.empty())
+            nnodes = keops_numa_nodes();
+        if (nnodes > 1) {
+            pointers.assign(nnodes, std::vector< TYPE * >(arg, arg + nargs));
+            copies.resize(nnodes * indsj.size());
+            claimed.assign(nnodes, 0);
+        }
+    }
+
+    // Returns the array of pointers to the arguments to be used by the calling thread.
+    // N.B. must be called by all the threads of the parallel region, since it contains a barrier.
+    TYPE **get() {
+        if (nnodes == 1)
+            return arg;
+        int node = keops_numa_current_node() % nnodes;
+        int rank;
+        #pragma omp atomic capture
+        rank = claimed[node]++;
+        if (rank == 0) {
+            // first thread of the node : the copies are allocated and written here, hence placed on this node
+            for (size_t k = 0; k < indsj.size(); k++) {
+                std::vector< TYPE > &copy = copies[node * indsj.size() + k];
+                copy.assign(arg[indsj[k]], arg[indsj[k]] + (size_t) ny * dimsy[k]);
+                pointers[node][indsj[k]] = copy.data();
+            }
+        }
+        #pragma omp barrier
+        return pointers[node].data();
+    }
+
+private:
+
+    int nnodes, ny;
+    TYPE **arg;
+    std::vector< int > indsj, dimsy, claimed;
+    std::vector< std::vector< TYPE * > > pointers;
+    std::vector< std::vector< TYPE > > copies;
+
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+// Work decomposition of the block-sparse (ranges) reductions on Cpu.
+// Clusters of the ranges mode may have very uneven sizes and numbers of interacting j blocks,
+// so that a static partition of the rows leaves most threads idle at the end of the computation.
+// Hence the cost of each range of rows is estimated as |range| x (sum of the sizes of its j ranges),
+// heavy ranges are split into tasks of contiguous rows of roughly equal costs, and tasks are
+// processed with dynamic scheduling, heaviest first.
+// N.B. each row is always handled by a single task, which visits all its j ranges
+// in the same order : hence the results do not depend on the number of threads or on the scheduling.
+
+#define KEOPS_CPU_TASKS_PER_THREAD 8
+
+struct KeOps_range_task {
+    int range_index, start, end;
+    long cost;
+};
+
+std::vector< KeOps_range_task > build_range_tasks(int nranges, int *ranges_x, int *slices_x, int *ranges_y,
+                                                  int nthreads) {
+    std::vector< long > row_costs(nranges);
+    long total_cost = 0;
+    for (int range_index = 0; range_index < nranges; range_index++) {
+        int start_slice = (range_index < 1) ? 0 : slices_x[range_index - 1];
+        int end_slice = slices_x[range_index];
+        long row_cost = 1;  // the output of a row is written even if it interacts with no j range
+        for (int slice = start_slice; slice < end_slice; slice++)
+            row_cost += ranges_y[2 * slice + 1] - ranges_y[2 * slice];
+        row_costs[range_index] = row_cost;
+        total_cost += row_cost * (ranges_x[2 * range_index + 1] - ranges_x[2 * range_index]);
+    }
+
+    long target_cost = std::max(1L, total_cost / ((long) KEOPS_CPU_TASKS_PER_THREAD * nthreads));
+
+    std::vector< KeOps_range_task > tasks;
+    for (int range_index = 0; range_index < nranges; range_index++) {
+        int start_x = ranges_x[2 * range_index];
+        int end_x = ranges_x[2 * range_index + 1];
+        int rows_per_task = (int) std::min((long) std::max(1, end_x - start_x),
+                                           std::max(1L, target_cost / row_costs[range_index]));
+        for (int start = start_x; start < end_x; start += rows_per_task) {
+            KeOps_range_task task;
+            task.range_index = range_index;
+            task.start = start;
+            task.end = std::min(end_x, start + rows_per_task);
+            task.cost = row_costs[range_index] * (task.end - task.start);
+            tasks.push_back(task);
+        }
+    }
+
+    // heaviest tasks first, so that the lightest ones fill the gaps at the end
+    std::stable_sort(tasks.begin(), tasks.end(),
+                     [](const KeOps_range_task &a, const KeOps_range_task &b) { return a.cost > b.cost; });
+    return tasks;
+}
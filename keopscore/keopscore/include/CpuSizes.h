@@ -0,0 +1,28 @@
+#pragma once
+
+/////////////////////////////////////////////
+//            CPU     Options             //
+/////////////////////////////////////////////
+
+// Width in bytes of the SIMD registers of the target instruction set, known at compile time.
+// The blocked CPU reductions (see CpuReduc.py) evaluate formulas for KEOPS_CPU_SIMD_BYTES / sizeof(TYPE)
+// consecutive j indices at once, one per SIMD lane.
+#if defined(__AVX512F__)
+#define KEOPS_CPU_SIMD_BYTES 64
+#elif defined(__AVX__)
+#define KEOPS_CPU_SIMD_BYTES 32
+#else
+// SSE, NEON, or scalar code
+#define KEOPS_CPU_SIMD_BYTES 16
+#endif
+
+// Blocked CPU reductions : maximal number of rows of the output sharing a tile of j variables,
+// and size in bytes of a tile of j variables, chosen so that it stays in the L2 cache while
+// the rows of the block are processed.
+#ifndef KEOPS_CPU_BLOCK_I
+#define KEOPS_CPU_BLOCK_I 16
+#endif
+
+#ifndef KEOPS_CPU_TILE_J_BYTES
+#define KEOPS_CPU_TILE_J_BYTES 65536
+#endif
@@ -0,0 +1,462 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cuda.h>
+
+// Instrumentation of the calls of a KeOps_module. It is only compiled if KEOPS_PROFILING is set to 1
+// (see use_profiling in keopscore/config/config.py) : otherwise the KEOPS_PROF_* macros below expand
+// to nothing, and the statistics of the modules stay empty. When it is compiled, recording is enabled
+// at run time by KeOps_module::set_profiling, and gives :
+//  - host timers for the phases of the calls (Sizes, Ranges, range_preprocess, load_args, ...),
+//  - timings of the kernels and copies, measured with CUDA events. They are read lazily : when the
+//    statistics or the trace are queried, or when too many of them are pending,
+//  - counters of the bytes copied between host and device, and of the memory allocations,
+//  - NVTX ranges named after the hash of the formula, if the NVTX headers are available,
+// as a KeOps_stats struct (KeOps_module::get_stats) and as a Chrome trace (KeOps_module::write_trace),
+// which may be opened in chrome://tracing or https://ui.perfetto.dev.
+// The host timers and counters apply to the calls of the current thread : KeOps_prof_call sets the
+// profiler of the module as the current one for the duration of a call.
+
+#ifndef KEOPS_PROFILING
+#define KEOPS_PROFILING 0
+#endif
+
+#if KEOPS_PROFILING && defined(__has_include)
+#if __has_include(<nvtx3/nvToolsExt.h>)
+#include <nvtx3/nvToolsExt.h>
+#define KEOPS_USE_NVTX 1
+#endif
+#endif
+
+// maximal number of events kept for the trace ; then only the statistics are updated
+#define KEOPS_TRACE_MAX_EVENTS 100000
+// number of pending CUDA events timings above which the completed ones are read
+#define KEOPS_PROF_MAX_PENDING 1024
+
+
+struct KeOps_phase_stats {
+    long long count;
+    double total_ms, max_ms;
+
+    KeOps_phase_stats() : count(0), total_ms(0), max_ms(0) {}
+
+    void add(double ms) {
+        count++;
+        total_ms += ms;
+        max_ms = std::max(max_ms, ms);
+    }
+
+    void merge(const KeOps_phase_stats &other) {
+        count += other.count;
+        total_ms += other.total_ms;
+        max_ms = std::max(max_ms, other.max_ms);
+    }
+};
+
+
+struct KeOps_stats {
+    std::string tag;    // hash of the formula
+    int compiled;       // 1 if the instrumentation is compiled (KEOPS_PROFILING=1)
+    long long calls;
+    // host phases and device operations (kernels and copies), by name
+    std::map< std::string, KeOps_phase_stats > host, device;
+    long long bytes_htod, bytes_dtoh;
+    long long device_allocs, device_alloc_bytes, host_allocs, host_alloc_bytes;
+
+    KeOps_stats() : compiled(KEOPS_PROFILING), calls(0), bytes_htod(0), bytes_dtoh(0),
+                    device_allocs(0), device_alloc_bytes(0), host_allocs(0), host_alloc_bytes(0) {}
+
+    void merge(const KeOps_stats &other) {
+        if (tag.empty())
+            tag = other.tag;
+        calls += other.calls;
+        for (std::map< std::string, KeOps_phase_stats >::const_iterator it = other.host.begin();
+             it != other.host.end(); ++it)
+            host[it->first].merge(it->second);
+        for (std::map< std::string, KeOps_phase_stats >::const_iterator it = other.device.begin();
+             it != other.device.end(); ++it)
+            device[it->first].merge(it->second);
+        bytes_htod += other.bytes_htod;
+        bytes_dtoh += other.bytes_dtoh;
+        device_allocs += other.device_allocs;
+        device_alloc_bytes += other.device_alloc_bytes;
+        host_allocs += other.host_allocs;
+        host_alloc_bytes += other.host_alloc_bytes;
+    }
+};
+
+
+// event of the Chrome trace : host phases have pid 1 and the id of their thread, device operations
+// have pid 2 and the id of their stream. Times are in microseconds, from the first use of a profiler.
+struct KeOps_trace_event {
+    std::string name, tag;
+    int pid, tid;
+    double ts, dur;
+};
+
+
+// writes events in the Chrome trace format
+inline void KeOps_write_trace(const char *filename, const std::vector< KeOps_trace_event > &events) {
+    std::ofstream f(filename);
+    if (!f)
+        throw std::runtime_error(std::string("[KeOps] cannot write trace file ") + filename);
+    f << "{\"traceEvents\": [\n"
+      << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"KeOps host\"}},\n"
+      << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 2, \"args\": {\"name\": \"KeOps device\"}}";
+    for (size_t k = 0; k < events.size(); k++) {
+        const KeOps_trace_event &e = events[k];
+        f << ",\n{\"name\": \"" << e.name << "\", \"cat\": \"" << (e.pid == 1 ? "host" : "device")
+          << "\", \"ph\": \"X\", \"pid\": " << e.pid << ", \"tid\": " << e.tid
+          << ", \"ts\": " << e.ts << ", \"dur\": " << e.dur
+          << ", \"args\": {\"formula\": \"" << e.tag << "\"}}";
+    }
+    f << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+
+class KeOps_profiler {
+public:
+
+    KeOps_profiler() : enabled(false), ref_event(NULL) {}
+
+    // N.B. must be called with the context of the module set as current context
+    ~KeOps_profiler() {
+        release();
+    }
+
+    // hash of the formula, used to name the NVTX ranges and the trace events
+    void set_tag(const std::string &tag_) {
+        tag = tag_;
+        stats.tag = tag;
+    }
+
+    // N.B. must be called with the context of the module set as current context
+    void set_enabled(int val) {
+        std::lock_guard< std::mutex > lock(mutex);
+        if (val && KEOPS_PROFILING && ref_event == NULL) {
+            // reference for the timestamps of the device operations
+            CUDA_SAFE_CALL(cuEventCreate(&ref_event, CU_EVENT_DEFAULT));
+            CUDA_SAFE_CALL(cuEventRecord(ref_event, NULL));
+            CUDA_SAFE_CALL(cuEventSynchronize(ref_event));
+            ref_us = now_us();
+        }
+        enabled = val && KEOPS_PROFILING;
+    }
+
+    bool is_enabled() const {
+        return enabled;
+    }
+
+    // N.B. must be called with the context of the module set as current context
+    KeOps_stats get_stats() {
+        std::lock_guard< std::mutex > lock(mutex);
+        read_pending(true);
+        return stats;
+    }
+
+    // N.B. must be called with the context of the module set as current context
+    std::vector< KeOps_trace_event > get_trace() {
+        std::lock_guard< std::mutex > lock(mutex);
+        read_pending(true);
+        return trace;
+    }
+
+    // N.B. must be called with the context of the module set as current context
+    void reset() {
+        std::lock_guard< std::mutex > lock(mutex);
+        read_pending(true);
+        stats = KeOps_stats();
+        stats.tag = tag;
+        trace.clear();
+    }
+
+    // N.B. must be called with the context of the module set as current context
+    void release() {
+        std::lock_guard< std::mutex > lock(mutex);
+        for (size_t k = 0; k < pending.size(); k++) {
+            CUDA_SAFE_CALL_NO_EXCEPTION(cuEventDestroy(pending[k].start));
+            CUDA_SAFE_CALL_NO_EXCEPTION(cuEventDestroy(pending[k].stop));
+        }
+        pending.clear();
+        for (size_t k = 0; k < free_events.size(); k++)
+            CUDA_SAFE_CALL_NO_EXCEPTION(cuEventDestroy(free_events[k]));
+        free_events.clear();
+        if (ref_event)
+            CUDA_SAFE_CALL_NO_EXCEPTION(cuEventDestroy(ref_event));
+        ref_event = NULL;
+        enabled = false;
+    }
+
+    // profiler of the call running in the current thread, if it records
+    static KeOps_profiler *&current() {
+        static thread_local KeOps_profiler *P = NULL;
+        return P;
+    }
+
+    static KeOps_profiler *active() {
+        KeOps_profiler *P = current();
+        return (P && P->enabled) ? P : NULL;
+    }
+
+    static double now_us() {
+        static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+        return std::chrono::duration< double, std::micro >(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    void add_call() {
+        std::lock_guard< std::mutex > lock(mutex);
+        stats.calls++;
+    }
+
+    void add_host(const char *name, double start_us, double end_us) {
+        std::lock_guard< std::mutex > lock(mutex);
+        stats.host[name].add((end_us - start_us) / 1000);
+        add_event(name, 1, thread_index(std::this_thread::get_id()), start_us, end_us - start_us);
+    }
+
+    // direction : 0 for host to device, 1 for device to host
+    static void count_bytes(int direction, size_t bytes) {
+        KeOps_profiler *P = active();
+        if (P == NULL)
+            return;
+        std::lock_guard< std::mutex > lock(P->mutex);
+        (direction == 0 ? P->stats.bytes_htod : P->stats.bytes_dtoh) += bytes;
+    }
+
+    // location : 0 for device memory, 1 for page-locked host memory
+    static void count_alloc(int location, size_t bytes) {
+        KeOps_profiler *P = active();
+        if (P == NULL)
+            return;
+        std::lock_guard< std::mutex > lock(P->mutex);
+        (location == 0 ? P->stats.device_allocs : P->stats.host_allocs)++;
+        (location == 0 ? P->stats.device_alloc_bytes : P->stats.host_alloc_bytes) += bytes;
+    }
+
+    CUevent get_event() {
+        std::lock_guard< std::mutex > lock(mutex);
+        CUevent ev;
+        if (free_events.empty()) {
+            CUDA_SAFE_CALL(cuEventCreate(&ev, CU_EVENT_DEFAULT));
+        } else {
+            ev = free_events.back();
+            free_events.pop_back();
+        }
+        return ev;
+    }
+
+    // start and stop have been recorded on stream around the operation name
+    void add_device(const char *name, CUstream stream, CUevent start, CUevent stop) {
+        std::lock_guard< std::mutex > lock(mutex);
+        pending_timing p = {name, stream_index(stream), start, stop};
+        pending.push_back(p);
+        if (pending.size() > KEOPS_PROF_MAX_PENDING)
+            read_pending(false);
+    }
+
+    void nvtx_push(const char *name) {
+#ifdef KEOPS_USE_NVTX
+        nvtxRangePushA(("KeOps " + tag + " : " + name).c_str());
+#endif
+    }
+
+    void nvtx_pop() {
+#ifdef KEOPS_USE_NVTX
+        nvtxRangePop();
+#endif
+    }
+
+private:
+
+    struct pending_timing {
+        const char *name;
+        int tid;
+        CUevent start, stop;
+    };
+
+    std::mutex mutex;
+    bool enabled;
+    std::string tag;
+    KeOps_stats stats;
+    std::vector< KeOps_trace_event > trace;
+    std::vector< pending_timing > pending;
+    std::vector< CUevent > free_events;
+    std::map< std::thread::id, int > threads;
+    std::map< CUstream, int > streams;
+    CUevent ref_event;
+    double ref_us;
+
+    int thread_index(std::thread::id id) {
+        std::map< std::thread::id, int >::iterator it = threads.find(id);
+        if (it != threads.end())
+            return it->second;
+        int k = threads.size();
+        threads[id] = k;
+        return k;
+    }
+
+    int stream_index(CUstream stream) {
+        std::map< CUstream, int >::iterator it = streams.find(stream);
+        if (it != streams.end())
+            return it->second;
+        int k = streams.size();
+        streams[stream] = k;
+        return k;
+    }
+
+    void add_event(const char *name, int pid, int tid, double ts, double dur) {
+        if (trace.size() >= KEOPS_TRACE_MAX_EVENTS)
+            return;
+        KeOps_trace_event e = {name, tag, pid, tid, ts, dur};
+        trace.push_back(e);
+    }
+
+    // reads the timings of the pending device operations, in the order of their recording.
+    // If wait is false, we stop at the first one which has not completed yet.
+    void read_pending(bool wait) {
+        size_t k = 0;
+        for (; k < pending.size(); k++) {
+            pending_timing &p = pending[k];
+            if (wait)
+                CUDA_SAFE_CALL(cuEventSynchronize(p.stop));
+            else if (cuEventQuery(p.stop) != CUDA_SUCCESS)
+                break;
+            float ms, offset_ms;
+            CUDA_SAFE_CALL(cuEventElapsedTime(&ms, p.start, p.stop));
+            CUDA_SAFE_CALL(cuEventElapsedTime(&offset_ms, ref_event, p.start));
+            stats.device[p.name].add(ms);
+            add_event(p.name, 2, p.tid, ref_us + 1000 * (double) offset_ms, 1000 * (double) ms);
+            free_events.push_back(p.start);
+            free_events.push_back(p.stop);
+        }
+        pending.erase(pending.begin(), pending.begin() + k);
+    }
+
+};
+
+
+#if KEOPS_PROFILING
+
+// Sets the profiler of a module as the current one for the duration of a call, and times the call.
+class KeOps_prof_call {
+public:
+    KeOps_prof_call(KeOps_profiler &P) : previous(KeOps_profiler::current()) {
+        KeOps_profiler::current() = &P;
+        if (P.is_enabled()) {
+            P.add_call();
+            P.nvtx_push("launch_kernel");
+            start = KeOps_profiler::now_us();
+        }
+    }
+
+    ~KeOps_prof_call() {
+        KeOps_profiler *P = KeOps_profiler::active();
+        if (P) {
+            P->add_host("launch_kernel", start, KeOps_profiler::now_us());
+            P->nvtx_pop();
+        }
+        KeOps_profiler::current() = previous;
+    }
+
+private:
+    KeOps_profiler *previous;
+    double start;
+};
+
+
+// host timer of a phase of the current call, from its construction to the end of its scope,
+// or to the call of stop()
+class KeOps_prof_host_scope {
+public:
+    KeOps_prof_host_scope(const char *name_) : P(KeOps_profiler::active()), name(name_) {
+        if (P) {
+            P->nvtx_push(name);
+            start = KeOps_profiler::now_us();
+        }
+    }
+
+    void stop() {
+        if (P) {
+            P->add_host(name, start, KeOps_profiler::now_us());
+            P->nvtx_pop();
+        }
+        P = NULL;
+    }
+
+    ~KeOps_prof_host_scope() {
+        stop();
+    }
+
+private:
+    KeOps_profiler *P;
+    const char *name;
+    double start;
+};
+
+
+// CUDA events timer of the work enqueued on stream, from its construction to the end of its scope.
+// It is disabled while the stream is captured in a CUDA graph.
+class KeOps_prof_device_scope {
+public:
+    KeOps_prof_device_scope(const char *name_, CUstream stream_) :
+            P(KeOps_profiler::active()), name(name_), stream(stream_) {
+        if (P) {
+            CUstreamCaptureStatus capture_status;
+            CUDA_SAFE_CALL(cuStreamIsCapturing(stream, &capture_status));
+            if (capture_status != CU_STREAM_CAPTURE_STATUS_NONE) {
+                P = NULL;
+                return;
+            }
+            start = P->get_event();
+            stop = P->get_event();
+            CUDA_SAFE_CALL(cuEventRecord(start, stream));
+        }
+    }
+
+    ~KeOps_prof_device_scope() {
+        if (P) {
+            CUDA_SAFE_CALL_NO_EXCEPTION(cuEventRecord(stop, stream));
+            P->add_device(name, stream, start, stop);
+        }
+    }
+
+private:
+    KeOps_profiler *P;
+    const char *name;
+    CUstream stream;
+    CUevent start, stop;
+};
+
+#define KEOPS_PROF_CONCAT2(a, b) a##b
+#define KEOPS_PROF_CONCAT(a, b) KEOPS_PROF_CONCAT2(a, b)
+#define KEOPS_PROF_CALL(profiler) KeOps_prof_call KEOPS_PROF_CONCAT(keops_prof_, __LINE__)(profiler)
+#define KEOPS_PROF_HOST(name) KeOps_prof_host_scope KEOPS_PROF_CONCAT(keops_prof_, __LINE__)(name)
+#define KEOPS_PROF_HOST_START(timer, name) KeOps_prof_host_scope timer(name)
+#define KEOPS_PROF_HOST_STOP(timer) timer.stop()
+#define KEOPS_PROF_DEVICE(name, stream) KeOps_prof_device_scope KEOPS_PROF_CONCAT(keops_prof_, __LINE__)(name, stream)
+#define KEOPS_PROF_BYTES_HTOD(bytes) KeOps_profiler::count_bytes(0, bytes)
+#define KEOPS_PROF_BYTES_DTOH(bytes) KeOps_profiler::count_bytes(1, bytes)
+#define KEOPS_PROF_DEVICE_ALLOC(bytes) KeOps_profiler::count_alloc(0, bytes)
+#define KEOPS_PROF_HOST_ALLOC(bytes) KeOps_profiler::count_alloc(1, bytes)
+
+#else
+
+#define KEOPS_PROF_CALL(profiler)
+#define KEOPS_PROF_HOST(name)
+#define KEOPS_PROF_HOST_START(timer, name)
+#define KEOPS_PROF_HOST_STOP(timer)
+#define KEOPS_PROF_DEVICE(name, stream)
+#define KEOPS_PROF_BYTES_HTOD(bytes)
+#define KEOPS_PROF_BYTES_DTOH(bytes)
+#define KEOPS_PROF_DEVICE_ALLOC(bytes)
+#define KEOPS_PROF_HOST_ALLOC(bytes)
+
+#endif
@@ -67,8 +67,8 @@ public:
     // constructors
     Sizes(int _nargs, TYPE **args, const std::vector <std::vector< int >> &argshapes, int _nx, int _ny,
           int tagIJ_, int use_half_, int dimout_,
-          const std::vector< int > &indsI_, std::vector< int > indsJ_, const std::vector< int > &indsP_,
-          const std::vector< int > &dimsX_, std::vector< int > dimsY_, const std::vector< int > &dimsP_) {
+          const std::vector< int > &indsI_, const std::vector< int > &indsJ_, const std::vector< int > &indsP_,
+          const std::vector< int > &dimsX_, const std::vector< int > &dimsY_, const std::vector< int > &dimsP_) {
 
         tagIJ = tagIJ_;
         use_half = use_half_;
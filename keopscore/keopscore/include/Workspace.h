@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cuda.h>
+
+// Growable device memory arena used for the per-call scratch data of a KeOps_module :
+// array of pointers to the arguments, copies of host data, "inflated" output of the 2D scheme,
+// lookup tables of the ranges mode, etc.
+// Each call sub-allocates its buffers in the arena through get(). If the arena is too small,
+// extra blocks are allocated for the current call, and the arena is grown to the size needed
+// at the beginning of the next call. Hence, in steady state, calls do not allocate device memory at all.
+// Since calls may be enqueued asynchronously on streams, an event is recorded at the end of each call ;
+// the next call waits for it before reusing the memory.
+
+#define KEOPS_WORKSPACE_ALIGN 256
+
+class Workspace {
+public:
+
+    Workspace() : base(0), capacity(0), used(0), required(0), last_use(NULL), last_stream(NULL), pending(false),
+                  n_allocs(0) {}
+
+    // N.B. must be called with the context of the module set as current context
+    void init(size_t size) {
+        CUDA_SAFE_CALL(cuEventCreate(&last_use, CU_EVENT_DISABLE_TIMING));
+        capacity = align(size);
+        CUDA_SAFE_CALL(cuMemAlloc(&base, capacity));
+        n_allocs++;
+    }
+
+    // if the previous call was enqueued on another stream, we make the current one wait for it,
+    // because we are going to overwrite the same memory.
+    void wait(CUstream stream) {
+        if (pending && stream != last_stream)
+            CUDA_SAFE_CALL(cuStreamWaitEvent(stream, last_use, 0));
+    }
+
+    // called at the beginning of each call, before any call to get()
+    void begin(CUstream stream) {
+        wait(stream);
+        if (!extra_blocks.empty()) {
+            // the previous call needed more memory than available : we grow the arena.
+            if (pending)
+                CUDA_SAFE_CALL(cuEventSynchronize(last_use));
+            free_blocks();
+            capacity = required;
+            CUDA_SAFE_CALL(cuMemAlloc(&base, capacity));
+            KEOPS_PROF_DEVICE_ALLOC(capacity);
+            n_allocs++;
+        }
+        used = 0;
+    }
+
+    // returns a pointer to a device buffer of given size (in bytes), valid until the end of the call
+    CUdeviceptr get(size_t size) {
+        size = align(size);
+        CUdeviceptr p;
+        if (used + size <= capacity) {
+            p = base + used;
+        } else {
+            CUDA_SAFE_CALL(cuMemAlloc(&p, size));
+            KEOPS_PROF_DEVICE_ALLOC(size);
+            n_allocs++;
+            extra_blocks.push_back(p);
+        }
+        used += size;
+        return p;
+    }
+
+    template< typename T >
+    T *get(size_t n) {
+        return (T *) get(sizeof(T) * n);
+    }
+
+    // called at the end of each call, once all work using the workspace has been enqueued on stream
+    void end(CUstream stream) {
+        required = used;
+        CUDA_SAFE_CALL(cuEventRecord(last_use, stream));
+        last_stream = stream;
+        pending = true;
+    }
+
+    // number of device memory allocations since the creation of the workspace ; may be read
+    // from another thread than the one using the workspace (see KeOps_module::get_plan_stats)
+    long long num_allocs() const {
+        return n_allocs;
+    }
+
+    // N.B. must be called with the context of the module set as current context
+    void release() {
+        if (pending)
+            CUDA_SAFE_CALL_NO_EXCEPTION(cuEventSynchronize(last_use));
+        free_blocks();
+        if (last_use)
+            CUDA_SAFE_CALL_NO_EXCEPTION(cuEventDestroy(last_use));
+        last_use = NULL;
+        pending = false;
+    }
+
+private:
+
+    CUdeviceptr base;
+    size_t capacity, used, required;
+    std::vector< CUdeviceptr > extra_blocks;
+    CUevent last_use;
+    CUstream last_stream;
+    bool pending;
+    std::atomic< long long > n_allocs;
+
+    static size_t align(size_t size) {
+        return ((size + KEOPS_WORKSPACE_ALIGN - 1) / KEOPS_WORKSPACE_ALIGN) * KEOPS_WORKSPACE_ALIGN;
+    }
+
+    void free_blocks() {
+        for (size_t k = 0; k < extra_blocks.size(); k++)
+            CUDA_SAFE_CALL_NO_EXCEPTION(cuMemFree(extra_blocks[k]));
+        extra_blocks.clear();
+        if (base)
+            CUDA_SAFE_CALL_NO_EXCEPTION(cuMemFree(base));
+        base = 0;
+    }
+
+};
+
+
+// Growable page-locked host buffer, used as staging area for asynchronous copies between
+// host memory and the device. Contrary to the workspace, it is only used by host data calls,
+// which always wait for all their work before returning : hence the buffer is idle at the
+// beginning of each call and may be reallocated there.
+
+class PinnedBuffer {
+public:
+
+    PinnedBuffer() : ptr(NULL), capacity(0) {}
+
+    // N.B. must be called with the context of the module set as current context
+    void *get(size_t size) {
+        if (size > capacity) {
+            release();
+            CUDA_SAFE_CALL(cuMemHostAlloc(&ptr, size, 0));
+            KEOPS_PROF_HOST_ALLOC(size);
+            capacity = size;
+        }
+        return ptr;
+    }
+
+    template< typename T >
+    T *get(size_t n) {
+        return (T *) get(sizeof(T) * n);
+    }
+
+    void release() {
+        if (ptr)
+            CUDA_SAFE_CALL_NO_EXCEPTION(cuMemFreeHost(ptr));
+        ptr = NULL;
+        capacity = 0;
+    }
+
+private:
+
+    void *ptr;
+    size_t capacity;
+
+};
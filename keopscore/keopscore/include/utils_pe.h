@@ -1,3 +1,5 @@
+#pragma once
+
 #include <numeric>
 #include <cuda.h>
 
@@ -56,32 +58,42 @@ char *read_text_file(char const *path) {
 
 
 
+// instrumentation and scratch device memory of KeOps_module, which rely on the macros above
+#include "Profiler.h"
+#include "Workspace.h"
+
+
 template<typename TYPE>
-void load_args_FromDevice(CUdeviceptr &p_data, TYPE *out, TYPE *&out_d, int nargs, TYPE **arg, TYPE **&arg_d) {
-    CUDA_SAFE_CALL(cuMemAlloc(&p_data, sizeof(TYPE *) * nargs));
+void load_args_FromDevice(Workspace &ws, TYPE *out, TYPE *&out_d, int nargs, TYPE **arg, TYPE **&arg_d,
+                          CUstream stream) {
     out_d = out;
-    arg_d = (TYPE **) p_data;
+    arg_d = ws.get< TYPE * >(nargs);
     // copy array of pointers
-    CUDA_SAFE_CALL(cuMemcpyHtoD((CUdeviceptr) arg_d, arg, nargs * sizeof(TYPE *)));
+    CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) arg_d, arg, nargs * sizeof(TYPE *), stream));
+    KEOPS_PROF_BYTES_HTOD(nargs * sizeof(TYPE *));
 }
 
 
+// resident_d, if not NULL, gives the device copies of the arguments which stay on the device
+// from call to call (see KeOps_module::set_resident_args), and NULL for the other ones :
+// these arguments are neither copied nor stored in the workspace.
 template<typename TYPE>
 void
-load_args_FromHost(CUdeviceptr &p_data, TYPE *out, TYPE *&out_d, int nargs,
+load_args_FromHost(Workspace &ws, TYPE *out, TYPE *&out_d, int nargs,
                    TYPE **arg, TYPE **&arg_d,
                    const std::vector< std::vector< int > > &argshape,
-                   int sizeout) {
-    int sizes[nargs];
-    int totsize = sizeout;
+                   size_t sizeout, CUstream stream, TYPE *const *resident_d = NULL) {
+    size_t sizes[nargs];
+    size_t totsize = sizeout;
     for (int k = 0; k < nargs; k++) {
-        sizes[k] = std::accumulate(argshape[k].begin(), argshape[k].end(), 1, std::multiplies< int >());
+        if (resident_d != NULL && resident_d[k] != NULL)
+            sizes[k] = 0;
+        else
+            sizes[k] = std::accumulate(argshape[k].begin(), argshape[k].end(), (size_t) 1, std::multiplies< size_t >());
         totsize += sizes[k];
     }
 
-    CUDA_SAFE_CALL(cuMemAlloc(&p_data, sizeof(TYPE *) * nargs + sizeof(TYPE) * totsize));
-
-    arg_d = (TYPE **) p_data;
+    arg_d = (TYPE **) ws.get(sizeof(TYPE *) * nargs + sizeof(TYPE) * totsize);
     TYPE *dataloc = (TYPE *) (arg_d + nargs);
 
     // host array of pointers to device data
@@ -90,11 +102,19 @@ load_args_FromHost(CUdeviceptr &p_data, TYPE *out, TYPE *&out_d, int nargs,
     out_d = dataloc;
     dataloc += sizeout;
     for (int k = 0; k < nargs; k++) {
+        if (resident_d != NULL && resident_d[k] != NULL) {
+            ph[k] = resident_d[k];
+            continue;
+        }
         ph[k] = dataloc;
-        CUDA_SAFE_CALL(cuMemcpyHtoD((CUdeviceptr) dataloc, arg[k], sizeof(TYPE) * sizes[k]));
+        // N.B. copies from pageable host memory return once the data has been staged,
+        // so the host arrays may be released or modified as soon as the call returns.
+        CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) dataloc, arg[k], sizeof(TYPE) * sizes[k], stream));
+        KEOPS_PROF_BYTES_HTOD(sizeof(TYPE) * sizes[k]);
         dataloc += sizes[k];
     }
 
     // copy array of pointers
-    CUDA_SAFE_CALL(cuMemcpyHtoD((CUdeviceptr) arg_d, ph, nargs * sizeof(TYPE *)));
+    CUDA_SAFE_CALL(cuMemcpyHtoDAsync((CUdeviceptr) arg_d, ph, nargs * sizeof(TYPE *), stream));
+    KEOPS_PROF_BYTES_HTOD(nargs * sizeof(TYPE *));
 }
@@ -1,7 +1,11 @@
+from keopscore.config.indices import c_index
 from keopscore.formulas.reductions import *
 from keopscore.formulas.GetReduction import GetReduction
 from keopscore.utils.code_gen_utils import Var_loader, new_c_varname, pointer, c_include
 
+# types of the computations for the storage types which are not computed upon directly
+compute_types = {"__nv_bfloat16": "float"}
+
 
 class MapReduce:
     """
@@ -27,7 +31,10 @@ class MapReduce:
 
         self.red_formula = GetReduction(red_formula_string, aliases=aliases)
 
-        self.dtype = dtype
+        # dtype_io is the storage type of the inputs and output, and dtype the type of the computations :
+        # bfloat16 values are loaded and stored as such, but computations are done in float.
+        self.dtype_io = dtype
+        self.dtype = compute_types.get(dtype, dtype)
         self.dtypeacc = dtypeacc
         self.nargs = nargs
         self.sum_scheme_string = sum_scheme_string
@@ -49,6 +56,9 @@ class MapReduce:
         else:
             self.headers += "#define USE_HALF 0\n"
 
+        if self.dtype_io == "__nv_bfloat16":
+            self.headers += c_include("cuda_bf16.h")
+
         red_formula = self.red_formula
         formula = red_formula.formula
         dtype = self.dtype
@@ -66,10 +76,14 @@ class MapReduce:
         self.param_loc = c_array(dtype, self.varloader.dimp, "param_loc")
 
         argname = new_c_varname("arg")
-        self.arg = c_variable(pointer(pointer(dtype)), argname)
+        self.arg = c_variable(pointer(pointer(self.dtype_io)), argname)
         self.args = [self.arg[k] for k in range(nargs)]
 
         self.acc = c_array(dtypeacc, red_formula.dimred, "acc")
         self.acctmp = c_array(dtypeacc, red_formula.dimred, "acctmp")
         self.fout = c_array(dtype, formula.dim, "fout")
-        self.outi = c_array(dtype, red_formula.dim, f"(out + i * {red_formula.dim})")
+        self.outi = c_array(
+            self.dtype_io,
+            red_formula.dim,
+            f"(out + {c_index('i')} * {red_formula.dim})",
+        )
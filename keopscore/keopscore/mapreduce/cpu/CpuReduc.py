@@ -2,7 +2,19 @@ from keopscore import debug_ops_at_exec
 from keopscore.binders.cpp.Cpu_link_compile import Cpu_link_compile
 from keopscore.mapreduce.cpu.CpuAssignZero import CpuAssignZero
 from keopscore.mapreduce.MapReduce import MapReduce
-from keopscore.utils.code_gen_utils import c_include
+from keopscore.formulas.reductions import (
+    Sum_Reduction,
+    Max_Reduction,
+    Min_Reduction,
+    Max_SumShiftExpWeight_Reduction,
+)
+from keopscore.utils.code_gen_utils import (
+    c_include,
+    c_array,
+    c_variable,
+    new_c_varname,
+    pointer,
+)
 import keopscore
 
 
@@ -13,13 +25,55 @@ class CpuReduc(MapReduce, Cpu_link_compile):
 
     AssignZero = CpuAssignZero
 
+    # reductions for which the blocked code is used : partial results of the SIMD lanes
+    # are merged with ReducePair, which is exact for max and min, and is a block summation
+    # for sums. Other reductions (and the Kahan scheme) use the simple loop.
+    blocked_reductions = (
+        Sum_Reduction,
+        Max_Reduction,
+        Min_Reduction,
+        Max_SumShiftExpWeight_Reduction,
+    )
+
     def __init__(self, *args):
         MapReduce.__init__(self, *args)
         Cpu_link_compile.__init__(self)
         self.dimy = self.varloader.dimy
 
+    def use_blocked_code(self):
+        return type(self.red_formula) in self.blocked_reductions and (
+            self.sum_scheme_string in ("direct_sum", "block_sum")
+        )
+
     def get_code(self):
         super().get_code()
+        if self.use_blocked_code():
+            self.get_blocked_code()
+        else:
+            self.get_simple_code()
+        self.get_launch_code()
+
+    def get_numa_code(self):
+        # Code of the NUMA mode (see include/CpuNuma.h) : declaration of the replicas of the j variables,
+        # opening of the parallel region, and array of pointers to the arguments (the local
+        # replicas, or the original arguments) for the threads of the region.
+        arg_node = c_array(pointer(self.dtype), len(self.args), new_c_varname("arg_node"))
+        numa_replicas = new_c_varname("numa_replicas")
+        varloader = self.varloader
+        declare = f"""
+    KeOps_numa_replicas< {self.dtype} > {numa_replicas}(nx, ny, {len(self.args)}, {self.arg.id},
+                                                 {{{", ".join(str(k) for k in varloader.indsj)}}},
+                                                 {{{", ".join(str(d) for d in varloader.dimsy)}}});"""
+        parallel = """
+#if KEOPS_CPU_NUMA
+    #pragma omp parallel proc_bind(spread)
+#else
+    #pragma omp parallel
+#endif"""
+        get = f"{pointer(self.dtype)} *{arg_node.id} = {numa_replicas}.get();"
+        return declare, parallel, get, [arg_node[k] for k in range(len(self.args))]
+
+    def get_simple_code(self):
 
         i = self.i
         j = self.j
@@ -28,8 +82,8 @@ class CpuReduc(MapReduce, Cpu_link_compile):
         outi = self.outi
         acc = self.acc
         arg = self.arg
-        args = self.args
-        table = self.varloader.direct_table(args, i, j)
+        declare_numa, parallel, get_args_node, args_node = self.get_numa_code()
+        table = self.varloader.direct_table(args_node, i, j)
         sum_scheme = self.sum_scheme
 
         headers = ["cmath", "stdlib.h"]
@@ -38,12 +92,17 @@ class CpuReduc(MapReduce, Cpu_link_compile):
         if debug_ops_at_exec:
             headers.append("iostream")
         self.headers += c_include(*headers)
+        self.headers += '#include "include/CpuNuma.h"\n'
 
         self.code = f"""
 {self.headers}
 template < typename TYPE > 
 int CpuConv_{self.gencode_filename}(int nx, int ny, TYPE* out, TYPE **{arg.id}) {{
-    #pragma omp parallel for
+    {declare_numa}
+    {parallel}
+    {{
+    {get_args_node}
+    #pragma omp for schedule(static)
     for (int i = 0; i < nx; i++) {{
         {fout.declare()}
         {acc.declare()}
@@ -58,10 +117,130 @@ int CpuConv_{self.gencode_filename}(int nx, int ny, TYPE* out, TYPE **{arg.id})
         {sum_scheme.final_operation(acc)}
         {red_formula.FinalizeOutput(acc, outi, i)}
     }}
+    }}
+    return 0;
+}}
+                    """
+
+    def get_blocked_code(self):
+        # Cache blocked and vectorized version : the j range is cut in tiles which stay in cache
+        # while they are used by a block of rows. For each row, the formula is evaluated for
+        # KEOPS_CPU_LANES consecutive j at once (one per SIMD lane), each lane having its own
+        # accumulator ; the lanes are merged in the accumulator of the row at the end of each tile.
+
+        i = self.i
+        j = self.j
+        red_formula = self.red_formula
+        dimred = red_formula.dimred
+        dtype = self.dtype
+        dtypeacc = self.dtypeacc
+        fout = self.fout
+        outi = self.outi
+        arg = self.arg
+        args = self.args
+        declare_numa, parallel, get_args_node, args_node = self.get_numa_code()
+        # local copies of the pointers to the arguments : being restrict, they let the compiler
+        # know that the inputs are not modified by the stores to the accumulators, which is needed
+        # for vectorizing the loops over the lanes.
+        args_loc = [
+            c_variable(pointer(dtype), name)
+            for name in new_c_varname("arg_loc", len(args), as_list=True)
+        ]
+        declare_args_loc = "".join(
+            f"{dtype} * __restrict__ {a.id} = {b.id};\n"
+            for a, b in zip(args_loc, args_node)
+        )
+        table = self.varloader.direct_table(args_loc, i, j)
+
+        acc_row = c_array(dtypeacc, dimred, f"(acc_rows + (i - ib) * {dimred})")
+        acc_lane = c_array(dtypeacc, dimred, "acc_lane")
+        load_lane = f"for (int k = 0; k < {dimred}; k++) acc_lane[k] = acc_lanes[k * KEOPS_CPU_LANES + l];"
+        store_lane = f"for (int k = 0; k < {dimred}; k++) acc_lanes[k * KEOPS_CPU_LANES + l] = acc_lane[k];"
+
+        headers = ["cmath", "stdlib.h", "algorithm"]
+        if keopscore.config.config.use_OpenMP:
+            headers.append("omp.h")
+        if debug_ops_at_exec:
+            headers.append("iostream")
+        self.headers += c_include(*headers)
+        self.headers += '#include "include/CpuSizes.h"\n'
+        self.headers += '#include "include/CpuNuma.h"\n'
+
+        self.code = f"""
+{self.headers}
+#define KEOPS_CPU_LANES ((int) (KEOPS_CPU_SIMD_BYTES / sizeof({dtype})))
+
+template < typename TYPE > 
+int CpuConv_{self.gencode_filename}(int nx, int ny, TYPE* out, TYPE **{arg.id}) {{
+    int tile_j = std::max(1, (int) (KEOPS_CPU_TILE_J_BYTES / ({max(1, self.dimy)} * sizeof({dtype}) * KEOPS_CPU_LANES)))
+                 * KEOPS_CPU_LANES;
+    int block_i = KEOPS_CPU_BLOCK_I;
+#ifdef _OPENMP
+    // smaller blocks of rows if needed, to keep all threads busy
+    block_i = std::max(1, std::min(block_i, nx / (4 * omp_get_max_threads())));
+#endif
+    {declare_numa}
+    {parallel}
+    {{
+    {get_args_node}
+    {declare_args_loc}
+    #pragma omp for schedule(static)
+    for (int ib = 0; ib < nx; ib += block_i) {{
+        int iend = std::min(ib + block_i, nx);
+        {dtypeacc} acc_rows[KEOPS_CPU_BLOCK_I * {dimred}];
+        {dtypeacc} acc_lanes[KEOPS_CPU_LANES * {dimred}];
+        for (int i = ib; i < iend; i++) {{
+            {red_formula.InitializeReduction(acc_row)}
+        }}
+        for (int jb = 0; jb < ny; jb += tile_j) {{
+            int jend = std::min(jb + tile_j, ny);
+            for (int i = ib; i < iend; i++) {{
+                #pragma omp simd
+                for (int l = 0; l < KEOPS_CPU_LANES; l++) {{
+                    {acc_lane.declare()}
+                    {red_formula.InitializeReduction(acc_lane)}
+                    {store_lane}
+                }}
+                int jv = jb;
+                for (; jv + KEOPS_CPU_LANES <= jend; jv += KEOPS_CPU_LANES) {{
+                    #pragma omp simd
+                    for (int l = 0; l < KEOPS_CPU_LANES; l++) {{
+                        int j = jv + l;
+                        {fout.declare()}
+                        {acc_lane.declare()}
+                        {load_lane}
+                        {red_formula.formula(fout, table)}
+                        {red_formula.ReducePairShort(acc_lane, fout, j)}
+                        {store_lane}
+                    }}
+                }}
+                // remaining j of the tile
+                for (int j = jv; j < jend; j++) {{
+                    int l = j - jv;
+                    {fout.declare()}
+                    {acc_lane.declare()}
+                    {load_lane}
+                    {red_formula.formula(fout, table)}
+                    {red_formula.ReducePairShort(acc_lane, fout, j)}
+                    {store_lane}
+                }}
+                for (int l = 0; l < KEOPS_CPU_LANES; l++) {{
+                    {acc_lane.declare()}
+                    {load_lane}
+                    {red_formula.ReducePair(acc_row, acc_lane)}
+                }}
+            }}
+        }}
+        for (int i = ib; i < iend; i++) {{
+            {red_formula.FinalizeOutput(acc_row, outi, i)}
+        }}
+    }}
+    }}
     return 0;
 }}
                     """
 
+    def get_launch_code(self):
         self.code += f"""
 #include "stdarg.h"
 #include <vector>
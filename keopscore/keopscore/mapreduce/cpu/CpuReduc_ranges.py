@@ -63,7 +63,7 @@ class CpuReduc_ranges(MapReduce, Cpu_link_compile):
         imstartx = c_variable("int", "i-start_x")
         jmstarty = c_variable("int", "j-start_y")
 
-        headers = ["cmath", "stdlib.h"]
+        headers = ["cmath", "stdlib.h", "vector"]
         if keopscore.config.config.use_OpenMP:
             headers.append("omp.h")
         if debug_ops_at_exec:
@@ -97,6 +97,7 @@ void check_nargs(int nargs, int nminargs) {{
 #include "include/Sizes.h"
 #include "include/ranges_utils.h"
 #include "include/Ranges.h"
+#include "include/CpuRangesTasks.h"
 
 template< typename TYPE>                 
 int CpuConv_ranges_{self.gencode_filename}(int nx, int ny, 
@@ -131,11 +132,6 @@ int CpuConv_ranges_{self.gencode_filename}(int nx, int ny,
     // And finally for the parameters, with "1" instead of "M".
     fill_shapes(nbatchdims, shapes, shapes_i, shapes_j, shapes_p,  {red_formula.tagJ}, indsi, indsj, indsp);
     
-    // Actual for-for loop -----------------------------------------------------
-
-    {param_loc.declare()}
-    {varloader.load_vars("p", param_loc, args)}  // If nbatchdims == 0, the parameters are fixed once and for all
-    
     // Set the output to zero, as the ranges may not cover the full output -----
     {acctmp.declare()} // __TYPEACC__ acctmp[DIMRED];
     for (int i = 0; i < nx; i++) {{
@@ -156,15 +152,29 @@ int CpuConv_ranges_{self.gencode_filename}(int nx, int ny,
     int* slices_x = {red_formula.tagJ} ? ranges[1] : ranges[4];
     int* ranges_y = {red_formula.tagJ} ? ranges[2] : ranges[5];
 
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    std::vector< KeOps_range_task > tasks = build_range_tasks(nranges, ranges_x, slices_x, ranges_y, nthreads);
+    int ntasks = tasks.size();
+
+    // Actual for-for loop -----------------------------------------------------
+
+    #pragma omp parallel
+    {{
+    {param_loc.declare()}
+    {varloader.load_vars("p", param_loc, args)}  // If nbatchdims == 0, the parameters are fixed once and for all
+
     int indices_i[sizei], indices_j[sizej], indices_p[sizep];  // Buffers for the "broadcasted indices"
     for (int k = 0; k < sizei; k++) {{ indices_i[k] = 0; }}  // Fill the "offsets" with zeroes,
     for (int k = 0; k < sizej; k++) {{ indices_j[k] = 0; }}  // the default value when nbatchdims == 0.
     for (int k = 0; k < sizep; k++) {{ indices_p[k] = 0; }}
-    
-    
-    for (int range_index = 0; range_index < nranges; range_index++) {{
+
+    #pragma omp for schedule(dynamic, 1)
+    for (int task_index = 0; task_index < ntasks; task_index++) {{
+        int range_index = tasks[task_index].range_index;
         int start_x = ranges_x[2 * range_index];
-        int end_x = ranges_x[2 * range_index + 1];
         int start_slice = (range_index < 1) ? 0 : slices_x[range_index - 1];
         int end_slice = slices_x[range_index];
 
@@ -176,9 +186,8 @@ int CpuConv_ranges_{self.gencode_filename}(int nx, int ny,
             vect_broadcast_index(range_index, nbatchdims, sizep, shapes, shapes_p, indices_p);
             {varloader.load_vars("p", param_loc, args, offsets=indices_p)}  // Load the paramaters, once per tile
         }}
-    
-        #pragma omp parallel for   
-        for (int i = start_x; i < end_x; i++) {{
+
+        for (int i = tasks[task_index].start; i < tasks[task_index].end; i++) {{
             {xi.declare()}
             {yj.declare()}
             {fout.declare()}
@@ -218,6 +227,7 @@ int CpuConv_ranges_{self.gencode_filename}(int nx, int ny,
             {red_formula.FinalizeOutput(acc, outi, i)}
         }}
     }}
+    }}
     return 0;
 }}
                     """
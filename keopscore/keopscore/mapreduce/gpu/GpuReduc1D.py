@@ -1,9 +1,13 @@
+from keopscore.config.indices import c_index
 from keopscore.binders.nvrtc.Gpu_link_compile import Gpu_link_compile
 from keopscore.mapreduce.gpu.GpuAssignZero import GpuAssignZero
 from keopscore.mapreduce.MapReduce import MapReduce
+from keopscore.mapreduce.gpu.reduce2D import reduce2D_code
+from keopscore.formulas.reductions.sum_schemes import kahan_scheme
 from keopscore.utils.code_gen_utils import (
     c_variable,
     c_array,
+    VectCopy,
 )
 
 
@@ -12,6 +16,11 @@ class GpuReduc1D(MapReduce, Gpu_link_compile):
 
     AssignZero = GpuAssignZero
 
+    # whether the generic split-j kernel GpuConv1DOnDevice_splitj is generated (see get_kernel_code).
+    # The variants of the 1D scheme set it to False : the binder then launches their own kernel
+    # even for small nx, since the generic one would silently replace it.
+    has_splitj_kernel = True
+
     def __init__(self, *args):
         MapReduce.__init__(self, *args)
         Gpu_link_compile.__init__(self)
@@ -20,8 +29,38 @@ class GpuReduc1D(MapReduce, Gpu_link_compile):
     def get_code(self):
         super().get_code()
 
+        self.code = f"""
+                          
+                        {self.headers}
+                        
+                        {self.get_kernel_code()}
+
+                        {GpuReduc1D.get_kernel_code(self, splitj=True) if self.has_splitj_kernel else ""}
+
+                        {reduce2D_code(self.red_formula, self.dtype, self.dtypeacc, self.dtype_io)}
+                        
+                        {self.get_kernel_code(tile=True) if self.tagHostDevice == 0 else ""}
+                    """
+
+    def get_kernel_code(self, tile=False, splitj=False):
+        # With tile=False, returns the code of the main kernel GpuConv1DOnDevice.
+        # With tile=True, returns the code of GpuConv1DOnDevice_tile, which is used by the binder
+        # for computations on data larger than the device memory : it processes one tile of the
+        # j range, starting at index joffset, and carries the accumulators from one tile to the next
+        # through the acc_io array. The output is only written for the last tile. With the Kahan
+        # scheme, the compensations are carried too, after the nx accumulators of the tile ; the
+        # block_sum scheme adds its temporary sums to acc at the end of each block, so that it
+        # has nothing else to carry. This kernel is only needed for host data.
+        # With splitj=True, returns the code of GpuConv1DOnDevice_splitj, which the binder uses
+        # when nx is too small to fill the device : the line of blocks blockIdx.y reduces over the
+        # j indices in [blockIdx.y * jchunk, (blockIdx.y + 1) * jchunk), and stores its partial results
+        # in outB, as the 2D scheme does. They are combined by the kernel reduce2D (see reduce2D.py).
+        # The variants of the 1D scheme (GpuReduc1D_regblock, etc.) override the main kernel and
+        # reuse the tile kernel, but have no split-j kernel (see has_splitj_kernel).
+
         red_formula = self.red_formula
         dtype = self.dtype
+        dtypeacc = self.dtypeacc
         varloader = self.varloader
 
         i = self.i
@@ -38,16 +77,65 @@ class GpuReduc1D(MapReduce, Gpu_link_compile):
         yjloc = c_array(dtype, varloader.dimy, f"(yj + threadIdx.x * {varloader.dimy})")
         yjrel = c_array(dtype, varloader.dimy, "yjrel")
         table = varloader.table(self.xi, yjrel, self.param_loc)
-        jreltile = c_variable("int", "(jrel + tile * blockDim.x)")
 
-        self.code = f"""
-                          
-                        {self.headers}
-                        
-                        extern "C" __global__ void GpuConv1DOnDevice(int nx, int ny, {dtype} *out, {dtype} **{arg.id}) {{
+        jrange = ""
+        jload = j
+        init_tmp = sum_scheme.initialize_temporary_accumulator_first_init()
+        if tile:
+            jreltile = c_variable("int", "(joffset + jrel + tile * blockDim.x)")
+            acci = c_array(dtypeacc, red_formula.dimred, f"(acc_io + {c_index('i')} * {red_formula.dimred})")
+            signature = f"GpuConv1DOnDevice_tile(int nx, int ny, int joffset, int first, int last, {dtypeacc} *acc_io, {self.dtype_io} *out, {self.dtype_io} **{arg.id})"
+            init_acc = f"""if (first) {{
+                              {red_formula.InitializeReduction(acc)}
+                            }} else {{
+                              {VectCopy(acc, acci)}
+                            }}"""
+            final_acc = f"""if (last) {{
+                              {red_formula.FinalizeOutput(acc, outi, i)}
+                            }} else {{
+                              {VectCopy(acci, acc)}
+                            }}"""
+            if isinstance(sum_scheme, kahan_scheme):
+                dim_kahan = red_formula.dim_kahan
+                tmpi = c_array(
+                    dtypeacc,
+                    dim_kahan,
+                    f"(acc_io + {c_index('nx')} * {red_formula.dimred} + {c_index('i')} * {dim_kahan})",
+                )
+                init_tmp = f"""if (first) {{
+                                 {init_tmp}
+                               }} else {{
+                                 {VectCopy(sum_scheme.tmp_acc, tmpi)}
+                               }}"""
+                final_acc += f"""
+                            if (!last) {{
+                              {VectCopy(tmpi, sum_scheme.tmp_acc)}
+                            }}"""
+        elif splitj:
+            jreltile = c_variable("int", "(joffset + jrel + tile * blockDim.x)")
+            accB = c_array(
+                dtype,
+                red_formula.dimred,
+                f"(outB + ({c_index('blockIdx.y')} * nx + i) * {red_formula.dimred})",
+            )
+            signature = f"GpuConv1DOnDevice_splitj(int nx, int ny, int jchunk, {dtype} *outB, {self.dtype_io} **{arg.id})"
+            init_acc = f"{red_formula.InitializeReduction(acc)} // acc = 0"
+            final_acc = VectCopy(accB, acc)
+            # ny is then the number of j indices of the line of blocks, starting at joffset
+            jrange = "int joffset = blockIdx.y * jchunk;\nny = min(jchunk, ny - joffset);"
+            jload = c_variable("int", "(joffset + j)")
+        else:
+            jreltile = c_variable("int", "(jrel + tile * blockDim.x)")
+            signature = f"GpuConv1DOnDevice(int nx, int ny, {self.dtype_io} *out, {self.dtype_io} **{arg.id})"
+            init_acc = f"{red_formula.InitializeReduction(acc)} // acc = 0"
+            final_acc = red_formula.FinalizeOutput(acc, outi, i)
+
+        return f"""
+                        extern "C" __global__ void {signature} {{
     
                           // get the index of the current thread
                           int i = blockIdx.x * blockDim.x + threadIdx.x;
+                          {jrange}
 
                           // declare shared mem
                           extern __shared__ {dtype} yj[];
@@ -62,8 +150,8 @@ class GpuReduc1D(MapReduce, Gpu_link_compile):
                           {sum_scheme.declare_temporary_accumulator()}
 
                           if (i < nx) {{
-                            {red_formula.InitializeReduction(acc)} // acc = 0
-                            {sum_scheme.initialize_temporary_accumulator_first_init()}
+                            {init_acc}
+                            {init_tmp}
                             {varloader.load_vars('i', xi, args, row_index=i)} // load xi variables from global memory to local thread memory
                           }}
 
@@ -73,7 +161,7 @@ class GpuReduc1D(MapReduce, Gpu_link_compile):
                             int j = tile * blockDim.x + threadIdx.x;
 
                             if (j < ny) {{ // we load yj from device global memory only if j<ny
-                              {varloader.load_vars("j", yjloc, args, row_index=j)} 
+                              {varloader.load_vars("j", yjloc, args, row_index=jload)} 
                             }}
                             __syncthreads();
 
@@ -89,7 +177,7 @@ class GpuReduc1D(MapReduce, Gpu_link_compile):
                             __syncthreads();
                           }}
                           if (i < nx) {{
-                            {red_formula.FinalizeOutput(acc, outi, i)} 
+                            {final_acc}
                           }}
 
                         }}
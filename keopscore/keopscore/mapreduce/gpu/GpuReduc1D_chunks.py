@@ -1,5 +1,6 @@
 from keopscore import cuda_block_size
 from keopscore.config.chunks import dimchunk
+from keopscore.config.indices import c_index
 from keopscore.binders.nvrtc.Gpu_link_compile import Gpu_link_compile
 from keopscore.formulas.reductions.sum_schemes import *
 from keopscore.mapreduce.gpu.GpuAssignZero import GpuAssignZero
@@ -250,13 +251,15 @@ class GpuReduc1D_chunks(MapReduce, Gpu_link_compile):
             foutj,
         )
         fout_tmp = c_array(dtype, chk.dimfout, "fout_tmp")
-        outi = c_array(dtype, chk.dimout, f"(out + i * {chk.dimout})")
+        outi = c_array(
+            self.dtype_io, chk.dimout, f"(out + {c_index('i')} * {chk.dimout})"
+        )
 
         self.code = f"""
                           
                         {self.headers}
                         
-                        extern "C" __global__ void GpuConv1DOnDevice(int nx, int ny, {dtype} *out, {dtype} **{arg.id}) {{
+                        extern "C" __global__ void GpuConv1DOnDevice(int nx, int ny, {self.dtype_io} *out, {self.dtype_io} **{arg.id}) {{
     
                           // get the index of the current thread
                           int i = blockIdx.x * blockDim.x + threadIdx.x;
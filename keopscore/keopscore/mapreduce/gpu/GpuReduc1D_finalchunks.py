@@ -1,5 +1,6 @@
 from keopscore import cuda_block_size
 from keopscore.config.chunks import dimfinalchunk
+from keopscore.config.indices import c_index
 from keopscore.binders.nvrtc.Gpu_link_compile import Gpu_link_compile
 from keopscore.formulas.reductions.Sum_Reduction import Sum_Reduction
 from keopscore.formulas.reductions.sum_schemes import *
@@ -63,7 +64,7 @@ def do_finalchunk_sub(
                 if ({i.id} < {nx.id}) {{
                     {use_pragma_unroll()}
                     for (int k=0; k<{dimfinalchunk_curr}; k++)
-                        {out.id}[i*{dimout}+{chunk.id}*{dimfinalchunk}+k] += {acc.id}[k];
+                        {out.id}[{c_index('i')}*{dimout}+{chunk.id}*{dimfinalchunk}+k] += {acc.id}[k];
                 }}
                 __syncthreads();
             """
@@ -193,7 +194,7 @@ class GpuReduc1D_finalchunks(MapReduce, Gpu_link_compile):
                               {load_vars(dimsx, indsi, xi, args, row_index=i)} // load xi variables from global memory to local thread memory
                               {use_pragma_unroll()}
                               for (int k=0; k<{dimout}; k++) {{
-                                  out[i*{dimout}+k] = 0.0f;
+                                  out[{c_index('i')}*{dimout}+k] = 0.0f;
                               }}
                           }}
                           
@@ -0,0 +1,180 @@
+from keopscore.formulas.reductions.KMin_ArgKMin_Reduction import KMin_ArgKMin_Reduction
+from keopscore.mapreduce.gpu.GpuReduc1D import GpuReduc1D
+from keopscore.utils.code_gen_utils import (
+    c_array,
+    infinity,
+    use_pragma_unroll,
+)
+
+
+class GpuReduc1D_knn(GpuReduc1D):
+    # Variant of the 1D scheme for the K-nearest-neighbors reductions (KMin, ArgKMin and
+    # KMin_ArgKMin) of scalar formulas, for large values of K : in the 1D scheme, each thread keeps
+    # its K best values in registers and inserts each new value with a sequential insertion sort,
+    # which spills registers and diverges for large K.
+    # Here each warp computes one row of the output : the 32 lanes evaluate the formula for 32
+    # consecutive columns, and the sorted list of the K best (value, index) pairs of the row is kept
+    # in shared memory, with the value of its K-th element as a threshold. The values which are
+    # not below the threshold are discarded with a single warp vote, which is the common case once
+    # the list is filled ; the others are inserted one by one in increasing order of j, the warp
+    # computing the insertion position with ballots and shifting the list in parallel.
+    # The result is the same as the one of the 1D scheme, including the order of ties.
+    # The number of threads per row is exported in the module as KeOps_threads_per_row,
+    # which the binder reads to compute the grid size, and block sizes must be multiples of 32,
+    # which is exported as KeOps_block_multiple.
+    #
+    # Layout of the shared memory, for a block of B threads :
+    #   yj  : B x dimy        the current tile of the j variables, as in the 1D scheme
+    #   knn : B/32 x 2K       the sorted lists of the rows of the warps, with the layout of the
+    #                         accumulator of KMin_ArgKMin_Reduction (values and indices interleaved)
+
+    # below min_K, the insertion sort of the 1D scheme in registers is faster ; above max_K,
+    # the lists use too much shared memory for large blocks.
+    min_K, max_K = 16, 256
+    # the split-j kernel of GpuReduc1D would use the insertion sort of the 1D scheme
+    has_splitj_kernel = False
+
+    @classmethod
+    def applies(cls, red_formula, nargs, dtype, dtypeacc, *args):
+        use_half = args[-2]
+        return (
+            isinstance(red_formula, KMin_ArgKMin_Reduction)
+            and red_formula.formula.dim == 1
+            and cls.min_K <= red_formula.K <= cls.max_K
+            and dtype in ("float", "double")
+            and dtypeacc == dtype
+            and not use_half
+        )
+
+    def __init__(self, *args):
+        super().__init__(*args)
+        # each thread holds 2K/32 elements of the list of its warp
+        K = self.red_formula.K
+        self.dimy = self.varloader.dimy + (2 * K + 31) // 32
+
+    def get_code(self):
+        super().get_code()
+        self.code += f"""
+                        extern "C" {{ __device__ int KeOps_threads_per_row = 32; }}
+                        extern "C" {{ __device__ int KeOps_block_multiple = 32; }}
+                    """
+
+    def get_kernel_code(self, tile=False):
+        # The out-of-core kernel GpuConv1DOnDevice_tile is the one of the 1D scheme
+        if tile:
+            return super().get_kernel_code(tile=True)
+
+        red_formula = self.red_formula
+        dtype = self.dtype
+        varloader = self.varloader
+        K = red_formula.K
+        # number of elements of the list handled by each lane
+        nchunks = (K + 31) // 32
+
+        i = self.i
+        fout = self.fout
+        outi = self.outi
+        xi = self.xi
+        args = self.args
+        param_loc = self.param_loc
+
+        yjloc = c_array(dtype, varloader.dimy, f"(yj + threadIdx.x * {varloader.dimy})")
+        yjrel = c_array(dtype, varloader.dimy, "yjrel")
+        knn = c_array(dtype, 2 * K, "knn")
+        inf = infinity(dtype)
+
+        return f"""
+                        extern "C" __global__ void GpuConv1DOnDevice(int nx, int ny, {self.dtype_io} *out, {self.dtype_io} **{self.arg.id}) {{
+
+                          // each warp computes one row
+                          int lane = threadIdx.x % 32, warp = threadIdx.x / 32;
+                          int i = blockIdx.x * (blockDim.x / 32) + warp;
+
+                          // declare shared mem
+                          extern __shared__ {dtype} yj[];
+                          {dtype} *knn = yj + blockDim.x * {varloader.dimy} + warp * {2 * K};
+
+                          // load parameters variables from global memory to local thread memory
+                          {param_loc.declare()}
+                          {varloader.load_vars("p", param_loc, args)}
+
+                          {fout.declare()}
+                          {xi.declare()}
+
+                          if (i < nx) {{
+                            {varloader.load_vars('i', xi, args, row_index=i)} // load xi variables from global memory to local thread memory
+                          }}
+                          for (int l = lane; l < {K}; l += 32) {{
+                            knn[2 * l] = {inf};
+                            knn[2 * l + 1] = 0;
+                          }}
+                          // value of the K-th element of the list, the same for all the lanes
+                          {dtype} threshold = {inf};
+                          __syncwarp();
+
+                          for (int jstart = 0, tile = 0; jstart < ny; jstart += blockDim.x, tile++) {{
+
+                            // get the current column
+                            int j = tile * blockDim.x + threadIdx.x;
+                            int jtile = min(blockDim.x, ny - jstart);
+
+                            if (j < ny) {{ // we load yj from device global memory only if j<ny
+                              {varloader.load_vars("j", yjloc, args, row_index=self.j)}
+                            }}
+                            __syncthreads();
+
+                            if (i < nx) {{ // N.B. the condition is the same for all the lanes of the warp
+                              for (int jsub = 0; jsub < jtile; jsub += 32) {{
+                                int jrel = jsub + lane;
+                                {dtype} value = {inf};
+                                if (jrel < jtile) {{
+                                  {dtype} *yjrel = yj + jrel * {varloader.dimy};
+                                  {red_formula.formula(fout, varloader.table(xi, yjrel, param_loc))} // Call the function, which outputs results in fout
+                                  value = fout[0];
+                                }}
+                                unsigned candidates = __ballot_sync(0xffffffffu, value < threshold);
+                                while (candidates) {{
+                                  int src = __ffs(candidates) - 1;
+                                  candidates &= candidates - 1;
+                                  {dtype} v = __shfl_sync(0xffffffffu, value, src);
+                                  // the threshold may have decreased since the vote
+                                  if (v < threshold) {{
+                                    // position of v in the list, after the values which are equal to it
+                                    int pos = 0;
+                                    {dtype} shifted[{nchunks}][2];
+                                    {use_pragma_unroll(None)}
+                                    for (int c = 0; c < {nchunks}; c++) {{
+                                      int l = 32 * c + lane;
+                                      pos += __popc(__ballot_sync(0xffffffffu, l < {K} && knn[2 * l] <= v));
+                                      if (l > 0 && l < {K}) {{
+                                        shifted[c][0] = knn[2 * l - 2];
+                                        shifted[c][1] = knn[2 * l - 1];
+                                      }}
+                                    }}
+                                    __syncwarp();
+                                    {use_pragma_unroll(None)}
+                                    for (int c = 0; c < {nchunks}; c++) {{
+                                      int l = 32 * c + lane;
+                                      if (l > pos && l < {K}) {{
+                                        knn[2 * l] = shifted[c][0];
+                                        knn[2 * l + 1] = shifted[c][1];
+                                      }} else if (l == pos) {{
+                                        knn[2 * l] = v;
+                                        knn[2 * l + 1] = jstart + jsub + src;
+                                      }}
+                                    }}
+                                    __syncwarp();
+                                    threshold = knn[{2 * (K - 1)}];
+                                  }}
+                                }}
+                              }}
+                            }}
+                            __syncthreads();
+                          }}
+
+                          if (i < nx && lane == 0) {{
+                            {red_formula.FinalizeOutput(knn, outi, i)}
+                          }}
+
+                        }}
+                    """
@@ -1,6 +1,7 @@
 from keopscore.binders.nvrtc.Gpu_link_compile import Gpu_link_compile
 from keopscore.mapreduce.gpu.GpuAssignZero import GpuAssignZero
 from keopscore.mapreduce.MapReduce import MapReduce
+from keopscore.mapreduce.gpu.ranges_lookup import ranges_lookup_code
 from keopscore.utils.code_gen_utils import (
     c_variable,
     c_array,
@@ -70,9 +71,12 @@ class GpuReduc1D_ranges(MapReduce, Gpu_link_compile):
         self.code = f"""
                         {self.headers}
 
-                        extern "C" __global__ void GpuConv1DOnDevice_ranges(int nx, int ny, int nbatchdims,
+                        {ranges_lookup_code}
+
+                        // computes block "block" of the lookup table
+                        __device__ __forceinline__ void GpuConv1DOnDevice_ranges_block(int block, int nx, int ny, int nbatchdims,
                                                     int *offsets_d, int *lookup_d, int *slices_x,
-                                                    int *ranges_y, {dtype} *out, {dtype} **{arg.id}) {{
+                                                    int *ranges_y, {self.dtype_io} *out, {self.dtype_io} **{arg.id}) {{
                                                         
                           int offsets[{nvars}];
                           {declare_assign_indices_i}
@@ -81,11 +85,15 @@ class GpuReduc1D_ranges(MapReduce, Gpu_link_compile):
                           
                           if (nbatchdims > 0)
                               for (int k = 0; k < {nvars}; k++)
-                                  offsets[k] = offsets_d[ {nvars} * blockIdx.x + k ];
+                                  offsets[k] = offsets_d[ {nvars} * block + k ];
                           // Retrieve our position along the laaaaarge [1,~nx] axis: -----------------
-                          int range_id= (lookup_d)[3*blockIdx.x] ;
-                          int start_x = (lookup_d)[3*blockIdx.x+1] ;
-                          int end_x   = (lookup_d)[3*blockIdx.x+2] ;
+                          int range_id= (lookup_d)[3*block] ;
+                          int start_x = (lookup_d)[3*block+1] ;
+                          int end_x   = (lookup_d)[3*block+2] ;
+
+                          // the blocks beyond the end of a lookup table built on the device are empty
+                          if (start_x >= end_x)
+                              return;
   
                           // The "slices_x" vector encodes a set of cutting points in
                           // the "ranges_y" array of ranges.
@@ -166,4 +174,35 @@ class GpuReduc1D_ranges(MapReduce, Gpu_link_compile):
                           	{red_formula.FinalizeOutput(acc, outi, i)} 
                           }}
                       }}
+
+                      // one block per block of the lookup table
+                      extern "C" __global__ void GpuConv1DOnDevice_ranges(int nx, int ny, int nbatchdims,
+                                                  int *offsets_d, int *lookup_d, int *slices_x,
+                                                  int *ranges_y, {self.dtype_io} *out, {self.dtype_io} **{arg.id}) {{
+                          GpuConv1DOnDevice_ranges_block(blockIdx.x, nx, ny, nbatchdims, offsets_d, lookup_d,
+                                                         slices_x, ranges_y, out, {arg.id});
+                      }}
+
+                      // Persistent version, for lookup tables with many more blocks than the GPU can run at once
+                      // (e.g. large batches of small problems) : the grid only has as many blocks as can be
+                      // resident on the device, and each of them pulls the blocks of the lookup table from a
+                      // queue, which is the counter *queue (set to 0 before the launch), until all nblocks
+                      // blocks of the table have been computed.
+                      extern "C" __global__ void GpuConv1DOnDevice_ranges_persistent(int nx, int ny, int nbatchdims,
+                                                  int *offsets_d, int *lookup_d, int *slices_x,
+                                                  int *ranges_y, {self.dtype_io} *out, {self.dtype_io} **{arg.id},
+                                                  int nblocks, int *queue) {{
+                          __shared__ int next_block;
+                          while (true) {{
+                              if (threadIdx.x == 0)
+                                  next_block = atomicAdd(queue, 1);
+                              __syncthreads();
+                              int block = next_block;
+                              __syncthreads();
+                              if (block >= nblocks)
+                                  return;
+                              GpuConv1DOnDevice_ranges_block(block, nx, ny, nbatchdims, offsets_d, lookup_d,
+                                                             slices_x, ranges_y, out, {arg.id});
+                          }}
+                      }}
                     """
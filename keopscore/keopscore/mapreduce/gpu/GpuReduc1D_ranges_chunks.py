@@ -1,9 +1,11 @@
 from keopscore import cuda_block_size
 from keopscore.config.chunks import dimchunk
+from keopscore.config.indices import c_index
 from keopscore.binders.nvrtc.Gpu_link_compile import Gpu_link_compile
 from keopscore.formulas.reductions.sum_schemes import *
 from keopscore.mapreduce.gpu.GpuAssignZero import GpuAssignZero
 from keopscore.mapreduce.MapReduce import MapReduce
+from keopscore.mapreduce.gpu.ranges_lookup import ranges_lookup_code
 from keopscore.utils.code_gen_utils import (
     load_vars,
     load_vars_chunks,
@@ -356,17 +358,21 @@ class GpuReduc1D_ranges_chunks(MapReduce, Gpu_link_compile):
             foutj,
         )
         fout_tmp = c_array(dtype, chk.dimfout, "fout_tmp")
-        outi = c_array(dtype, chk.dimout, f"(out + i * {chk.dimout})")
+        outi = c_array(
+            self.dtype_io, chk.dimout, f"(out + {c_index('i')} * {chk.dimout})"
+        )
 
         threadIdx_x = c_variable("int", "threadIdx.x")
 
         self.code = f"""
                           
                         {self.headers}
+
+                        {ranges_lookup_code}
                         
                         extern "C" __global__ void GpuConv1DOnDevice_ranges(int nx, int ny, int nbatchdims,
                                                     int *offsets_d, int *lookup_d, int *slices_x,
-                                                    int *ranges_y, {dtype} *out, {dtype} **{arg.id}) {{
+                                                    int *ranges_y, {self.dtype_io} *out, {self.dtype_io} **{arg.id}) {{
                                                         
                           int offsets[{nvars}];
                           {declare_assign_indices_i}
@@ -381,6 +387,10 @@ class GpuReduc1D_ranges_chunks(MapReduce, Gpu_link_compile):
                           int range_id= (lookup_d)[3*blockIdx.x] ;
                           int start_x = (lookup_d)[3*blockIdx.x+1] ;
                           int end_x   = (lookup_d)[3*blockIdx.x+2] ;
+
+                          // the blocks beyond the end of a lookup table built on the device are empty
+                          if (start_x >= end_x)
+                              return;
                           
                           // The "slices_x" vector encodes a set of cutting points in
                           // the "ranges_y" array of ranges.
@@ -1,10 +1,12 @@
 from keopscore import cuda_block_size
 from keopscore.config.chunks import dimfinalchunk
+from keopscore.config.indices import c_index
 from keopscore.binders.nvrtc.Gpu_link_compile import Gpu_link_compile
 from keopscore.formulas.reductions.Sum_Reduction import Sum_Reduction
 from keopscore.formulas.reductions.sum_schemes import *
 from keopscore.mapreduce.gpu.GpuAssignZero import GpuAssignZero
 from keopscore.mapreduce.MapReduce import MapReduce
+from keopscore.mapreduce.gpu.ranges_lookup import ranges_lookup_code
 from keopscore.utils.code_gen_utils import (
     load_vars,
     load_vars_chunks,
@@ -85,7 +87,7 @@ def do_finalchunk_sub_ranges(
                 if ({i.id} < {end_x.id}) {{
                     {use_pragma_unroll()}
                     for (int k=0; k<{dimfinalchunk_curr}; k++)
-                        {out.id}[i*{dimout}+{chunk.id}*{dimfinalchunk}+k] += {acc.id}[k];
+                        {out.id}[{c_index('i')}*{dimout}+{chunk.id}*{dimfinalchunk}+k] += {acc.id}[k];
                 }}
                 __syncthreads();
             """
@@ -240,6 +242,8 @@ class GpuReduc1D_ranges_finalchunks(MapReduce, Gpu_link_compile):
         self.code = f"""
                           
                         {self.headers}
+
+                        {ranges_lookup_code}
                         
                         extern "C" __global__ void GpuConv1DOnDevice_ranges(int nx, int ny, int nbatchdims,
                                                     int *offsets_d, int *lookup_d, int *slices_x,
@@ -260,6 +264,10 @@ class GpuReduc1D_ranges_finalchunks(MapReduce, Gpu_link_compile):
                           int range_id= (lookup_d)[3*blockIdx.x] ;
                           int start_x = (lookup_d)[3*blockIdx.x+1] ;
                           int end_x   = (lookup_d)[3*blockIdx.x+2] ;
+
+                          // the blocks beyond the end of a lookup table built on the device are empty
+                          if (start_x >= end_x)
+                              return;
                           
                           // The "slices_x" vector encodes a set of cutting points in
                           // the "ranges_y" array of ranges.
@@ -291,7 +299,7 @@ class GpuReduc1D_ranges_finalchunks(MapReduce, Gpu_link_compile):
                               
                               {use_pragma_unroll()}
                               for (int k=0; k<{dimout}; k++) {{
-                                  out[i*{dimout}+k] = 0.0f;
+                                  out[{c_index('i')}*{dimout}+k] = 0.0f;
                               }}
                           }}
                           
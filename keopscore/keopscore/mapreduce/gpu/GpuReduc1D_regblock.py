@@ -0,0 +1,154 @@
+from keopscore.formulas.reductions.sum_schemes import *
+from keopscore.mapreduce.gpu.GpuReduc1D import GpuReduc1D
+from keopscore.utils.code_gen_utils import (
+    c_variable,
+    c_array,
+    Var_loader,
+)
+
+
+class GpuReduc1D_regblock(GpuReduc1D):
+    # Register blocked variant of the 1D scheme : each thread computes several rows of the output,
+    # holding their i variables and accumulators in registers, so that each y_j read from shared memory
+    # is used for all these rows. This is faster for low dimensional formulas, which are limited
+    # by the bandwidth of shared memory rather than by arithmetic.
+    # The rows of a thread are blockDim.x apart, so that accesses to global memory are still coalesced.
+    # The number of rows per thread is exported in the module as KeOps_rows_per_thread,
+    # which the binder reads to compute the grid size.
+
+    # registers available for the state of the rows of a thread (i variables and accumulators)
+    register_budget = 64
+    max_rows_per_thread = 4
+    # above this dimension of the j variables, formulas are usually not limited by shared memory
+    max_dimy = 16
+    # the split-j kernel of GpuReduc1D computes one row per thread
+    has_splitj_kernel = False
+
+    @classmethod
+    def rows_per_thread(cls, red_formula):
+        varloader = Var_loader(red_formula)
+        if varloader.dimy > cls.max_dimy:
+            return 1
+        # accumulators are counted twice, for the temporary accumulators of the sum schemes
+        row_size = max(1, varloader.dimx + 2 * red_formula.dimred)
+        return max(1, min(cls.max_rows_per_thread, cls.register_budget // row_size))
+
+    def get_code(self):
+        self.R = self.rows_per_thread(self.red_formula)
+        super().get_code()
+        self.code += f"""
+                        extern "C" {{ __device__ int KeOps_rows_per_thread = {self.R}; }}
+                    """
+
+    def get_kernel_code(self, tile=False):
+        # The out-of-core kernel GpuConv1DOnDevice_tile is the one of the 1D scheme
+        if tile:
+            return super().get_kernel_code(tile=True)
+
+        R = self.R
+        red_formula = self.red_formula
+        dtype = self.dtype
+        dtypeacc = self.dtypeacc
+        varloader = self.varloader
+
+        fout = self.fout
+        outi = self.outi
+        arg = self.arg
+        args = self.args
+        param_loc = self.param_loc
+
+        yjloc = c_array(dtype, varloader.dimy, f"(yj + threadIdx.x * {varloader.dimy})")
+        yjrel = c_array(dtype, varloader.dimy, "yjrel")
+        jreltile = c_variable("int", "(jrel + tile * blockDim.x)")
+
+        # i variables, accumulator and sum scheme of each row of the thread
+        xis = [c_array(dtype, varloader.dimx, f"xi_{r}") for r in range(R)]
+        accs = [c_array(dtypeacc, red_formula.dimred, f"acc_{r}") for r in range(R)]
+        sum_schemes = []
+        for r in range(R):
+            sum_scheme = eval(self.sum_scheme_string)(red_formula, dtype)
+            if hasattr(sum_scheme, "tmp_acc"):
+                sum_scheme.tmp_acc = c_array(
+                    sum_scheme.tmp_acc.dtype, sum_scheme.tmp_acc.dim, f"tmp_{r}"
+                )
+            sum_schemes.append(sum_scheme)
+
+        def for_rows(fun):
+            # code of fun(r) for each row r < nx of the thread, with i set to the index of the row
+            code = ""
+            for r in range(R):
+                code += f"""{{
+                              int i = ifirst + {r} * blockDim.x;
+                              if (i < nx) {{
+                                {fun(r)}
+                              }}
+                            }}
+                            """
+            return code
+
+        declare_rows = "".join(
+            xis[r].declare()
+            + accs[r].declare()
+            + sum_schemes[r].declare_temporary_accumulator()
+            for r in range(R)
+        )
+
+        init_rows = for_rows(
+            lambda r: f"""{red_formula.InitializeReduction(accs[r])} // acc = 0
+                          {sum_schemes[r].initialize_temporary_accumulator_first_init()}
+                          {varloader.load_vars('i', xis[r], args, row_index=self.i)}"""
+        )
+
+        # N.B. rows beyond nx are computed on garbage data, but never written
+        compute_rows = "".join(
+            f"""{{
+                    {red_formula.formula(fout, varloader.table(xis[r], yjrel, param_loc))}
+                    {sum_schemes[r].accumulate_result(accs[r], fout, jreltile)}
+                }}
+                """
+            for r in range(R)
+        )
+
+        return f"""
+                        extern "C" __global__ void GpuConv1DOnDevice(int nx, int ny, {self.dtype_io} *out, {self.dtype_io} **{arg.id}) {{
+
+                          // index of the first row of the current thread
+                          int ifirst = blockIdx.x * blockDim.x * {R} + threadIdx.x;
+
+                          // declare shared mem
+                          extern __shared__ {dtype} yj[];
+
+                          // load parameters variables from global memory to local thread memory
+                          {param_loc.declare()}
+                          {varloader.load_vars("p", param_loc, args)}
+
+                          {fout.declare()}
+                          {declare_rows}
+
+                          {init_rows}
+
+                          for (int jstart = 0, tile = 0; jstart < ny; jstart += blockDim.x, tile++) {{
+
+                            // get the current column
+                            int j = tile * blockDim.x + threadIdx.x;
+
+                            if (j < ny) {{ // we load yj from device global memory only if j<ny
+                              {varloader.load_vars("j", yjloc, args, row_index=self.j)}
+                            }}
+                            __syncthreads();
+
+                            if (ifirst < nx) {{ // we compute only if needed
+                              {dtype} * yjrel = yj;
+                              {"".join(s.initialize_temporary_accumulator_block_init() for s in sum_schemes)}
+                              for (int jrel = 0; (jrel < blockDim.x) && (jrel < ny - jstart); jrel++, yjrel += {varloader.dimy}) {{
+                                {compute_rows}
+                              }}
+                              {"".join(sum_schemes[r].final_operation(accs[r]) for r in range(R))}
+                            }}
+                            __syncthreads();
+                          }}
+
+                          {for_rows(lambda r: red_formula.FinalizeOutput(accs[r], outi, self.i))}
+
+                        }}
+                    """
@@ -0,0 +1,329 @@
+import copy
+
+from keopscore.config.indices import c_index
+from keopscore.formulas.reductions.sum_schemes import *
+from keopscore.formulas.maths.Mult import Mult_Impl
+from keopscore.formulas.maths.Scalprod import Scalprod_Impl
+from keopscore.formulas.maths.Square import Square_Impl
+from keopscore.formulas.maths.Subtract import Subtract_Impl
+from keopscore.formulas.maths.Sum import Sum_Impl
+from keopscore.formulas.variables.Var import Var
+from keopscore.mapreduce.gpu.GpuReduc1D import GpuReduc1D
+from keopscore.utils.code_gen_utils import (
+    c_variable,
+    c_array,
+    Var_loader,
+    use_pragma_unroll,
+)
+from keopscore.utils.gpu_utils import get_gpu_compute_capability
+
+
+def gram_operands(node, tagI, tagJ):
+    # If node is a squared distance between an "i" variable x and a "j" variable y, written as
+    # SqDist(x,y) (i.e. (x-y)|(x-y)) or Sum((x-y)**2), or an inner product x|y or Sum(x*y),
+    # returns x, y and a boolean telling if node is a squared distance.
+    if isinstance(node, Scalprod_Impl):
+        a, b = node.children
+    elif isinstance(node, Sum_Impl) and isinstance(node.children[0], Square_Impl):
+        a = b = node.children[0].children[0]
+    elif isinstance(node, Sum_Impl) and isinstance(node.children[0], Mult_Impl):
+        a, b = node.children[0].children
+    else:
+        return None
+    if a == b and isinstance(a, Subtract_Impl):
+        (u, v), is_sqdist = a.children, True
+    else:
+        (u, v), is_sqdist = (a, b), False
+    if not (isinstance(u, Var) and isinstance(v, Var) and u.dim == v.dim):
+        return None
+    if (u.cat, v.cat) == (tagI, tagJ):
+        return u, v, is_sqdist
+    elif (u.cat, v.cat) == (tagJ, tagI):
+        return v, u, is_sqdist
+    return None
+
+
+def find_gram_node(formula, tagI, tagJ):
+    # returns the first node of the formula for which gram_operands applies, or None
+    if gram_operands(formula, tagI, tagJ) is not None:
+        return formula
+    for child in formula.children:
+        node = find_gram_node(child, tagI, tagJ)
+        if node is not None:
+            return node
+    return None
+
+
+class GpuReduc1D_tensorcore(GpuReduc1D):
+    # Variant of the 1D scheme for formulas built on a squared distance SqDist(x,y) or an inner product
+    # x|y between an "i" variable x and a "j" variable y, such as Exp(-g*SqDist(x,y))*b :
+    # each warp computes the inner products <x_i,y_j> for its 32 rows and a tile of 16 columns
+    # with TF32 tensor core instructions (mma.sync m16n8k8, with float accumulation), and then
+    # each thread evaluates the rest of the formula and the reduction for its row, using
+    # |x_i|^2 + |y_j|^2 - 2<x_i,y_j> for the squared distance. The distance matrix is never stored.
+    # The operands of the mma are rounded to TF32 (10 bits mantissa) ; the norms are computed on
+    # the rounded values, so that the squared distance is the exact one for the rounded points
+    # up to float rounding errors. This mode is enabled by setting KEOPS_TENSOR_CORES=1.
+    # Block sizes must be multiples of 32, which is exported in the module as KeOps_block_multiple.
+    #
+    # Layout of the shared memory, for a block of B threads (this is B*dimy floats) :
+    #   ys     : B x ldy        the current tile of y, rounded to TF32 (row j of the tile = y_j)
+    #   gram   : B x ldgram     the inner products computed by each warp, for its 32 rows and 16 columns
+    #   normy  : B              squared norms of the rounded y_j
+    #   yj     : B x dimy_post  the other "j" variables of the formula, as in the 1D scheme
+
+    # supported dimensions of x and y : multiples of the k dimension of the mma, large enough
+    # for the tensor cores to be worth it ; above max_dim, the i operands do not fit in registers.
+    min_dim, max_dim = 32, 128
+    # number of columns of the tiles computed by the warps (two n8 mma tiles)
+    ncols_tile = 16
+    # static shared memory limit, used to ensure that blocks of 32 threads fit on any device
+    shared_mem_limit = 49152
+    # the split-j kernel of GpuReduc1D does not use the tensor cores
+    has_splitj_kernel = False
+
+    @classmethod
+    def post_formula_and_operands(cls, red_formula):
+        # the formula with the squared distance (or inner product) replaced by a scalar variable
+        # of category 3, which is computed from the tensor core products
+        tagI, tagJ = red_formula.tagI, red_formula.tagJ
+        formula = red_formula.formula
+        node = find_gram_node(formula, tagI, tagJ)
+        if node is None:
+            return None
+        x, y, is_sqdist = gram_operands(node, tagI, tagJ)
+        gram_var = Var(Var_loader(red_formula).nminargs, 1, 3)
+        post_formula = formula.replace(node, gram_var)
+        post_red_formula = copy.copy(red_formula)
+        post_red_formula.formula = post_formula
+        post_red_formula.children = [post_formula]
+        post_red_formula.Vars_ = post_formula.Vars_
+        return post_red_formula, gram_var, x, y, is_sqdist
+
+    @classmethod
+    def shared_floats_per_thread(cls, D, dimy_post):
+        return (D + 4) + (cls.ncols_tile + 1) + 1 + dimy_post
+
+    @classmethod
+    def applies(cls, red_formula, nargs, dtype, dtypeacc, *args):
+        use_half, device_id = args[-2], args[-1]
+        if dtype != "float" or use_half:
+            return False
+        res = cls.post_formula_and_operands(red_formula)
+        if res is None:
+            return False
+        post_red_formula, gram_var, x, y, is_sqdist = res
+        D = x.dim
+        if D % 8 != 0 or not cls.min_dim <= D <= cls.max_dim:
+            return False
+        dimy_post = Var_loader(post_red_formula).dimy
+        if 32 * cls.shared_floats_per_thread(D, dimy_post) * 4 > cls.shared_mem_limit:
+            return False
+        # TF32 mma instructions require compute capability 8.0
+        return get_gpu_compute_capability(device_id) >= (8, 0)
+
+    def __init__(self, *args):
+        super().__init__(*args)
+        (
+            self.post_red_formula,
+            self.gram_var,
+            self.x,
+            self.y,
+            self.is_sqdist,
+        ) = self.post_formula_and_operands(self.red_formula)
+        self.post_varloader = Var_loader(self.post_red_formula)
+        self.dimy = self.shared_floats_per_thread(
+            self.x.dim, self.post_varloader.dimy
+        )
+
+    def get_code(self):
+        super().get_code()
+        self.code += f"""
+                        extern "C" {{ __device__ int KeOps_block_multiple = 32; }}
+                    """
+
+    def get_kernel_code(self, tile=False):
+        # The out-of-core kernel GpuConv1DOnDevice_tile is the one of the 1D scheme
+        if tile:
+            return super().get_kernel_code(tile=True)
+
+        red_formula = self.red_formula
+        post_formula = self.post_red_formula.formula
+        dtype = self.dtype
+        dtypeacc = self.dtypeacc
+        varloader = self.post_varloader
+
+        i = self.i
+        fout = self.fout
+        outi = self.outi
+        acc = self.acc
+        args = self.args
+        sum_scheme = self.sum_scheme
+        param_loc = self.param_loc
+
+        D = self.x.dim
+        ksteps = D // 8
+        ldy = D + 4  # padding, so that the loads of the mma operands are free of bank conflicts
+        ldgram = self.ncols_tile + 1
+        dimy_post = varloader.dimy
+        xarg, yarg = args[self.x.ind], args[self.y.ind]
+
+        xi = c_array(dtype, varloader.dimx, "xi")
+        yjloc = c_array(dtype, dimy_post, f"(yj + threadIdx.x * {dimy_post})")
+        yjrel = c_array(dtype, dimy_post, "yjrel")
+        gram_ij = c_array(dtype, 1, "gram_ij")
+        table = varloader.table(xi, yjrel, param_loc)
+        table[self.gram_var.ind] = gram_ij
+        jreltile = c_variable("int", "(jrel + tile * blockDim.x)")
+
+        gram_value = f"gram[lane * {ldgram} + jrel - jsub]"
+        if self.is_sqdist:
+            # N.B. the cancellation may give slightly negative values for close points
+            gram_value = f"fmaxf(normx + normy[jrel] - 2.0f * {gram_value}, 0.0f)"
+
+        return f"""
+                        __device__ __forceinline__ unsigned keops_to_tf32(float x) {{
+                          unsigned r;
+                          asm("cvt.rna.tf32.f32 %0, %1;" : "=r"(r) : "f"(x));
+                          return r & 0xffffe000u;
+                        }}
+
+                        // c += a * b for a 16x8 tile c, with a of size 16x8 (row major) and b of size 8x8 (column major)
+                        __device__ __forceinline__ void keops_mma_tf32(float *c, const unsigned *a, unsigned b0, unsigned b1) {{
+                          asm volatile("mma.sync.aligned.m16n8k8.row.col.f32.tf32.tf32.f32 "
+                                       "{{%0,%1,%2,%3}}, {{%4,%5,%6,%7}}, {{%8,%9}}, {{%0,%1,%2,%3}};"
+                                       : "+f"(c[0]), "+f"(c[1]), "+f"(c[2]), "+f"(c[3])
+                                       : "r"(a[0]), "r"(a[1]), "r"(a[2]), "r"(a[3]), "r"(b0), "r"(b1));
+                        }}
+
+                        extern "C" __global__ void GpuConv1DOnDevice(int nx, int ny, {self.dtype_io} *out, {self.dtype_io} **{self.arg.id}) {{
+
+                          // get the index of the current thread
+                          int i = blockIdx.x * blockDim.x + threadIdx.x;
+
+                          // position of the thread in its warp, and in the fragments of the mma
+                          int lane = threadIdx.x % 32, g = lane / 4, t = lane % 4;
+                          // first row of the warp
+                          int iwarp = i - lane;
+
+                          // declare shared mem
+                          extern __shared__ {dtype} smem[];
+                          {dtype} *ys = smem;
+                          {dtype} *gram = ys + blockDim.x * {ldy} + (threadIdx.x / 32) * 32 * {ldgram};
+                          {dtype} *normy = smem + blockDim.x * {ldy + ldgram};
+                          {dtype} *yj = normy + blockDim.x;
+
+                          // load parameters variables from global memory to local thread memory
+                          {param_loc.declare()}
+                          {varloader.load_vars("p", param_loc, args)}
+
+                          {fout.declare()}
+                          {xi.declare()}
+                          {gram_ij.declare()}
+                          {acc.declare()}
+                          {sum_scheme.declare_temporary_accumulator()}
+
+                          // rows iwarp to iwarp+31 of x, as mma operands : xa[m][s] is the tile of
+                          // rows iwarp+16m to iwarp+16m+15 and columns 8s to 8s+7 (zero beyond nx)
+                          unsigned xa[2][{ksteps}][4];
+                          {use_pragma_unroll(None)}
+                          for (int m = 0; m < 2; m++) {{
+                            int r0 = iwarp + 16 * m + g, r1 = r0 + 8;
+                            {use_pragma_unroll(None)}
+                            for (int s = 0; s < {ksteps}; s++) {{
+                              int c0 = 8 * s + t, c1 = c0 + 4;
+                              xa[m][s][0] = r0 < nx ? keops_to_tf32({xarg.id}[{c_index('r0')} * {D} + c0]) : 0u;
+                              xa[m][s][1] = r1 < nx ? keops_to_tf32({xarg.id}[{c_index('r1')} * {D} + c0]) : 0u;
+                              xa[m][s][2] = r0 < nx ? keops_to_tf32({xarg.id}[{c_index('r0')} * {D} + c1]) : 0u;
+                              xa[m][s][3] = r1 < nx ? keops_to_tf32({xarg.id}[{c_index('r1')} * {D} + c1]) : 0u;
+                            }}
+                          }}
+
+                          float normx = 0.0f;
+                          if (i < nx) {{
+                            {red_formula.InitializeReduction(acc)} // acc = 0
+                            {sum_scheme.initialize_temporary_accumulator_first_init()}
+                            {varloader.load_vars('i', xi, args, row_index=i)} // load xi variables from global memory to local thread memory
+                            for (int k = 0; k < {D}; k++) {{
+                              float v = __uint_as_float(keops_to_tf32({xarg.id}[{c_index('i')} * {D} + k]));
+                              normx += v * v;
+                            }}
+                          }}
+
+                          for (int jstart = 0, tile = 0; jstart < ny; jstart += blockDim.x, tile++) {{
+
+                            // get the current column
+                            int j = tile * blockDim.x + threadIdx.x;
+                            int jtile = min(blockDim.x, ny - jstart);
+
+                            // coalesced load of the tile of y, rounded to TF32 (zero beyond ny)
+                            for (int e = threadIdx.x; e < blockDim.x * {D}; e += blockDim.x) {{
+                              int r = e / {D}, c = e % {D};
+                              ys[r * {ldy} + c] = r < jtile ? __uint_as_float(keops_to_tf32({yarg.id}[{c_index('(jstart + r)')} * {D} + c])) : 0.0f;
+                            }}
+                            if (j < ny) {{ // we load yj from device global memory only if j<ny
+                              {varloader.load_vars("j", yjloc, args, row_index=self.j)}
+                            }}
+                            __syncthreads();
+
+                            float sy = 0.0f;
+                            for (int k = 0; k < {D}; k++)
+                              sy += ys[threadIdx.x * {ldy} + k] * ys[threadIdx.x * {ldy} + k];
+                            normy[threadIdx.x] = sy;
+                            __syncthreads();
+
+                            if (iwarp < nx) {{ // N.B. all the threads of the warp take part in the mma
+                              {sum_scheme.initialize_temporary_accumulator_block_init()}
+                              for (int jsub = 0; jsub < jtile; jsub += {self.ncols_tile}) {{
+
+                                // inner products of the 32 rows of the warp with columns jsub to jsub+15
+                                float c[2][2][4];
+                                {use_pragma_unroll(None)}
+                                for (int m = 0; m < 2; m++)
+                                  {use_pragma_unroll(None)}
+                                  for (int n = 0; n < 2; n++)
+                                    c[m][n][0] = c[m][n][1] = c[m][n][2] = c[m][n][3] = 0.0f;
+                                {use_pragma_unroll(None)}
+                                for (int s = 0; s < {ksteps}; s++) {{
+                                  {use_pragma_unroll(None)}
+                                  for (int n = 0; n < 2; n++) {{
+                                    const {dtype} *yb = ys + (jsub + 8 * n + g) * {ldy} + 8 * s + t;
+                                    unsigned b0 = __float_as_uint(yb[0]), b1 = __float_as_uint(yb[4]);
+                                    keops_mma_tf32(c[0][n], xa[0][s], b0, b1);
+                                    keops_mma_tf32(c[1][n], xa[1][s], b0, b1);
+                                  }}
+                                }}
+                                {use_pragma_unroll(None)}
+                                for (int m = 0; m < 2; m++)
+                                  {use_pragma_unroll(None)}
+                                  for (int n = 0; n < 2; n++) {{
+                                    {dtype} *gr = gram + (16 * m + g) * {ldgram} + 8 * n + 2 * t;
+                                    gr[0] = c[m][n][0];
+                                    gr[1] = c[m][n][1];
+                                    gr[8 * {ldgram}] = c[m][n][2];
+                                    gr[8 * {ldgram} + 1] = c[m][n][3];
+                                  }}
+                                __syncwarp();
+
+                                if (i < nx) {{
+                                  for (int jrel = jsub; (jrel < jsub + {self.ncols_tile}) && (jrel < jtile); jrel++) {{
+                                    {dtype} *yjrel = yj + jrel * {dimy_post};
+                                    {gram_ij.id}[0] = {gram_value};
+                                    {post_formula(fout, table)} // Call the function, which outputs results in fout
+                                    {sum_scheme.accumulate_result(acc, fout, jreltile)}
+                                  }}
+                                }}
+                                __syncwarp();
+                              }}
+                              if (i < nx) {{
+                                {sum_scheme.final_operation(acc)}
+                              }}
+                            }}
+                            __syncthreads();
+                          }}
+                          if (i < nx) {{
+                            {red_formula.FinalizeOutput(acc, outi, i)}
+                          }}
+
+                        }}
+                    """
@@ -1,7 +1,9 @@
+from keopscore.config.indices import c_index
 from keopscore.binders.nvrtc.Gpu_link_compile import Gpu_link_compile
 from keopscore.formulas.reductions.sum_schemes import block_sum, kahan_scheme
 from keopscore.mapreduce.gpu.GpuAssignZero import GpuAssignZero
 from keopscore.mapreduce.MapReduce import MapReduce
+from keopscore.mapreduce.gpu.reduce2D import reduce2D_code
 from keopscore.utils.code_gen_utils import c_variable, c_array, use_pragma_unroll
 from keopscore.utils.misc_utils import KeOps_Error
 
@@ -23,14 +25,8 @@ class GpuReduc2D(MapReduce, Gpu_link_compile):
         j = self.j
         red_formula = self.red_formula
         dtype = self.dtype
-        dimin = red_formula.dimred
-        dimout = red_formula.dim
         varloader = self.varloader
         dtypeacc = self.dtypeacc
-        acc2 = c_array(dtypeacc, dimin, "acc2")
-
-        inloc = c_array(dtype, dimin, f"(in + (tid+y*nx)*{dimin})")
-        outloc = c_array(dtype, dimout, f"(out+tid*{dimout})")
 
         dimsx = varloader.dimsx
         dimsy = varloader.dimsy
@@ -67,58 +63,13 @@ class GpuReduc2D(MapReduce, Gpu_link_compile):
 
         jrelloc = c_variable("int", "(blockDim.x*blockIdx.y+jrel)")
 
-        tid = c_variable("int", "tid")
-
         self.code = f"""
                           
                         {self.headers}
                         
-                        extern "C" __global__ void reduce2D({dtype} *in, {dtype} *out, int sizeY, int nx) {{
-                            /* Function used as a final reduction pass in the 2D scheme,
-                             * once the block reductions have been made.
-                             * Takes as input:
-                             * - in,  a  sizeY * (nx * DIMIN ) array
-                             * - out, an          nx * DIMOUT   array
-                             *
-                             * Computes, in parallel, the "columnwise"-reduction (which correspond to lines of blocks)
-                             * of *in and stores the result in out.
-                             */
-                            int tid = blockIdx.x * blockDim.x + threadIdx.x;
-
-                            /* As shown below, the code that is used to store the block-wise sum
-                              "tmp" in parallel is:
-                                if(i<nx)
-                                    for(int k=0; k<DIMX1; k++)
-                                        (*px)[blockIdx.y*DIMX1*nx+i*DIMX1+k] = tmp[k];
-                            */
+                        {reduce2D_code(red_formula, dtype, dtypeacc, self.dtype_io)}
 
-                            /* // This code should be a bit more efficient (more parallel) in the case
-                               // of a simple "fully parallel" reduction op such as "sum", "max" or "min"
-                            TYPE res = 0;
-                            if(tid < nx*DIMVECT) {{
-                                for (int i = 0; i < sizeY; i++)
-                                    res += in[tid + i*nx*DIMVECT]; // We use "+=" as a reduction op. But it could be anything, really!
-                                // res = in[tid+ nx* DIMVECT];
-                                out[tid] = res;
-                            }}
-                            */
-
-                            // However, for now, we use a "vectorized" reduction op.,
-                            // which can also handle non-trivial reductions such as "LogSumExp"
-                            {acc2.declare()}
-                            {red_formula.InitializeReduction(acc2)} // acc = 0
-                            if(tid < nx) {{
-                                for (int y = 0; y < sizeY; y++) {{
-                                    {red_formula.ReducePair(acc2, inloc)} // acc += in[(tid+y*nx) *DIMVECT : +DIMVECT]; 
-                                }}
-                                {red_formula.FinalizeOutput(acc2, outloc, tid)}
-                            }}
-                        }}
-                        
-                        
-                        
-                        
-                        extern "C" __global__ void GpuConv2DOnDevice(int nx, int ny, {dtype} *out, {dtype} **{arg.id}) {{
+                        extern "C" __global__ void GpuConv2DOnDevice(int nx, int ny, {dtype} *out, {self.dtype_io} **{arg.id}) {{
                             
                             {fout.declare()}
                             
@@ -184,7 +135,7 @@ class GpuReduc2D(MapReduce, Gpu_link_compile):
                             if(i<nx) {{
                                 {use_pragma_unroll()}
                                 for(int k=0; k<{dimred}; k++) {{
-                                    out[blockIdx.y*{dimred}*nx+i*{dimred}+k] = acc[k];
+                                    out[({c_index('blockIdx.y')}*nx+i)*{dimred}+k] = acc[k];
                                 }}
                             }}
                         }}
@@ -3,6 +3,9 @@ from .GpuReduc1D import GpuReduc1D
 from .GpuReduc1D_chunks import GpuReduc1D_chunks
 from .GpuReduc1D_finalchunks import GpuReduc1D_finalchunks
 from .GpuReduc1D_ranges import GpuReduc1D_ranges
+from .GpuReduc1D_regblock import GpuReduc1D_regblock
+from .GpuReduc1D_tensorcore import GpuReduc1D_tensorcore
+from .GpuReduc1D_knn import GpuReduc1D_knn
 from .GpuReduc1D_ranges_chunks import GpuReduc1D_ranges_chunks
 from .GpuReduc1D_ranges_finalchunks import (
     GpuReduc1D_ranges_finalchunks,
@@ -0,0 +1,70 @@
+# Kernels building the lookup table of the blocks of the 1D ranges schemes on the device, for ranges
+# stored on the device : see range_preprocess_from_device in keopscore/binders/nvrtc/keops_nvrtc.cpp,
+# which launches KeOps_ranges_scan with one block of KEOPS_RANGES_SCAN_THREADS = 1024 threads,
+# and KeOps_ranges_lookup with blocks of KEOPS_RANGES_LOOKUP_THREADS threads.
+# Range r of ranges_x is cut in blocks of blockSize_x rows, and block k of the table is described by
+# lookup[3*k], lookup[3*k+1], lookup[3*k+2] : index of its range, first and last rows.
+
+ranges_lookup_code = """
+                        // number of blocks of a range
+                        __device__ __forceinline__ int KeOps_range_nblocks(const int *ranges_x, int r, int blockSize_x) {
+                          int len_range = ranges_x[2 * r + 1] - ranges_x[2 * r];
+                          return (len_range / blockSize_x) + (len_range % blockSize_x == 0 ? 0 : 1);
+                        }
+
+                        // block_offsets[r] = index of the first block of range r, for r <= nranges (exclusive prefix
+                        // sum of the numbers of blocks of the ranges) : each thread sums a contiguous chunk of ranges,
+                        // and the sums of the chunks are scanned in shared memory.
+                        extern "C" __global__ void KeOps_ranges_scan(int nranges, const int *ranges_x, int blockSize_x,
+                                                                     int *block_offsets) {
+                          __shared__ int sums[1024];
+                          int t = threadIdx.x;
+                          int chunk = (nranges + blockDim.x - 1) / blockDim.x;
+                          int first = min(t * chunk, nranges), last = min(first + chunk, nranges);
+                          int sum = 0;
+                          for (int r = first; r < last; r++)
+                            sum += KeOps_range_nblocks(ranges_x, r, blockSize_x);
+                          sums[t] = sum;
+                          __syncthreads();
+                          for (int d = 1; d < blockDim.x; d *= 2) {
+                            int v = t >= d ? sums[t - d] : 0;
+                            __syncthreads();
+                            sums[t] += v;
+                            __syncthreads();
+                          }
+                          int offset = sums[t] - sum;
+                          for (int r = first; r < last; r++) {
+                            block_offsets[r] = offset;
+                            offset += KeOps_range_nblocks(ranges_x, r, blockSize_x);
+                          }
+                          if (t == blockDim.x - 1)
+                            block_offsets[nranges] = sums[t];
+                        }
+
+                        // one thread per block of the table, for nblocks >= block_offsets[nranges] blocks :
+                        // the extra blocks are empty.
+                        extern "C" __global__ void KeOps_ranges_lookup(int nranges, const int *ranges_x, int blockSize_x,
+                                                                       const int *block_offsets, int nblocks, int *lookup) {
+                          int k = blockIdx.x * blockDim.x + threadIdx.x;
+                          if (k >= nblocks)
+                            return;
+                          int range_id = 0, start_x = 0, end_x = 0;
+                          if (k < block_offsets[nranges]) {
+                            // last range whose first block is at most k (which is not an empty range)
+                            int lo = 0, hi = nranges - 1;
+                            while (lo < hi) {
+                              int mid = (lo + hi + 1) / 2;
+                              if (block_offsets[mid] <= k)
+                                lo = mid;
+                              else
+                                hi = mid - 1;
+                            }
+                            range_id = lo;
+                            start_x = ranges_x[2 * lo] + (k - block_offsets[lo]) * blockSize_x;
+                            end_x = min(start_x + blockSize_x, ranges_x[2 * lo + 1]);
+                          }
+                          lookup[3 * k] = range_id;
+                          lookup[3 * k + 1] = start_x;
+                          lookup[3 * k + 2] = end_x;
+                        }
+                    """
@@ -0,0 +1,59 @@
+from keopscore.config.indices import c_index
+from keopscore.utils.code_gen_utils import c_variable, c_array
+
+
+def reduce2D_code(red_formula, dtype, dtypeacc, dtype_io):
+    # Code of the kernel reduce2D, which combines the partial results of the reduction computed
+    # by the blocks of a line of blocks : with the 2D scheme (see GpuReduc2D), and with the split-j
+    # variant of the 1D scheme (see GpuReduc1D), in which each line of blocks covers a range of j indices.
+    # The partial results are combined with the ReducePair method of the reduction, so that this
+    # works for all reductions (sums, Max_SumShiftExp, ArgMin, etc.).
+    dimin = red_formula.dimred
+    dimout = red_formula.dim
+    acc2 = c_array(dtypeacc, dimin, "acc2")
+    inloc = c_array(dtype, dimin, f"(in + ({c_index('y')}*nx+tid)*{dimin})")
+    outloc = c_array(dtype_io, dimout, f"(out+{c_index('tid')}*{dimout})")
+    tid = c_variable("int", "tid")
+    return f"""
+                        extern "C" __global__ void reduce2D({dtype} *in, {dtype_io} *out, int sizeY, int nx) {{
+                            /* Function used as a final reduction pass in the 2D scheme (and the split-j 1D scheme),
+                             * once the block reductions have been made.
+                             * Takes as input:
+                             * - in,  a  sizeY * (nx * DIMIN ) array
+                             * - out, an          nx * DIMOUT   array
+                             *
+                             * Computes, in parallel, the "columnwise"-reduction (which correspond to lines of blocks)
+                             * of *in and stores the result in out.
+                             */
+                            int tid = blockIdx.x * blockDim.x + threadIdx.x;
+
+                            /* As shown below, the code that is used to store the block-wise sum
+                              "tmp" in parallel is:
+                                if(i<nx)
+                                    for(int k=0; k<DIMX1; k++)
+                                        (*px)[blockIdx.y*DIMX1*nx+i*DIMX1+k] = tmp[k];
+                            */
+
+                            /* // This code should be a bit more efficient (more parallel) in the case
+                               // of a simple "fully parallel" reduction op such as "sum", "max" or "min"
+                            TYPE res = 0;
+                            if(tid < nx*DIMVECT) {{
+                                for (int i = 0; i < sizeY; i++)
+                                    res += in[tid + i*nx*DIMVECT]; // We use "+=" as a reduction op. But it could be anything, really!
+                                // res = in[tid+ nx* DIMVECT];
+                                out[tid] = res;
+                            }}
+                            */
+
+                            // However, for now, we use a "vectorized" reduction op.,
+                            // which can also handle non-trivial reductions such as "LogSumExp"
+                            {acc2.declare()}
+                            {red_formula.InitializeReduction(acc2)} // acc = 0
+                            if(tid < nx) {{
+                                for (int y = 0; y < sizeY; y++) {{
+                                    {red_formula.ReducePair(acc2, inloc)} // acc += in[(tid+y*nx) *DIMVECT : +DIMVECT]; 
+                                }}
+                                {red_formula.FinalizeOutput(acc2, outloc, tid)}
+                            }}
+                        }}
+                    """
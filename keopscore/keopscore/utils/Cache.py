@@ -1,9 +1,24 @@
 import os
 import pickle
 import keopscore
+from keopscore.utils.misc_utils import codegen_lock
 
-# global configuration parameter to be added for the lookup :
-env_param = keopscore.config.config.cpp_flags
+
+def get_env_param():
+    # global configuration parameters to be added for the lookup. They are read at each call,
+    # since they may be changed after importing keopscore, and select the code of the formulas.
+    config = keopscore.config.config
+    env_param = config.cpp_flags
+    if config.use_gpu_tensor_cores:
+        env_param += " tensor_cores"
+    if not config.use_gpu_register_blocking:
+        env_param += " no_register_blocking"
+    if not config.use_gpu_warp_knn:
+        env_param += " no_warp_knn"
+    # the cpu modules are compiled for these instruction sets (see LinkCompile)
+    isa_targets = config.get_cpu_isa_targets()
+    env_param += " cpu_isa=" + ",".join(isa for isa, _, _ in isa_targets)
+    return env_param
 
 
 class Cache:
@@ -22,10 +37,11 @@ class Cache:
             atexit.register(self.save_cache)
 
     def __call__(self, *args):
-        str_id = "".join(list(str(arg) for arg in args)) + str(env_param)
-        if not str_id in self.library:
-            self.library[str_id] = self.fun(*args)
-        return self.library[str_id]
+        str_id = "".join(list(str(arg) for arg in args)) + get_env_param()
+        with codegen_lock:
+            if not str_id in self.library:
+                self.library[str_id] = self.fun(*args)
+            return self.library[str_id]
 
     def reset(self, new_save_folder=None):
         self.library = {}
@@ -58,7 +74,7 @@ class Cache_partial:
             atexit.register(self.save_cache)
 
     def __call__(self, *args):
-        str_id = "".join(list(str(arg) for arg in args)) + str(env_param)
+        str_id = "".join(list(str(arg) for arg in args)) + get_env_param()
         if not str_id in self.library:
             if self.use_cache_file:
                 if str_id in self.library_params:
@@ -2,6 +2,7 @@ import os
 from hashlib import sha256
 
 from keopscore.config.config import disable_pragma_unrolls
+from keopscore.config.indices import c_index
 from keopscore.utils.misc_utils import KeOps_Error, KeOps_Message
 
 
@@ -259,6 +260,10 @@ def cast_to(dtype, var):
         return f"__half22float2({var.id})"
     elif dtype == "half2" and var.dtype == "float2":
         return f"__float22half2_rn({var.id})"
+    elif dtype == "__nv_bfloat16" and var.dtype in simple_dtypes:
+        return f"__float2bfloat16_rn((float)({var.id}))"
+    elif dtype in simple_dtypes and var.dtype == "__nv_bfloat16":
+        return f"({dtype})(__bfloat162float({var.id}))"
     else:
         KeOps_Error(f"not implemented: casting from {var.dtype} to {dtype}")
 
@@ -592,7 +597,9 @@ def direct_table(nminargs, dimsx, dimsy, dimsp, indsi, indsj, indsp, args, i, j)
         for u in range(len(dims)):
             arg = args[inds[u]]
             res[inds[u]] = c_array(
-                value(arg.dtype), dims[u], f"({arg.id}+{row_index.id}*{dims[u]})"
+                value(arg.dtype),
+                dims[u],
+                f"({arg.id}+{c_index(row_index.id)}*{dims[u]})",
             )
     return res
 
@@ -690,7 +697,7 @@ def load_vars(dims, inds, xloc, args, row_index=c_zero_int, offsets=None, indsre
             string += use_pragma_unroll()
             string += f"for(int v=0; v<{dims[u]}; v++) {{\n"
             string += (
-                f"    {xloc.id}[a] = {args[inds[u]].id}[{row_index_str}*{dims[u]}+v];\n"
+                f"    {xloc.id}[a] = {args[inds[u]].id}[{c_index(row_index_str)}*{dims[u]}+v];\n"
             )
             string += "     a++;\n"
             string += "}\n"
@@ -731,7 +738,7 @@ def load_vars_chunks(
         for u in range(len(inds)):
             string += use_pragma_unroll()
             string += f"for(int v=0; v<{dim_chunk_load}; v++) {{\n"
-            string += f"    {xloc.id}[a] = {args[inds[u]].id}[{row_index.id}*{dim_org}+{k.id}*{dim_chunk}+v];\n"
+            string += f"    {xloc.id}[a] = {args[inds[u]].id}[{c_index(row_index.id)}*{dim_org}+{k.id}*{dim_chunk}+v];\n"
             string += "     a++;\n"
             string += "}"
         string += "}"
@@ -770,7 +777,7 @@ def load_vars_chunks_offsets(
             l = indsref.index(inds[u])
             string += use_pragma_unroll()
             string += f"for(int v=0; v<{dim_chunk_load}; v++) {{\n"
-            string += f"    {xloc.id}[a] = {args[inds[u]].id}[({row_index.id}+{offsets.id}[{l}])*{dim_org}+{k.id}*{dim_chunk}+v];\n"
+            string += f"    {xloc.id}[a] = {args[inds[u]].id}[{c_index(f'({row_index.id}+{offsets.id}[{l}])')}*{dim_org}+{k.id}*{dim_chunk}+v];\n"
             string += "     a++;\n"
             string += "}"
         string += "}"
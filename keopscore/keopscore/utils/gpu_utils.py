@@ -14,8 +14,6 @@ from os.path import join
 
 # Some constants taken from cuda.h
 CUDA_SUCCESS = 0
-CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_BLOCK = 1
-CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK = 8
 
 libcuda_folder = os.path.dirname(find_library_abspath("cuda"))
 libnvrtc_folder = os.path.dirname(find_library_abspath("nvrtc"))
@@ -141,83 +139,80 @@ def get_gpu_props():
     Here we assume the system has cuda support (more precisely that libcuda can be loaded)
     Adapted from https://gist.github.com/f0k/0d6431e3faa60bffc788f8b4daa029b1
     credit: Jan Schlüter
+    N.B. the properties of the devices (max threads and shared memory per block) are
+    queried at runtime by the binder, for the device of each module.
     """
     cuda = ctypes.CDLL(find_library("cuda"))
 
     nGpus = ctypes.c_int()
-    error_str = ctypes.c_char_p()
 
     result = cuda.cuInit(0)
     if result != CUDA_SUCCESS:
-        # cuda.cuGetErrorString(result, ctypes.byref(error_str))
-        # KeOps_Warning("cuInit failed with error code %d: %s" % (result, error_str.value.decode()))
         KeOps_Warning(
             "cuda was detected, but driver API could not be initialized. Switching to cpu only."
         )
-        return 0, ""
+        return 0
 
     result = cuda.cuDeviceGetCount(ctypes.byref(nGpus))
     if result != CUDA_SUCCESS:
-        # cuda.cuGetErrorString(result, ctypes.byref(error_str))
-        # KeOps_Warning("cuDeviceGetCount failed with error code %d: %s" % (result, error_str.value.decode()))
         KeOps_Warning(
             "cuda was detected, driver API has been initialized, but no working GPU has been found. Switching to cpu only."
         )
-        return 0, ""
+        return 0
 
     nGpus = nGpus.value
 
-    def safe_call(d, result):
-        test = result == CUDA_SUCCESS
-        if not test:
+    for d in range(nGpus):
+        # getting handle to cuda device
+        device = ctypes.c_int()
+        if cuda.cuDeviceGet(ctypes.byref(device), ctypes.c_int(d)) != CUDA_SUCCESS:
             KeOps_Warning(
                 f"""
                     cuda was detected, driver API has been initialized, 
-                    but there was an error for detecting properties of GPU device nr {d}. 
+                    but there was an error for detecting GPU device nr {d}. 
                     Switching to cpu only.
                 """
             )
-        return test
+            return 0
 
-    test = True
-    MaxThreadsPerBlock = [0] * (nGpus)
-    SharedMemPerBlock = [0] * (nGpus)
-    for d in range(nGpus):
-        # getting handle to cuda device
-        device = ctypes.c_int()
-        result &= safe_call(d, cuda.cuDeviceGet(ctypes.byref(device), ctypes.c_int(d)))
-
-        # getting MaxThreadsPerBlock info for device
-        output = ctypes.c_int()
-        result &= safe_call(
-            d,
-            cuda.cuDeviceGetAttribute(
-                ctypes.byref(output),
-                ctypes.c_int(CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_BLOCK),
-                device,
-            ),
-        )
-        MaxThreadsPerBlock[d] = output.value
-
-        # getting SharedMemPerBlock info for device
-        result &= safe_call(
-            d,
-            cuda.cuDeviceGetAttribute(
-                ctypes.byref(output),
-                ctypes.c_int(CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK),
-                device,
-            ),
-        )
-        SharedMemPerBlock[d] = output.value
+    return nGpus
 
-    # Building compile flags in the form "-D..." options for further compilations
-    # (N.B. the purpose is to avoid the device query at runtime because it would slow down computations)
-    string_flags = f"-DMAXIDGPU={nGpus-1} "
-    for d in range(nGpus):
-        string_flags += f"-DMAXTHREADSPERBLOCK{d}={MaxThreadsPerBlock[d]} "
-        string_flags += f"-DSHAREDMEMPERBLOCK{d}={SharedMemPerBlock[d]} "
 
-    if test:
-        return nGpus, string_flags
-    else:
-        return 0, 0, ""
+def get_gpu_name(device_id):
+    """
+    Return the name of a GPU device, as reported by libcuda (e.g. "NVIDIA A100-SXM4-40GB").
+    It is used to identify the device in the results of the autotuner of pykeops.
+    """
+    cuda = ctypes.CDLL(find_library("cuda"))
+    device = ctypes.c_int()
+    name = ctypes.create_string_buffer(256)
+    if (
+        cuda.cuInit(0) != CUDA_SUCCESS
+        or cuda.cuDeviceGet(ctypes.byref(device), ctypes.c_int(device_id))
+        != CUDA_SUCCESS
+        or cuda.cuDeviceGetName(name, ctypes.c_int(len(name)), device) != CUDA_SUCCESS
+    ):
+        return f"device{device_id}"
+    return name.value.decode()
+
+
+def get_gpu_compute_capability(device_id):
+    """
+    Return the compute capability (major, minor) of a GPU device, e.g. (8, 0) for an A100,
+    or (0, 0) if it cannot be queried.
+    """
+    cuda = ctypes.CDLL(find_library("cuda"))
+    device = ctypes.c_int()
+    major, minor = ctypes.c_int(), ctypes.c_int()
+    if (
+        cuda.cuInit(0) != CUDA_SUCCESS
+        or cuda.cuDeviceGet(ctypes.byref(device), ctypes.c_int(device_id))
+        != CUDA_SUCCESS
+        # CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR and _MINOR
+        or cuda.cuDeviceGetAttribute(ctypes.byref(major), ctypes.c_int(75), device)
+        != CUDA_SUCCESS
+        or cuda.cuDeviceGetAttribute(ctypes.byref(minor), ctypes.c_int(76), device)
+        != CUDA_SUCCESS
+    ):
+        return 0, 0
+    return major.value, minor.value
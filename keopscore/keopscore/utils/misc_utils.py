@@ -2,6 +2,9 @@
 # .  Warnings, Errors, etc.
 #######################################################################
 
+import threading
+from contextlib import contextmanager
+
 import keopscore
 
 
@@ -28,6 +31,31 @@ def KeOps_Error(message, show_line_number=True):
     raise ValueError(message)
 
 
+def KeOps_OS_Run_parallel(commands, names):
+    # Runs the shell commands at once (e.g. the compilations of a formula for several instruction
+    # sets), and raises an error with the output of the ones which fail, given by their names.
+    import subprocess
+
+    procs = [
+        subprocess.Popen(
+            command, shell=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE
+        )
+        for command in commands
+    ]
+    errors = []
+    for command, name, proc in zip(commands, names, procs):
+        _, err = proc.communicate()
+        if proc.returncode != 0:
+            errors.append(f"{name} : {command}\n{err.decode('utf-8')}")
+        elif err != b"":
+            KeOps_Warning(f"There were warnings compiling {name} :", newline=True)
+            print(err.decode("utf-8"))
+    if errors:
+        KeOps_Error(
+            "Compilation failed for " + "\n".join(errors), show_line_number=False
+        )
+
+
 def KeOps_OS_Run(command):
     import sys
 
@@ -90,3 +118,43 @@ def find_library_abspath(lib):
     abspath = cast(lmptr, POINTER(LINKMAP)).contents.l_name
 
     return abspath.decode("utf-8")
+
+
+class CodegenLock:
+    """
+    Lock held during the generation of code for a formula (see keopscore.utils.Cache),
+    since code generation relies on global settings such as the ones of keopscore.config.chunks.
+    It is reentrant, and may be released while compiling generated code, which does not depend
+    on these settings, so that several formulas may be compiled concurrently.
+    """
+
+    def __init__(self):
+        self._lock = threading.Lock()
+        self._local = threading.local()
+
+    def __enter__(self):
+        depth = getattr(self._local, "depth", 0)
+        if depth == 0:
+            self._lock.acquire()
+        self._local.depth = depth + 1
+
+    def __exit__(self, *args):
+        self._local.depth -= 1
+        if self._local.depth == 0:
+            self._lock.release()
+
+    @contextmanager
+    def released(self):
+        depth = getattr(self._local, "depth", 0)
+        if depth > 0:
+            self._local.depth = 0
+            self._lock.release()
+        try:
+            yield
+        finally:
+            if depth > 0:
+                self._lock.acquire()
+                self._local.depth = depth
+
+
+codegen_lock = CodegenLock()
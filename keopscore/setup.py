@@ -66,11 +66,18 @@ setup(
             "config/libiomp5.dylib",
             "binders/nvrtc/keops_nvrtc.cpp",
             "binders/nvrtc/nvrtc_jit.cpp",
+            "binders/aot/keops_aot.cpp",
+            "binders/aot/keops_aot.h",
+            "include/CpuNuma.h",
+            "include/CpuRangesTasks.h",
+            "include/CpuSizes.h",
             "include/CudaSizes.h",
+            "include/Profiler.h",
             "include/ranges_utils.h",
             "include/Ranges.h",
             "include/Sizes.h",
             "include/utils_pe.h",
+            "include/Workspace.h",
         ],
     },
     install_requires=[],
@@ -21,6 +21,110 @@ def set_verbose(val):
     keopscore.verbose = val
 
 
+###########################################################
+# CUDA graphs : computations on GPU data with fixed shapes are captured
+# in CUDA graphs at the first call, and replayed at the next calls.
+# The graphs of block-sparse reductions (with a ranges argument) build their
+# lookup tables on the device from the current contents of the ranges arrays,
+# which may change from call to call.
+use_cuda_graphs = False
+
+
+def set_cuda_graphs(val):
+    import pykeops
+
+    global use_cuda_graphs
+    use_cuda_graphs = val
+    if keopscore.config.config.use_cuda:
+        for obj in pykeops.common.keops_io.keops_binder["nvrtc"].library.values():
+            if hasattr(obj, "launch_keops"):
+                obj.launch_keops.set_cuda_graphs(int(val))
+
+
+###########################################################
+# Pipelined computations on host data : the i variables and the output are transferred
+# tile by tile through pinned staging buffers, overlapping with the computations on the
+# previous tiles. This only pays off when the transfers take a significant part of the
+# call, e.g. with cheap formulas and few j points (see benchmarks/benchmark_gpu_pipelined.py).
+use_pipelined = False
+
+
+def set_pipelined(val):
+    import pykeops
+
+    global use_pipelined
+    use_pipelined = val
+    if keopscore.config.config.use_cuda:
+        for obj in pykeops.common.keops_io.keops_binder["nvrtc"].library.values():
+            if hasattr(obj, "launch_keops"):
+                obj.launch_keops.set_pipelined(int(val))
+
+
+###########################################################
+# Profiling : timings of the phases of the calls of the nvrtc binder (host preprocessing, kernels
+# and copies), counters of transfers and allocations, and traces in the Chrome trace format.
+# The instrumentation is only compiled when the environment variable KEOPS_PROFILING=1 is set
+# (in a separate build folder) ; otherwise the statistics are empty.
+use_profiling = os.getenv("PYKEOPS_PROFILING") == "1"
+
+
+def _nvrtc_modules():
+    import pykeops
+
+    if not keopscore.config.config.use_cuda:
+        return {}
+    return {
+        key: obj.launch_keops
+        for key, obj in pykeops.common.keops_io.keops_binder["nvrtc"].library.items()
+        if hasattr(obj, "launch_keops")
+    }
+
+
+def set_profiling(val):
+    global use_profiling
+    use_profiling = val
+    for module in _nvrtc_modules().values():
+        module.set_profiling(int(val))
+
+
+def get_profiling_stats(reset=False):
+    """Returns a dict of the statistics of the formulas, indexed by their hash."""
+    res = {}
+    for module in _nvrtc_modules().values():
+        stats = module.get_stats()
+        res[stats["formula"]] = stats
+        if reset:
+            module.reset_stats()
+    return res
+
+
+def write_profiling_trace(filename):
+    """Writes the events of all the formulas in a file of the Chrome trace format."""
+    import json
+
+    events = [
+        {"name": "process_name", "ph": "M", "pid": 1, "args": {"name": "KeOps host"}},
+        {"name": "process_name", "ph": "M", "pid": 2, "args": {"name": "KeOps device"}},
+    ]
+    for module in _nvrtc_modules().values():
+        events += module.get_trace()
+    with open(filename, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, f)
+
+
+###########################################################
+# Autotuning : the launch configuration of Gpu reductions (1D or 2D scheme, chunked mode and
+# CUDA block size) is benchmarked at the first call for each formula, device and order of
+# magnitude of the sizes, and the fastest one is used for the next calls. The scheme given by the
+# backend option is then ignored. See pykeops/common/keops_io/autotune.py
+autotune = os.getenv("PYKEOPS_AUTOTUNE") == "1"
+
+
+def set_autotune(val):
+    global autotune
+    autotune = val
+
+
 ###########################################################
 # Set version
 
@@ -0,0 +1,65 @@
+"""
+NUMA mode of the CPU reductions
+=========================================
+
+We measure the scaling of a large Gaussian kernel product on CPU with
+the number of threads, with and without the NUMA mode of KeOps
+(``KEOPS_CPU_NUMA=1``, see ``keopscore/include/CpuNuma.h``). In the NUMA mode,
+threads are bound to the cores, each socket handles a contiguous part of
+the output, and the :math:`y_j` variables are replicated on each NUMA node.
+
+The reduction streams the :math:`y_j`'s from memory once per block of
+``KEOPS_CPU_BLOCK_I`` rows: we report the corresponding bandwidth, which
+should keep growing when the threads of the second socket are used.
+
+Each configuration runs in a separate process, since the NUMA mode is a compile option.
+Threads are bound with ``OMP_PLACES=cores`` in both modes.
+"""
+
+import os
+import subprocess
+import sys
+
+M, N, D = 200000, 1000000, 3
+BLOCK_I = 16  # KEOPS_CPU_BLOCK_I, see keopscore/include/CpuSizes.h
+
+script = f"""
+import time
+import numpy as np
+from pykeops.numpy import Genred
+
+x = np.random.rand({M}, {D}).astype("float32")
+y = np.random.rand({N}, {D}).astype("float32")
+b = np.random.rand({N}, 1).astype("float32")
+conv = Genred("Exp(-SqDist(x,y)) * b", ["x = Vi({D})", "y = Vj({D})", "b = Vj(1)"], axis=1)
+conv(x[:100], y, b, backend="CPU")  # compilation
+start = time.perf_counter()
+conv(x, y, b, backend="CPU")
+print(time.perf_counter() - start)
+"""
+
+
+def run(nthreads, numa):
+    env = dict(
+        os.environ,
+        OMP_NUM_THREADS=str(nthreads),
+        OMP_PLACES="cores",
+        KEOPS_CPU_NUMA="1" if numa else "0",
+    )
+    out = subprocess.run(
+        [sys.executable, "-c", script], env=env, capture_output=True, text=True
+    )
+    return float(out.stdout.strip().split("\n")[-1])
+
+
+if __name__ == "__main__":
+    ncores = os.cpu_count()
+    list_threads = sorted({2**k for k in range(ncores.bit_length())} | {ncores})
+    # bytes of y_j and b_j read by the reduction loops
+    streamed = (M / BLOCK_I) * N * (D + 1) * 4
+    print(f"{'threads':>8} {'time':>10} {'GB/s':>8} {'time NUMA':>10} {'GB/s':>8}")
+    for nthreads in list_threads:
+        t, t_numa = run(nthreads, False), run(nthreads, True)
+        print(
+            f"{nthreads:8d} {t:9.3f}s {streamed / t / 1e9:8.1f} {t_numa:9.3f}s {streamed / t_numa / 1e9:8.1f}"
+        )
@@ -0,0 +1,57 @@
+"""
+Pipelined computations on host data
+=========================================
+
+We measure the time of Gaussian kernel products on host (numpy) data, computed on the GPU
+with and without the pipelined mode of KeOps (``pykeops.set_pipelined(True)``, see
+``launch_pipelined_from_host`` in ``keopscore/binders/nvrtc/keops_nvrtc.cpp``). In the
+pipelined mode, the :math:`x_i`'s and the output are transferred in tiles of rows through pinned
+staging buffers, overlapping with the computations on the previous tiles, while the
+:math:`y_j`'s and :math:`b_j`'s are copied once at the beginning.
+
+The overlap can only hide the transfers of the :math:`x_i`'s and of the output : the pipeline
+pays off when they take a significant part of the call, i.e. with many rows, high dimensional
+:math:`x_i`'s and few :math:`y_j`'s. With many :math:`y_j`'s, the computation dominates and
+the additional launches and synchronizations of the tiles may make the pipelined mode slower,
+which is why it is off by default.
+"""
+
+import time
+
+import numpy as np
+
+import pykeops
+from pykeops.numpy import Genred
+
+D = 64
+list_M = [10000, 100000, 1000000]
+list_N = [100, 1000, 10000]
+nrepeats = 5
+
+
+def run(conv, x, y, b, pipelined):
+    pykeops.set_pipelined(pipelined)
+    try:
+        conv(x, y, b, backend="GPU_1D")  # compilation and warm-up
+        start = time.perf_counter()
+        for _ in range(nrepeats):
+            conv(x, y, b, backend="GPU_1D")
+        return (time.perf_counter() - start) / nrepeats
+    finally:
+        pykeops.set_pipelined(False)
+
+
+if __name__ == "__main__":
+    conv = Genred(
+        "Exp(-SqDist(x,y)) * b", [f"x = Vi({D})", f"y = Vj({D})", "b = Vj(1)"], axis=1
+    )
+    print(f"{'M':>8} {'N':>8} {'time':>10} {'time pipelined':>15} {'speed-up':>9}")
+    for M in list_M:
+        for N in list_N:
+            x = np.random.rand(M, D).astype("float32") / np.sqrt(D)
+            y = np.random.rand(N, D).astype("float32") / np.sqrt(D)
+            b = np.random.rand(N, 1).astype("float32")
+            t, t_pipelined = run(conv, x, y, b, False), run(conv, x, y, b, True)
+            print(
+                f"{M:8d} {N:8d} {t:9.4f}s {t_pipelined:14.4f}s {t / t_pipelined:9.2f}"
+            )
@@ -64,6 +64,21 @@ class LoadKeOps:
                 aliases_new.append(alias)
 
         self.params = types.SimpleNamespace()
+        # arguments of the constructor, used to build variants of the same reduction (see autotune.py)
+        self.params.init_args = (
+            tagCPUGPU,
+            tag1D2D,
+            tagHostDevice,
+            use_ranges,
+            device_id_request,
+            formula,
+            aliases,
+            nargs,
+            dtype,
+            lang,
+            optional_flags,
+        )
+        self.params.use_ranges = use_ranges
         self.params.aliases_old = aliases
         self.params.aliases = aliases_new
         self.params.lang = lang
@@ -77,6 +92,10 @@ class LoadKeOps:
         self.params.enable_chunks = optional_flags["enable_chunks"]
         self.params.enable_final_chunks = -1
         self.params.mult_var_highdim = optional_flags["multVar_highdim"]
+        # set for arrays with more than 2^31 elements (see LoadKeOps_nvrtc.call_keops)
+        self.params.use_int64_indices = optional_flags.get("use_int64_indices", False)
+        # arguments which stay the same from call to call (see ResidentArgs in operations.py)
+        self.params.resident_args = optional_flags.get("resident_args", ())
         self.params.tagHostDevice = tagHostDevice
 
         if dtype == "float32":
@@ -88,6 +107,10 @@ class LoadKeOps:
         elif dtype == "float16":
             self.params.c_dtype = "half2"
             self.params.use_half = True
+        elif dtype == "bfloat16":
+            # bfloat16 data is loaded and stored as such, but computations are done in float
+            self.params.c_dtype = "__nv_bfloat16"
+            self.params.use_half = False
         else:
             raise ValueError("not implemented")
 
@@ -103,6 +126,9 @@ class LoadKeOps:
         if use_ranges:
             map_reduce_id += "_ranges"
 
+        if self.params.use_int64_indices:
+            map_reduce_id += "_int64"
+
         (
             self.params.tag,
             self.params.source_name,
@@ -137,7 +163,10 @@ class LoadKeOps:
             tagCPUGPU,
             tag1D2D,
             self.params.use_half,
-            device_id_request,
+            # with several devices, the code is built for the first one
+            device_id_request[0]
+            if isinstance(device_id_request, (list, tuple))
+            else device_id_request,
         )
 
         # now we switch indsi, indsj and dimsx, dimsy in case tagI=1.
@@ -227,6 +256,11 @@ class LoadKeOps:
 
         self.outshape = out.shape
 
+        # stream on which the computation is enqueued: with PyTorch Gpu tensors we use the current
+        # torch stream, so that KeOps reductions are ordered with - and may overlap - other torch
+        # operations. 0 denotes the NULL stream, in which case the call is synchronous.
+        self.stream_ptr = self.tools.get_stream(device_args)
+
         self.call_keops(nx, ny)
 
         if self.params.dtype == "float16":
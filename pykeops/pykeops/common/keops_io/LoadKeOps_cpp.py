@@ -3,10 +3,15 @@ import sysconfig
 
 import keopscore.config.config
 from keopscore.config.config import get_build_folder
+from keopscore.binders.cpp.isa_dispatch import (
+    get_isa_code,
+    get_isa_compile_command,
+    get_isa_dispatch_code,
+)
 from keopscore.utils.Cache import Cache_partial
 from pykeops.common.keops_io.LoadKeOps import LoadKeOps
 from pykeops.common.utils import pyKeOps_Message
-from keopscore.utils.misc_utils import KeOps_OS_Run
+from keopscore.utils.misc_utils import KeOps_OS_Run, KeOps_OS_Run_parallel
 from pykeops.config import pykeops_cpp_name, python_includes
 
 
@@ -22,15 +27,37 @@ class LoadKeOps_cpp_class(LoadKeOps):
         )
 
         if not os.path.exists(dllname):
+            # the formula is compiled for each instruction set in a separate object file (these
+            # compilations run in parallel), and the objects are linked with the pybind11 module.
+            # N.B. the objects do not share the std templates (see get_isa_compile_command).
+            isa_commands, isa_names, objnames = [], [], []
+            for isa, isa_flags, _ in keopscore.config.config.get_cpu_isa_targets():
+                isa_srcname = pykeops_cpp_name(
+                    tag=self.params.tag + "_" + isa, extension=".cpp"
+                )
+                objname = pykeops_cpp_name(
+                    tag=self.params.tag + "_" + isa, extension=".o"
+                )
+                f = open(isa_srcname, "w")
+                dtype = cpp_dtype[self.params.dtype]
+                source_name, tag = self.params.source_name, self.params.tag
+                f.write(get_isa_code(source_name, tag, dtype, isa))
+                f.close()
+                isa_commands.append(
+                    get_isa_compile_command(isa_srcname, objname, tag, isa, isa_flags)
+                )
+                isa_names.append(f"formula {self.params.tag} for instruction set {isa}")
+                objnames.append(objname)
             f = open(srcname, "w")
             f.write(self.get_pybind11_code())
             f.close()
-            compile_command = f"{keopscore.config.config.cxx_compiler} {keopscore.config.config.cpp_flags} {python_includes} {srcname} -o {dllname}"
+            compile_command = f"{keopscore.config.config.cxx_compiler} {keopscore.config.config.cpp_flags} {python_includes} {srcname} {' '.join(objnames)} -o {dllname}"
             pyKeOps_Message(
                 "Compiling pykeops cpp " + self.params.tag + " module ... ",
                 flush=True,
                 end="",
             )
+            KeOps_OS_Run_parallel(isa_commands, isa_names)
             KeOps_OS_Run(compile_command)
             pyKeOps_Message("OK", use_tag=False, flush=True)
 
@@ -69,7 +96,8 @@ class LoadKeOps_cpp_class(LoadKeOps):
 
     def get_pybind11_code(self):
         return f"""
-#include "{self.params.source_name}"
+#include <vector>
+{get_isa_dispatch_code(self.params.tag)}
 
 #include <pybind11/pybind11.h>
 namespace py = pybind11;
@@ -150,26 +178,29 @@ int launch_pykeops_{self.params.tag}_cpu(int dimY, int nx, int ny,
     }}
 
 
-    return launch_keops_cpu_{self.params.tag}< TYPE >(dimY,
-                                                      nx,
-                                                      ny,
-                                                      tagI,
-                                                      tagZero,
-                                                      use_half,
-                                                      dimred,
-                                                      use_chunk_mode,
-                                                      indsi_v,
-                                                      indsj_v,
-                                                      indsp_v,
-                                                      dimout,
-                                                      dimsx_v,
-                                                      dimsy_v,
-                                                      dimsp_v,
-                                                      ranges,
-                                                      shapeout_v,
-                                                      out,
-                                                      arg,
-                                                      argshape_v);
+    // version of the entry point for the instruction set of the cpu, chosen at the first call
+    static auto launch_keops_cpu = select_launch_keops_cpu< TYPE >();
+
+    return launch_keops_cpu(dimY,
+                            nx,
+                            ny,
+                            tagI,
+                            tagZero,
+                            use_half,
+                            dimred,
+                            use_chunk_mode,
+                            indsi_v,
+                            indsj_v,
+                            indsp_v,
+                            dimout,
+                            dimsx_v,
+                            dimsy_v,
+                            dimsp_v,
+                            ranges,
+                            shapeout_v,
+                            out,
+                            arg,
+                            argshape_v);
 
 }}
 
@@ -1,4 +1,7 @@
 import os
+from ctypes import addressof, c_int64
+from functools import reduce
+from operator import mul
 
 import keopscore.config.config
 from keopscore.config.config import get_build_folder
@@ -6,10 +9,23 @@ import pykeops
 from keopscore.binders.nvrtc.Gpu_link_compile import Gpu_link_compile
 from keopscore.utils.Cache import Cache_partial
 from pykeops.common.keops_io.LoadKeOps import LoadKeOps
+from pykeops.common.keops_io.autotune import (
+    is_autotunable,
+    get_tuned_launch,
+    ind_optional_flags,
+)
 from pykeops.common.utils import pyKeOps_Message
 from keopscore.utils.misc_utils import KeOps_OS_Run
 
 
+# number of elements of an array above which its offsets overflow 32 bits integers
+max_int32_size = 2**31 - 1
+
+# rank of the shapes for which the raw arrays of the calls are first allocated (two batch
+# dimensions) ; they are reallocated when a call has more batch dimensions (see pack_call)
+packed_shape_rank = 4
+
+
 class LoadKeOps_nvrtc_class(LoadKeOps):
     def __init__(self, *args, fast_init=False):
         super().__init__(*args, fast_init=fast_init)
@@ -19,37 +35,42 @@ class LoadKeOps_nvrtc_class(LoadKeOps):
 
         pykeops_nvrtc = importlib.import_module("pykeops_nvrtc")
 
-        if self.params.c_dtype == "float":
-            self.launch_keops = pykeops_nvrtc.KeOps_module_float(
-                self.params.device_id_request,
-                self.params.nargs,
-                self.params.low_level_code_file,
-            )
-        elif self.params.c_dtype == "double":
-            self.launch_keops = pykeops_nvrtc.KeOps_module_double(
-                self.params.device_id_request,
-                self.params.nargs,
-                self.params.low_level_code_file,
-            )
-        elif self.params.c_dtype == "half2":
-            self.launch_keops = pykeops_nvrtc.KeOps_module_half2(
-                self.params.device_id_request,
-                self.params.nargs,
-                self.params.low_level_code_file,
-            )
+        # a list or tuple of device ids means that the computation is split across these devices
+        device_id_request = self.params.device_id_request
+        if isinstance(device_id_request, (list, tuple)):
+            if self.params.c_dtype not in ("float", "double"):
+                raise ValueError(
+                    "[KeOps] Multi-device computations are only available for float32 "
+                    "and float64 data."
+                )
+            module_type, plan_type = "KeOps_multi_module_", "KeOps_multi_call_plan_"
+            device_id_request = list(device_id_request)
+        else:
+            module_type, plan_type = "KeOps_module_", "KeOps_call_plan_"
 
-    def call_keops(self, nx, ny):
-        self.launch_keops(
+        self.launch_keops = getattr(pykeops_nvrtc, module_type + self.params.c_dtype)(
+            device_id_request,
+            self.params.nargs,
+            self.params.low_level_code_file,
+        )
+        self.launch_keops.set_cuda_graphs(int(pykeops.use_cuda_graphs))
+        self.launch_keops.set_pipelined(int(pykeops.use_pipelined))
+        self.launch_keops.set_profiling(int(pykeops.use_profiling))
+        # resident host arguments are copied once to the device, and kept there by the module
+        resident_args = getattr(self.params, "resident_args", ())
+        if resident_args and self.params.tagHostDevice == 0:
+            self.launch_keops.set_resident_args(list(resident_args))
+        # the metadata of the formula are converted once for all in the call plan, whose
+        # launch method only takes the sizes and raw pointers (see pykeops_nvrtc.cpp)
+        self.call_plan = getattr(pykeops_nvrtc, plan_type + self.params.c_dtype)(
+            self.launch_keops,
             self.params.tagHostDevice,
             self.params.dimy,
-            nx,
-            ny,
             self.params.tagI,
             self.params.tagZero,
             self.params.use_half,
             self.params.tag1D2D,
             self.params.dimred,
-            self.params.cuda_block_size,
             self.params.use_chunk_mode,
             self.params.indsi,
             self.params.indsj,
@@ -58,11 +79,113 @@ class LoadKeOps_nvrtc_class(LoadKeOps):
             self.params.dimsx,
             self.params.dimsy,
             self.params.dimsp,
-            self.ranges_ptr_new,
-            self.outshape,
-            self.out_ptr,
-            self.args_ptr_new,
-            self.argshapes_new,
+        )
+        self.empty_ranges_packed = (c_int64 * 7)(*self.empty_ranges_new)
+        self.alloc_packed_call(self.params.nargs, packed_shape_rank)
+        # launch configurations selected by the autotuner, for each order of magnitude of nx and ny
+        self.tuned_launches = {}
+        # binder of the same reduction with 64 bits indices, built when needed
+        self.int64_variant = None
+
+    def call_keops(self, nx, ny):
+        self.pack_call()
+        if pykeops.autotune and is_autotunable(self.params):
+            variant, cuda_block_size = get_tuned_launch(self, nx, ny)
+        else:
+            variant, cuda_block_size = self, self.params.cuda_block_size
+        # the 32 bits indices are faster, and are used whenever the sizes of the arrays allow it
+        if variant.needs_int64_indices(self, nx, ny, cuda_block_size):
+            variant = variant.get_int64_variant()
+        variant.launch(self, nx, ny, cuda_block_size)
+
+    def needs_int64_indices(self, src, nx, ny, cuda_block_size):
+        # checks the sizes of the arrays of the current call of src with the scheme of self,
+        # including the intermediate output of the 2D scheme or of the split-j variant of the
+        # 1D scheme, whose size is computed by the module with its own launch configuration.
+        if getattr(self.params, "use_int64_indices", False):
+            return False
+        sizes = [reduce(mul, shape, 1) for shape in (src.outshape, *src.argshapes_new)]
+        if max(sizes) > max_int32_size:
+            return True
+        nbatches = reduce(mul, src.outshape[:-2], 1)
+        tagRanges = 0 if src.ranges_ptr_new is src.empty_ranges_new else 1
+        buffer_size = self.call_plan.buffer_size(
+            nbatches * nx, nbatches * ny, cuda_block_size, tagRanges
+        )
+        return buffer_size > max_int32_size
+
+    def get_int64_variant(self):
+        # binder of the same reduction, compiled with 64 bits indices (see keopscore/config/indices.py)
+        if self.int64_variant is None:
+            if not hasattr(self.params, "init_args"):
+                raise ValueError(
+                    "[KeOps] The sizes of the arrays require 64 bits indices, which are not "
+                    "available for this binder."
+                )
+            args = list(self.params.init_args)
+            args[ind_optional_flags] = dict(
+                args[ind_optional_flags], use_int64_indices=True
+            )
+            self.int64_variant = LoadKeOps_nvrtc(*args)
+        return self.int64_variant
+
+    def alloc_packed_call(self, nargs, rank):
+        # raw arrays read by the call plan, allocated once and filled in place by pack_call. The
+        # shapes are nargs, then the rank and the dimensions of the output and of each argument.
+        self.packed_ranges = (c_int64 * 7)()
+        self.packed_args = (c_int64 * nargs)()
+        self.packed_shapes = (c_int64 * (1 + (nargs + 1) * (rank + 1)))()
+        self.packed_ptrs_dense = (
+            addressof(self.empty_ranges_packed),
+            addressof(self.packed_args),
+            addressof(self.packed_shapes),
+        )
+        self.packed_ptrs_ranges = (
+            addressof(self.packed_ranges),
+            *self.packed_ptrs_dense[1:],
+        )
+
+    def pack_call(self):
+        # writes the pointers and shapes of the current call in the raw arrays read by the call plan ;
+        # they are kept in self.packed_ptrs until the next call.
+        try:
+            self.fill_packed_call()
+        except (IndexError, ValueError):
+            # more arguments or batch dimensions than the arrays can hold
+            rank = max(len(shape) for shape in (self.outshape, *self.argshapes_new))
+            self.alloc_packed_call(len(self.args_ptr_new), rank)
+            self.fill_packed_call()
+
+    def fill_packed_call(self):
+        if self.ranges_ptr_new is self.empty_ranges_new:
+            self.packed_ptrs = self.packed_ptrs_dense
+        else:
+            self.packed_ranges[:] = self.ranges_ptr_new
+            self.packed_ptrs = self.packed_ptrs_ranges
+        nargs = len(self.args_ptr_new)
+        self.packed_args[:nargs] = self.args_ptr_new
+        shapes = self.packed_shapes
+        shapes[0] = nargs
+        k = 1
+        for shape in (self.outshape, *self.argshapes_new):
+            rank = len(shape)
+            shapes[k] = rank
+            shapes[k + 1 : k + 1 + rank] = shape
+            k += rank + 1
+
+    def launch(self, src, nx, ny, cuda_block_size):
+        # launches the module of self on the arguments of the current call of src, which is a binder
+        # of the same reduction, possibly compiled with another scheme or chunk mode (see autotune.py)
+        ranges_ptr, args_ptr, shapes_ptr = src.packed_ptrs
+        self.call_plan.launch(
+            nx,
+            ny,
+            cuda_block_size,
+            ranges_ptr,
+            src.out_ptr,
+            args_ptr,
+            shapes_ptr,
+            src.stream_ptr,
         )
 
     def import_module(self):
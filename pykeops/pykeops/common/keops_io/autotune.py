@@ -0,0 +1,204 @@
+"""
+Autotuning of the launch configuration of the Gpu reductions.
+
+The default launch configuration of a reduction is given by heuristics : the 1D or 2D scheme is
+chosen by the backend option, the chunked modes are used above the dimension thresholds
+set in keopscore/config/chunks.py, and the CUDA block size is bounded by
+keopscore.config.config.cuda_block_size. These heuristics were tuned on a particular device.
+
+When pykeops.autotune is set (see pykeops.set_autotune), the first call of a reduction for a given
+formula, device and order of magnitude of nx and ny benchmarks the candidate configurations
+on the arguments of the call, and the fastest one is used for the next calls. The results are
+stored in a json file of the build folder, next to the compiled cubins, so that the
+benchmarks are run only once.
+"""
+
+import functools
+import json
+import math
+import os
+import threading
+import time
+
+from keopscore.config.config import get_build_folder
+from keopscore.utils.gpu_utils import get_gpu_name
+from pykeops.common.utils import pyKeOps_Message
+
+# candidate values of the CUDA block size ; with the chunked modes, the block size
+# is fixed at compile time, so only the default value is used.
+block_sizes = (64, 128, 192, 256, 512, 1024)
+
+# number of timed runs of each configuration, after a warm-up run
+nrep = 3
+
+# positions of tag1D2D and optional_flags in the arguments of LoadKeOps_nvrtc
+ind_tag1D2D, ind_optional_flags = 1, 10
+
+autotune_lock = threading.RLock()
+results = None
+
+
+def results_file():
+    return os.path.join(get_build_folder(), "autotune_cache.json")
+
+
+def load_results():
+    global results
+    if results is None:
+        results = {}
+        if os.path.isfile(results_file()):
+            try:
+                with open(results_file(), "r") as f:
+                    results = json.load(f)
+            except ValueError:
+                pass
+    return results
+
+
+def save_result(key, result):
+    # the file may have been updated by another process since we loaded it
+    results[key] = result
+    path = results_file()
+    if os.path.isfile(path):
+        try:
+            with open(path, "r") as f:
+                results.update({k: v for k, v in json.load(f).items() if k != key})
+        except ValueError:
+            pass
+    tmp_path = f"{path}.{os.getpid()}.tmp"
+    with open(tmp_path, "w") as f:
+        json.dump(results, f, indent=1)
+    os.replace(tmp_path, path)
+
+
+def size_bucket(n):
+    # order of magnitude (in powers of 2) of a size
+    return int(math.log2(n)) if n > 0 else 0
+
+
+def is_autotunable(params):
+    return (
+        hasattr(params, "init_args")
+        and not params.tagZero
+        and not isinstance(params.device_id_request, (list, tuple))
+    )
+
+
+@functools.lru_cache(maxsize=None)
+def device_name(device_id):
+    return get_gpu_name(device_id)
+
+
+def get_key(params, nx, ny):
+    return " ; ".join(
+        str(item)
+        for item in (
+            params.red_formula_string,
+            params.aliases,
+            params.dtype,
+            params.c_dtype_acc,
+            params.sum_scheme,
+            params.mult_var_highdim,
+            params.tagHostDevice,
+            params.use_ranges,
+            device_name(params.device_id_request),
+            size_bucket(nx),
+            size_bucket(ny),
+        )
+    )
+
+
+def get_variant(params, tag1D2D, enable_chunks):
+    # binder of the same reduction, compiled with another scheme or chunk mode
+    from pykeops.common.keops_io.LoadKeOps_nvrtc import LoadKeOps_nvrtc
+
+    args = list(params.init_args)
+    args[ind_tag1D2D] = tag1D2D
+    args[ind_optional_flags] = dict(
+        args[ind_optional_flags], enable_chunks=enable_chunks
+    )
+    return LoadKeOps_nvrtc(*args)
+
+
+def get_candidates(binder):
+    params = binder.params
+    schemes = (0,) if params.use_ranges else (0, 1)
+    # chunks are only tried if they have not been disabled by the user
+    chunks = (True, False) if params.enable_chunks else (False,)
+    candidates, tags = [], set()
+    for tag1D2D in schemes:
+        for enable_chunks in chunks:
+            variant = get_variant(params, tag1D2D, enable_chunks)
+            # the 2D scheme has no chunked mode, and low dimensional formulas are never chunked
+            if variant.params.tag in tags:
+                continue
+            tags.add(variant.params.tag)
+            sizes = (
+                block_sizes
+                if variant.params.use_chunk_mode == 0
+                else (variant.params.cuda_block_size,)
+            )
+            candidates += [
+                (
+                    dict(tag1D2D=tag1D2D, enable_chunks=enable_chunks, cuda_block_size=s),
+                    variant,
+                )
+                for s in sizes
+            ]
+    return candidates
+
+
+def benchmark(binder, variant, nx, ny, cuda_block_size):
+    def run():
+        variant.launch(binder, nx, ny, cuda_block_size)
+        if binder.stream_ptr:
+            # computations on torch streams are asynchronous
+            import torch
+
+            torch.cuda.synchronize()
+
+    run()
+    timings = []
+    for _ in range(nrep):
+        start = time.perf_counter()
+        run()
+        timings.append(time.perf_counter() - start)
+    return min(timings)
+
+
+def get_tuned_launch(binder, nx, ny):
+    """
+    Returns the binder and the CUDA block size to be used for the current call of binder,
+    running the benchmarks if needed.
+    """
+    buckets = size_bucket(nx), size_bucket(ny)
+    if buckets in binder.tuned_launches:
+        return binder.tuned_launches[buckets]
+    with autotune_lock:
+        key = get_key(binder.params, nx, ny)
+        result = load_results().get(key)
+        if result is None:
+            # the variants are compiled before the benchmarks, if needed
+            candidates = get_candidates(binder)
+            pyKeOps_Message(
+                f"Autotuning launch configuration for nx={nx}, ny={ny} ... ",
+                flush=True,
+                end="",
+            )
+            best = None
+            for config, variant in candidates:
+                elapsed = benchmark(binder, variant, nx, ny, config["cuda_block_size"])
+                if best is None or elapsed < best["time"]:
+                    best = dict(config, time=elapsed)
+            result = best
+            save_result(key, result)
+            pyKeOps_Message(
+                f"OK : {'2D' if result['tag1D2D'] else '1D'} scheme, "
+                f"chunks {'enabled' if result['enable_chunks'] else 'disabled'}, "
+                f"block size {result['cuda_block_size']}",
+                use_tag=False,
+                flush=True,
+            )
+        variant = get_variant(binder.params, result["tag1D2D"], result["enable_chunks"])
+        binder.tuned_launches[buckets] = variant, result["cuda_block_size"]
+    return binder.tuned_launches[buckets]
@@ -3,14 +3,16 @@
 
 #include <binders/nvrtc/keops_nvrtc.cpp>
 #include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
 
 namespace py = pybind11;
 
-template< typename TYPE >
-class KeOps_module_python : public KeOps_module< TYPE > {
+// MODULE is KeOps_module (single device) or KeOps_multi_module (several devices)
+template< typename TYPE, template< typename > class MODULE = KeOps_module >
+class KeOps_module_python : public MODULE< TYPE > {
 public:
 
-    using KeOps_module< TYPE >::KeOps_module;
+    using MODULE< TYPE >::MODULE;
 
 
     int operator()(int tagHostDevice, int dimY, int nx, int ny,
@@ -24,7 +26,8 @@ public:
                    py::tuple py_shapeout,
                    long out_void,
                    py::tuple py_arg,
-                   py::tuple py_argshape
+                   py::tuple py_argshape,
+                   long stream_void
     ) {
 
         /*------------------------------------*/
@@ -100,7 +103,14 @@ public:
 //            for (auto j : i)
 //                std::cout << j << " " ;
 
-        return KeOps_module< TYPE >::launch_kernel(tagHostDevice,
+        // stream on which the computation is enqueued (0 means the NULL stream, with synchronous behaviour)
+        CUstream stream = (CUstream) stream_void;
+
+        // all the Python objects have been read: we release the GIL during the computation,
+        // so that several Python threads may run KeOps reductions concurrently.
+        py::gil_scoped_release release;
+
+        return MODULE< TYPE >::launch_kernel(tagHostDevice,
                                                    dimY,
                                                    nx,
                                                    ny,
@@ -122,10 +132,187 @@ public:
                                                    shapeout_v,
                                                    out,
                                                    arg,
-                                                   argshape_v);
+                                                   argshape_v,
+                                                   stream);
+    }
+
+
+    // statistics of the profiler (see Profiler.h) as a dict : timings of the host phases
+    // and of the device operations, by name, counters of transfers and allocations.
+    py::dict get_stats_dict() {
+        KeOps_stats stats;
+        {
+            py::gil_scoped_release release;
+            stats = this->get_stats();
+        }
+        py::dict res, host, device;
+        for (auto &it : stats.host)
+            host[py::str(it.first)] = py::dict(py::arg("count") = it.second.count,
+                                               py::arg("total_ms") = it.second.total_ms,
+                                               py::arg("max_ms") = it.second.max_ms);
+        for (auto &it : stats.device)
+            device[py::str(it.first)] = py::dict(py::arg("count") = it.second.count,
+                                                 py::arg("total_ms") = it.second.total_ms,
+                                                 py::arg("max_ms") = it.second.max_ms);
+        res["formula"] = stats.tag;
+        res["compiled"] = stats.compiled;
+        res["calls"] = stats.calls;
+        res["host"] = host;
+        res["device"] = device;
+        res["bytes_htod"] = stats.bytes_htod;
+        res["bytes_dtoh"] = stats.bytes_dtoh;
+        res["device_allocs"] = stats.device_allocs;
+        res["device_alloc_bytes"] = stats.device_alloc_bytes;
+        res["host_allocs"] = stats.host_allocs;
+        res["host_alloc_bytes"] = stats.host_alloc_bytes;
+        return res;
+    }
+
+    // counters of the launch configurations and of the workspace allocations (see KeOps_plan_stats)
+    py::dict get_plan_stats_dict() {
+        KeOps_plan_stats stats;
+        {
+            py::gil_scoped_release release;
+            stats = this->get_plan_stats();
+        }
+        return py::dict(py::arg("plan_hits") = stats.plan_hits,
+                        py::arg("plan_misses") = stats.plan_misses,
+                        py::arg("workspace_allocs") = stats.workspace_allocs);
+    }
+
+    // events of the profiler, as the dicts of the Chrome trace format
+    py::list get_trace_list() {
+        std::vector< KeOps_trace_event > trace;
+        {
+            py::gil_scoped_release release;
+            trace = this->get_trace();
+        }
+        py::list res;
+        for (auto &e : trace)
+            res.append(py::dict(py::arg("name") = e.name, py::arg("cat") = (e.pid == 1 ? "host" : "device"),
+                                py::arg("ph") = "X", py::arg("pid") = e.pid, py::arg("tid") = e.tid,
+                                py::arg("ts") = e.ts, py::arg("dur") = e.dur,
+                                py::arg("args") = py::dict(py::arg("formula") = e.tag)));
+        return res;
     }
 
 };
+
+
+// Call plan of a reduction : the metadata of the formula (indices and dimensions of the variables,
+// scheme, chunk mode, ...), which are the same for all the calls, are converted once for all when
+// the plan is created. launch only takes the sizes and raw pointers to arrays prepared by the caller,
+// so that there is no conversion of Python objects nor heap allocation at each call :
+//  - arg points to the nargs pointers to the arguments,
+//  - ranges points to the 7 pointers to the ranges arrays (see LoadKeOps.genred),
+//  - shapes points to the 64 bits integers : nargs, then the number of dimensions of the output
+//    followed by its shape, then the same for each argument.
+template< typename TYPE, template< typename > class MODULE = KeOps_module >
+class KeOps_call_plan {
+public:
+
+    KeOps_module_python< TYPE, MODULE > &module;
+    int tagHostDevice, dimY, tagI, tagZero, use_half, tag1D2D, dimred, use_chunk_mode, dimout;
+    std::vector< int > indsi, indsj, indsp, dimsx, dimsy, dimsp;
+
+    KeOps_call_plan(KeOps_module_python< TYPE, MODULE > &module_,
+                    int tagHostDevice_, int dimY_,
+                    int tagI_, int tagZero_, int use_half_,
+                    int tag1D2D_, int dimred_, int use_chunk_mode_,
+                    std::vector< int > indsi_, std::vector< int > indsj_, std::vector< int > indsp_,
+                    int dimout_,
+                    std::vector< int > dimsx_, std::vector< int > dimsy_, std::vector< int > dimsp_) :
+            module(module_), tagHostDevice(tagHostDevice_), dimY(dimY_),
+            tagI(tagI_), tagZero(tagZero_), use_half(use_half_),
+            tag1D2D(tag1D2D_), dimred(dimred_), use_chunk_mode(use_chunk_mode_), dimout(dimout_),
+            indsi(indsi_), indsj(indsj_), indsp(indsp_),
+            dimsx(dimsx_), dimsy(dimsy_), dimsp(dimsp_) {}
+
+    static const int64_t *read_shape(const int64_t *shapes, std::vector< int > &shape) {
+        shape.resize(shapes[0]);
+        for (int64_t k = 0; k < shapes[0]; k++)
+            shape[k] = (int) shapes[k + 1];
+        return shapes + shapes[0] + 1;
+    }
+
+    int launch(int nx, int ny, int cuda_block_size,
+               long ranges_void, long out_void, long arg_void, long shapes_void,
+               long stream_void) {
+
+        // the shapes are read in buffers owned by the thread, which keep their capacity from one
+        // call to the next (the GIL is released below, so the plan may be used by several threads)
+        static thread_local std::vector< int > shapeout;
+        static thread_local std::vector< std::vector< int > > argshape;
+
+        const int64_t *shapes = (const int64_t *) shapes_void;
+        int nargs = (int) *shapes++;
+        shapes = read_shape(shapes, shapeout);
+        argshape.resize(nargs);
+        for (int k = 0; k < nargs; k++)
+            shapes = read_shape(shapes, argshape[k]);
+
+        py::gil_scoped_release release;
+
+        return module.launch_kernel(tagHostDevice, dimY, nx, ny,
+                                    tagI, tagZero, use_half,
+                                    tag1D2D, dimred,
+                                    cuda_block_size, use_chunk_mode,
+                                    indsi, indsj, indsp,
+                                    dimout,
+                                    dimsx, dimsy, dimsp,
+                                    (int **) ranges_void,
+                                    shapeout, (TYPE *) out_void,
+                                    (TYPE **) arg_void,
+                                    argshape,
+                                    (CUstream) stream_void);
+    }
+
+    // number of elements of the intermediate output of a call, for the sizes nx, ny of the binders
+    // (i.e. with tagI=1 for reductions over i) including the batch dimensions (see KeOps_module::get_buffer_size)
+    size_t buffer_size(int nx, int ny, int cuda_block_size, int tagRanges) {
+        if (tagI == 1)
+            std::swap(nx, ny);
+        py::gil_scoped_release release;
+        return module.get_buffer_size(nx, ny, tag1D2D, tagRanges, dimY, dimred,
+                                      cuda_block_size, use_chunk_mode);
+    }
+
+};
+
+
+// DEVICE_IDS is the type of the first argument of the constructor of MODULE : a device id
+// for KeOps_module, a list of device ids for KeOps_multi_module
+template< typename TYPE, template< typename > class MODULE, typename DEVICE_IDS >
+void def_module(py::module &m, const char *name) {
+    typedef KeOps_module_python< TYPE, MODULE > Module;
+    py::class_< Module >(m, name)
+    .def(py::init< DEVICE_IDS, int, const char * >())
+    .def("__call__", &Module::operator())
+    .def("set_cuda_graphs", &Module::set_cuda_graphs)
+    .def("set_pipelined", &Module::set_pipelined)
+    .def("set_profiling", &Module::set_profiling)
+    .def("get_stats", &Module::get_stats_dict)
+    .def("get_trace", &Module::get_trace_list)
+    .def("reset_stats", &Module::reset_stats)
+    .def("write_trace", &Module::write_trace)
+    .def("get_plan_stats", &Module::get_plan_stats_dict)
+    .def("set_resident_args", &Module::set_resident_args)
+    .def("release_resident_args", &Module::release_resident_args);
+}
+
+
+template< typename TYPE, template< typename > class MODULE >
+void def_call_plan(py::module &m, const char *name) {
+    py::class_< KeOps_call_plan< TYPE, MODULE > >(m, name)
+    .def(py::init<KeOps_module_python< TYPE, MODULE > &, int, int, int, int, int, int, int, int,
+                  std::vector< int >, std::vector< int >, std::vector< int >, int,
+                  std::vector< int >, std::vector< int >, std::vector< int > >(),
+         py::keep_alive<1, 2>())
+    .def("launch", &KeOps_call_plan< TYPE, MODULE >::launch)
+    .def("buffer_size", &KeOps_call_plan< TYPE, MODULE >::buffer_size);
+}
+
+
 /////////////////////////////////////////////////////////////////////////////////
 //                    PyBind11 entry point                                     //
 /////////////////////////////////////////////////////////////////////////////////
@@ -134,15 +321,18 @@ public:
 PYBIND11_MODULE(pykeops_nvrtc, m) {
 m.doc() = "pyKeOps: KeOps for pytorch through pybind11 (pytorch flavour).";
 
-py::class_< KeOps_module_python< float > >(m, "KeOps_module_float")
-.def(py::init<int, int, const char *>())
-.def("__call__", &KeOps_module_python< float >::operator());
-
-py::class_< KeOps_module_python< double > >(m, "KeOps_module_double")
-.def(py::init<int, int, const char *>())
-.def("__call__", &KeOps_module_python< double >::operator());
-
-py::class_< KeOps_module_python< half2 > >(m, "KeOps_module_half2")
-.def(py::init<int, int, const char *>())
-.def("__call__", &KeOps_module_python< half2 >::operator());
+def_module< float, KeOps_module, int >(m, "KeOps_module_float");
+def_module< double, KeOps_module, int >(m, "KeOps_module_double");
+def_module< half2, KeOps_module, int >(m, "KeOps_module_half2");
+def_module< __nv_bfloat16, KeOps_module, int >(m, "KeOps_module___nv_bfloat16");
+// multi-device computations are not available in half precision (see KeOps_multi_module::launch_kernel)
+def_module< float, KeOps_multi_module, std::vector< int > >(m, "KeOps_multi_module_float");
+def_module< double, KeOps_multi_module, std::vector< int > >(m, "KeOps_multi_module_double");
+
+def_call_plan< float, KeOps_module >(m, "KeOps_call_plan_float");
+def_call_plan< double, KeOps_module >(m, "KeOps_call_plan_double");
+def_call_plan< half2, KeOps_module >(m, "KeOps_call_plan_half2");
+def_call_plan< __nv_bfloat16, KeOps_module >(m, "KeOps_call_plan___nv_bfloat16");
+def_call_plan< float, KeOps_multi_module >(m, "KeOps_multi_call_plan_float");
+def_call_plan< double, KeOps_multi_module >(m, "KeOps_multi_call_plan_double");
 }
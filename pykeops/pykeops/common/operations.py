@@ -1,6 +1,8 @@
+import weakref
+
 import numpy as np
 
-from pykeops.common.utils import get_tools
+from pykeops.common.utils import axis2cat, get_tools
 
 
 # Some advance operations defined at user level use in fact other reductions.
@@ -28,6 +30,22 @@ def preprocess(reduction_op, formula2):
     return reduction_op_internal, formula2
 
 
+def reduction_formula(reduction_op_internal, formula, opt_arg, axis, formula2):
+    # string of the KeOps reduction of formula, e.g. "Sum_Reduction(Exp(-SqDist(x,y)),0)"
+    str_opt_arg = "," + str(opt_arg) if opt_arg else ""
+    str_formula2 = "," + formula2 if formula2 else ""
+    return (
+        reduction_op_internal
+        + "_Reduction("
+        + formula
+        + str_opt_arg
+        + ","
+        + str(axis2cat(axis))
+        + str_formula2
+        + ")"
+    )
+
+
 def postprocess(out, binding, reduction_op, nout, opt_arg, dtype):
     tools = get_tools(binding)
     # Post-processing of the output:
@@ -80,6 +98,176 @@ def postprocess(out, binding, reduction_op, nout, opt_arg, dtype):
     return out
 
 
+class FusedReductions:
+    """
+    Fused mode of Genred, used when formula and reduction_op are lists : the reductions are computed
+    by a single KeOps Fused_Reduction, which evaluates all the formulas in the same pass over the data,
+    sharing their common subformulas. opt_arg and formula2 may be lists too, or values shared by all
+    the reductions. The output of the fused reduction is split and post-processed for each reduction.
+    """
+
+    sum_types = ("Sum", "Max_SumShiftExp", "Max_SumShiftExpWeight")
+
+    def __init__(self, formulas, reduction_ops, axis, opt_args, formulas2):
+        n = len(formulas)
+
+        def as_list(arg):
+            return list(arg) if isinstance(arg, (list, tuple)) else [arg] * n
+
+        self.reduction_ops, self.opt_args = as_list(reduction_ops), as_list(opt_args)
+        self.parts, ops_internal = [], []
+        for formula, reduction_op, opt_arg, formula2 in zip(
+            formulas, self.reduction_ops, self.opt_args, as_list(formulas2)
+        ):
+            reduction_op_internal, formula2 = preprocess(reduction_op, formula2)
+            self.parts.append(
+                reduction_formula(
+                    reduction_op_internal, formula, opt_arg, axis, formula2
+                )
+            )
+            ops_internal.append(reduction_op_internal)
+        self.formula = "Fused_Reduction(" + ",".join(self.parts) + ")"
+        # options are checked against the first reduction which is not of sum type, if any
+        self.reduction_op_internal = next(
+            (op for op in ops_internal if op not in self.sum_types), ops_internal[0]
+        )
+        self.dims = None
+
+    def postprocess(self, out, binding, nout, dtype, aliases):
+        tools = get_tools(binding)
+        if self.dims is None:
+            from keopscore.formulas.GetReduction import GetReduction
+
+            self.dims = [GetReduction(part, aliases).dim for part in self.parts]
+        res, start = [], 0
+        for dim, reduction_op, opt_arg in zip(
+            self.dims, self.reduction_ops, self.opt_args
+        ):
+            outk = tools.contiguous(out[..., start : start + dim])
+            res.append(postprocess(outk, binding, reduction_op, nout, opt_arg, dtype))
+            start += dim
+        return tuple(res)
+
+
+class ResidentArgs:
+    """
+    Resident arguments of Genred, which stay the same from call to call : e.g. the points y_j and weights b_j
+    of a database queried with new points x_i.
+    In computations on host data with the Gpu, the binder keeps device copies of these arguments, instead
+    of copying them at each call. Moreover, the subformulas which only depend on resident j variables and
+    parameters (e.g. |y_j|^2 or Exp(-|y_j|^2), see keopscore/formulas/hoisting.py) are evaluated for all j
+    by a first reduction, when the resident arguments are given for the first time : the main reduction then
+    reads these memoized per-j values, instead of evaluating the subformulas for each pair (i,j).
+    The memoized values and the device copies are computed again when a resident argument is replaced by
+    another array (another object, even at the data pointer of a freed one, or with another shape, or for
+    torch tensors, after in place modifications). After in place modifications of a numpy array, reset must
+    be called.
+    N.B. memoized values are not used for fused reductions, batch dimensions, and torch tensors which
+    require gradients.
+    """
+
+    def __init__(self, resident, aliases, binding, reduction_op_internal, *reduction):
+        # reduction is (formula, opt_arg, axis, formula2), or None for fused reductions
+        from keopscore.formulas.hoisting import hoist_static_subformulas
+        from pykeops.common.parse_type import get_type, complete_aliases
+
+        self.binding = binding
+        names, aliases_var = {}, []
+        for k, alias in enumerate(aliases):
+            name, cat, dim, pos = get_type(alias, position_in_list=k)
+            if name:
+                names[name] = pos
+                aliases_var.append(f"{name}=Var({pos},{dim},{cat})")
+        self.inds = sorted(names[r] if isinstance(r, str) else r for r in resident)
+        self.hoisted, self.routines = [], []
+        if reduction[0] is not None:
+            formula, opt_arg, axis, formula2 = reduction
+            formulas = [formula] + ([formula2] if formula2 else [])
+            res = hoist_static_subformulas(
+                formulas, aliases_var, self.inds, len(aliases)
+            )
+            if res:
+                formulas, self.hoisted = res
+                self.formula = reduction_formula(
+                    reduction_op_internal,
+                    formulas[0],
+                    opt_arg,
+                    axis,
+                    formulas[1] if formula2 else None,
+                )
+                self.aliases = complete_aliases(self.formula, list(aliases))
+                # the per-j values are computed as reductions over i, without i variables
+                tools = get_tools(binding)
+                self.routines = [
+                    tools.Genred(subformula, [], reduction_op="Sum", axis=0)
+                    for _, subformula, _ in self.hoisted
+                ]
+        # the memoized values are resident too
+        nhoisted = len(self.hoisted)
+        resident_args = self.inds + list(range(len(aliases), len(aliases) + nhoisted))
+        self.optional_flags = dict(resident_args=tuple(resident_args))
+        self.key, self.values, self.refs = None, None, ()
+
+    def get_key(self, args):
+        tools = get_tools(self.binding)
+        return tuple(
+            (
+                tools.get_pointer(args[k]),
+                tuple(args[k].shape),
+                getattr(args[k], "_version", 0),
+            )
+            for k in self.inds
+        )
+
+    def same_arrays(self, args):
+        # the resident arrays are referred to by weak references, so that they may be freed ; a new
+        # array may then be allocated at the same address, with the same shape and version counter
+        return len(self.refs) == len(self.inds) and all(
+            ref() is args[k] for ref, k in zip(self.refs, self.inds)
+        )
+
+    def __call__(self, args, backend, device_id):
+        # returns the arguments of the main reduction, and True if they include the memoized
+        # values, in which case the reduction must be computed with self.formula and self.aliases
+        key = self.get_key(args)
+        if key != self.key or not self.same_arrays(args):
+            # the device copies are made by the binder from the data pointers : they are
+            # released whenever the arrays change, including at the first call, since other
+            # routines may have left copies of freed arrays at the same addresses.
+            self.release_device_copies()
+            self.key, self.values = key, None
+            self.refs = tuple(weakref.ref(args[k]) for k in self.inds)
+        if len(self.hoisted) == 0 or max(len(arg.shape) for arg in args) > 2:
+            return args, False
+        if self.binding == "torch" and any(args[k].requires_grad for k in self.inds):
+            return args, False
+        if self.values is None:
+            self.values = tuple(
+                routine(*(args[k] for k in inds), backend=backend, device_id=device_id)
+                for routine, (_, _, inds) in zip(self.routines, self.hoisted)
+            )
+        return tuple(args) + self.values, True
+
+    def reset(self):
+        self.key, self.values, self.refs = None, None, ()
+        self.release_device_copies()
+
+    @staticmethod
+    def release_device_copies():
+        # N.B. the device copies of all the binders are released, including the ones
+        # of the gradients of the reduction, which have the same resident arguments.
+        import keopscore.config
+
+        if keopscore.config.config.use_cuda:
+            from pykeops.common.keops_io import keops_binder
+
+            for obj in keops_binder["nvrtc"].library.values():
+                if getattr(obj.params, "resident_args", ()) and hasattr(
+                    obj, "launch_keops"
+                ):
+                    obj.launch_keops.release_resident_args()
+
+
 def ConjugateGradientSolver(binding, linop, b, eps=1e-6):
     # Conjugate gradient algorithm to solve linear system of the form
     # Ma=b where linop is a linear operation corresponding
@@ -1,5 +1,6 @@
+from .far_field import far_field_sum
 from .grid_cluster import grid_cluster
-from .matrix import from_matrix
+from .matrix import from_matrix, from_offsets
 from .utils import (
     sort_clusters,
     cluster_ranges,
@@ -11,8 +12,10 @@ from .utils import (
 # N.B.: the order is important for the autodoc in sphinx!
 __all__ = sorted(
     [
+        "far_field_sum",
         "grid_cluster",
         "from_matrix",
+        "from_offsets",
         "sort_clusters",
         "cluster_ranges",
         "cluster_centroids",
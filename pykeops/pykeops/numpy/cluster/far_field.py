@@ -0,0 +1,221 @@
+import math
+import warnings
+
+import numpy as np
+
+from pykeops.numpy.cluster.matrix import from_matrix
+
+
+def chebyshev_nodes(order, dtype):
+    # Chebyshev nodes of the first kind in [-1,1]
+    k = np.arange(order, dtype=dtype)
+    return np.cos((2 * k + 1) * np.pi / (2 * order))
+
+
+def lagrange_basis(t, nodes):
+    # values of the Lagrange polynomials of the nodes at t, (...) -> (...,order)
+    L = []
+    for m in range(len(nodes)):
+        Lm = np.ones_like(t)
+        for k in range(len(nodes)):
+            if k != m:
+                Lm = Lm * (t - nodes[k]) / (nodes[m] - nodes[k])
+        L.append(Lm)
+    return np.stack(L, axis=-1)
+
+
+def sorted_ranges(lab, nclusters):
+    # [start,end) indices of the clusters of a vector of sorted labels, as int32
+    counts = np.bincount(lab, minlength=nclusters)
+    pivots = np.concatenate(([0], np.cumsum(counts)))
+    return np.stack((pivots[:-1], pivots[1:]), axis=1).astype("int32"), counts
+
+
+def bounding_boxes(x, lab, counts):
+    # centers and half widths of the bounding boxes of the clusters
+    C, D = len(counts), x.shape[1]
+    lo = np.full((C, D), np.inf, dtype=x.dtype)
+    hi = np.full((C, D), -np.inf, dtype=x.dtype)
+    np.minimum.at(lo, lab, x)
+    np.maximum.at(hi, lab, x)
+    empty = counts == 0
+    lo[empty], hi[empty] = 0, 0
+    return (lo + hi) / 2, (hi - lo) / 2
+
+
+def far_field_sum(
+    formula,
+    aliases,
+    x,
+    y,
+    b,
+    *params,
+    x_labels,
+    y_labels,
+    eps=1e-3,
+    eta=0.5,
+    max_order=8,
+    max_proxies=4096,
+    n_check=100,
+    backend="auto",
+):
+    r"""Approximates a kernel sum with exact near-field and interpolated far-field interactions.
+
+    This routine computes
+
+    .. math::
+        a_i = \sum_j K(x_i, y_j)\, b_j
+
+    up to a relative error **eps**, where the formula ``"K(x,y) * b"`` must be **linear**
+    in :math:`b_j` and **smooth** in :math:`y_j` away from :math:`x_i`. Given cluster labels
+    for the :math:`x_i`'s and :math:`y_j`'s (computed e.g. with :func:`grid_cluster`),
+    interactions between a cluster :math:`k` of :math:`x_i`'s and a cluster :math:`\ell` of
+    :math:`y_j`'s are split in two parts:
+
+    - If the clusters are **well separated**, i.e. if the sum of the radii of their
+      bounding boxes is smaller than **eta** times the distance between their centers,
+      the kernel is interpolated in :math:`y` on a tensor grid of :math:`q^D`
+      Chebyshev nodes :math:`p_{\ell,m}` of the bounding box of cluster :math:`\ell`:
+
+      .. math::
+          \sum_{j\in\ell} K(x_i, y_j)\, b_j \simeq \sum_m K(x_i, p_{\ell,m})\, W_{\ell,m},
+          \qquad W_{\ell,m} = \sum_{j\in\ell} L_m(y_j)\, b_j,
+
+      where the :math:`L_m` are the Lagrange polynomials of the grid. For :math:`q=1`,
+      this is a monopole expansion at the center of the box.
+
+    - Otherwise, the interaction is computed **exactly**.
+
+    Both parts are block-sparse reductions computed by the same KeOps routine, with
+    **ranges** arguments built by :func:`from_matrix`: if the clusters are small with respect
+    to the scale of the kernel, the cost is roughly linear in the number of points.
+    The order :math:`q` is chosen from **eps** and **eta**, and the error is then estimated
+    by comparison with the exact sums on **n_check** random rows: :math:`q` is increased
+    until the estimated error is smaller than **eps**, or equal to **max_order**.
+
+    Note:
+        Since each cluster has :math:`q^D` proxies, this routine is meant for points in
+        **low dimension** (typically :math:`D\leqslant 4`). A ValueError is raised if
+        the order required by **eps** gives more than **max_proxies** proxies per cluster.
+
+    Args:
+        formula (string): Formula of the summand, e.g. ``"Exp(-g * SqDist(x,y)) * b"``.
+        aliases (list of strings): Aliases of the variables of the formula, starting with
+            the ":math:`i`" variable :math:`x_i`, the ":math:`j`" variable :math:`y_j` and
+            the ":math:`j`" variable :math:`b_j`, e.g. ``["x = Vi(3)", "y = Vj(3)", "b = Vj(1)",
+            "g = Pm(1)"]``.
+        x ((M,D) array): Points :math:`x_i`.
+        y ((N,D) array): Points :math:`y_j`.
+        b ((N,E) array): Signal :math:`b_j`.
+        *params (arrays): The other arguments of the formula, which must be parameters.
+
+    Keyword Args:
+        x_labels ((M,) int array): Cluster labels of the :math:`x_i`'s.
+        y_labels ((N,) int array): Cluster labels of the :math:`y_j`'s.
+        eps (float): Target relative error. Default is 1e-3.
+        eta (float): Admissibility parameter of the pairs of clusters in the far field,
+            smaller values giving more accurate interpolations but more near field
+            interactions. Default is 0.5.
+        max_order (int): Maximum number :math:`q` of interpolation nodes per dimension.
+            Default is 8.
+        max_proxies (int): Maximum number :math:`q^D` of interpolation nodes per cluster,
+            which bounds the memory footprint of the far field. Default is 4096.
+        n_check (int): Number of random rows :math:`i` used to estimate the error.
+            Default is 100.
+        backend (string): Backend of the KeOps reductions. Default is "auto".
+
+    Returns:
+        (M,E) array, float:
+        The approximate sums :math:`a_i`, in the order of the :math:`x_i`'s,
+        and the estimated relative error.
+
+    Example:
+        >>> x, y = np.random.rand(100000, 3), np.random.rand(200000, 3)
+        >>> b, g = np.random.randn(200000, 1), np.array([10.0])
+        >>> a, err = far_field_sum(
+        ...     "Exp(-g * SqDist(x,y)) * b",
+        ...     ["x = Vi(3)", "y = Vj(3)", "b = Vj(1)", "g = Pm(1)"],
+        ...     x, y, b, g,
+        ...     x_labels=grid_cluster(x, 0.05),
+        ...     y_labels=grid_cluster(y, 0.05),
+        ...     eps=1e-4,
+        ... )
+    """
+    M, D = x.shape
+    order = max(1, min(max_order, math.ceil(math.log(eps) / math.log(eta / 2))))
+    if order**D > max_proxies:
+        raise ValueError(
+            f"[KeOps] far_field_sum: an order {order} interpolation in dimension {D} "
+            f"needs {order**D} proxies per cluster (max_proxies={max_proxies}). This "
+            "approximation is meant for low dimensional points : please use a larger "
+            "value of eps or an exact reduction."
+        )
+    while max_order**D > max_proxies:
+        max_order -= 1
+
+    from pykeops.numpy import Genred
+
+    routine = Genred(formula, aliases, reduction_op="Sum", axis=1)
+
+    # sort the points by cluster and compute the bounding boxes
+    x_labels, y_labels = x_labels.reshape(-1), y_labels.reshape(-1)
+    Cx, Cy = int(x_labels.max()) + 1, int(y_labels.max()) + 1
+    perm_x = np.argsort(x_labels, kind="stable")
+    perm_y = np.argsort(y_labels, kind="stable")
+    lab_x, lab_y = x_labels[perm_x], y_labels[perm_y]
+    x_s, y_s, b_s = x[perm_x], y[perm_y], b[perm_y]
+    ranges_x, counts_x = sorted_ranges(lab_x, Cx)
+    ranges_y, counts_y = sorted_ranges(lab_y, Cy)
+    center_x, hw_x = bounding_boxes(x_s, lab_x, counts_x)
+    center_y, hw_y = bounding_boxes(y_s, lab_y, counts_y)
+    radii = np.linalg.norm(hw_x, axis=1)[:, None]
+    radii = radii + np.linalg.norm(hw_y, axis=1)[None, :]
+    dist = np.linalg.norm(center_x[:, None, :] - center_y[None, :, :], axis=2)
+    far = radii < eta * dist
+    # projects the points y_j on [-1,1]^D in their boxes
+    t = (y_s - center_y[lab_y]) / np.maximum(hw_y[lab_y], 1e-12)
+
+    ranges = from_matrix(ranges_x, ranges_y, ~far)
+    out = routine(x_s, y_s, b_s, *params, backend=backend, ranges=ranges)
+    if not far.any():
+        return out[np.argsort(perm_x)], 0.0
+
+    # exact sums on random rows, to estimate the error
+    check = np.random.permutation(M)[:n_check]
+    exact = routine(x_s[check], y_s, b_s, *params, backend=backend)
+    norm = np.linalg.norm(exact)
+
+    chunk = max(1, 2**24 // max_order**D)
+    while True:
+        nodes = chebyshev_nodes(order, x.dtype)
+        grid = np.stack(np.meshgrid(*([nodes] * D), indexing="ij"), axis=-1)
+        grid = grid.reshape(1, -1, D)
+        Q = grid.shape[1]
+        proxies = (center_y[:, None, :] + hw_y[:, None, :] * grid).reshape(-1, D)
+        pivots = np.arange(Cy + 1) * Q
+        ranges_p = np.stack((pivots[:-1], pivots[1:]), axis=1).astype("int32")
+        # weights of the proxies, computed by chunks of points to bound the memory footprint
+        W = np.zeros((Cy * Q, b_s.shape[1]), dtype=b_s.dtype)
+        for start in range(0, len(y_s), chunk):
+            L = lagrange_basis(t[start : start + chunk], nodes)
+            basis = L[:, 0, :]
+            for d in range(1, D):
+                basis = (basis[:, :, None] * L[:, d, None, :]).reshape(len(L), -1)
+            lab = lab_y[start : start + chunk, None]
+            inds = lab * Q + np.arange(Q)
+            Wk = basis[:, :, None] * b_s[start : start + chunk, None, :]
+            np.add.at(W, inds.reshape(-1), Wk.reshape(-1, W.shape[1]))
+        ranges = from_matrix(ranges_x, ranges_p, far)
+        res = out + routine(x_s, proxies, W, *params, backend=backend, ranges=ranges)
+        err = np.linalg.norm(res[check] - exact) / norm if norm > 0 else 0.0
+        if err <= eps or order >= max_order:
+            break
+        order += 1
+
+    if err > eps:
+        warnings.warn(
+            f"[KeOps] far_field_sum: the estimated relative error {err:.2e} is "
+            f"larger than eps={eps:.2e} with order {order}. Please use "
+            "smaller clusters or a smaller value of eta."
+        )
+    return res[np.argsort(perm_x)], float(err)
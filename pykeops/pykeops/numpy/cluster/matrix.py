@@ -128,3 +128,44 @@ def from_matrix(ranges_i, ranges_j, keep):
         slices_j.astype("int32"),
         redranges_i.astype("int32"),
     )
+
+
+def from_offsets(offsets_i, offsets_j):
+    r"""Turns a ragged batch of independent problems into a KeOps-friendly **ranges** argument.
+
+    Problem :math:`p` of the batch is a reduction between the variables
+    ``x_i[ offsets_i[p]:offsets_i[p+1], : ]`` and ``y_j[ offsets_j[p]:offsets_j[p+1], : ]``,
+    as in the CSR format of sparse matrices : the problems may have different sizes,
+    and are solved by a single call of a KeOps reduction with the output ``ranges`` of
+    :func:`from_offsets`. On the GPU, large batches of small problems are handled by a
+    persistent kernel, whose blocks pull the tiles of the problems from a queue.
+
+    Args:
+        offsets_i ((P+1,) int32 array): Indices of the first ":math:`i`" variable of each problem,
+            followed by the total number of ":math:`i`" variables.
+        offsets_j ((P+1,) int32 array): Indices of the first ":math:`j`" variable of each problem,
+            followed by the total number of ":math:`j`" variables.
+
+    Returns:
+        A 6-uple of int32 arrays that can be used as an optional **ranges**
+        argument of :class:`numpy.Genred <pykeops.numpy.Genred>`, for reductions with respect
+        to ":math:`i`" or ":math:`j`".
+
+    Example:
+        >>> offsets_i = np.array( [0, 3, 8] )   # 2 problems, with 3 and 5 "i" variables
+        >>> offsets_j = np.array( [0, 4, 6] )   # and 4 and 2 "j" variables
+        >>> (ranges_i,slices_i,redranges_j, ranges_j,slices_j,redranges_i) = from_offsets(offsets_i, offsets_j)
+        >>> print(ranges_i)
+        [[0 3]
+         [3 8]]
+        >>> print(slices_i)
+        [1 2]
+        >>> print(redranges_j)
+        [[0 4]
+         [4 6]]
+    """
+    ranges_i = np.stack((offsets_i[:-1], offsets_i[1:]), axis=1).astype("int32")
+    ranges_j = np.stack((offsets_j[:-1], offsets_j[1:]), axis=1).astype("int32")
+    # one range of the other variables per problem
+    slices = np.arange(1, len(ranges_i) + 1, dtype="int32")
+    return (ranges_i, slices, ranges_j, ranges_j, slices, ranges_i)
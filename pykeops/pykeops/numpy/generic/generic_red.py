@@ -1,9 +1,14 @@
 import numpy as np
 
 from pykeops.common.get_options import get_tag_backend
-from pykeops.common.operations import preprocess, postprocess
+from pykeops.common.operations import (
+    preprocess,
+    postprocess,
+    reduction_formula,
+    FusedReductions,
+    ResidentArgs,
+)
 from pykeops.common.parse_type import get_sizes, complete_aliases, get_optional_flags
-from pykeops.common.utils import axis2cat
 from pykeops import default_device_id
 from pykeops.common.utils import pyKeOps_Warning
 
@@ -64,6 +69,7 @@ class Genred:
         sum_scheme="auto",
         enable_chunks=True,
         rec_multVar_highdim=False,
+        resident=None,
     ):
         r"""
         Instantiate a new generic operation.
@@ -77,6 +83,9 @@ class Genred:
                 that should be computed and reduced.
                 The correct syntax is described in the :doc:`documentation <../../Genred>`,
                 using appropriate :doc:`mathematical operations <../../../api/math-operations>`.
+                If **formula** is a list of strings, the corresponding reductions are fused : they are computed
+                in a single pass over the data, sharing their common subformulas, and a tuple of outputs is
+                returned. **reduction_op**, **opt_arg** and **formula2** may then be lists too.
             aliases (list of strings): A list of identifiers of the form ``"AL = TYPE(DIM)"``
                 that specify the categories and dimensions of the input variables. Here:
 
@@ -135,6 +144,15 @@ class Genred:
                                 with formulas involving large dimension variables. Beware ! This will only work if the formula has the very special form
                                 that allows such computation mode.
 
+            resident (list of strings or integers, default None): names (aliases) or positions of the arguments which
+                                stay the same from call to call, e.g. the points and weights of a database queried with new points.
+                                Host arrays are then copied once to the Gpu, and the subformulas which only depend on resident
+                                ``Vj`` and ``Pm`` variables (e.g. ``SqNorm2(y)``) are evaluated once for all :math:`j` and memoized,
+                                instead of being evaluated for each pair :math:`(i,j)`. The memoized values are computed again
+                                when a resident argument is replaced by another array (even if it is stored at the address
+                                of a freed one); after in place modifications of a resident array, :meth:`reset_resident`
+                                must be called.
+
         """
 
         if dtype:
@@ -147,7 +165,16 @@ class Genred:
             )
 
         self.reduction_op = reduction_op
-        reduction_op_internal, formula2 = preprocess(reduction_op, formula2)
+        # with lists of formulas and reduction operations, the reductions are fused
+        self.fused = (
+            FusedReductions(formula, reduction_op, axis, opt_arg, formula2)
+            if isinstance(formula, (list, tuple))
+            else None
+        )
+        if self.fused:
+            reduction_op_internal = self.fused.reduction_op_internal
+        else:
+            reduction_op_internal, formula2 = preprocess(reduction_op, formula2)
 
         self.optional_flags = get_optional_flags(
             reduction_op_internal,
@@ -162,24 +189,34 @@ class Genred:
         else:
             self.optional_flags["multVar_highdim"] = 0
 
-        str_opt_arg = "," + str(opt_arg) if opt_arg else ""
-        str_formula2 = "," + formula2 if formula2 else ""
-
-        self.formula = (
-            reduction_op_internal
-            + "_Reduction("
-            + formula
-            + str_opt_arg
-            + ","
-            + str(axis2cat(axis))
-            + str_formula2
-            + ")"
-        )
+        if self.fused:
+            self.formula = self.fused.formula
+        else:
+            self.formula = reduction_formula(
+                reduction_op_internal, formula, opt_arg, axis, formula2
+            )
         self.aliases = complete_aliases(self.formula, aliases)
 
         self.axis = axis
         self.opt_arg = opt_arg
 
+        # arguments which stay the same from call to call, and memoized subformulas
+        self.resident = None
+        if resident:
+            reduction = (None,) if self.fused else (formula, opt_arg, axis, formula2)
+            self.resident = ResidentArgs(
+                resident, self.aliases, "numpy", reduction_op_internal, *reduction
+            )
+            self.optional_flags.update(self.resident.optional_flags)
+
+    def reset_resident(self):
+        r"""
+        Drops the memoized values and the device copies of the resident arguments,
+        which are computed again at the next call.
+        """
+        if self.resident:
+            self.resident.reset()
+
     def __call__(self, *args, backend="auto", device_id=-1, ranges=None, out=None):
         r"""
         Apply the routine on arbitrary NumPy arrays.
@@ -215,7 +252,9 @@ class Genred:
             device_id (int, default=-1): Specifies the GPU that should be used
                 to perform the computation; a negative value lets your system
                 choose the default GPU. This parameter is only useful if your
-                system has access to several GPUs.
+                system has access to several GPUs. A list of GPU ids may also be given,
+                in which case the output lines are split in slices computed concurrently
+                on these GPUs (no ranges and no batch dimensions in this case).
 
             ranges (6-uple of integer arrays, None by default):
                 Ranges of integers that specify a
@@ -284,6 +323,12 @@ class Genred:
             that is inferred from the **formula**.
         """
 
+        formula, aliases = self.formula, self.aliases
+        if self.resident:
+            args, memoized = self.resident(args, backend, device_id)
+            if memoized:
+                formula, aliases = self.resident.formula, self.resident.aliases
+
         # Get tags
         tagCPUGPU, tag1D2D, tagHostDevice = get_tag_backend(backend, args)
 
@@ -306,8 +351,8 @@ class Genred:
             tagHostDevice,
             use_ranges,
             device_id,
-            self.formula,
-            self.aliases,
+            formula,
+            aliases,
             len(args),
             dtype,
             "numpy",
@@ -327,10 +372,11 @@ class Genred:
         if ranges:
             ranges = tuple(np.ascontiguousarray(r) for r in ranges)
 
-        nx, ny = get_sizes(self.aliases, *args)
+        nx, ny = get_sizes(aliases, *args)
         nout, nred = (nx, ny) if self.axis == 1 else (ny, nx)
 
-        if "Arg" in self.reduction_op:
+        reduction_ops = self.fused.reduction_ops if self.fused else [self.reduction_op]
+        if any("Arg" in reduction_op for reduction_op in reduction_ops):
             # when using Arg type reductions,
             # if nred is greater than 16 millions and dtype=float32, the result is not reliable
             # because we encode indices as floats, so we raise an exception ;
@@ -346,4 +392,6 @@ class Genred:
 
         out = self.myconv.genred_numpy(-1, ranges, nx, ny, nbatchdims, out, *args)
 
+        if self.fused:
+            return self.fused.postprocess(out, "numpy", nout, dtype, self.aliases)
         return postprocess(out, "numpy", self.reduction_op, nout, self.opt_arg, dtype)
@@ -135,6 +135,10 @@ class numpytools:
     def device_dict(x):
         return dict(cat="cpu")
 
+    @staticmethod
+    def get_stream(device):
+        return 0
+
 
 def squared_distances(x, y):
     x_norm = (x**2).sum(1).reshape(-1, 1)
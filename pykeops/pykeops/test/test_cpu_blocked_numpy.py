@@ -0,0 +1,44 @@
+import numpy as np
+import pytest
+
+from pykeops.numpy import Genred
+
+# sizes which are not multiples of the tiles and SIMD widths of the blocked CPU reductions
+M, N, D = 1037, 5003, 3
+
+np.random.seed(0)
+x = np.random.rand(M, D)
+y = np.random.rand(N, D)
+b = np.random.randn(N, 2)
+
+formula = "Exp(-SqDist(x,y)) * b"
+aliases = ["x = Vi(3)", "y = Vj(3)", "b = Vj(2)"]
+
+K = np.exp(-((x[:, None, :] - y[None, :, :]) ** 2).sum(-1))[:, :, None] * b[None, :, :]
+
+# the log-sum-exp reductions merge the (max, shifted sum) pairs of the SIMD lanes : with a
+# sharp kernel, the maxima of the lanes differ by orders of magnitude
+formula_lse = "-SqDist(x,y) * IntCst(20)"
+F = -20 * ((x[:, None, :] - y[None, :, :]) ** 2).sum(-1)
+Fmax = F.max(1, keepdims=True)
+E = np.exp(F - Fmax)
+
+
+@pytest.mark.parametrize(
+    "reduction_op, formula, formula2, ref",
+    [
+        ("Sum", formula, None, K.sum(1)),
+        ("Max", formula, None, K.max(1)),
+        ("Min", formula, None, K.min(1)),
+        ("LogSumExp", formula_lse, None, Fmax + np.log(E.sum(1, keepdims=True))),
+        ("LogSumExp", formula_lse, "Square(b)", Fmax + np.log(E @ b**2)),
+        ("SumSoftMaxWeight", formula_lse, "b", (E @ b) / E.sum(1, keepdims=True)),
+    ],
+)
+@pytest.mark.parametrize("dtype", ["float32", "float64"])
+def test_cpu_blocked_numpy(reduction_op, formula, formula2, ref, dtype):
+    my_conv = Genred(
+        formula, aliases, reduction_op=reduction_op, axis=1, formula2=formula2
+    )
+    res = my_conv(x.astype(dtype), y.astype(dtype), b.astype(dtype), backend="CPU")
+    assert np.allclose(res, ref, atol=1e-4 if dtype == "float32" else 1e-10)
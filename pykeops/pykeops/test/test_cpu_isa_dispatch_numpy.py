@@ -0,0 +1,99 @@
+import bisect
+import re
+import shutil
+import subprocess
+import sysconfig
+
+import numpy as np
+import pytest
+
+import keopscore.config.config
+from pykeops.numpy import Genred
+from pykeops.common.keops_io.LoadKeOps_cpp import LoadKeOps_cpp
+from pykeops.config import pykeops_cpp_name
+
+# The cpu modules contain the formula compiled for several instruction sets. The code of each
+# version, and all the functions it calls (e.g. the std templates, which all the versions
+# instantiate), must only use the registers of its own instruction set : otherwise the module
+# crashes with SIGILL on older cpus (see get_isa_compile_command in keopscore/binders/cpp/isa_dispatch.py).
+forbidden_registers = {
+    "avx2": ("%zmm",),
+    "sse42": ("%zmm", "%ymm"),
+    "generic": ("%zmm", "%ymm"),
+}
+
+M, N = 1037, 503
+
+np.random.seed(0)
+x = np.random.rand(M, 3).astype("float32")
+y = np.random.rand(N, 3).astype("float32")
+b = np.random.randn(N, 2).astype("float32")
+
+formula = "Exp(-SqDist(x,y)) * b"
+aliases = ["x = Vi(3)", "y = Vj(3)", "b = Vj(2)"]
+
+
+def isa_violations(filename):
+    # functions of the shared object which are reachable (through calls, or pointers to them, as
+    # the OpenMP outlined functions) from the version of the formula for an instruction set, and
+    # use registers of a wider one.
+    dump = subprocess.run(
+        ["objdump", "-d", "-C", "--no-show-raw-insn", filename],
+        capture_output=True,
+        text=True,
+        check=True,
+    ).stdout
+    names, body = {}, {}
+    for line in dump.splitlines():
+        m = re.match(r"^([0-9a-f]+) <(.*)>:$", line)
+        if m:
+            fun = int(m.group(1), 16)
+            names[fun], body[fun] = m.group(2), []
+        elif names and line.strip():
+            body[fun].append(line)
+    starts = sorted(names)
+
+    def refs(fun):
+        for line in body[fun]:
+            for addr in re.findall(r"\b([0-9a-f]+) <[^>]+>", line.split(":", 1)[-1]):
+                k = bisect.bisect_right(starts, int(addr, 16)) - 1
+                if k >= 0:
+                    yield starts[k]
+
+    violations = []
+    for isa, registers in forbidden_registers.items():
+        todo = [fun for fun in names if f"keops_cpu_{isa}::" in names[fun]]
+        seen = set(todo)
+        while todo:
+            fun = todo.pop()
+            if any(reg in line for line in body[fun] for reg in registers):
+                violations.append((isa, names[fun]))
+            for other in refs(fun):
+                if other not in seen:
+                    seen.add(other)
+                    todo.append(other)
+    return violations
+
+
+@pytest.mark.skipif(
+    len(keopscore.config.config.get_cpu_isa_targets()) == 1
+    or shutil.which("objdump") is None,
+    reason="Requires the x86 instruction sets dispatch and objdump",
+)
+def test_cpu_isa_dispatch_numpy():
+    my_conv = Genred(formula, aliases, axis=1)
+    res = my_conv(x, y, b, backend="CPU")
+    K = np.exp(-((x[:, None, :] - y[None, :, :]) ** 2).sum(-1))
+    assert np.allclose(res, K @ b, atol=1e-4)
+
+    binders = [
+        binder
+        for binder in LoadKeOps_cpp.library.values()
+        if binder.params.aliases_old == aliases
+    ]
+    assert binders
+    for binder in binders:
+        dllname = pykeops_cpp_name(
+            tag=binder.params.tag, extension=sysconfig.get_config_var("EXT_SUFFIX")
+        )
+        assert isa_violations(dllname) == []
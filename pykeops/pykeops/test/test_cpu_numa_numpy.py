@@ -0,0 +1,52 @@
+import os
+import subprocess
+import sys
+
+import numpy as np
+import pytest
+
+# The NUMA mode of the Cpu reductions (see keopscore/include/CpuNuma.h) is a compile option,
+# enabled by the KEOPS_CPU_NUMA environment variable which is read at import : the computations
+# are run in separate processes, with and without it. The j variables are replicated for
+# M >= KEOPS_CPU_NUMA_MIN_ROWS = 1024 rows only ; on a single node machine, the replicas
+# fall back to the original arrays.
+script = """
+import sys
+import numpy as np
+from pykeops.numpy import Genred
+
+M, N = int(sys.argv[1]), 2003
+np.random.seed(0)
+x = np.random.rand(M, 3)
+y = np.random.rand(N, 3)
+b = np.random.randn(N, 2)
+aliases = ["x = Vi(3)", "y = Vj(3)", "b = Vj(2)"]
+
+# Sum has the blocked code of the Cpu reductions, ArgMin the simple one
+gauss = Genred("Exp(-SqDist(x,y)) * b", aliases, axis=1)
+argmin = Genred("SqDist(x,y)", aliases, reduction_op="ArgMin", axis=1)
+print(" ".join(map(repr, gauss(x, y, b, backend="CPU").ravel())))
+print(" ".join(map(repr, argmin(x, y, b, backend="CPU").ravel())))
+"""
+
+
+def run(M, numa):
+    env = dict(os.environ, KEOPS_CPU_NUMA="1" if numa else "0")
+    out = subprocess.run(
+        [sys.executable, "-c", script, str(M)],
+        env=env,
+        capture_output=True,
+        text=True,
+    )
+    assert out.returncode == 0, out.stderr
+    lines = out.stdout.strip().split("\n")[-2:]
+    return [np.array(line.split(), dtype=float) for line in lines]
+
+
+@pytest.mark.parametrize("M", [1000, 5037])
+def test_cpu_numa_numpy(M):
+    res_gauss, res_argmin = run(M, numa=True)
+    ref_gauss, ref_argmin = run(M, numa=False)
+    assert res_gauss.shape == (2 * M,)
+    assert np.allclose(res_gauss, ref_gauss, atol=1e-10)
+    assert np.array_equal(res_argmin, ref_argmin)
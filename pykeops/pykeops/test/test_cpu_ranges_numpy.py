@@ -0,0 +1,61 @@
+import numpy as np
+import pytest
+
+from pykeops.numpy import Genred
+from pykeops.numpy.cluster import from_matrix
+
+# block-sparse reductions with clusters of very uneven sizes and numbers of interacting blocks,
+# which are split into several tasks by the CPU scheduler of the ranges mode :
+# - "uneven" : a heavy cluster of x interacting with all the blocks, and an isolated point,
+# - "empty" : empty clusters of x and y (whose ranges are [k,k)) at the start, in the middle
+#   and at the end, kept in the interactions,
+# - "dominant" : a single range of x holding almost all the points, with most of the work.
+cases = {
+    "uneven": ([700, 20, 20, 20, 300, 5, 5, 5, 5, 1], [50, 400, 10, 10, 10, 200, 3, 3]),
+    "empty": ([0, 300, 0, 0, 40, 7, 0], [0, 100, 0, 60, 2, 0]),
+    "dominant": ([3, 4000, 2, 1, 5], [500, 7, 30, 1]),
+}
+
+
+def case(name):
+    sizes_i, sizes_j = map(np.array, cases[name])
+    rng = np.random.default_rng(0)
+    M, N = sizes_i.sum(), sizes_j.sum()
+    x = rng.random((M, 3))
+    y = rng.random((N, 3))
+    b = rng.standard_normal((N, 2))
+
+    cumsum_i, cumsum_j = np.cumsum(sizes_i), np.cumsum(sizes_j)
+    ranges_i = np.stack((cumsum_i - sizes_i, cumsum_i), axis=1).astype("int32")
+    ranges_j = np.stack((cumsum_j - sizes_j, cumsum_j), axis=1).astype("int32")
+    keep = rng.random((len(sizes_i), len(sizes_j))) < 0.4
+    if name == "uneven":
+        keep[0, :] = True  # a heavy cluster, interacting with all the blocks
+        keep[-1, :] = False  # and an isolated point
+    elif name == "empty":
+        keep[sizes_i == 0, :] = True
+        keep[:, sizes_j == 0] = True
+    else:
+        keep[1, :] = True
+    ranges = from_matrix(ranges_i, ranges_j, keep)
+
+    mask = np.repeat(np.repeat(keep, sizes_i, axis=0), sizes_j, axis=1)
+    K = np.exp(-((x[:, None, :] - y[None, :, :]) ** 2).sum(-1))
+    return x, y, b, ranges, (mask * K) @ b
+
+
+@pytest.mark.parametrize("name", list(cases))
+@pytest.mark.parametrize("dtype", ["float32", "float64"])
+def test_cpu_ranges_numpy(name, dtype):
+    x, y, b, ranges, ref = case(name)
+    my_conv = Genred(
+        "Exp(-SqDist(x,y)) * b",
+        ["x = Vi(3)", "y = Vj(3)", "b = Vj(2)"],
+        reduction_op="Sum",
+        axis=1,
+    )
+    args = (x.astype(dtype), y.astype(dtype), b.astype(dtype))
+    res = my_conv(*args, backend="CPU", ranges=ranges)
+    assert np.allclose(res, ref, atol=1e-4 if dtype == "float32" else 1e-10)
+    # the result does not depend on the scheduling of the tasks
+    assert np.array_equal(res, my_conv(*args, backend="CPU", ranges=ranges))
@@ -0,0 +1,86 @@
+import pytest
+import torch
+
+import pykeops.torch.cluster as torch_cluster
+
+# a long range kernel sum, whose far field is interpolated on Chebyshev proxies of the clusters
+# of y, and whose near field is computed exactly with block-sparse reductions. The points are
+# uniform in [0,1]^3, split in clusters of width 0.1 : the pairs of clusters at distance larger
+# than about 0.35 (eta = 0.5) are in the far field.
+M, N = 3000, 4000
+width = 0.1
+
+backends = ["CPU"] + (["GPU_1D", "GPU_2D"] if torch.cuda.is_available() else [])
+
+gen = torch.Generator().manual_seed(0)
+x = torch.rand(M, 3, generator=gen, dtype=torch.float64)
+y = torch.rand(N, 3, generator=gen, dtype=torch.float64)
+b = torch.randn(N, 2, generator=gen, dtype=torch.float64)
+g = torch.tensor([0.1], dtype=torch.float64)
+x_labels = torch_cluster.grid_cluster(x, width)
+y_labels = torch_cluster.grid_cluster(y, width)
+
+formula = "b / (g + SqDist(x,y))"
+aliases = ["x = Vi(3)", "y = Vj(3)", "b = Vj(2)", "g = Pm(1)"]
+
+ref = (1 / (g + torch.cdist(x, y) ** 2)) @ b
+
+
+def rel_error(a, ref):
+    return ((a - ref).norm() / ref.norm()).item()
+
+
+def far_field_sum(**kwargs):
+    return torch_cluster.far_field_sum(
+        formula, aliases, x, y, b, g, x_labels=x_labels, y_labels=y_labels, **kwargs
+    )
+
+
+@pytest.mark.parametrize("eps", [1e-2, 1e-4])
+@pytest.mark.parametrize("backend", backends)
+def test_far_field_torch(backend, eps):
+    out, err = far_field_sum(eps=eps, backend=backend)
+    # the far field is used, and the estimated error is below the target
+    assert 0 < err <= eps
+    assert rel_error(out, ref) <= 3 * eps
+
+
+def test_far_field_error_bound():
+    # With well separated clusters, the error of the interpolation on q^D Chebyshev nodes
+    # decreases geometrically with the order q, roughly as (eta/2)^q. The error estimated
+    # on random rows must follow the actual error.
+    errs, estimates = [], []
+    for order in range(1, 6):
+        with pytest.warns(UserWarning, match="estimated relative error"):
+            out, err = far_field_sum(eps=1e-12, max_order=order, backend="CPU")
+        errs.append(rel_error(out, ref))
+        estimates.append(err)
+    for k in range(len(errs) - 1):
+        assert errs[k + 1] < errs[k]
+    assert errs[-1] < errs[0] / 100
+    for err, estimate in zip(errs, estimates):
+        assert err / 10 <= estimate <= 10 * err
+
+
+def test_far_field_near_only():
+    # with a small eta, no pair of clusters is well separated : the sum is exact
+    out, err = far_field_sum(eta=1e-3, backend="CPU")
+    assert err == 0.0
+    assert torch.allclose(out, ref, rtol=1e-10, atol=1e-10)
+
+
+def test_far_field_high_dimension():
+    # an order 7 interpolation in dimension 6 would need 7**6 proxies per cluster
+    z = torch.rand(100, 6, dtype=torch.float64)
+    labels = torch.zeros(100, dtype=torch.int32)
+    with pytest.raises(ValueError, match="low dimensional"):
+        torch_cluster.far_field_sum(
+            "Exp(-SqDist(x,y)) * b",
+            ["x = Vi(6)", "y = Vj(6)", "b = Vj(6)"],
+            z,
+            z,
+            z,
+            x_labels=labels,
+            y_labels=labels,
+            eps=1e-4,
+        )
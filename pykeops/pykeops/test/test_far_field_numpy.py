@@ -0,0 +1,57 @@
+import numpy as np
+import pytest
+
+import pykeops.numpy.cluster as numpy_cluster
+
+# numpy version of test_far_field.py, with points in [0,1/sqrt(3)]^3
+M, N = 3000, 4000
+
+rng = np.random.default_rng(0)
+x = rng.random((M, 3)) / np.sqrt(3)
+y = rng.random((N, 3)) / np.sqrt(3)
+b = rng.standard_normal((N, 2))
+g = np.array([0.1])
+width = 0.1
+
+formula = "b / (g + SqDist(x,y))"
+aliases = ["x = Vi(3)", "y = Vj(3)", "b = Vj(2)", "g = Pm(1)"]
+
+ref = (1 / (g + ((x[:, None, :] - y[None, :, :]) ** 2).sum(-1))) @ b
+
+
+def rel_error(a, ref):
+    return np.linalg.norm(a - ref) / np.linalg.norm(ref)
+
+
+def test_far_field_numpy():
+    out, err = numpy_cluster.far_field_sum(
+        formula,
+        aliases,
+        x,
+        y,
+        b,
+        g,
+        x_labels=numpy_cluster.grid_cluster(x, width),
+        y_labels=numpy_cluster.grid_cluster(y, width),
+        eps=1e-3,
+        backend="CPU",
+    )
+    assert err <= 1e-3
+    assert rel_error(out, ref) <= 3e-3
+
+
+def test_far_field_high_dimension_numpy():
+    # an order 7 interpolation in dimension 6 would need 7**6 proxies per cluster
+    z = np.random.default_rng(0).random((100, 6))
+    labels = np.zeros(100, dtype="int32")
+    with pytest.raises(ValueError, match="low dimensional"):
+        numpy_cluster.far_field_sum(
+            "Exp(-SqDist(x,y)) * b",
+            ["x = Vi(6)", "y = Vj(6)", "b = Vj(6)"],
+            z,
+            z,
+            z,
+            x_labels=labels,
+            y_labels=labels,
+            eps=1e-4,
+        )
@@ -0,0 +1,55 @@
+import pytest
+import torch
+from pykeops.torch import Genred
+
+# a kernel product, its normalization and a log-sum-exp are computed by a single fused reduction,
+# and compared with the separate reductions, together with the gradients with respect to x and b.
+M, N, D = 501, 1003, 3
+
+backends = ["CPU"] + (["GPU_1D", "GPU_2D"] if torch.cuda.is_available() else [])
+
+torch.manual_seed(0)
+x = torch.rand(M, D, dtype=torch.float64, requires_grad=True)
+y = torch.rand(N, D, dtype=torch.float64)
+b = torch.randn(N, 2, dtype=torch.float64, requires_grad=True)
+
+aliases = ["x = Vi(3)", "y = Vj(3)", "b = Vj(2)"]
+formulas = ["Exp(-SqDist(x,y)) * b", "Exp(-SqDist(x,y))", "-SqDist(x,y)"]
+reduction_ops = ["Sum", "Sum", "LogSumExp"]
+
+D2 = ((x.detach()[:, None, :] - y[None, :, :]) ** 2).sum(-1)
+
+
+@pytest.mark.parametrize("backend", backends)
+def test_fused_reductions(backend):
+    fused = Genred(formulas, aliases, reduction_op=reduction_ops, axis=1)
+    res = fused(x, y, b, backend=backend)
+    refs = [
+        Genred(formula, aliases, reduction_op=reduction_op, axis=1)(
+            x, y, b, backend=backend
+        )
+        for formula, reduction_op in zip(formulas, reduction_ops)
+    ]
+    for out, ref in zip(res, refs):
+        assert torch.allclose(out, ref, atol=1e-10)
+    assert torch.allclose(res[0], torch.exp(-D2) @ b.detach(), atol=1e-10)
+    assert torch.allclose(res[2], torch.logsumexp(-D2, 1, keepdim=True), atol=1e-10)
+
+    loss = sum((out**2).sum() for out in res)
+    loss_ref = sum((ref**2).sum() for ref in refs)
+    grads = torch.autograd.grad(loss, [x, b])
+    grads_ref = torch.autograd.grad(loss_ref, [x, b])
+    for grad, grad_ref in zip(grads, grads_ref):
+        assert torch.allclose(grad, grad_ref, atol=1e-8)
+
+
+def test_fused_argmin():
+    fused = Genred(
+        ["SqDist(x,y)", "Exp(-SqDist(x,y)) * b"],
+        aliases,
+        reduction_op=["ArgMin", "Sum"],
+        axis=1,
+    )
+    ind, res = fused(x.detach(), y, b.detach(), backend="CPU")
+    assert torch.equal(ind.view(-1).long(), D2.argmin(1))
+    assert torch.allclose(res, torch.exp(-D2) @ b.detach(), atol=1e-10)
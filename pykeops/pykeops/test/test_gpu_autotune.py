@@ -0,0 +1,81 @@
+import json
+import pytest
+import torch
+import pykeops
+import pykeops.common.keops_io.autotune as autotune
+import pykeops.common.keops_io.LoadKeOps_nvrtc as nvrtc
+from pykeops.torch import Genred
+
+device = "cuda" if torch.cuda.is_available() else "cpu"
+
+# a high dimensional formula, for which the autotuner compares the 1D and 2D schemes,
+# with and without chunks, and several block sizes.
+M, N, D = 1500, 1000, 200
+
+formula = "Exp(-SqDist(x,y) / p) * b"
+aliases = [f"x = Vi({D})", f"y = Vj({D})", "b = Vj(1)", "p = Pm(1)"]
+
+gen = torch.Generator().manual_seed(0)
+x = torch.rand(M, D, generator=gen).to(device)
+y = torch.rand(N, D, generator=gen).to(device)
+b = torch.randn(N, 1, generator=gen).to(device)
+p = torch.tensor([D / 6.0], device=device)
+
+
+def tuned_binders():
+    return {
+        binder
+        for binder in nvrtc.LoadKeOps_nvrtc.library.values()
+        if getattr(binder, "tuned_launches", None)
+    }
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_gpu_autotune(tmp_path, monkeypatch):
+    # the results are stored in a fresh file, so that the benchmarks are run by this test
+    path = str(tmp_path / "autotune_cache.json")
+    monkeypatch.setattr(autotune, "results_file", lambda: path)
+    monkeypatch.setattr(autotune, "results", None)
+    my_conv = Genred(formula, aliases, axis=1)
+    untuned = my_conv(x, y, b, p, backend="GPU")
+
+    # the first call runs the benchmarks, the next ones use the selected configuration
+    before = tuned_binders()
+    pykeops.set_autotune(True)
+    try:
+        outs = [my_conv(x, y, b, p, backend="GPU") for _ in range(3)]
+    finally:
+        pykeops.set_autotune(False)
+    for out in outs:
+        assert torch.allclose(out, untuned, rtol=1e-5, atol=1e-6)
+
+    [binder] = tuned_binders() - before
+    buckets = autotune.size_bucket(M), autotune.size_bucket(N)
+    variant, cuda_block_size = binder.tuned_launches[buckets]
+
+    # the selected configuration is one of the candidates, and is stored in the results file
+    with open(path) as f:
+        results = json.load(f)
+    result = results[autotune.get_key(binder.params, M, N)]
+    config = {k: result[k] for k in ("tag1D2D", "enable_chunks", "cuda_block_size")}
+    candidates = dict(
+        (tuple(sorted(c.items())), v) for c, v in autotune.get_candidates(binder)
+    )
+    assert candidates[tuple(sorted(config.items()))] is variant
+    assert cuda_block_size == config["cuda_block_size"]
+    assert variant.params.tag1D2D == config["tag1D2D"]
+
+    # in a new session, the configuration is read from the file without benchmarks
+    def benchmark(*args):
+        raise AssertionError("the autotuner should not run the benchmarks")
+
+    monkeypatch.setattr(autotune, "benchmark", benchmark)
+    monkeypatch.setattr(autotune, "results", None)
+    binder.tuned_launches.clear()
+    pykeops.set_autotune(True)
+    try:
+        out = my_conv(x, y, b, p, backend="GPU")
+    finally:
+        pykeops.set_autotune(False)
+    assert binder.tuned_launches[buckets] == (variant, cuda_block_size)
+    assert torch.allclose(out, untuned, rtol=1e-5, atol=1e-6)
@@ -0,0 +1,39 @@
+import pytest
+import torch
+from pykeops.torch import Genred
+
+# bfloat16 inputs and outputs, with computations and accumulation in float : the result must be
+# the float64 reduction of the same (bfloat16 rounded) data, rounded to bfloat16, up to the float
+# rounding errors. The kernel sums have magnitudes between 1e-1 and 1e3, so that the rounding
+# of the output (8 bits mantissa) is checked on several binades.
+M, N = 1000, 2001
+
+gen = torch.Generator().manual_seed(0)
+x = torch.rand(M, 3, generator=gen).to(torch.bfloat16)
+y = torch.rand(N, 3, generator=gen).to(torch.bfloat16)
+b = (torch.rand(N, 2, generator=gen) + 0.5).to(torch.bfloat16)
+s = torch.logspace(-4, 0, M)[:, None].to(torch.bfloat16)
+
+D2 = ((x.double()[:, None, :] - y.double()[None, :, :]) ** 2).sum(-1)
+ref = s.double() * (torch.exp(-D2) @ b.double())
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+@pytest.mark.parametrize("backend", ["GPU_1D", "GPU_2D"])
+@pytest.mark.parametrize("sum_scheme", ["block_sum", "kahan_scheme"])
+def test_gpu_bfloat16(backend, sum_scheme):
+    if backend == "GPU_2D" and sum_scheme == "kahan_scheme":
+        pytest.skip("kahan_scheme is not available with the 2D scheme")
+    my_conv = Genred(
+        "s * Exp(-SqDist(x,y)) * b",
+        ["s = Vi(1)", "x = Vi(3)", "y = Vj(3)", "b = Vj(2)"],
+        axis=1,
+        sum_scheme=sum_scheme,
+    )
+    args = (t.cuda() for t in (s, x, y, b))
+    res = my_conv(*args, backend=backend).cpu()
+    assert res.dtype == torch.bfloat16
+    # at most half a unit in the last place of bfloat16 away from the exact sum, and the correctly
+    # rounded value except when the exact sum is very close to a rounding tie
+    assert ((res.double() - ref).abs() <= 2**-8 * ref.abs() * (1 + 1e-4)).all()
+    assert (res == ref.to(torch.bfloat16)).double().mean() > 0.99
@@ -0,0 +1,70 @@
+import pytest
+import torch
+from pykeops.torch import Genred
+import pykeops.common.keops_io.LoadKeOps_nvrtc as nvrtc
+
+device = "cuda" if torch.cuda.is_available() else "cpu"
+
+# successive calls of the same reduction go through the same call plan, with new pointers and
+# shapes at each call : the sizes change, as well as the number of batch dimensions. The
+# aliases are not sorted by category, so that the indices of the i, j and parameter variables
+# in the list of arguments, converted once for all by the plan, are all different.
+formula = "Exp(-p * SqDist(x,y)) * b"
+aliases = ["b = Vj(2)", "p = Pm(1)", "x = Vi(3)", "y = Vj(3)"]
+
+
+def data(batch, M, N, seed):
+    gen = torch.Generator().manual_seed(seed)
+    x = torch.rand(batch + (M, 3), generator=gen)
+    y = torch.rand(batch + (N, 3), generator=gen)
+    b = torch.randn(batch + (N, 2), generator=gen)
+    p = torch.rand(1, generator=gen) + 1
+    return tuple(t.to(device) for t in (b, p, x, y))
+
+
+def ref(b, p, x, y):
+    D2 = ((x.double()[..., :, None, :] - y.double()[..., None, :, :]) ** 2).sum(-1)
+    return torch.exp(-p.double() * D2) @ b.double()
+
+
+def new_binders(before):
+    return [
+        binder
+        for binder in nvrtc.LoadKeOps_nvrtc.library.values()
+        if all(binder is not other for other in before)
+    ]
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_gpu_call_plan():
+    before = list(nvrtc.LoadKeOps_nvrtc.library.values())
+    my_conv = Genred(formula, aliases, axis=1)
+    for k, (batch, M, N) in enumerate(
+        [
+            ((), 100, 200),
+            ((), 1001, 17),
+            ((4,), 50, 70),
+            ((2, 3), 20, 30),
+            ((), 100, 200),
+        ]
+    ):
+        args = data(batch, M, N, seed=k)
+        res = my_conv(*args, backend="GPU_1D")
+        assert res.shape == batch + (M, 2)
+        assert torch.allclose(res.double(), ref(*args), atol=1e-5)
+
+    # calls with the same sizes reuse the launch configuration and the workspace of the
+    # previous one : no plan is computed and no device memory is allocated. N.B. the workspace
+    # is grown at the call following one which needed more memory.
+    [binder] = new_binders(before)
+    my_conv(*data((), 100, 200, seed=9), backend="GPU_1D")
+    stats = binder.launch_keops.get_plan_stats()
+    for k in range(5):
+        args = data((), 100, 200, seed=10 + k)
+        res = my_conv(*args, backend="GPU_1D")
+        assert torch.allclose(res.double(), ref(*args), atol=1e-5)
+    new_stats = binder.launch_keops.get_plan_stats()
+    assert new_stats["plan_misses"] == stats["plan_misses"]
+    assert new_stats["plan_hits"] >= stats["plan_hits"] + 5
+    assert new_stats["workspace_allocs"] == stats["workspace_allocs"]
+
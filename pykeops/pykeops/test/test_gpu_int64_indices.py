@@ -0,0 +1,71 @@
+import pytest
+import torch
+from pykeops.torch import Genred
+import pykeops.common.keops_io.LoadKeOps_nvrtc as nvrtc
+
+# the 64 bits indices are used for arrays with more than 2^31 elements, which do not fit in the
+# memory of most GPUs : the threshold is lowered here, so that small arrays use them as well.
+M, N = 1501, 1003
+
+device = "cuda" if torch.cuda.is_available() else "cpu"
+
+
+def data(M, N, D, E):
+    gen = torch.Generator().manual_seed(0)
+    x = torch.rand(M, D, generator=gen) / D**0.5
+    y = torch.rand(N, D, generator=gen) / D**0.5
+    b = torch.randn(N, E, generator=gen)
+    return x.to(device), y.to(device), b.to(device)
+
+
+def ref(x, y, b):
+    D2 = ((x.double()[:, None, :] - y.double()[None, :, :]) ** 2).sum(-1)
+    return torch.exp(-D2) @ b.double()
+
+
+formula = "Exp(-SqDist(x,y)) * b"
+
+
+def int64_binders():
+    return [
+        binder
+        for binder in nvrtc.LoadKeOps_nvrtc.library.values()
+        if getattr(binder.params, "use_int64_indices", False)
+    ]
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+@pytest.mark.parametrize("backend", ["GPU_1D", "GPU_2D"])
+def test_gpu_int64_indices(backend, monkeypatch):
+    monkeypatch.setattr(nvrtc, "max_int32_size", M)
+    x, y, b = data(M, N, 3, 2)
+    my_conv = Genred(formula, ["x = Vi(3)", "y = Vj(3)", "b = Vj(2)"], axis=1)
+    res = my_conv(x, y, b, backend=backend)
+    assert torch.allclose(res.double(), ref(x, y, b), atol=1e-4)
+    assert int64_binders()
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_gpu_int64_indices_threshold():
+    # With j variables of large dimension, the blocks of the 2D scheme are smaller than
+    # cuda_block_size, since a block must hold a tile of the y_j's in shared memory : its
+    # intermediate output then has more columns of blocks than the sizes of the call suggest.
+    D, E = 1000, 1
+    x, y, b = data(100, 200, D, E)
+    my_conv = Genred(formula, [f"x = Vi({D})", f"y = Vj({D})", f"b = Vj({E})"], axis=1)
+    res = my_conv(x, y, b, backend="GPU_2D")
+    assert torch.allclose(res.double(), ref(x, y, b), atol=1e-4)
+    binder = next(
+        binder
+        for binder in nvrtc.LoadKeOps_nvrtc.library.values()
+        if binder.params.tag1D2D == 1 and binder.params.dimy == D + E
+    )
+    cuda_block_size = binder.params.cuda_block_size
+    assert not binder.needs_int64_indices(binder, 100, 200, cuda_block_size)
+    # sizes for which blocks of cuda_block_size threads would give just less than 2^31
+    # partial results, without allocating the arrays
+    nx = 2**16
+    ny = (nvrtc.max_int32_size // (nx * E)) * cuda_block_size
+    ncols_blocks = (ny + cuda_block_size - 1) // cuda_block_size
+    assert nx * E * ncols_blocks <= nvrtc.max_int32_size
+    assert binder.needs_int64_indices(binder, nx, ny, cuda_block_size)
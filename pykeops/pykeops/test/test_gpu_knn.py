@@ -0,0 +1,62 @@
+import pytest
+import torch
+from pykeops.torch import Genred
+
+# K-nearest-neighbors reductions with large K use the warp level selection of GpuReduc1D_knn,
+# up to K = 256 (GpuReduc1D_knn.max_K) ; K = 100 is not a multiple of the warp size, and the
+# number of rows is not a multiple of the number of warps per block. The indices are checked
+# through the distances they point to, which does not depend on the order of ties.
+M, N = 1001, 2003
+
+device = "cuda" if torch.cuda.is_available() else "cpu"
+
+gen = torch.Generator().manual_seed(0)
+x = torch.rand(M, 3, generator=gen).to(device)
+y = torch.rand(N, 3, generator=gen).to(device)
+
+
+def sqdist(x, y):
+    return ((x.double()[:, None, :] - y.double()[None, :, :]) ** 2).sum(-1)
+
+
+D2 = sqdist(x, y)
+aliases = ["x = Vi(3)", "y = Vj(3)"]
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+@pytest.mark.parametrize("K", [16, 64, 100, 256])
+def test_gpu_knn(K):
+    ref = D2.topk(K, dim=1, largest=False).values
+    kmin = Genred("SqDist(x,y)", aliases, reduction_op="KMin", axis=1, opt_arg=K)
+    res = kmin(x, y, backend="GPU_1D")
+    assert torch.allclose(res.double(), ref, atol=1e-6)
+
+    argkmin = Genred("SqDist(x,y)", aliases, reduction_op="ArgKMin", axis=1, opt_arg=K)
+    ind = argkmin(x, y, backend="GPU_1D").long()
+    assert torch.allclose(D2.gather(1, ind), ref, atol=1e-6)
+    # the neighbors are all different
+    assert (ind.sort(1).values.diff(dim=1) > 0).all()
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+@pytest.mark.parametrize("K", [7, 64, 256])
+def test_gpu_knn_ties(K):
+    # points y_j on the integer grid {0,...,11}^3 and queries x_i at the centers of its cells
+    # or on its nodes : the squared distances are exact integers (or quarters), with many
+    # ties, e.g. the 8 corners of a cell. Any choice among tied neighbors is valid, but the
+    # values must be exact and the neighbors all different.
+    grid = torch.arange(12, dtype=torch.float32)
+    y = torch.cartesian_prod(grid, grid, grid).to(device)
+    gen = torch.Generator().manual_seed(1)
+    x = torch.randint(0, 11, (M, 3), generator=gen).float().to(device)
+    x[: M // 2] += 0.5
+    D2_ties = sqdist(x, y)
+    ref = D2_ties.topk(K, dim=1, largest=False).values
+
+    kmin = Genred("SqDist(x,y)", aliases, reduction_op="KMin", axis=1, opt_arg=K)
+    assert torch.equal(kmin(x, y, backend="GPU_1D").double(), ref)
+
+    argkmin = Genred("SqDist(x,y)", aliases, reduction_op="ArgKMin", axis=1, opt_arg=K)
+    ind = argkmin(x, y, backend="GPU_1D").long()
+    assert torch.equal(D2_ties.gather(1, ind), ref)
+    assert (ind.sort(1).values.diff(dim=1) > 0).all()
@@ -0,0 +1,56 @@
+import json
+
+import pytest
+import torch
+
+import pykeops
+from pykeops.torch import Genred
+
+# the statistics are only recorded when the nvrtc binder is compiled with KEOPS_PROFILING=1
+M, N, D = 1000, 2000, 3
+
+torch.manual_seed(0)
+x = torch.rand(M, D)
+y = torch.rand(N, D)
+
+aliases = ["x = Vi(3)", "y = Vj(3)"]
+formula = "Exp(-SqDist(x,y))"
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_gpu_profiling(tmp_path):
+    my_conv = Genred(formula, aliases, axis=1)
+    pykeops.set_profiling(True)
+    try:
+        my_conv(x, y, backend="GPU_1D")
+        stats = pykeops.get_profiling_stats(reset=True)
+        for _ in range(3):
+            res = my_conv(x, y, backend="GPU_1D")
+        stats = pykeops.get_profiling_stats()
+        if not any(s["compiled"] for s in stats.values()):
+            pytest.skip("KeOps is not compiled with KEOPS_PROFILING=1")
+
+        s = next(s for s in stats.values() if s["calls"] > 0)
+        assert s["calls"] == 3
+        assert s["host"]["sizes"]["count"] == 3
+        # GpuConv1DOnDevice, or its split-j variant for few rows
+        kernels = [
+            v for k, v in s["device"].items() if k.startswith("GpuConv1DOnDevice")
+        ]
+        assert sum(v["count"] for v in kernels) == 3
+        assert all(v["total_ms"] > 0 for v in kernels)
+        # host data : the arguments are sent and the output is read back at each call
+        assert s["bytes_htod"] >= 3 * 4 * (M + N) * D
+        assert s["bytes_dtoh"] == 3 * 4 * M
+
+        filename = str(tmp_path / "trace.json")
+        pykeops.write_profiling_trace(filename)
+        with open(filename) as f:
+            events = json.load(f)["traceEvents"]
+        assert any(e["name"].startswith("GpuConv1DOnDevice") for e in events)
+    finally:
+        pykeops.set_profiling(False)
+
+    D2 = ((x[:, None, :] - y[None, :, :]) ** 2).sum(-1)
+    ref = torch.exp(-D2).sum(1, keepdim=True)
+    assert torch.allclose(res, ref, rtol=1e-4)
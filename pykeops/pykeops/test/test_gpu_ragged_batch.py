@@ -0,0 +1,114 @@
+import pytest
+import torch
+from pykeops.torch import Genred
+from pykeops.torch.cluster import from_offsets
+
+# ragged batches of independent problems, of sizes between 0 and 40, given by CSR offsets.
+# The points of all the problems are in the same cube, so that any interaction between two
+# problems would change the results. With P = 5000 problems, the lookup table has more
+# blocks than the GPU can run at once, so that they are computed by the persistent kernel
+# GpuConv1DOnDevice_ranges_persistent ; with P = 20, by the regular ranges kernel.
+nmax = 40
+
+device = "cuda" if torch.cuda.is_available() else "cpu"
+
+formula = "Exp(-SqDist(x,y)) * b"
+aliases = ["x = Vi(3)", "y = Vj(3)", "b = Vj(2)"]
+
+
+def ragged_batch(P, seed=0, empty=None):
+    gen = torch.Generator().manual_seed(seed)
+    sizes_i = torch.randint(0, nmax + 1, (P,), generator=gen)
+    sizes_j = torch.randint(0, nmax + 1, (P,), generator=gen)
+    # some empty problems on each side, and problems with rows but no columns
+    sizes_i[:3], sizes_i[3:6], sizes_j[3:6] = 0, 5, 0
+    if empty == "trailing":
+        # the offsets end with repeated values
+        sizes_i[-10:], sizes_j[-10:] = 0, 0
+    elif empty == "alternate":
+        # every other problem has no rows, and every third one no columns
+        sizes_i[::2], sizes_j[::3] = 0, 0
+    elif empty == "columns":
+        # all the problems but one have no columns
+        sizes_j[:], sizes_j[P // 2] = 0, nmax
+    offsets_i = torch.cat((torch.zeros(1, dtype=torch.long), sizes_i.cumsum(0)))
+    offsets_j = torch.cat((torch.zeros(1, dtype=torch.long), sizes_j.cumsum(0)))
+    M, N = int(offsets_i[-1]), int(offsets_j[-1])
+    x = torch.rand(M, 3, generator=gen).to(device)
+    y = torch.rand(N, 3, generator=gen).to(device)
+    b = torch.randn(N, 2, generator=gen).to(device)
+    return sizes_i, sizes_j, offsets_i, offsets_j, x, y, b
+
+
+def ref_problems(sizes_i, sizes_j, x, y, b, axis):
+    # reductions of the problems one after the other, in float64
+    res, start_i, start_j = [], 0, 0
+    for si, sj in zip(sizes_i.tolist(), sizes_j.tolist()):
+        xp = x[start_i : start_i + si].double()
+        yp = y[start_j : start_j + sj].double()
+        K = torch.exp(-((xp[:, None, :] - yp[None, :, :]) ** 2).sum(-1))
+        if axis == 1:
+            res.append(K @ b[start_j : start_j + sj].double())
+        else:
+            res.append(K.t() @ torch.ones_like(xp[:, :2]))
+        start_i, start_j = start_i + si, start_j + sj
+    return torch.cat(res)
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+@pytest.mark.parametrize("P", [20, 5000])
+@pytest.mark.parametrize("ranges_device", ["cpu", "cuda"])
+def test_gpu_ragged_batch(P, ranges_device):
+    sizes_i, sizes_j, offsets_i, offsets_j, x, y, b = ragged_batch(P)
+    ranges = from_offsets(offsets_i.to(ranges_device), offsets_j.to(ranges_device))
+    my_conv = Genred(formula, aliases, axis=1)
+    res = my_conv(x, y, b, ranges=ranges, backend="GPU_1D")
+    ref = ref_problems(sizes_i, sizes_j, x, y, b, axis=1)
+    assert torch.allclose(res.double(), ref, atol=1e-4)
+    # the rows of the problems without columns are exactly zero
+    rows = torch.repeat_interleave(sizes_j == 0, sizes_i).to(device)
+    assert rows.any() and (res[rows] == 0).all()
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+@pytest.mark.parametrize("P", [20, 5000])
+@pytest.mark.parametrize("empty", ["trailing", "alternate", "columns"])
+def test_gpu_ragged_batch_empty(P, empty):
+    # batches with many zero-size problems : the problems without rows have no output, and
+    # the rows of the problems without columns are exactly zero
+    sizes_i, sizes_j, offsets_i, offsets_j, x, y, b = ragged_batch(P, empty=empty)
+    my_conv = Genred(formula, aliases, axis=1)
+    ranges = from_offsets(offsets_i, offsets_j)
+    res = my_conv(x, y, b, ranges=ranges, backend="GPU_1D")
+    assert res.shape == (len(x), 2)
+    ref = ref_problems(sizes_i, sizes_j, x, y, b, axis=1)
+    assert torch.allclose(res.double(), ref, atol=1e-4)
+    rows = torch.repeat_interleave(sizes_j == 0, sizes_i).to(device)
+    assert (res[rows] == 0).all()
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_gpu_ragged_batch_axis0():
+    # the same ranges also describe the reductions over i, with the roles of the offsets
+    # swapped : here, with a signal equal to 1 for all the x_i
+    sizes_i, sizes_j, offsets_i, offsets_j, x, y, _ = ragged_batch(5000, seed=1)
+    ones = torch.ones(len(x), 2, device=device)
+    my_conv = Genred(formula, ["y = Vj(3)", "x = Vi(3)", "b = Vi(2)"], axis=0)
+    ranges = from_offsets(offsets_i, offsets_j)
+    res = my_conv(y, x, ones, ranges=ranges, backend="GPU_1D")
+    ref = ref_problems(sizes_i, sizes_j, x, y, None, axis=0)
+    assert torch.allclose(res.double(), ref, atol=1e-4)
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_gpu_ragged_batch_grad():
+    # the gradients go through the same ranges
+    sizes_i, sizes_j, offsets_i, offsets_j, x, y, b = ragged_batch(5000, seed=2)
+    x.requires_grad_(True)
+    my_conv = Genred(formula, aliases, axis=1)
+    res = my_conv(x, y, b, ranges=from_offsets(offsets_i, offsets_j), backend="GPU_1D")
+    [g] = torch.autograd.grad((res**2).sum(), [x])
+    xd = x.detach().double().requires_grad_(True)
+    ref = ref_problems(sizes_i, sizes_j, xd, y, b, axis=1)
+    [g_ref] = torch.autograd.grad((ref**2).sum(), [xd])
+    assert torch.allclose(g.double(), g_ref, atol=1e-3)
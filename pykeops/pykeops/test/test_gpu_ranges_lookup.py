@@ -0,0 +1,61 @@
+import pytest
+import torch
+from pykeops.torch import Genred
+
+device = "cuda" if torch.cuda.is_available() else "cpu"
+
+# block-sparse reduction with many small clusters (some of them empty) and ranges on the device :
+# the lookup table of the blocks is built on the device (see range_preprocess_from_device).
+# Cluster k of x interacts with clusters k and k+1 of y.
+nclusters, D = 3000, 3
+
+torch.manual_seed(0)
+
+
+def clusters(n):
+    # random cluster sizes between 0 and 9, and the corresponding ranges
+    sizes = torch.randint(0, 10, (n,))
+    ends = sizes.cumsum(0)
+    return torch.stack((ends - sizes, ends), dim=1).int()
+
+
+ranges_x, ranges_y = clusters(nclusters), clusters(nclusters + 1)
+M, N = int(ranges_x[-1, 1]), int(ranges_y[-1, 1])
+x = torch.rand(M, D, device=device)
+y = torch.rand(N, D, device=device)
+b = torch.randn(N, 2, device=device)
+
+# y ranges of the x clusters, and x ranges of the y clusters
+redranges_y = torch.stack((ranges_y[:-1], ranges_y[1:]), dim=1).reshape(-1, 2)
+slices_x = 2 * torch.arange(1, nclusters + 1).int()
+redranges_x, slices_y = [], []
+for k in range(nclusters + 1):
+    redranges_x += [ranges_x[k]] if k == 0 else [ranges_x[k - 1 : k + 1]]
+    slices_y.append(sum(len(r.view(-1, 2)) for r in redranges_x))
+redranges_x = torch.cat([r.view(-1, 2) for r in redranges_x])
+slices_y = torch.tensor(slices_y).int()
+ranges = tuple(
+    r.contiguous().to(device)
+    for r in (ranges_x, slices_x, redranges_y, ranges_y, slices_y, redranges_x)
+)
+
+mask = torch.zeros(M, N, dtype=torch.bool, device=device)
+for k in range(nclusters):
+    i0, i1 = ranges_x[k].tolist()
+    j0, j1 = int(ranges_y[k, 0]), int(ranges_y[k + 1, 1])
+    mask[i0:i1, j0:j1] = True
+D2 = ((x[:, None, :] - y[None, :, :]) ** 2).sum(-1)
+K = torch.where(mask, torch.exp(-D2), torch.zeros_like(D2))
+
+formula = "Exp(-SqDist(x,y)) * b"
+aliases = ["x = Vi(3)", "y = Vj(3)", "b = Vj(2)"]
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_gpu_ranges_lookup():
+    my_conv = Genred(formula, aliases, axis=1)
+    ref = K @ b
+    # the second call checks the reuse of the memory of the first one
+    for _ in range(2):
+        res = my_conv(x, y, b, ranges=ranges, backend="GPU_1D")
+        assert torch.allclose(res, ref, atol=1e-4)
@@ -0,0 +1,41 @@
+import pytest
+import torch
+from pykeops.torch import Genred
+
+# low dimensional formulas use the register blocked 1D scheme (GpuReduc1D_regblock) ; the number of
+# rows is not a multiple of the number of rows per block, so that some rows of the last block are unused.
+# With D = 3, signals of dimension E = 2, 8 and 12 give 4, 3 and 2 rows per thread.
+M, N = 1501, 1003
+
+gen = torch.Generator().manual_seed(0)
+x = torch.rand(M, 3, generator=gen)
+y = torch.rand(N, 3, generator=gen)
+b = torch.randn(N, 12, generator=gen)
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+@pytest.mark.parametrize("E", [2, 8, 12])
+@pytest.mark.parametrize("reduction_op", ["Sum", "Max", "ArgMin"])
+@pytest.mark.parametrize("sum_scheme", ["direct_sum", "block_sum", "kahan_scheme"])
+def test_gpu_regblock(E, reduction_op, sum_scheme):
+    if sum_scheme != "block_sum" and reduction_op != "Sum":
+        pytest.skip("sum schemes only apply to Sum reductions")
+    bE = b[:, :E].contiguous()
+    D2 = ((x.double()[:, None, :] - y.double()[None, :, :]) ** 2).sum(-1)
+    K = torch.exp(-D2)[:, :, None] * bE.double()[None, :, :]
+    my_conv = Genred(
+        "Exp(-SqDist(x,y)) * b",
+        ["x = Vi(3)", "y = Vj(3)", f"b = Vj({E})"],
+        reduction_op=reduction_op,
+        axis=1,
+        sum_scheme=sum_scheme,
+    )
+    res = my_conv(x.cuda(), y.cuda(), bE.cuda(), backend="GPU_1D").cpu()
+    if reduction_op == "Sum":
+        assert torch.allclose(res.double(), K.sum(1), atol=1e-4)
+    elif reduction_op == "Max":
+        assert torch.allclose(res.double(), K.max(1).values, atol=1e-5)
+    else:
+        # ties aside, the indices of the minima must give the minimal values
+        mins = K.gather(1, res.long()[:, None, :])[:, 0, :]
+        assert torch.allclose(mins, K.min(1).values, atol=1e-5)
@@ -0,0 +1,111 @@
+import os
+import subprocess
+import sys
+import pytest
+import torch
+from pykeops.torch import Genred, LazyTensor
+
+# few rows i and many columns j : the blocks of the 1D scheme cannot fill the device, so that
+# the binder splits the j range between lines of blocks (kernel GpuConv1DOnDevice_splitj), whose
+# partial results are combined by the kernel reduce2D. The variants of the 1D scheme (register
+# blocked, knn and tensor core kernels) have no split-j kernel, and must still be used here.
+M, N = 100, 200000
+
+device = "cuda" if torch.cuda.is_available() else "cpu"
+
+# above 16 dimensions of j variables, the generic 1D scheme is used rather than the register
+# blocked one (see GpuReduc1D_regblock.max_dimy)
+D = 20
+
+torch.manual_seed(0)
+x = torch.rand(M, D, device=device) / D**0.5
+y = torch.rand(N, D, device=device) / D**0.5
+b = torch.randn(N, 2, device=device)
+D2 = ((x.double()[:, None, :] - y.double()[None, :, :]) ** 2).sum(-1)
+
+# low dimensional points, for the register blocked and knn kernels
+x3, y3 = x[:, :3].contiguous(), y[:, :3].contiguous()
+D2_3 = ((x3.double()[:, None, :] - y3.double()[None, :, :]) ** 2).sum(-1)
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_gpu_splitj_sum():
+    aliases = [f"x = Vi({D})", f"y = Vj({D})", "b = Vj(2)"]
+    my_conv = Genred("Exp(-SqDist(x,y)) * b", aliases, axis=1)
+    res = my_conv(x, y, b, backend="GPU_1D")
+    ref = torch.exp(-D2) @ b.double()
+    assert torch.allclose(res.double(), ref, rtol=1e-4, atol=1e-2)
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_gpu_splitj_logsumexp():
+    aliases = [f"x = Vi({D})", f"y = Vj({D})"]
+    my_conv = Genred("-SqDist(x,y)", aliases, reduction_op="LogSumExp", axis=1)
+    res = my_conv(x, y, backend="GPU_1D")
+    ref = torch.logsumexp(-D2, dim=1, keepdim=True)
+    assert torch.allclose(res.double(), ref, atol=1e-4)
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_gpu_splitj_argmin():
+    aliases = [f"x = Vi({D})", f"y = Vj({D})"]
+    my_conv = Genred("SqDist(x,y)", aliases, reduction_op="ArgMin", axis=1)
+    res = my_conv(x, y, backend="GPU_1D").long().view(-1)
+    # ties aside, the indices of the minima must give the minimal distances
+    assert torch.allclose(D2[torch.arange(M), res], D2.min(dim=1).values, atol=1e-6)
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_gpu_splitj_regblock():
+    # a low dimensional Cauchy kernel sum, computed by the register blocked kernel
+    X, Y = LazyTensor(x3[:, None, :]), LazyTensor(y3[None, :, :])
+    K = 1 / (1 + ((X - Y) ** 2).sum(-1))
+    res = K.__matmul__(b, backend="GPU_1D")
+    ref = (1 / (1 + D2_3)) @ b.double()
+    assert torch.allclose(res.double(), ref, rtol=1e-4, atol=1e-2)
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+@pytest.mark.parametrize("K", [64, 256])
+def test_gpu_splitj_knn(K):
+    # K nearest neighbors with large K, computed by the warp level knn kernel
+    X, Y = LazyTensor(x3[:, None, :]), LazyTensor(y3[None, :, :])
+    Dxy = ((X - Y) ** 2).sum(-1)
+    vals, inds = Dxy.Kmin_argKmin(K, dim=1, backend="GPU_1D")
+    ref = D2_3.topk(K, dim=1, largest=False).values
+    assert torch.allclose(vals.double(), ref, atol=1e-6)
+    # ties aside, the indices must give the same distances
+    assert torch.allclose(D2_3.gather(1, inds.long()), ref, atol=1e-6)
+
+
+# The tensor core scheme is enabled by the KEOPS_TENSOR_CORES environment variable, which is
+# read at import : the computation is run in a separate process, as in test_gpu_tensorcore.py
+script = f"""
+import torch
+from pykeops.torch import LazyTensor
+
+torch.manual_seed(0)
+x = torch.rand({M}, 1, 64, device="cuda") / 8
+y = torch.rand(1, {N}, 64, device="cuda") / 8
+b = torch.randn({N}, 2, device="cuda")
+
+# reference computed on the inputs rounded to TF32, as in the tensor cores
+tf32 = lambda t: (t.view(torch.int32) + 0x1000 & -0x2000).view(torch.float32)
+Dxy = ((tf32(x).double() - tf32(y).double()) ** 2).sum(-1)
+ref = (-Dxy).exp() @ b.double()
+X, Y = LazyTensor(x), LazyTensor(y)
+res = (-((X - Y) ** 2).sum(-1)).exp().__matmul__(b, backend="GPU_1D")
+print(float(((res - ref).abs() / (ref.abs() + 1e-3)).max()))
+"""
+
+
+@pytest.mark.skipif(
+    not torch.cuda.is_available() or torch.cuda.get_device_capability() < (8, 0),
+    reason="Requires a GPU with TF32 tensor cores",
+)
+def test_gpu_splitj_tensorcore():
+    env = dict(os.environ, KEOPS_TENSOR_CORES="1")
+    out = subprocess.run(
+        [sys.executable, "-c", script], env=env, capture_output=True, text=True
+    )
+    assert float(out.stdout.strip().split("\n")[-1]) < 1e-4
@@ -0,0 +1,46 @@
+import os
+import subprocess
+import sys
+import pytest
+import torch
+
+# The tensor core scheme GpuReduc1D_tensorcore is enabled by the KEOPS_TENSOR_CORES environment
+# variable, which is read at import : the computations are run in a separate process.
+script = """
+import torch
+from pykeops.torch import LazyTensor
+
+torch.manual_seed(0)
+M, N, D = 1000, 1500, 64
+x = torch.rand(M, 1, D, device="cuda") / 4
+y = torch.rand(1, N, D, device="cuda") / 4
+b = torch.randn(N, 2, device="cuda")
+
+# reference computed on the inputs rounded to TF32, as in the tensor cores
+tf32 = lambda t: (t.view(torch.int32) + 0x1000 & -0x2000).view(torch.float32)
+Dxy = ((tf32(x).double() - tf32(y).double()) ** 2).sum(-1)
+ref_gauss = (-Dxy).exp() @ b.double()
+ref_argmin = Dxy.argmin(1)
+
+X, Y = LazyTensor(x), LazyTensor(y)
+Dxy_keops = ((X - Y) ** 2).sum(-1)
+res_gauss = (-Dxy_keops).exp() @ b
+res_argmin = Dxy_keops.argmin(1).view(-1)
+print(float(((res_gauss - ref_gauss).abs() / (ref_gauss.abs() + 1e-3)).max()))
+print(float((res_argmin.long() != ref_argmin).float().mean()))
+"""
+
+
+@pytest.mark.skipif(
+    not torch.cuda.is_available() or torch.cuda.get_device_capability() < (8, 0),
+    reason="Requires a GPU with TF32 tensor cores",
+)
+def test_gpu_tensorcore():
+    env = dict(os.environ, KEOPS_TENSOR_CORES="1")
+    out = subprocess.run(
+        [sys.executable, "-c", script], env=env, capture_output=True, text=True
+    )
+    err_gauss, err_argmin = map(float, out.stdout.strip().split("\n")[-2:])
+    assert err_gauss < 1e-4
+    # rare ties may be resolved differently
+    assert err_argmin < 1e-2
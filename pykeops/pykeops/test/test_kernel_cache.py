@@ -0,0 +1,47 @@
+import os
+import numpy as np
+import pytest
+
+import pykeops.config
+
+
+@pytest.mark.skipif(not pykeops.config.gpu_available, reason="Requires a GPU")
+def test_kernel_cache_warmup(tmp_path):
+    import keopscore.config.config as keops_config
+    from keopscore.get_keops_dll import get_keops_dll, warmup
+
+    cache_folder = keops_config.get_kernel_cache_folder()
+    keops_config.set_kernel_cache_folder(str(tmp_path))
+    try:
+        # random constants make the formulas new, so that they are actually compiled
+        list_of_args = [
+            (
+                "GpuReduc1D",
+                f"Sum_Reduction(Exp(-{c}*SqDist(Var(0,3,0),Var(1,3,1)))*Var(2,1,1),0)",
+                -1,
+                -1,
+                -1,
+                [],
+                3,
+                "float",
+                "float",
+                "block_sum",
+                1,
+                1,
+                0,
+                0,
+                0,
+            )
+            for c in np.random.rand(4)
+        ]
+        # the first formula is given twice
+        res = warmup(list_of_args + list_of_args[:1], max_workers=4)
+        assert len(res) == 5
+        assert res[4] == res[0]
+        for args, r in zip(list_of_args, res):
+            assert get_keops_dll(*args) == r
+            assert os.path.isfile(r[2])
+        # one binary in the cache for each formula
+        assert len(os.listdir(tmp_path)) == 4
+    finally:
+        keops_config.set_kernel_cache_folder(cache_folder)
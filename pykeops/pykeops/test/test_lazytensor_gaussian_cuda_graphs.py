@@ -0,0 +1,64 @@
+import math
+import pytest
+import torch
+import pykeops
+from pykeops.torch import Genred, LazyTensor
+from pykeops.torch.cluster import from_matrix
+
+M, N, D = 2500, 2000, 3
+
+device = "cuda" if torch.cuda.is_available() else "cpu"
+
+torch.manual_seed(0)
+x = torch.rand(M, D, device=device) / math.sqrt(D)
+y = torch.rand(N, D, device=device) / math.sqrt(D)
+b = torch.randn(N, 1, device=device)
+
+Kxy = torch.exp(-((x.double()[:, None, :] - y.double()[None, :, :]) ** 2).sum(-1))
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_lazytensor_gaussian_cuda_graphs():
+    # the first call captures a graph, the next ones replay it, including
+    # with new argument tensors of the same shapes.
+    X, Y = LazyTensor(x[:, None, :]), LazyTensor(y[None, :, :])
+    pykeops.set_cuda_graphs(True)
+    try:
+        for k in range(3):
+            bk = b + k
+            out_keops = (-((X - Y) ** 2).sum(-1)).exp() @ bk
+            assert torch.allclose(
+                out_keops.double(), Kxy @ bk.double(), rtol=1e-4, atol=1e-4
+            )
+    finally:
+        pykeops.set_cuda_graphs(False)
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_cuda_graphs_ranges():
+    # block-sparse calls with the same ranges tensors, whose contents change between
+    # the calls, as when new ranges tensors reuse the memory of previous ones : the
+    # replays must rebuild the lookup table from the new contents.
+    pivots_x = torch.arange(0, M + 1, 25, device=device, dtype=torch.int32)
+    pivots_y = torch.arange(0, N + 1, 100, device=device, dtype=torch.int32)
+    ranges_x = torch.stack((pivots_x[:-1], pivots_x[1:]), dim=1)
+    ranges_y = torch.stack((pivots_y[:-1], pivots_y[1:]), dim=1)
+    keep = torch.rand(100, 20, generator=torch.Generator().manual_seed(0)) < 0.3
+    ranges = from_matrix(ranges_x, ranges_y, keep.to(device))
+    my_conv = Genred(
+        "Exp(-SqDist(x,y)) * b", ["x = Vi(3)", "y = Vj(3)", "b = Vj(1)"], axis=1
+    )
+    pykeops.set_cuda_graphs(True)
+    try:
+        for k in range(3):
+            # same shapes, other blocks
+            keep_k = keep.roll(k, dims=1)
+            ranges_k = from_matrix(ranges_x, ranges_y, keep_k.to(device))
+            for r, r_k in zip(ranges, ranges_k):
+                r.copy_(r_k)
+            out_keops = my_conv(x, y, b, ranges=ranges, backend="GPU_1D")
+            mask = keep_k.repeat_interleave(25, 0).repeat_interleave(100, 1)
+            ref = (Kxy * mask.to(device)) @ b.double()
+            assert torch.allclose(out_keops.double(), ref, rtol=1e-4, atol=1e-4)
+    finally:
+        pykeops.set_cuda_graphs(False)
@@ -0,0 +1,85 @@
+import pytest
+import torch
+
+import pykeops
+from pykeops.torch import LazyTensor
+
+# With pykeops.set_pipelined(True), and M large enough, the computation on host data is split in
+# several tiles of rows (of at least 8192 rows, rounded up to a multiple of the block size : 8256
+# rows with the default block size of 192), which are transferred and processed in a pipeline.
+# The i variables x_i and a_i are staged tile by tile, while the j variables y_j and b_j are
+# copied once.
+N, D, E = 200, 3, 2
+
+
+def data(M, seed=0):
+    gen = torch.Generator().manual_seed(seed)
+    x = torch.rand(M, D, generator=gen, dtype=torch.float64)
+    a = torch.rand(M, 1, generator=gen, dtype=torch.float64) + 0.5
+    y = torch.rand(N, D, generator=gen, dtype=torch.float64)
+    b = torch.randn(N, E, generator=gen, dtype=torch.float64)
+    return x, a, y, b
+
+
+def fun(x, a, y, b, backend):
+    if backend == "keops":
+        X, A = LazyTensor(x[:, None, :]), LazyTensor(a[:, None, :])
+        K = (-A * ((X - LazyTensor(y[None, :, :])) ** 2).sum(-1)).exp()
+        return K.__matmul__(b, device_id=0)
+    D2 = torch.cdist(x, y, compute_mode="donot_use_mm_for_euclid_dist") ** 2
+    return torch.exp(-a * D2) @ b
+
+
+# the last tile has a single row, a part of the rows of the others, or as many rows
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+@pytest.mark.parametrize("M", [8257, 20000, 24768, 100000])
+def test_lazytensor_gaussian_fromhost_pipelined(M):
+    args = data(M)
+    copies = [t.clone() for t in args]
+    pykeops.set_pipelined(True)
+    pykeops.set_profiling(True)
+    try:
+        pykeops.get_profiling_stats(reset=True)
+        out_keops = fun(*args, "keops")
+        stats = pykeops.get_profiling_stats()
+    finally:
+        pykeops.set_profiling(False)
+        pykeops.set_pipelined(False)
+    assert out_keops.device.type == "cpu"
+    assert torch.allclose(out_keops, fun(*args, "torch"))
+    # the inputs are read through the staging buffer, and are not modified
+    assert all(torch.equal(t, c) for t, c in zip(args, copies))
+    # the call went through launch_pipelined_from_host, whose phase is recorded when the
+    # nvrtc binder is compiled with KEOPS_PROFILING=1 (see test_gpu_profiling.py)
+    if any(s["compiled"] for s in stats.values()):
+        s = next(s for s in stats.values() if s["calls"] > 0)
+        assert s["host"]["pipeline"]["count"] == 1
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_lazytensor_gaussian_fromhost_pipelined_sizes():
+    # the staging buffer is grown for larger calls, and reused by smaller ones
+    pykeops.set_pipelined(True)
+    try:
+        for k, M in enumerate([20000, 100000, 8257, 50000]):
+            args = data(M, seed=k)
+            assert torch.allclose(fun(*args, "keops"), fun(*args, "torch"))
+    finally:
+        pykeops.set_pipelined(False)
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_lazytensor_gaussian_fromhost_not_pipelined():
+    # the pipeline is off by default
+    args = data(100000)
+    pykeops.set_profiling(True)
+    try:
+        pykeops.get_profiling_stats(reset=True)
+        out_keops = fun(*args, "keops")
+        stats = pykeops.get_profiling_stats()
+    finally:
+        pykeops.set_profiling(False)
+    assert torch.allclose(out_keops, fun(*args, "torch"))
+    if any(s["compiled"] for s in stats.values()):
+        s = next(s for s in stats.values() if s["calls"] > 0)
+        assert "pipeline" not in s["host"]
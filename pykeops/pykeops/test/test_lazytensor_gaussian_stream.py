@@ -0,0 +1,30 @@
+import math
+import pytest
+import torch
+from pykeops.torch import LazyTensor
+
+M, N, D = 2500, 2000, 3
+
+device = "cuda" if torch.cuda.is_available() else "cpu"
+
+torch.manual_seed(0)
+x = torch.rand(M, 1, D, device=device) / math.sqrt(D)
+y = torch.rand(1, N, D, device=device) / math.sqrt(D)
+b = torch.randn(N, 1, device=device)
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+def test_lazytensor_gaussian_stream():
+    # the KeOps reduction is enqueued on the current (non default) torch stream :
+    # it must wait for the torch operation which computes its input on this stream,
+    # and be waited for by the one which uses its output.
+    Kxy = (-((LazyTensor(x) - LazyTensor(y)) ** 2).sum(-1)).exp()
+    stream = torch.cuda.Stream()
+    stream.wait_stream(torch.cuda.current_stream())
+    with torch.cuda.stream(stream):
+        bk = torch.cat((b[:1000], 2 * b[1000:]))
+        out_keops = 2 * (Kxy @ bk)
+    torch.cuda.current_stream().wait_stream(stream)
+    Dxy = ((x.double() - y.double()) ** 2).sum(-1)
+    ref = 2 * (torch.exp(-Dxy) @ torch.cat((b[:1000], 2 * b[1000:])).double())
+    assert torch.allclose(out_keops.double(), ref, rtol=1e-4, atol=1e-4)
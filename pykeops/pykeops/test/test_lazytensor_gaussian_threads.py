@@ -0,0 +1,46 @@
+import math
+import threading
+import pytest
+import torch
+from pykeops.torch import LazyTensor
+
+nthreads = 8
+N, D = 2000, 3
+
+device = "cuda" if torch.cuda.is_available() else "cpu"
+
+# each thread has its own points x_i, and shares y_j and b_j
+torch.manual_seed(0)
+xs = [torch.rand(2500 + k, D, device=device) / math.sqrt(D) for k in range(nthreads)]
+y = torch.rand(N, D, device=device) / math.sqrt(D)
+b = torch.randn(N, 1, device=device)
+
+
+def fun(x, y, b):
+    X, Y = LazyTensor(x[:, None, :]), LazyTensor(y[None, :, :])
+    return (-((X - Y) ** 2).sum(-1)).exp() @ b
+
+
+@pytest.mark.skipif(not torch.cuda.is_available(), reason="Requires a GPU")
+@pytest.mark.parametrize("host", [False, True])
+def test_lazytensor_gaussian_threads(host):
+    # the same KeOps module is called concurrently from several threads, with different
+    # sizes : each call uses its own stream and scratch memory.
+    args = [(x.cpu(), y.cpu(), b.cpu()) if host else (x, y, b) for x in xs]
+    fun(*args[0])  # compiles the formula
+    outs = [None] * nthreads
+
+    def worker(k):
+        for _ in range(5):
+            outs[k] = fun(*args[k])
+
+    threads = [threading.Thread(target=worker, args=(k,)) for k in range(nthreads)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    for k in range(nthreads):
+        Dxy = ((xs[k].double()[:, None, :] - y.double()[None, :, :]) ** 2).sum(-1)
+        ref = torch.exp(-Dxy) @ b.double()
+        assert torch.allclose(outs[k].double().to(device), ref, rtol=1e-4, atol=1e-4)
@@ -0,0 +1,37 @@
+import numpy as np
+import pytest
+
+from pykeops.numpy import Genred
+import pykeops.config
+
+if pykeops.config.gpu_available:
+    from keopscore.utils.gpu_utils import get_gpu_props
+
+    ngpus = get_gpu_props()
+else:
+    ngpus = 0
+
+M, N, D = 10000, 3000, 3
+
+np.random.seed(0)
+x = np.random.rand(M, D)
+y = np.random.rand(N, D)
+b = np.random.rand(N, 2)
+
+formula = "Exp(-SqDist(x,y)) * b"
+
+
+@pytest.mark.skipif(ngpus < 2, reason="Requires several GPUs")
+@pytest.mark.parametrize(
+    "aliases, axis",
+    [
+        (["x = Vi(3)", "y = Vj(3)", "b = Vj(2)"], 1),
+        (["x = Vj(3)", "y = Vi(3)", "b = Vi(2)"], 0),
+    ],
+)
+def test_multi_gpu_numpy(aliases, axis):
+    # the output lines are split across the devices
+    my_conv = Genred(formula, aliases, reduction_op="Sum", axis=axis)
+    res_single = my_conv(x, y, b, backend="GPU", device_id=0)
+    res_multi = my_conv(x, y, b, backend="GPU", device_id=[0, 1])
+    assert np.allclose(res_single, res_multi)
@@ -0,0 +1,79 @@
+import pytest
+import torch
+from pykeops.torch import Genred
+
+# the points y_j and weights b_j of a database stay the same while the queries x_i change :
+# they are resident arguments, kept on the device, and the subformulas p*|y_j|^2 and
+# Normalize(b_j) are memoized instead of being computed for each pair (i,j).
+M, N, D = 300, 1001, 3
+
+backends = ["CPU"] + (["GPU_1D", "GPU_2D"] if torch.cuda.is_available() else [])
+
+gen = torch.Generator().manual_seed(0)
+y = torch.rand(N, D, generator=gen, dtype=torch.float64)
+b = torch.randn(N, 2, generator=gen, dtype=torch.float64)
+p = torch.tensor([0.5], dtype=torch.float64)
+
+formula = "Exp(-SqDist(x,y) - p*SqNorm2(y)) * Normalize(b)"
+aliases = ["x = Vi(3)", "y = Vj(3)", "b = Vj(2)", "p = Pm(1)"]
+
+
+def fun_torch(x, y, b, p):
+    D2 = ((x[:, None, :] - y[None, :, :]) ** 2).sum(-1)
+    K = (-D2 - p * (y**2).sum(-1)[None, :]).exp()
+    return K @ (b / b.norm(dim=1, keepdim=True))
+
+
+def queries(k):
+    gen = torch.Generator().manual_seed(k + 1)
+    return torch.rand(M, D, generator=gen, dtype=torch.float64)
+
+
+@pytest.mark.parametrize("backend", backends)
+def test_resident_args(backend):
+    routine = Genred(formula, aliases, axis=1, resident=["y", "b", "p"])
+    assert len(routine.resident.hoisted) == 2
+
+    yk, bk = y.clone(), b.clone()
+    for k in range(3):
+        x = queries(k)
+        out = routine(x, yk, bk, p, backend=backend)
+        assert torch.allclose(out, fun_torch(x, yk, bk, p), atol=1e-10)
+
+    # new database, and in place modification of the weights (detected by torch)
+    yk = torch.rand(N, D, dtype=torch.float64)
+    out = routine(x, yk, bk, p, backend=backend)
+    assert torch.allclose(out, fun_torch(x, yk, bk, p), atol=1e-10)
+    bk.add_(1)
+    out = routine(x, yk, bk, p, backend=backend)
+    assert torch.allclose(out, fun_torch(x, yk, bk, p), atol=1e-10)
+
+    # the memoized values are not used when gradients are required
+    yg = yk.clone().requires_grad_(True)
+    out = routine(x, yg, bk, p, backend=backend)
+    out_torch = fun_torch(x, yg, bk, p)
+    assert torch.allclose(out, out_torch, atol=1e-10)
+    [g] = torch.autograd.grad((out**2).sum(), [yg])
+    [g_torch] = torch.autograd.grad((out_torch**2).sum(), [yg])
+    assert torch.allclose(g, g_torch, atol=1e-8)
+
+
+@pytest.mark.parametrize("backend", backends)
+def test_resident_args_address_reuse(backend):
+    # a resident array is freed, and a new one with other values is stored at the same address,
+    # with the same shape and version counter : the memoized values and the device copies of
+    # the first one must not be used.
+    routine = Genred(formula, aliases, axis=1, resident=["y", "b", "p"])
+    x = queries(0)
+    buffer = y.numpy().copy()
+    yk = torch.from_numpy(buffer)
+    ptr = yk.data_ptr()
+    out = routine(x, yk, b, p, backend=backend)
+    assert torch.allclose(out, fun_torch(x, yk, b, p), atol=1e-10)
+
+    del yk
+    buffer[:] = buffer[::-1] / 2
+    yk = torch.from_numpy(buffer)
+    assert yk.data_ptr() == ptr and yk._version == 0
+    out = routine(x, yk, b, p, backend=backend)
+    assert torch.allclose(out, fun_torch(x, yk, b, p), atol=1e-10)
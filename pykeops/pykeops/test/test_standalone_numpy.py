@@ -0,0 +1,51 @@
+import ctypes
+
+import numpy as np
+
+from keopscore.aot import build_aot_library
+
+# standalone library of a reduction (see keopscore/aot.py), called through its C interface
+M, N, D = 300, 400, 3
+
+np.random.seed(0)
+x = np.random.rand(M, D).astype("float32")
+y = np.random.rand(N, D).astype("float32")
+b = np.random.rand(N, 2).astype("float32")
+
+formula = "Sum_Reduction(Exp(-SqDist(x,y))*b,0)"
+aliases = ["x=Vi(3)", "y=Vj(3)", "b=Vj(2)"]
+
+
+def launch(lib, out, args, on_device=0):
+    lib.keops_aot_init.restype = ctypes.c_void_p
+    lib.keops_aot_launch.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int]
+    lib.keops_aot_launch.argtypes += [ctypes.c_void_p] * 4 + [ctypes.c_int]
+    lib.keops_aot_destroy.argtypes = [ctypes.c_void_p]
+    lib.keops_aot_last_error.restype = ctypes.c_char_p
+    handle = lib.keops_aot_init(0)
+    assert handle is not None
+    ptrs = (ctypes.c_void_p * len(args))(*[a.ctypes.data for a in args])
+    res = lib.keops_aot_launch(
+        handle, M, N, out.ctypes.data, ptrs, None, None, on_device
+    )
+    error = lib.keops_aot_last_error().decode()
+    lib.keops_aot_destroy(handle)
+    return res, error
+
+
+def test_standalone_cpu(tmp_path):
+    path = build_aot_library(
+        "gauss", formula, aliases, backend="cpu", output_dir=str(tmp_path)
+    )
+    assert (tmp_path / "gauss.h").exists() and (tmp_path / "keops_aot.h").exists()
+    lib = ctypes.CDLL(path)
+
+    out = np.zeros((M, 2), dtype="float32")
+    res, _ = launch(lib, out, [x, y, b])
+    assert res == 0
+    ref = np.exp(-((x[:, None, :] - y[None, :, :]) ** 2).sum(-1)) @ b
+    assert np.allclose(out, ref, rtol=1e-4, atol=1e-4)
+
+    # cpu libraries only support host data
+    res, error = launch(lib, out, [x, y, b], on_device=1)
+    assert res == -1 and "host data" in error
@@ -0,0 +1,220 @@
+import math
+import warnings
+
+import torch
+
+from pykeops.torch.cluster.matrix import from_matrix
+
+
+def chebyshev_nodes(order, dtype, device):
+    # Chebyshev nodes of the first kind in [-1,1]
+    k = torch.arange(order, dtype=dtype, device=device)
+    return torch.cos((2 * k + 1) * math.pi / (2 * order))
+
+
+def lagrange_basis(t, nodes):
+    # values of the Lagrange polynomials of the nodes at t, (...) -> (...,order)
+    L = []
+    for m in range(len(nodes)):
+        Lm = torch.ones_like(t)
+        for k in range(len(nodes)):
+            if k != m:
+                Lm = Lm * (t - nodes[k]) / (nodes[m] - nodes[k])
+        L.append(Lm)
+    return torch.stack(L, dim=-1)
+
+
+def sorted_ranges(lab, nclusters):
+    # [start,end) indices of the clusters of a vector of sorted labels, as int32
+    counts = torch.bincount(lab, minlength=nclusters)
+    pivots = torch.cat((counts.new_zeros(1), counts.cumsum(0)))
+    return torch.stack((pivots[:-1], pivots[1:]), dim=1).int(), counts
+
+
+def bounding_boxes(x, lab, counts):
+    # centers and half widths of the bounding boxes of the clusters
+    C, D = len(counts), x.shape[1]
+    index = lab.view(-1, 1).expand(-1, D)
+    lo = torch.full((C, D), math.inf, dtype=x.dtype, device=x.device)
+    hi = torch.full((C, D), -math.inf, dtype=x.dtype, device=x.device)
+    lo = lo.scatter_reduce(0, index, x, "amin")
+    hi = hi.scatter_reduce(0, index, x, "amax")
+    empty = counts == 0
+    lo[empty], hi[empty] = 0, 0
+    return (lo + hi) / 2, (hi - lo) / 2
+
+
+def far_field_sum(
+    formula,
+    aliases,
+    x,
+    y,
+    b,
+    *params,
+    x_labels,
+    y_labels,
+    eps=1e-3,
+    eta=0.5,
+    max_order=8,
+    max_proxies=4096,
+    n_check=100,
+    backend="auto",
+):
+    r"""Approximates a kernel sum with exact near-field and interpolated far-field interactions.
+
+    This routine computes
+
+    .. math::
+        a_i = \sum_j K(x_i, y_j)\, b_j
+
+    up to a relative error **eps**, where the formula ``"K(x,y) * b"`` must be **linear**
+    in :math:`b_j` and **smooth** in :math:`y_j` away from :math:`x_i`. Given cluster labels
+    for the :math:`x_i`'s and :math:`y_j`'s (computed e.g. with :func:`grid_cluster`),
+    interactions between a cluster :math:`k` of :math:`x_i`'s and a cluster :math:`\ell` of
+    :math:`y_j`'s are split in two parts:
+
+    - If the clusters are **well separated**, i.e. if the sum of the radii of their
+      bounding boxes is smaller than **eta** times the distance between their centers,
+      the kernel is interpolated in :math:`y` on a tensor grid of :math:`q^D`
+      Chebyshev nodes :math:`p_{\ell,m}` of the bounding box of cluster :math:`\ell`:
+
+      .. math::
+          \sum_{j\in\ell} K(x_i, y_j)\, b_j \simeq \sum_m K(x_i, p_{\ell,m})\, W_{\ell,m},
+          \qquad W_{\ell,m} = \sum_{j\in\ell} L_m(y_j)\, b_j,
+
+      where the :math:`L_m` are the Lagrange polynomials of the grid. For :math:`q=1`,
+      this is a monopole expansion at the center of the box.
+
+    - Otherwise, the interaction is computed **exactly**.
+
+    Both parts are block-sparse reductions computed by the same KeOps routine, with
+    **ranges** arguments built by :func:`from_matrix`: if the clusters are small with respect
+    to the scale of the kernel, the cost is roughly linear in the number of points.
+    The order :math:`q` is chosen from **eps** and **eta**, and the error is then estimated
+    by comparison with the exact sums on **n_check** random rows: :math:`q` is increased
+    until the estimated error is smaller than **eps**, or equal to **max_order**.
+
+    Note:
+        Since each cluster has :math:`q^D` proxies, this routine is meant for points in
+        **low dimension** (typically :math:`D\leqslant 4`). A ValueError is raised if
+        the order required by **eps** gives more than **max_proxies** proxies per cluster.
+
+    Args:
+        formula (string): Formula of the summand, e.g. ``"Exp(-g * SqDist(x,y)) * b"``.
+        aliases (list of strings): Aliases of the variables of the formula, starting with
+            the ":math:`i`" variable :math:`x_i`, the ":math:`j`" variable :math:`y_j` and
+            the ":math:`j`" variable :math:`b_j`, e.g. ``["x = Vi(3)", "y = Vj(3)", "b = Vj(1)",
+            "g = Pm(1)"]``.
+        x ((M,D) Tensor): Points :math:`x_i`.
+        y ((N,D) Tensor): Points :math:`y_j`.
+        b ((N,E) Tensor): Signal :math:`b_j`.
+        *params (Tensors): The other arguments of the formula, which must be parameters.
+
+    Keyword Args:
+        x_labels ((M,) IntTensor): Cluster labels of the :math:`x_i`'s.
+        y_labels ((N,) IntTensor): Cluster labels of the :math:`y_j`'s.
+        eps (float): Target relative error. Default is 1e-3.
+        eta (float): Admissibility parameter of the pairs of clusters in the far field,
+            smaller values giving more accurate interpolations but more near field
+            interactions. Default is 0.5.
+        max_order (int): Maximum number :math:`q` of interpolation nodes per dimension.
+            Default is 8.
+        max_proxies (int): Maximum number :math:`q^D` of interpolation nodes per cluster,
+            which bounds the memory footprint of the far field. Default is 4096.
+        n_check (int): Number of random rows :math:`i` used to estimate the error.
+            Default is 100.
+        backend (string): Backend of the KeOps reductions. Default is "auto".
+
+    Returns:
+        (M,E) Tensor, float:
+        The approximate sums :math:`a_i`, in the order of the :math:`x_i`'s,
+        and the estimated relative error.
+
+    Example:
+        >>> x, y = torch.rand(100000, 3).cuda(), torch.rand(200000, 3).cuda()
+        >>> b, g = torch.randn(200000, 1).cuda(), torch.tensor([10.0]).cuda()
+        >>> a, err = far_field_sum(
+        ...     "Exp(-g * SqDist(x,y)) * b",
+        ...     ["x = Vi(3)", "y = Vj(3)", "b = Vj(1)", "g = Pm(1)"],
+        ...     x, y, b, g,
+        ...     x_labels=grid_cluster(x, 0.05),
+        ...     y_labels=grid_cluster(y, 0.05),
+        ...     eps=1e-4,
+        ... )
+    """
+    M, D = x.shape
+    order = max(1, min(max_order, math.ceil(math.log(eps) / math.log(eta / 2))))
+    if order**D > max_proxies:
+        raise ValueError(
+            f"[KeOps] far_field_sum: an order {order} interpolation in dimension {D} "
+            f"needs {order**D} proxies per cluster (max_proxies={max_proxies}). This "
+            "approximation is meant for low dimensional points : please use a larger "
+            "value of eps or an exact reduction."
+        )
+    while max_order**D > max_proxies:
+        max_order -= 1
+
+    from pykeops.torch import Genred
+
+    routine = Genred(formula, aliases, reduction_op="Sum", axis=1)
+
+    # sort the points by cluster and compute the bounding boxes
+    x_labels, y_labels = x_labels.view(-1).long(), y_labels.view(-1).long()
+    Cx, Cy = int(x_labels.max()) + 1, int(y_labels.max()) + 1
+    lab_x, perm_x = torch.sort(x_labels)
+    lab_y, perm_y = torch.sort(y_labels)
+    x_s, y_s, b_s = x[perm_x], y[perm_y], b[perm_y]
+    with torch.no_grad():
+        ranges_x, counts_x = sorted_ranges(lab_x, Cx)
+        ranges_y, counts_y = sorted_ranges(lab_y, Cy)
+        center_x, hw_x = bounding_boxes(x_s, lab_x, counts_x)
+        center_y, hw_y = bounding_boxes(y_s, lab_y, counts_y)
+        radii = hw_x.norm(dim=1)[:, None] + hw_y.norm(dim=1)[None, :]
+        far = radii < eta * torch.cdist(center_x, center_y)
+    # projects the points y_j on [-1,1]^D in their boxes
+    t = (y_s - center_y[lab_y]) / hw_y[lab_y].clamp(min=1e-12)
+
+    ranges = from_matrix(ranges_x, ranges_y, ~far)
+    out = routine(x_s, y_s, b_s, *params, backend=backend, ranges=ranges)
+    if not far.any():
+        return out[torch.argsort(perm_x)], 0.0
+
+    # exact sums on random rows, to estimate the error
+    check = torch.randperm(M, device=x.device)[:n_check]
+    exact = routine(x_s[check], y_s, b_s, *params, backend=backend)
+    norm = exact.norm().item()
+
+    chunk = max(1, 2**24 // max_order**D)
+    while True:
+        nodes = chebyshev_nodes(order, x.dtype, x.device)
+        grid = torch.stack(torch.meshgrid(*([nodes] * D), indexing="ij"), dim=-1)
+        grid = grid.view(1, -1, D)
+        Q = grid.shape[1]
+        proxies = (center_y[:, None, :] + hw_y[:, None, :] * grid).view(-1, D)
+        pivots = torch.arange(Cy + 1, device=x.device) * Q
+        ranges_p = torch.stack((pivots[:-1], pivots[1:]), dim=1).int()
+        # weights of the proxies, computed by chunks of points to bound the memory footprint
+        W = b_s.new_zeros((Cy * Q, b_s.shape[1]))
+        for start in range(0, len(y_s), chunk):
+            L = lagrange_basis(t[start : start + chunk], nodes)
+            basis = L[:, 0, :]
+            for d in range(1, D):
+                basis = (basis[:, :, None] * L[:, d, None, :]).view(len(L), -1)
+            lab = lab_y[start : start + chunk, None]
+            inds = lab * Q + torch.arange(Q, device=x.device)
+            Wk = basis[:, :, None] * b_s[start : start + chunk, None, :]
+            W = W.index_add(0, inds.view(-1), Wk.view(-1, W.shape[1]))
+        ranges = from_matrix(ranges_x, ranges_p, far)
+        res = out + routine(x_s, proxies, W, *params, backend=backend, ranges=ranges)
+        err = (res[check] - exact).norm().item() / norm if norm > 0 else 0.0
+        if err <= eps or order >= max_order:
+            break
+        order += 1
+
+    if err > eps:
+        warnings.warn(
+            f"[KeOps] far_field_sum: the estimated relative error {err:.2e} is "
+            f"larger than eps={eps:.2e} with order {order}. Please use "
+            "smaller clusters or a smaller value of eta."
+        )
+    return res[torch.argsort(perm_x)], err
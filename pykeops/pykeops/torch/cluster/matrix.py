@@ -128,6 +128,49 @@ def from_matrix(ranges_i, ranges_j, keep):
     return (ranges_i, slices_i, redranges_j, ranges_j, slices_j, redranges_i)
 
 
+def from_offsets(offsets_i, offsets_j):
+    r"""Turns a ragged batch of independent problems into a KeOps-friendly **ranges** argument.
+
+    Problem :math:`p` of the batch is a reduction between the variables
+    ``x_i[ offsets_i[p]:offsets_i[p+1], : ]`` and ``y_j[ offsets_j[p]:offsets_j[p+1], : ]``,
+    as in the CSR format of sparse matrices : the problems may have different sizes,
+    and are solved by a single call of a KeOps reduction with the output ``ranges`` of
+    :func:`from_offsets`. On the GPU, large batches of small problems are handled by a
+    persistent kernel, whose blocks pull the tiles of the problems from a queue.
+
+    Args:
+        offsets_i ((P+1,) IntTensor): Indices of the first ":math:`i`" variable of each problem,
+            followed by the total number of ":math:`i`" variables.
+        offsets_j ((P+1,) IntTensor): Indices of the first ":math:`j`" variable of each problem,
+            followed by the total number of ":math:`j`" variables.
+
+    Returns:
+        A 6-uple of IntTensors that can be used as an optional **ranges**
+        argument of :class:`torch.Genred <pykeops.torch.Genred>`, for reductions with respect
+        to ":math:`i`" or ":math:`j`".
+
+    Example:
+        >>> offsets_i = torch.IntTensor( [0, 3, 8] )   # 2 problems, with 3 and 5 "i" variables
+        >>> offsets_j = torch.IntTensor( [0, 4, 6] )   # and 4 and 2 "j" variables
+        >>> (ranges_i,slices_i,redranges_j, ranges_j,slices_j,redranges_i) = from_offsets(offsets_i, offsets_j)
+        >>> print(ranges_i)
+        tensor([[0, 3],
+                [3, 8]], dtype=torch.int32)
+        >>> print(slices_i)
+        tensor([1, 2], dtype=torch.int32)
+        >>> print(redranges_j)
+        tensor([[0, 4],
+                [4, 6]], dtype=torch.int32)
+    """
+    ranges_i = torch.stack((offsets_i[:-1], offsets_i[1:]), dim=1).int()
+    ranges_j = torch.stack((offsets_j[:-1], offsets_j[1:]), dim=1).int()
+    # one range of the other variables per problem
+    slices = torch.arange(
+        1, len(ranges_i) + 1, dtype=torch.int32, device=ranges_i.device
+    )
+    return (ranges_i, slices, ranges_j, ranges_j, slices, ranges_i)
+
+
 if __name__ == "__main__":
     r_i = torch.IntTensor([[2, 5], [7, 12]])
     r_j = torch.IntTensor([[1, 4], [4, 9], [20, 30]])
@@ -120,6 +120,8 @@ class torchtools:
             return "float64"
         elif dtype == torch.float16:
             return "float16"
+        elif dtype == torch.bfloat16:
+            return "bfloat16"
         elif dtype == int:
             return int
         elif dtype == list:
@@ -171,6 +173,8 @@ class torchtools:
             dtype = torch.float64
         elif dtype == "float16":
             dtype = torch.float16
+        elif dtype == "bfloat16":
+            dtype = torch.bfloat16
         elif dtype == "int32":
             dtype = torch.int32
         else:
@@ -202,6 +206,13 @@ class torchtools:
     def pointer(x):
         return x.data.data_ptr()
 
+    @staticmethod
+    def get_stream(device):
+        if isinstance(device, torch.device) and device.type == "cuda":
+            return torch.cuda.current_stream(device).cuda_stream
+        else:
+            return 0
+
 
 def squared_distances(x, y):
     x_norm = (x**2).sum(1).reshape(-1, 1)